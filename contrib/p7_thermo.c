@@ -1,5 +1,6 @@
 #include "hmmer.h"
 #include <string.h>
+#include "p7_thermo.h"
 
 /* Check that esl exceptions, esl_fatal, -eslINFINITY, etc. are used
    in the correct contexts!! */
@@ -17,6 +18,43 @@
 static void
 processEstimates(const float numSamplesM1, float v1Up, float v1Dn, float *v1Bt, float v2Up, float v2Dn, float *v2Bt);
 
+/* Shared work for sampling at one temperature in
+   p7_thermoEstimateMany(); see sample_work(). */
+#define THERMO_BLOCKSIZE 8	/* samples per RNG seed */
+
+typedef struct {
+    const P7_BG          *bg;
+    const P7_PROFILE     *gm;	/* scores samples */
+    const P7_PROFILE     *gmT;	/* samples, via gxT */
+    const P7_PROFILE     *gmDT;	/* importance weights of samples */
+    const P7_GMX         *gxT;	/* Forward matrix of gmT(dsqX) */
+    const ESL_DSQ        *dsqX;	/* all X/N, length gm->L */
+    const uint32_t       *seed;	/* [0..nblocks-1] RNG seed per block */
+    enum p7m_scoretypes_e p7m_score;
+    int                   numSamples;
+    float                *ZDT;	/* [0..numSamples-1] Forward sum of gmDT(dsq) */
+    float                *ssc;	/* [0..numSamples-1] score compared to the threshold */
+    float                *fsc;	/* [0..numSamples-1] Forward score of gm(dsq) */
+    P7_GMX               *gx;	/* caller's matrix, for the calling thread */
+} THERMO_WORKSET;
+
+/* One thread's scratch space for sample_work() */
+typedef struct {
+    ESL_RANDOMNESS       *rng;
+    P7_TRACE             *tr;
+    ESL_DSQ              *dsq;
+    P7_GMX               *gx;
+    int                   own_gx; /* TRUE if <gx> isn't the caller's */
+} THERMO_WORKER;
+
+static void estimate_one(int numSamples, float ZT, float Z1, const float *ZDT, const float *ssc, const float *fsc, float threshold, float *scratch,
+			 int *support, float *pv, float *pvstd, float *sn, float *snstd);
+static int  nearest_temperature(const P7_THERMO *thermo, float temperature);
+static int  sample_init(void *arg, int tid, void **ret_tls);
+static int  sample_work(void *arg, void *tls, int b, char *errbuf);
+static void sample_fini(void *tls);
+static void free_clones(P7_THERMO *thermo);
+
 /* printMantissa(x): For printing the m.mm part of a m.mmEx.xx
    floating point number, exp(x)*/
 static float 
@@ -37,15 +75,21 @@ utest_thermo(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const
     P7_THERMO            *thermos[p7M_NSCORETYPES]; /* all the thermos */
     P7_THERMO            *thermo; /* the thermo of current interest */
     int                   idx;
-    int                   support; /* number of nonzero terms in importance sampling sum */
-    float                 pv;	   /* p-value */
+    int                  *support = NULL; /* number of nonzero terms in importance sampling sum */
+    float                *pv      = NULL; /* p-value */
     float                 pvsp;	   /* p-value or specificity, whichever is smaller */
-    float                 pvstd;   /* standard deviation of pv (and also of sp) */
-    float                 sn;	   /* sensitivity */
+    float                *pvstd   = NULL; /* standard deviation of pv (and also of sp) */
+    float                *sn      = NULL; /* sensitivity */
     float                 snfn;	   /* sensitivity or false negative rate, whichever is smaller */
-    float                 snstd;   /* standard deviation of sn (and also of fnr) */
+    float                *snstd   = NULL; /* standard deviation of sn (and also of fnr) */
     float                 stretch; /* For generating interesting scores to test */
-    float                 sc = 0;
+    float                *sc      = NULL; /* score thresholds to evaluate */
+    int                  *support2 = NULL; /* the same five estimates, from a threaded run */
+    float                *pv2      = NULL;
+    float                *pvstd2   = NULL;
+    float                *sn2      = NULL;
+    float                *snstd2   = NULL;
+    ESL_RANDOMNESS       *r2       = NULL; /* reseeded for each of the runs */
     enum p7m_scoretypes_e p7m_score;
     const int             numSamples       = 100; /* Should be a parameter?!! */
 
@@ -63,6 +107,17 @@ utest_thermo(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const
     for (p7m_score = 0; p7m_score < p7M_NSCORETYPES; p7m_score++) {
 	if ((scores[p7m_score] = malloc(sizeof(float) * nseq))   == NULL)  esl_fatal("scores malloc failed");
     }
+    if ((sc      = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("threshold malloc failed");
+    if ((support = malloc(sizeof(int)   * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((pv      = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((pvstd   = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((sn      = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((snstd   = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((support2 = malloc(sizeof(int)   * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((pv2      = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((pvstd2   = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((sn2      = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
+    if ((snstd2   = malloc(sizeof(float) * nseq)) == NULL)  esl_fatal("estimate malloc failed");
 
     /* Generate some typical scores */
     for (idx = 0; idx < nseq; idx++) {
@@ -107,9 +162,24 @@ utest_thermo(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const
 	    stretch = (float) idx / (float) (nseq - 1);
 	    stretch *= stretch;
 	    stretch *= stretch;
-	    sc = stretch * (thermo->scores[0] - scores[p7m_score][0]) + scores[p7m_score][0];
+	    sc[idx] = stretch * (thermo->scores[0] - scores[p7m_score][0]) + scores[p7m_score][0];
+	}
+	/* One call, so thresholds near each other share samples.
+	   Serial, then threaded from the same seed: the estimates
+	   must be identical. */
+	if ((r2 = esl_randomness_Create(42))            == NULL)  esl_fatal("rng creation failed");
+	if (p7_thermo_SetThreads(thermo, 1)              != eslOK) esl_fatal("p7_thermo_SetThreads failed");
+	if (p7_thermoEstimateMany(r2, thermo, bg, gm, gx, numSamples, sc, nseq, support, pv, pvstd, sn, snstd) != eslOK) esl_fatal("p7_thermoEstimateMany failed");
+	esl_randomness_Init(r2, 42);
+	if (p7_thermo_SetThreads(thermo, 4)              != eslOK) esl_fatal("p7_thermo_SetThreads failed");
+	if (p7_thermoEstimateMany(r2, thermo, bg, gm, gx, numSamples, sc, nseq, support2, pv2, pvstd2, sn2, snstd2) != eslOK) esl_fatal("p7_thermoEstimateMany failed");
+	esl_randomness_Destroy(r2);
+	for (idx = 0; idx < nseq; idx++) {
+	    if (support[idx] != support2[idx] || pv[idx] != pv2[idx] || pvstd[idx] != pvstd2[idx] || sn[idx] != sn2[idx] || snstd[idx] != snstd2[idx])
+		esl_fatal("p7_thermoEstimateMany results depend on the number of threads");
+	}
 
-	    if (p7_thermoEstimate(r, thermo, bg, gm, gx, numSamples, sc, &support, &pv, &pvstd, &sn, &snstd) != eslOK) esl_fatal("p7_thermoEstimate failed");
+	for (idx = 0; idx < nseq; idx++) {
 	    if (esl_opt_GetBoolean(go, "--vv")) {
 		/* If expf(pv) <= 0.5 display it; otherwise display
 		   specificity =1-pv.  Likewise, if expf(sn) <= 0.5
@@ -117,30 +187,41 @@ utest_thermo(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const
 		   =1-sn.  Note that sp=logf(1.0f-expf(pv)) is
 		   log(-pv) + pv/2 +pv^2/24 + ... when pv is near
 		   zero. */
-		if (pv <= logf(0.5f)) pvsp = pv; /* pv */
-		else if (pv <= -1e-10) pvsp = logf(1.0f - expf(pv)); /* sp */
-		else pvsp = logf(-pv) + 0.5f*pv; /* sp */
-		if (sn <= logf(0.5f)) snfn = sn; /* sn */
-		else if (sn <= -1e-10) snfn = logf(1.0f - expf(sn)); /* fnr */
-		else snfn = logf(-sn) + 0.5*sn;	/* fnr */
+		if (pv[idx] <= logf(0.5f)) pvsp = pv[idx]; /* pv */
+		else if (pv[idx] <= -1e-10) pvsp = logf(1.0f - expf(pv[idx])); /* sp */
+		else pvsp = logf(-pv[idx]) + 0.5f*pv[idx]; /* sp */
+		if (sn[idx] <= logf(0.5f)) snfn = sn[idx]; /* sn */
+		else if (sn[idx] <= -1e-10) snfn = logf(1.0f - expf(sn[idx])); /* fnr */
+		else snfn = logf(-sn[idx]) + 0.5*sn[idx];	/* fnr */
 		printf("utest_thermo: %s threshold %9.4f: %s = %5.3fe%+04d +- %3.0f%%, %s = %5.3fe%+04d +- %3.0f%%, support = %d/%d\n",
 		       (p7m_score == p7M_FORWARD ? "Forward" : "Viterbi"),
-		       sc,
-		       pv > log(0.5f) ? "specificity" : "    p-value",
+		       sc[idx],
+		       pv[idx] > log(0.5f) ? "specificity" : "    p-value",
 		       printMantissa(pvsp),
 		       printExponent(pvsp),
-		       100.0f * expf(pvstd-pvsp),
-		       sn > log(0.5f) ? "f-neg. rate" : "sensitivity",
+		       100.0f * expf(pvstd[idx]-pvsp),
+		       sn[idx] > log(0.5f) ? "f-neg. rate" : "sensitivity",
 		       printMantissa(snfn),
 		       printExponent(snfn),
-		       100.0f * expf(snstd-snfn),
-		       support,
+		       100.0f * expf(snstd[idx]-snfn),
+		       support[idx],
 		       numSamples);
 	    }
 	}
     }
 
-    if (dsq) free(dsq);
+    if (dsq)     free(dsq);
+    if (sc)      free(sc);
+    if (support) free(support);
+    if (pv)      free(pv);
+    if (pvstd)   free(pvstd);
+    if (sn)      free(sn);
+    if (snstd)   free(snstd);
+    if (support2) free(support2);
+    if (pv2)      free(pv2);
+    if (pvstd2)   free(pvstd2);
+    if (sn2)      free(sn2);
+    if (snstd2)   free(snstd2);
     p7_gmx_Destroy(gx);
     p7_trace_Destroy(tr);
     for (p7m_score = 0; p7m_score < p7M_NSCORETYPES; p7m_score++) {
@@ -154,7 +235,7 @@ utest_thermo(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const
  * Synopsis:  Estimates both the p-value and sensitivity of a score threshold.
  * Incept:    LAN, Mon Aug 18 12:31:53 EDT 2008 [Wadsworth]
  *
- * Purpose:   
+ * Purpose:
  *	      For any forward score threshold (or likewise for viterbi
  *	      scores) we may be interested in what fraction of
  *	      sequences of length L, drawn from the background model
@@ -167,11 +248,15 @@ utest_thermo(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const
  *
  *            We must first create and configure <r>, <thermo>, <bg>,
  *            <gm>, and <gx>.  In particular, <thermo> includes
- *            whether the score <threshold> is forward or viterbi.
- *            <numSamples> is the number of samples drawn from the
- *            importance sampling distribution, and confidence limits
- *            are inversely proportional to its square root.
- *            
+ *            whether the score <threshold> is forward or viterbi, and
+ *            it must have been calibrated by p7_thermoCalibrate() with
+ *            this same <gm>.  <numSamples> is the number of samples
+ *            drawn from the importance sampling distribution, and
+ *            confidence limits are inversely proportional to its
+ *            square root.
+ *
+ *            This is p7_thermoEstimateMany() for a single threshold.
+ *
  * Returns:   <pv> is the logf of the computed p-value.  <pvstd> is
  *            the logf of the standard deviation of the computed <pv>.
  *            <sn> is the logf of the computed sensitivity.  <snstd>
@@ -183,27 +268,151 @@ utest_thermo(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const
  *            we worry that the region just above the threshold may
  *            not be adequately represented in the importance sampling
  *            sum.
+ *
+ * Throws:    <eslEINVAL> if <thermo> is not calibrated; <eslEMEM> on
+ *            allocation error.
  */
 
 int
 p7_thermoEstimate(ESL_RANDOMNESS *r, const P7_THERMO *thermo, const P7_BG *bg, const P7_PROFILE *gm, P7_GMX *gx, int numSamples, float threshold, int *support, float *pv, float *pvstd, float *sn, float *snstd)
 {
-    P7_PROFILE *gmT       = NULL; /* For sampling a sequence <dsq> at a specified temperature. */
-    P7_PROFILE *gmDT      = NULL; /* For evaluating <dsq> at a specified temperature. */
-    P7_GMX     *gxT       = NULL;
-    P7_GMX     *gxDT      = NULL;
+    return p7_thermoEstimateMany(r, thermo, bg, gm, gx, numSamples, &threshold, 1, support, pv, pvstd, sn, snstd);
+}
+
+/* Function:  p7_thermoEstimateMany()
+ * Synopsis:  Estimates p-values and sensitivities of several score thresholds.
+ *
+ * Purpose:   As p7_thermoEstimate(), for the <n> score thresholds
+ *            <threshold[0..n-1]>; results for <threshold[i]> are
+ *            returned in <support[i]>, <pv[i]>, <pvstd[i]>, <sn[i]>
+ *            and <snstd[i]>.
+ *
+ *            Each threshold is estimated at the calibrated temperature
+ *            nearest to the one p7_thermoSuggestTemp() suggests for
+ *            it. The importance sampling estimate is unbiased at any
+ *            temperature (the temperature only affects its variance),
+ *            so this costs little accuracy, and it lets us use the
+ *            temperature-adjusted profiles that p7_thermoCalibrate()
+ *            built once, and share one set of <numSamples> samples
+ *            among all the thresholds that land on the same
+ *            temperature.  A sweep over many thresholds therefore
+ *            costs at most one sampling pass per calibrated
+ *            temperature, rather than one per threshold.
+ *
+ *            Samples are drawn and scored in blocks by the number
+ *            of threads set with p7_thermo_SetThreads() (if HMMER
+ *            is built with thread support). Each block has its own random number seed,
+ *            drawn from <r>, so results do not depend on the number
+ *            of threads.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <thermo> is not calibrated; <eslEMEM> on
+ *            allocation error.
+ */
+int
+p7_thermoEstimateMany(ESL_RANDOMNESS *r, const P7_THERMO *thermo, const P7_BG *bg, const P7_PROFILE *gm, P7_GMX *gx, int numSamples, const float *threshold, int n,
+		      int *support, float *pv, float *pvstd, float *sn, float *snstd)
+{
+    THERMO_WORKSET ws;
+    P7_GMX     *gxT       = NULL; /* Forward matrix of gmT(dsqX), for sampling */
     ESL_DSQ    *dsqX      = NULL; /* Sequence of all X/N */
-    ESL_DSQ    *dsq       = NULL; /* Sampled sequence */
-    P7_TRACE   *tr        = NULL; /* Sampled path through states */
-    float      *pvUp = NULL;      /* pv contributions at threshold or higher */
-    float      *pvDn = NULL;      /* pv contributions below threshold */
-    float      *snUp = NULL;      /* sn contributions at threshold or higher */
-    float      *snDn = NULL;      /* sn contributions below threshold */
+    uint32_t   *seed      = NULL; /* one RNG seed per block of samples */
+    int        *tidx      = NULL; /* index of calibrated temperature used for each threshold */
+    float      *ZDT       = NULL; /* Forward sums of gmDT(dsq) */
+    float      *ssc       = NULL; /* Sample scores of the thresholded type */
+    float      *fsc       = NULL; /* Sample forward scores */
+    float      *scratch   = NULL; /* pvUp, pvDn, snUp, snDn for estimate_one() */
     float       temperature = 0.0f;
-    float       sc        = 0.0f;
     float       ZT        = 0.0f; /* Forward sum of gmT(dsqX) */
-    float       Z1        = 0.0f; /* Forward sum of gmT(dsqX) for T = 1 */
-    float       ZDT       = 0.0f; /* Forward sum of gmDT(dsq) */
+    const int   L         = gm->L;
+    const int   deg       = gm->abc->Kp-2; /* maximally degenerate character (X/N) */
+    const int   nblocks   = (numSamples + THERMO_BLOCKSIZE - 1) / THERMO_BLOCKSIZE;
+    int         i, t, b, z;
+    int         status;
+
+    if (thermo->gmT == NULL) ESL_EXCEPTION(eslEINVAL, "<thermo> has not been calibrated");
+    if (numSamples < 1)      ESL_EXCEPTION(eslEINVAL, "need at least one sample");
+
+    if ((gxT  = p7_gmx_Create(gm->M, L))         == NULL) { status = eslEMEM; goto ERROR; }
+    ESL_ALLOC(dsqX,    sizeof(ESL_DSQ)  * (L+2));
+    ESL_ALLOC(seed,    sizeof(uint32_t) * nblocks);
+    ESL_ALLOC(tidx,    sizeof(int)      * n);
+    ESL_ALLOC(ZDT,     sizeof(float)    * numSamples);
+    ESL_ALLOC(ssc,     sizeof(float)    * numSamples);
+    ESL_ALLOC(fsc,     sizeof(float)    * numSamples);
+    ESL_ALLOC(scratch, sizeof(float)    * numSamples * 4);
+
+    /* Create string of all degenerate characters */
+    for (z = 1; z <= L; z++) dsqX[z] = deg; /* The X/N character */
+
+    /* Choose a temperature for efficient estimation of each threshold. */
+    for (i = 0; i < n; i++) {
+	p7_thermoSuggestTemp(thermo, threshold[i], &temperature);
+	tidx[i] = nearest_temperature(thermo, temperature);
+    }
+
+    ws.bg         = bg;
+    ws.gm         = gm;
+    ws.gxT        = gxT;
+    ws.dsqX       = dsqX;
+    ws.seed       = seed;
+    ws.p7m_score  = thermo->p7m_score;
+    ws.numSamples = numSamples;
+    ws.ZDT        = ZDT;
+    ws.ssc        = ssc;
+    ws.fsc        = fsc;
+    ws.gx         = gx;
+
+    for (t = 0; t < thermo->numTemperatures; t++) {
+	for (i = 0; i < n; i++) if (tidx[i] == t) break;
+	if (i == n) continue;	/* no threshold wants this temperature */
+
+	/* Fill up gxT matrix with useful values for the traces. */
+	if ((status = p7_GForward(dsqX, L, thermo->gmT[t], gxT, &ZT)) != eslOK) goto ERROR;
+
+	for (b = 0; b < nblocks; b++) seed[b] = (uint32_t) esl_rnd_Roll(r, 2147483647) + 1; /* nonzero: 0 means "arbitrary" */
+	ws.gmT  = thermo->gmT[t];
+	ws.gmDT = thermo->gmDT[t];
+	if ((status = p7_ThreadedFor(thermo->ncpu, nblocks, &ws, sample_init, sample_work, sample_fini, NULL, NULL)) != eslOK) goto ERROR;
+
+	for (; i < n; i++)
+	    if (tidx[i] == t)
+		estimate_one(numSamples, ZT, thermo->Z1, ZDT, ssc, fsc, threshold[i], scratch,
+			     &support[i], &pv[i], &pvstd[i], &sn[i], &snstd[i]);
+    }
+    status = eslOK;
+
+ ERROR:
+    p7_gmx_Destroy(gxT);
+    if (dsqX)    free(dsqX);
+    if (seed)    free(seed);
+    if (tidx)    free(tidx);
+    if (ZDT)     free(ZDT);
+    if (ssc)     free(ssc);
+    if (fsc)     free(fsc);
+    if (scratch) free(scratch);
+    return status;
+}
+
+
+/* estimate_one()
+ *
+ * Turns the <numSamples> scored samples drawn at one temperature
+ * into the estimates for one <threshold>. The importance sampling
+ * weight of a sample is ZT - ZDT[z]; it counts toward the p-value
+ * (and, weighted by its forward score, toward the sensitivity) if
+ * its score ssc[z] reaches the threshold. <scratch> has room for
+ * 4*<numSamples> floats.
+ */
+static void
+estimate_one(int numSamples, float ZT, float Z1, const float *ZDT, const float *ssc, const float *fsc, float threshold, float *scratch,
+	     int *support, float *pv, float *pvstd, float *sn, float *snstd)
+{
+    float      *pvUp      = scratch;		    /* pv contributions at threshold or higher */
+    float      *pvDn      = scratch +   numSamples; /* pv contributions below threshold */
+    float      *snUp      = scratch + 2*numSamples; /* sn contributions at threshold or higher */
+    float      *snDn      = scratch + 3*numSamples; /* sn contributions below threshold */
     float       pv1Up     = 0.0f; /* "mean" of pv samples at or above threshold */
     float       pv1Dn     = 0.0f; /* "mean" of pv samples below threshold */
     float       pv1Bt     = 0.0f; /* mean of all pv samples */
@@ -216,77 +425,21 @@ p7_thermoEstimate(ESL_RANDOMNESS *r, const P7_THERMO *thermo, const P7_BG *bg, c
     float       sn2Up     = 0.0f; /* "variance" of sn samples at or above threshold */
     float       sn2Dn     = 0.0f; /* "variance" of sn samples below threshold */
     float       sn2Bt     = 0.0f; /* variance of all sn samples */
-    const int   L         = gm->L;
-    const int   deg       = gm->abc->Kp-2; /* maximally degenerate character (X/N) */
-    const int   p7m_score = thermo->p7m_score;
-    const float           numSamplesLog = logf((float) numSamples);
+    const float numSamplesLog = logf((float) numSamples);
+    int         nonZeros  = 0;
     int         z;
-    int         status;
-
-    if ((gmT  = p7_profile_Clone(gm))            == NULL) esl_fatal("failed to create gmT");
-    if ((gmDT = p7_profile_Clone(gm))            == NULL) esl_fatal("failed to create gmDT");
-    if ((gxT  = p7_gmx_Create(gm->M, L))         == NULL) esl_fatal("failed to create gxT");
-    if ((gxDT = p7_gmx_Create(gm->M, L))         == NULL) esl_fatal("failed to create gxDT");
-    if ((dsqX = malloc(sizeof(ESL_DSQ) * (L+2))) == NULL) esl_fatal("failed to create dsqX");
-    if ((dsq  = malloc(sizeof(ESL_DSQ) * (L+2))) == NULL) esl_fatal("failed to create dsq");
-    if ((tr   = p7_trace_Create())               == NULL) esl_fatal("failed to create tr");
-    if ((pvUp = malloc(sizeof(float) * numSamples)) == NULL) esl_fatal("failed to create samples");
-    if ((pvDn = malloc(sizeof(float) * numSamples)) == NULL) esl_fatal("failed to create samples");
-    if ((snUp = malloc(sizeof(float) * numSamples)) == NULL) esl_fatal("failed to create samples");
-    if ((snDn = malloc(sizeof(float) * numSamples)) == NULL) esl_fatal("failed to create samples");
 
-    /* Create string of all degenerate characters */
-    for (z = 1; z <= L; z++) dsqX[z] = deg; /* The X/N character */
-
-    /* Need to normalize sensitivity value by the foreground model
-       probability of length <L>.  Note that <Z1> is the same even for
-       subsequent calles to p7_thermoEstimate(), even if the score
-       threshold is significanctly different; <Z1> should be
-       cached, perhaps in <thermo>!! */
-    p7_profileAdjustClones(1.0, bg, gm, gmT, gmDT);
-    p7_GForward(dsqX, L, gmT, gxT, &Z1);
-
-    /* Choose a temperature for efficient estimation. */
-    p7_thermoSuggestTemp(thermo, threshold, &temperature);
-
-    /* Make two profiles at this temperature.  <gmT> will be used to
-       evaluate <dsqX>.  <gmDT> will be used to evaluate <dsq>. */
-    p7_profileAdjustClones(temperature, bg, gm, gmT, gmDT);
-    /* Fill up gxT matrix with useful values for a later trace. */
-    p7_GForward(dsqX, L, gmT, gxT, &ZT);
-
-    /* Note that the calculated 1/ZDT scores should be cached (perhaps
-       in <thermo>) for later calls to p7_thermoEstimate, because they
-       can be re-used if a subsequent call is for score threshold
-       nearby to the current one.  Under these circumstances, this
-       would save nearly 100% of the run time for subsequent calls to
-       p7_thermoEstimate!! */
-    int nonZeros = 0;
     for (z = 0; z < numSamples; z++) {
-	/* Trace back a set of states and emissions */
-	p7_StochasticDsqTrace(r, dsqX, L, bg, gmT, gxT, tr, dsq);
-	/* Evaluate sampled sequence of emissions */
-	switch(p7m_score) {
-	case p7M_FORWARD:
-	    p7_GForward(dsq, L, gm, gx, &sc);
-	    break;
-	case p7M_VITERBI:
-	    p7_GViterbi(dsq, L, gm, gx, &sc);
-	    break;
-	}
-	p7_GForward(dsq, L, gmDT, gxDT, &ZDT);
-	if (sc >= threshold) {
-	    if (p7m_score != p7M_FORWARD) p7_GForward(dsq, L, gm, gx, &sc); /* needed for sensitivities only */
+	if (ssc[z] >= threshold) {
 	    nonZeros++;
-	    pvUp[z] = ZT - ZDT; /* Contribution to pv importance sampling sum */
+	    pvUp[z] = ZT - ZDT[z]; /* Contribution to pv importance sampling sum */
 	    pvDn[z] = -eslINFINITY;
-	    snUp[z] = ZT - ZDT + sc - Z1; /* Contribution to sn importance sampling sum */
+	    snUp[z] = ZT - ZDT[z] + fsc[z] - Z1; /* Contribution to sn importance sampling sum */
 	    snDn[z] = -eslINFINITY;
 	} else {
-	    if (p7m_score != p7M_FORWARD) p7_GForward(dsq, L, gm, gx, &sc); /* needed for sensitivities only */
-	    pvDn[z] = ZT - ZDT; /* Contribution to pv Importance Sampling sum */
+	    pvDn[z] = ZT - ZDT[z]; /* Contribution to pv Importance Sampling sum */
 	    pvUp[z] = -eslINFINITY;
-	    snDn[z] = ZT - ZDT + sc - Z1; /* Contribution to sn Importance Sampling sum */
+	    snDn[z] = ZT - ZDT[z] + fsc[z] - Z1; /* Contribution to sn Importance Sampling sum */
 	    snUp[z] = -eslINFINITY;
 	}
     }
@@ -338,24 +491,106 @@ p7_thermoEstimate(ESL_RANDOMNESS *r, const P7_THERMO *thermo, const P7_BG *bg, c
 
     /* Report to the user */
     *support = nonZeros;
-    status = eslOK;
+}
 
-    /* Clean up */
-    p7_profile_Destroy(gmT);
-    p7_profile_Destroy(gmDT);
-    p7_gmx_Destroy(gxT);
-    p7_gmx_Destroy(gxDT);
-    if (dsqX) free (dsqX);
-    if (dsq) free (dsq);
-    p7_trace_Destroy(tr);
-    if (pvUp) free (pvUp);
-    if (pvDn) free (pvDn);
-    if (snUp) free (snUp);
-    if (snDn) free (snDn);
 
+/* nearest_temperature()
+ *
+ * Index of the calibrated temperature closest to <temperature>, on a
+ * log scale: p7_thermoCalibrate() places its points at geometric
+ * means.
+ */
+static int
+nearest_temperature(const P7_THERMO *thermo, float temperature)
+{
+    int   t;
+    int   best  = 0;
+    float bestd = eslINFINITY;
+    float d;
+
+    for (t = 0; t < thermo->numTemperatures; t++) {
+	d = fabsf(logf(thermo->temperatures[t] / temperature));
+	if (d < bestd) { bestd = d; best = t; }
+    }
+    return best;
+}
+
+
+/* sample_init(), sample_work(), sample_fini()
+ *
+ * Draw <ws->numSamples> sequences from <ws->gmT> by stochastic
+ * traceback of <ws->gxT>, and score each one with <ws->gm> and
+ * <ws->gmDT>, with p7_ThreadedFor() on <thermo->ncpu> threads. The
+ * calling thread uses the caller's matrix <ws->gx>; the others
+ * allocate their own.
+ *
+ * Samples are handed out in blocks of THERMO_BLOCKSIZE. Block <b>
+ * reseeds its thread's RNG with <ws->seed[b]>, so which samples are
+ * drawn does not depend on which thread draws them.
+ *
+ * p7_GForward() is the SSE engine in SSE builds, and sampling and
+ * scoring are the bulk of the cost of an estimate; scores land in
+ * <ws->ZDT>, <ws->ssc> and <ws->fsc>, indexed by sample.
+ */
+static int
+sample_init(void *arg, int tid, void **ret_tls)
+{
+    THERMO_WORKSET *ws = (THERMO_WORKSET *) arg;
+    THERMO_WORKER  *w  = NULL;
+    int             status;
+
+    ESL_ALLOC(w, sizeof(THERMO_WORKER));
+    w->rng    = esl_randomness_Create(ws->seed[0]);
+    w->tr     = p7_trace_Create();
+    w->dsq    = NULL;
+    w->own_gx = (tid != 0);
+    w->gx     = (w->own_gx ? p7_gmx_Create(ws->gm->M, ws->gm->L) : ws->gx);
+    ESL_ALLOC(w->dsq, sizeof(ESL_DSQ) * (ws->gm->L+2));
+    if (w->rng == NULL || w->tr == NULL || w->gx == NULL) { status = eslEMEM; goto ERROR; }
+    *ret_tls = w;
+    return eslOK;
+
+ ERROR:
+    sample_fini(w);
     return status;
 }
 
+static int
+sample_work(void *arg, void *tls, int b, char *errbuf)
+{
+    THERMO_WORKSET *ws = (THERMO_WORKSET *) arg;
+    THERMO_WORKER  *w  = (THERMO_WORKER *) tls;
+    const int       L  = ws->gm->L;
+    int             z;
+    int             status;
+
+    esl_randomness_Init(w->rng, ws->seed[b]);
+    for (z = b * THERMO_BLOCKSIZE; z < ESL_MIN(ws->numSamples, (b+1) * THERMO_BLOCKSIZE); z++) {
+	/* Trace back a set of states and emissions */
+	if ((status = p7_StochasticDsqTrace(w->rng, ws->dsqX, L, ws->bg, ws->gmT, ws->gxT, w->tr, w->dsq)) != eslOK) return status;
+	/* Evaluate sampled sequence of emissions */
+	if ((status = p7_GForward(w->dsq, L, ws->gm,   w->gx, &(ws->fsc[z]))) != eslOK) return status;
+	if ((status = p7_GForward(w->dsq, L, ws->gmDT, w->gx, &(ws->ZDT[z]))) != eslOK) return status;
+	if (ws->p7m_score == p7M_VITERBI) {
+	    if ((status = p7_GViterbi(w->dsq, L, ws->gm, w->gx, &(ws->ssc[z]))) != eslOK) return status;
+	} else ws->ssc[z] = ws->fsc[z];
+    }
+    return eslOK;
+}
+
+static void
+sample_fini(void *tls)
+{
+    THERMO_WORKER *w = (THERMO_WORKER *) tls;
+
+    if (w == NULL) return;
+    esl_randomness_Destroy(w->rng);
+    p7_trace_Destroy(w->tr);
+    if (w->dsq)    free(w->dsq);
+    if (w->own_gx) p7_gmx_Destroy(w->gx);
+    free(w);
+}
+
 
 /* Function:  processEstimates()
 
@@ -644,6 +879,11 @@ p7_thermo_Create(void)
     thermo->numTemperatures = 0;
     thermo->temperatures = NULL;
     thermo->scores = NULL;
+    thermo->gmT = NULL;
+    thermo->gmDT = NULL;
+    thermo->nclones = 0;
+    thermo->Z1 = 0.0f;
+    thermo->ncpu = 0;
 
     return thermo;
 
@@ -665,12 +905,34 @@ void
 p7_thermo_Destroy(P7_THERMO *thermo)
 {
     if (thermo) {
+	free_clones(thermo);
 	if (thermo->temperatures) free (thermo->temperatures);
 	if (thermo->scores)       free (thermo->scores);
 	free(thermo);
     }
 }
 
+/* Function:  p7_thermo_SetThreads()
+ * Synopsis:  Set the number of threads for p7_thermoEstimate*().
+ *
+ * Purpose:   Have p7_thermoEstimate() and p7_thermoEstimateMany()
+ *            draw and score samples with <ncpu> threads; 0 or 1
+ *            means serial, and so does any value if HMMER is built
+ *            without thread support. Results do not depend on
+ *            <ncpu>.
+ *
+ * Returns:   <eslOK>.
+ *
+ * Throws:    <eslEINVAL> if <ncpu> is negative.
+ */
+int
+p7_thermo_SetThreads(P7_THERMO *thermo, int ncpu)
+{
+    if (ncpu < 0) ESL_EXCEPTION(eslEINVAL, "<ncpu> must be >= 0");
+    thermo->ncpu = ncpu;
+    return eslOK;
+}
+
 /* Function:  p7_thermoCalibrate()
  * Synopsis:  Populate a P7_THERMO structure
  * Incept:    LAN, Mon Aug 18 12:31:53 EDT 2008 [Wadsworth]
@@ -678,6 +940,12 @@ p7_thermo_Destroy(P7_THERMO *thermo)
  * Purpose:   Computes the relationship between temperature and score.
  *            Score can be forward or viterbi.
  *
+ *            The temperature-adjusted profile clones made for each
+ *            calibration point are kept in <thermo>, along with the
+ *            Forward sum <Z1> at T = 1, for p7_thermoEstimate() to
+ *            use. <thermo> may only be used for estimates with this
+ *            same <gm>.
+ *
  * Returns:   <eslOK>
  *
  * Throws:    allocation errors
@@ -694,6 +962,8 @@ p7_thermoCalibrate(P7_THERMO *thermo, ESL_RANDOMNESS *r, int p7m_score, const P7
     P7_TRACE   *tr   = NULL;	/* For backtrace through Z(T) calculation */
     float      *sc   = NULL;    /* Array of scores at one temperature */
     float       ZT   = 0.0f;	/* Computed Z(T) value */
+    float       T;		/* Temperature being placed in sorted order */
+    P7_PROFILE *pT, *pDT;	/* ... and its clones */
     const int   L    = gm->L;	/* Length of sequence to be scanned */
     const int   deg  = gm->abc->Kp-2; /* maximally degenerate character (X/N) */
     int         numTemperatures  = 50;	/* Number of (x,y) points for the curve */
@@ -711,12 +981,18 @@ p7_thermoCalibrate(P7_THERMO *thermo, ESL_RANDOMNESS *r, int p7m_score, const P7
     thermo->temperatures = NULL;
     if (thermo->scores) free (thermo->scores);
     thermo->scores = NULL;
+    free_clones(thermo);
+    thermo->numTemperatures = 0;
 
     /* Allocate memory */
     if (!(numTemperatures > 0 && firstTemperature > 0.0f && lastTemperature > firstTemperature))
 	ESL_XEXCEPTION(eslEINVAL, "Bad p7_thermoCalibrate parameter(s)");
     ESL_ALLOC(thermo->temperatures, sizeof(float) * numTemperatures);
     ESL_ALLOC(thermo->scores,       sizeof(float) * numTemperatures);
+    ESL_ALLOC(thermo->gmT,          sizeof(P7_PROFILE *) * numTemperatures);
+    ESL_ALLOC(thermo->gmDT,         sizeof(P7_PROFILE *) * numTemperatures);
+    for (t = 0; t < numTemperatures; t++) thermo->gmT[t] = thermo->gmDT[t] = NULL;
+    thermo->nclones = numTemperatures; /* so a failure below frees the clones made so far */
     if ((gmT = p7_profile_Clone(gm))             == NULL) esl_fatal("failed to create gmT");
     if ((gmDT = p7_profile_Clone(gm))            == NULL) esl_fatal("failed to create gmDT");
     if ((gxT = p7_gmx_Create(gm->M, L))          == NULL) esl_fatal("failed to create gxT");
@@ -736,6 +1012,10 @@ p7_thermoCalibrate(P7_THERMO *thermo, ESL_RANDOMNESS *r, int p7m_score, const P7
     temperatures = thermo->temperatures;
     scores = thermo->scores;
 
+    /* Forward sum of <dsqX> at T = 1, for normalizing sensitivities */
+    if ((status = p7_profileAdjustClones(1.0, bg, gm, gmT, gmDT)) != eslOK) goto ERROR;
+    if ((status = p7_GForward(dsqX, L, gmT, gxT, &(thermo->Z1)))  != eslOK) goto ERROR;
+
     prMaxG = -10;
     for (t = 0; t < numTemperatures ; ++t) {
 	/*
@@ -791,15 +1071,18 @@ p7_thermoCalibrate(P7_THERMO *thermo, ESL_RANDOMNESS *r, int p7m_score, const P7
 	 * Compute y coordinates
 	 */
 
-	/* Make <gmT> and <gmDT> profiles work for this temperature */
-	p7_profileAdjustClones(temperatures[t], bg, gm, gmT, gmDT);
+	/* Make <gmT> and <gmDT> profiles for this temperature; they
+	   are kept for p7_thermoEstimate(). */
+	if ((thermo->gmT[t]  = p7_profile_Clone(gm)) == NULL) { status = eslEMEM; goto ERROR; }
+	if ((thermo->gmDT[t] = p7_profile_Clone(gm)) == NULL) { status = eslEMEM; goto ERROR; }
+	if ((status = p7_profileAdjustClones(temperatures[t], bg, gm, thermo->gmT[t], thermo->gmDT[t])) != eslOK) goto ERROR;
 	/* Fill up <gxT> matrix with useful values for the subsequent
 	   stochastic trace. */
-	p7_GForward(dsqX, L, gmT, gxT, &ZT);
+	p7_GForward(dsqX, L, thermo->gmT[t], gxT, &ZT);
 
 	for (j = 0; j < numScores; j++) {
 	    /* Trace back a set of states <tr> and emissions <dsq> */
-	    p7_StochasticDsqTrace(r, dsqX, L, bg, gmT, gxT, tr, dsq);
+	    p7_StochasticDsqTrace(r, dsqX, L, bg, thermo->gmT[t], gxT, tr, dsq);
 	    /* Find the score of <dsq> and save it as sc[j]. */
 	    switch(thermo->p7m_score) {
 	    case p7M_FORWARD:
@@ -840,7 +1123,19 @@ p7_thermoCalibrate(P7_THERMO *thermo, ESL_RANDOMNESS *r, int p7m_score, const P7
 	 * but so be it.
 	 */
 
-	esl_vec_FSortIncreasing(temperatures, t+1);
+	/* temperatures[0..t-1] are already sorted; insert the new
+	   one, keeping its clones alongside. */
+	T   = temperatures[t];
+	pT  = thermo->gmT[t];
+	pDT = thermo->gmDT[t];
+	for (g = t; g > 0 && temperatures[g-1] > T; g--) {
+	    temperatures[g] = temperatures[g-1];
+	    thermo->gmT[g]  = thermo->gmT[g-1];
+	    thermo->gmDT[g] = thermo->gmDT[g-1];
+	}
+	temperatures[g] = T;
+	thermo->gmT[g]  = pT;
+	thermo->gmDT[g] = pDT;
 	esl_vec_FSortDecreasing(scores, t+1);
     }
 
@@ -860,6 +1155,7 @@ p7_thermoCalibrate(P7_THERMO *thermo, ESL_RANDOMNESS *r, int p7m_score, const P7
 
  ERROR:
     /* Reset <thermo> to an unused state */
+    free_clones(thermo);
     thermo->p7m_score = p7M_NSCORETYPES;
     thermo->numTemperatures = 0;
     if (thermo->temperatures) free (thermo->temperatures);
@@ -912,6 +1208,28 @@ p7_thermoSuggestTemp(const P7_THERMO *thermo, float score, float *temperature)
     return eslOK;
 }
 
+/* free_clones(thermo): Free the temperature-adjusted profiles
+   that p7_thermoCalibrate() keeps in <thermo>: all <nclones> slots,
+   since a failed calibration may have filled some of them without
+   setting <numTemperatures>. */
+static void
+free_clones(P7_THERMO *thermo)
+{
+    int t;
+
+    if (thermo->gmT) {
+	for (t = 0; t < thermo->nclones; t++) p7_profile_Destroy(thermo->gmT[t]);
+	free(thermo->gmT);
+    }
+    if (thermo->gmDT) {
+	for (t = 0; t < thermo->nclones; t++) p7_profile_Destroy(thermo->gmDT[t]);
+	free(thermo->gmDT);
+    }
+    thermo->gmT     = NULL;
+    thermo->gmDT    = NULL;
+    thermo->nclones = 0;
+}
+
 /* printMantissa(x): For printing the m.mm part of a m.mmEx.xx
    floating point number, exp(x)*/
 float 
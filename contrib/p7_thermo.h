@@ -22,14 +22,24 @@ typedef struct p7_thermo_s {
     int                   numTemperatures; /* array length for <temperatures> and <scores> */
     float                *temperatures;	/* x-coordinate of curve */
     float                *scores; /* y-coordinates of curve */
+
+    /* Set by p7_thermoCalibrate(), for p7_thermoEstimate*() */
+    P7_PROFILE          **gmT;  /* [0..numTemperatures-1] profile clones for sampling at temperatures[t] */
+    P7_PROFILE          **gmDT; /* [0..numTemperatures-1] profile clones for evaluating samples at temperatures[t] */
+    int                   nclones; /* # of slots in <gmT>, <gmDT>, NULL or not; what free_clones() frees */
+    float                 Z1;   /* Forward sum of the X/N sequence at temperature 1 */
+
+    int                   ncpu; /* threads for p7_thermoEstimate*(); 0 or 1 = serial; see p7_thermo_SetThreads() */
 } P7_THERMO;
 
 extern void utest_thermo         (ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const P7_BG *bg, const P7_PROFILE *gm, int nseq, int L);
 extern int p7_thermoEstimate     (ESL_RANDOMNESS *r, const P7_THERMO *thermo, const P7_BG *bg, const P7_PROFILE *gm, P7_GMX *gx, int numSamples, float threshold, int *support, float *pv, float *pvstd, float *sn, float *snstd);
+extern int p7_thermoEstimateMany (ESL_RANDOMNESS *r, const P7_THERMO *thermo, const P7_BG *bg, const P7_PROFILE *gm, P7_GMX *gx, int numSamples, const float *threshold, int n, int *support, float *pv, float *pvstd, float *sn, float *snstd);
 extern int p7_profileAdjustClones(float temperature, const P7_BG *bg, const P7_PROFILE *src, P7_PROFILE *dstT, P7_PROFILE *dstDT);
 extern int p7_StochasticDsqTrace (ESL_RANDOMNESS *r, const ESL_DSQ *dsqX, int L, const P7_BG *bg, const P7_PROFILE *gmT, const P7_GMX *gxT, P7_TRACE *tr, ESL_DSQ *dsq);
 extern P7_THERMO *p7_thermo_Create(void);
 extern void p7_thermo_Destroy    (P7_THERMO *thermo);
+extern int p7_thermo_SetThreads  (P7_THERMO *thermo, int ncpu);
 extern int p7_thermoCalibrate    (P7_THERMO *thermo, ESL_RANDOMNESS *r, int p7m_score, const P7_BG *bg, const P7_PROFILE *gm, P7_GMX *gx);
 extern int p7_thermoSuggestTemp  (const P7_THERMO *thermo, float score, float *temperature);
 
@@ -0,0 +1,181 @@
+#! /usr/bin/perl -w
+
+# Runs a pmark benchmark on the local machine, with a pool of worker
+# processes instead of a cluster queue.
+#
+# Usage:
+#   ./pmark-local.pl [options] <top_builddir> <top_srcdir> <resultdir> <nproc> <benchmark prefix> <benchmark script>
+#
+# The arguments are the same as pmark-master.pl's, and the <benchmark
+# script> is any of the x-* driver scripts, called with the same seven
+# arguments:
+#    <top_builddir> <top_srcdir> <resultdir> <tblfile> <msafile> <fafile> <outfile>
+#
+# <nproc> is the number of driver scripts to run at once. The queries
+# in <prefix>.tbl are split into <nshards> subtables (by default,
+# 4*<nproc>), dealt out round-robin in order of decreasing alignment
+# length as pmark-master.pl does; the subtables are then run
+# largest-first as workers come free, so a few long queries don't
+# leave the other workers idle at the end. Targets are not split:
+# each driver searches the whole <prefix>.fa, so E-values are the same
+# as in a single serial run.
+#
+# Creates, in addition to the <resultdir> working directory:
+#   <resultdir>/tbl.<i>       : subtable <i>
+#   <resultdir>/tbl.<i>.out   : driver output for subtable <i>
+#   <resultdir>/tbl.<i>.log   : driver stdout/stderr for subtable <i>
+#   <resultdir>.out           : all tbl.<i>.out merged, sorted by E-value
+#   <resultdir>.time          : wall and CPU time per subtable, and totals
+#   <resultdir>.xy            : rocplot output for <resultdir>.out, if a
+#                               rocplot executable was found
+#
+# CPU time is user+system time of the driver and everything it ran
+# (esl-afetch, hmmbuild, the search program...), so it measures the
+# cost of a method independently of <nproc>, and can be compared
+# between methods run on the same machine.
+#
+# Options:
+#   -s <n>    : split queries into <n> subtables      [4*<nproc>]
+#   -R <f>    : rocplot executable                    [<top_builddir>/profmark/rocplot]
+#   -r <opts> : extra options to pass to rocplot, e.g. "-n"
+#
+# Examples:
+#   ./pmark-local.pl ~/releases/hmmer-release/build ~/releases/hmmer-release h3    16 pmark ./x-hmmsearch
+#   ./pmark-local.pl ~/releases/hmmer-release/build ~/releases/hmmer-release h3-fps 16 pmark ./x-fps-phmmer
+#   grep total h3.time h3-fps.time
+#
+
+use Getopt::Std;
+use Time::HiRes qw(time);
+
+getopts('s:R:r:');
+
+if ($#ARGV != 5) { die "Usage: ./pmark-local.pl [options] <top_builddir> <top_srcdir> <resultdir> <nproc> <benchmark prefix> <benchmark script>\n"; }
+$top_builddir  = shift;
+$top_srcdir    = shift;
+$resultdir     = shift;
+$ncpu          = shift;
+$benchmark_pfx = shift;
+$pmark_script  = shift;
+
+$tbl          = "$benchmark_pfx.tbl";
+$msafile      = "$benchmark_pfx.msa";
+$fafile       = "$benchmark_pfx.fa";
+$nshards      = ($opt_s ? $opt_s : 4 * $ncpu);
+$rocplot      = ($opt_R ? $opt_R : "$top_builddir/profmark/rocplot");
+$rocopts      = ($opt_r ? $opt_r : "");
+
+if ($ncpu < 1)              { die "<nproc> must be at least 1"; }
+if ($nshards < 1)           { die "-s <n> must be at least 1"; }
+if (! -x $pmark_script)     { die "didn't find executable benchmark script $pmark_script"; }
+foreach $f ($tbl, $msafile, $fafile) { if (! -e $f) { die "didn't find benchmark file $f"; } }
+if (-e $resultdir) { die("$resultdir exists");}
+mkdir($resultdir) || die "failed to create $resultdir";
+
+# Suck in the master table
+open(BENCHMARK_TBL, $tbl) || die;
+$n    = 0;
+while (<BENCHMARK_TBL>)
+{
+    ($msaname[$n], undef, $L) = split;
+    $alen{$msaname[$n]} = $L;
+    $n++;
+}
+close BENCHMARK_TBL;
+if ($n == 0) { die "no queries in $tbl"; }
+if ($nshards > $n) { $nshards = $n; }
+
+# Sort it by alen - this helps load balance.
+sub by_alen { $alen{$b} <=> $alen{$a} }
+@sorted_msaname = sort by_alen @msaname;
+
+# Create <nshards> subtables; the sum of their alignment lengths
+# is the estimate of their cost, for running the biggest first.
+for ($i = 0; $i < $n; $i++)
+{
+    $subtbl[$i % $nshards]   .= "$sorted_msaname[$i]\n";
+    $subcost[$i % $nshards]  += $alen{$sorted_msaname[$i]};
+    $subnq[$i % $nshards]++;
+}
+for ($i = 0; $i < $nshards; $i++)
+{
+    open(SUBTBL, ">$resultdir/tbl.$i") || die ("Failed to create $resultdir/tbl.$i");
+    print SUBTBL $subtbl[$i];
+    close SUBTBL;
+}
+@queue = sort { $subcost[$b] <=> $subcost[$a] } (0..$nshards-1);
+
+# Run the pool. Perl's times() accumulates the user+sys time of
+# children (and their waited-for descendants) as they are reaped, so
+# its increase across one waitpid() is the CPU time of that subtable.
+$t0       = time();
+$nrunning = 0;
+$nfailed  = 0;
+%running  = ();
+while (@queue || $nrunning)
+{
+    while (@queue && $nrunning < $ncpu)
+    {
+	$i   = shift @queue;
+	$pid = fork();
+	if (! defined $pid) { die "fork failed"; }
+	if ($pid == 0)
+	{
+	    open(STDOUT, ">$resultdir/tbl.$i.log") || die;
+	    open(STDERR, ">&STDOUT")               || die;
+	    exec($pmark_script, $top_builddir, $top_srcdir, $resultdir, "$resultdir/tbl.$i", $msafile, $fafile, "$resultdir/tbl.$i.out");
+	    die "failed to exec $pmark_script";
+	}
+	$running{$pid} = $i;
+	$start[$i]     = time();
+	$nrunning++;
+    }
+
+    (undef, undef, $cuser0, $csys0) = times();
+    $pid = waitpid(-1, 0);
+    if ($pid <= 0) { last; }
+    (undef, undef, $cuser, $csys) = times();
+
+    $i = $running{$pid};
+    delete $running{$pid};
+    $nrunning--;
+    $wall[$i]   = time() - $start[$i];
+    $cpu[$i]    = ($cuser - $cuser0) + ($csys - $csys0);
+    $status[$i] = $? >> 8;
+    if ($?) { $nfailed++; printf STDERR ("subtable %d FAILED (exit %d); see $resultdir/tbl.$i.log\n", $i, $status[$i]); }
+}
+$totwall = time() - $t0;
+
+# Merge outputs, sorted by E-value (the "cat *.out | sort -g" of 00README)
+@hits = ();
+for ($i = 0; $i < $nshards; $i++)
+{
+    if (! open(SUBOUT, "$resultdir/tbl.$i.out")) { next; }
+    push @hits, <SUBOUT>;
+    close SUBOUT;
+}
+open(OUTFILE, ">$resultdir.out") || die "failed to open $resultdir.out";
+print OUTFILE sort { (split(' ', $a))[0] <=> (split(' ', $b))[0] } @hits;
+close OUTFILE;
+
+# Timing table
+$totcpu = 0;
+open(TIMEFILE, ">$resultdir.time") || die "failed to open $resultdir.time";
+printf TIMEFILE ("# %s on %s, %d processes\n", $pmark_script, $benchmark_pfx, $ncpu);
+printf TIMEFILE ("# %-6s %8s %10s %10s %6s\n",  "subtbl", "queries", "wall(s)", "cpu(s)", "exit");
+for ($i = 0; $i < $nshards; $i++)
+{
+    printf TIMEFILE ("  %-6d %8d %10.1f %10.1f %6d\n", $i, $subnq[$i], $wall[$i], $cpu[$i], $status[$i]);
+    $totcpu += $cpu[$i];
+}
+printf TIMEFILE ("total    %8d %10.1f %10.1f %6d   cpu/query %.2f\n", $n, $totwall, $totcpu, $nfailed, $totcpu / $n);
+close TIMEFILE;
+printf STDERR ("%s: %d queries, %.1fs wall, %.1fs cpu (%.2f cpu/query), %d failed subtables\n", $resultdir, $n, $totwall, $totcpu, $totcpu / $n, $nfailed);
+
+# ROC plot
+if (-x $rocplot)
+{
+    system("$rocplot $rocopts $benchmark_pfx $resultdir.out > $resultdir.xy") == 0 || die "FAILED: $rocplot $rocopts $benchmark_pfx $resultdir.out";
+}
+
+exit ($nfailed ? 1 : 0);
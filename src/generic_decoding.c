@@ -13,6 +13,13 @@
 #include "easel.h"
 #include "hmmer.h"
 
+static int   decoding_serial(const P7_PROFILE *gm, const P7_GMX *fwd, P7_GMX *bck, P7_GMX *pp);
+#ifdef eslENABLE_SSE
+static int   decoding_sse   (const P7_PROFILE *gm, const P7_GMX *fwd, P7_GMX *bck, P7_GMX *pp);
+static float decode_row_sse (const float *fwdrow, const float *bckrow, float *pprow, int M, float overall_sc);
+static void  scale_row_sse  (float *pprow, int M, float scale);
+#endif
+
 /*****************************************************************
  * 1. Posterior decoding algorithms.
  *****************************************************************/
@@ -75,6 +82,20 @@
  */
 int
 p7_GDecoding(const P7_PROFILE *gm, const P7_GMX *fwd, P7_GMX *bck, P7_GMX *pp)
+{
+#ifdef eslENABLE_SSE
+  return decoding_sse(gm, fwd, bck, pp);
+#else
+  return decoding_serial(gm, fwd, bck, pp);
+#endif
+}
+
+
+/* decoding_serial()
+ * The reference implementation of p7_GDecoding(), one cell at a time.
+ */
+static int
+decoding_serial(const P7_PROFILE *gm, const P7_GMX *fwd, P7_GMX *bck, P7_GMX *pp)
 {
   float      **dp   = pp->dp;
   float       *xmx  = pp->xmx;
@@ -229,6 +250,118 @@ p7_GDomainDecoding(const P7_PROFILE *gm, const P7_GMX *fwd, const P7_GMX *bck, P
 
 
 
+#ifdef eslENABLE_SSE
+/* decoding_sse()
+ * Same as decoding_serial(), with the M,I cells of each row done
+ * four at a time by decode_row_sse() and scale_row_sse().
+ */
+static int
+decoding_sse(const P7_PROFILE *gm, const P7_GMX *fwd, P7_GMX *bck, P7_GMX *pp)
+{
+  float      **dp   = pp->dp;
+  float       *xmx  = pp->xmx;
+  int          L    = fwd->L;
+  int          M    = gm->M;
+  int          i,k;
+  float        overall_sc = fwd->xmx[p7G_NXCELLS*L + p7G_C] + gm->xsc[p7P_C][p7P_MOVE];
+  float        denom;
+  
+  pp->M = M;
+  pp->L = L;
+
+  XMX(0, p7G_E) = 0.0;
+  XMX(0, p7G_N) = 0.0;		
+  XMX(0, p7G_J) = 0.0;		
+  XMX(0, p7G_B) = 0.0;
+  XMX(0, p7G_C) = 0.0;
+  for (k = 0; k <= M; k++)
+    MMX(0,k) = IMX(0,k) = DMX(0,k) = 0.0;
+  
+  for (i = 1; i <= L; i++)
+    {
+      denom = decode_row_sse(fwd->dp[i], bck->dp[i], dp[i], M, overall_sc);
+      
+      /* order doesn't matter.  note that this whole function is trivially simd parallel */
+      XMX(i,p7G_E) = 0.;
+      XMX(i,p7G_N) = expf(fwd->xmx[p7G_NXCELLS*(i-1) + p7G_N] + bck->xmx[p7G_NXCELLS*i + p7G_N] + gm->xsc[p7P_N][p7P_LOOP] - overall_sc);
+      XMX(i,p7G_J) = expf(fwd->xmx[p7G_NXCELLS*(i-1) + p7G_J] + bck->xmx[p7G_NXCELLS*i + p7G_J] + gm->xsc[p7P_J][p7P_LOOP] - overall_sc);
+      XMX(i,p7G_B) = 0.;
+      XMX(i,p7G_C) = expf(fwd->xmx[p7G_NXCELLS*(i-1) + p7G_C] + bck->xmx[p7G_NXCELLS*i + p7G_C] + gm->xsc[p7P_C][p7P_LOOP] - overall_sc);
+      denom += XMX(i,p7G_N) + XMX(i,p7G_J) + XMX(i,p7G_C);
+      
+      denom = 1.0 / denom;
+      scale_row_sse(dp[i], M, denom);
+      XMX(i,p7G_N) *= denom;
+      XMX(i,p7G_J) *= denom;
+      XMX(i,p7G_C) *= denom;
+    }
+  return eslOK;
+}
+
+
+/* decode_row_sse()
+ * The M,I cells of one row of p7_GDecoding(), four floats at a time
+ * straight down the interleaved M,I,D row; D cells (every third
+ * float) are masked to zero. Row k=0 and I_M are zero as well.
+ * Returns the sum of the row's M,I posteriors, unnormalized.
+ * <bckrow> and <pprow> may be the same row.
+ */
+static float
+decode_row_sse(const float *fwdrow, const float *bckrow, float *pprow, int M, float overall_sc)
+{
+  __m128 dmask[3];
+  __m128 scv    = _mm_set1_ps(overall_sc);
+  __m128 sumv   = _mm_setzero_ps();
+  __m128 v;
+  int    n      = (M+1) * p7G_NSCELLS;
+  int    j, r;
+  float  denom;
+
+  /* Starting at j = p7G_NSCELLS (k=1), D lanes repeat with period 3 vectors */
+  dmask[0] = _mm_castsi128_ps(_mm_set_epi32( 0, -1,  0,  0));  /* j%12 == 3  */
+  dmask[1] = _mm_castsi128_ps(_mm_set_epi32( 0,  0, -1,  0));  /* j%12 == 7  */
+  dmask[2] = _mm_castsi128_ps(_mm_set_epi32(-1,  0,  0, -1));  /* j%12 == 11 */
+
+  for (j = 0; j < p7G_NSCELLS; j++) pprow[j] = 0.;
+  for (j = p7G_NSCELLS, r = 0; j + 4 <= n; j += 4, r = (r+1) % 3)
+    {
+      v    = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(fwdrow+j), _mm_loadu_ps(bckrow+j)), scv);
+      v    = _mm_andnot_ps(dmask[r], esl_sse_expf(v));
+      sumv = _mm_add_ps(sumv, v);
+      _mm_storeu_ps(pprow+j, v);
+    }
+  esl_sse_hsum_ps(sumv, &denom);
+  for ( ; j < n; j++)
+    {
+      pprow[j] = (j % p7G_NSCELLS == p7G_D) ? 0. : expf(fwdrow[j] + bckrow[j] - overall_sc);
+      denom   += pprow[j];
+    }
+
+  denom -= pprow[M*p7G_NSCELLS + p7G_I];
+  pprow[M*p7G_NSCELLS + p7G_I] = 0.;
+  return denom;
+}
+
+/* scale_row_sse()
+ * Multiply the M,I cells k=1..M of one posterior decoding row by <scale>.
+ */
+static void
+scale_row_sse(float *pprow, int M, float scale)
+{
+  __m128 sv = _mm_set1_ps(scale);
+  int    n  = (M+1) * p7G_NSCELLS;
+  int    j;
+
+  for (j = p7G_NSCELLS; j + 4 <= n; j += 4)
+    _mm_storeu_ps(pprow+j, _mm_mul_ps(_mm_loadu_ps(pprow+j), sv));
+  for ( ; j < n; j++)
+    pprow[j] *= scale;
+}
+#endif /*eslENABLE_SSE*/
+/*------------------ end, decoding algorithms -------------------*/
+
+
+
 /*****************************************************************
  * 2. Benchmark driver
  *****************************************************************/
@@ -331,7 +464,82 @@ main(int argc, char **argv)
  * 3. Unit tests
  *****************************************************************/
 #ifdef p7GENERIC_DECODING_TESTDRIVE
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
 
+#ifdef eslENABLE_SSE
+/* The "engines" test compares the SSE and serial paths of
+ * p7_GDecoding() cell by cell, on the same Forward and Backward
+ * matrices for random seqs, local and glocal. They differ only by
+ * expf() vs. esl_sse_expf() rounding. Each SSE row must also sum to
+ * one.
+ */
+static void
+utest_engines(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, P7_HMM *hmm, int nseq, int L)
+{
+  P7_PROFILE *gm   = NULL;
+  ESL_DSQ    *dsq  = NULL;
+  P7_GMX     *fwd  = NULL;
+  P7_GMX     *bck  = NULL;
+  P7_GMX     *pp1  = NULL;
+  P7_GMX     *pp2  = NULL;
+  int         mode;
+  int         idx;
+  int         i, k, s;
+  float       sum;
+  float       tol  = 1e-4;
+
+  if ((gm  = p7_profile_Create(hmm->M, abc))  == NULL)  esl_fatal("failed to create profile");
+  if ((dsq = malloc(sizeof(ESL_DSQ) *(L+2))) == NULL)  esl_fatal("malloc failed");
+  if ((fwd = p7_gmx_Create(hmm->M, L))       == NULL)  esl_fatal("matrix creation failed");
+  if ((bck = p7_gmx_Create(hmm->M, L))       == NULL)  esl_fatal("matrix creation failed");
+  if ((pp1 = p7_gmx_Create(hmm->M, L))       == NULL)  esl_fatal("matrix creation failed");
+  if ((pp2 = p7_gmx_Create(hmm->M, L))       == NULL)  esl_fatal("matrix creation failed");
+
+  for (mode = 0; mode < 2; mode++)
+    {
+      if (p7_ProfileConfig(hmm, bg, gm, L, (mode == 0 ? p7_LOCAL : p7_GLOCAL)) != eslOK) esl_fatal("failed to config profile");
+      for (idx = 0; idx < nseq; idx++)
+	{
+	  if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq) != eslOK) esl_fatal("seq generation failed");
+	  if (p7_GForward (dsq, L, gm, fwd, NULL)     != eslOK) esl_fatal("forward failed");
+	  if (p7_GBackward(dsq, L, gm, bck, NULL)     != eslOK) esl_fatal("backward failed");
+	  if (decoding_serial(gm, fwd, bck, pp1)      != eslOK) esl_fatal("serial decoding failed");
+	  if (decoding_sse   (gm, fwd, bck, pp2)      != eslOK) esl_fatal("SSE decoding failed");
+
+	  for (i = 0; i <= L; i++)
+	    {
+	      sum = 0.;
+	      for (k = 0; k <= gm->M; k++)
+		for (s = 0; s < p7G_NSCELLS; s++)
+		  {
+		    if (fabs(pp1->dp[i][k*p7G_NSCELLS+s] - pp2->dp[i][k*p7G_NSCELLS+s]) > tol)
+		      esl_fatal("SSE decoding differs from serial at i=%d k=%d s=%d: %f %f", i, k, s, pp1->dp[i][k*p7G_NSCELLS+s], pp2->dp[i][k*p7G_NSCELLS+s]);
+		    sum += pp2->dp[i][k*p7G_NSCELLS+s];
+		  }
+	      for (s = 0; s < p7G_NXCELLS; s++)
+		{
+		  if (fabs(pp1->xmx[i*p7G_NXCELLS+s] - pp2->xmx[i*p7G_NXCELLS+s]) > tol)
+		    esl_fatal("SSE decoding differs from serial at i=%d special %d: %f %f", i, s, pp1->xmx[i*p7G_NXCELLS+s], pp2->xmx[i*p7G_NXCELLS+s]);
+		  sum += pp2->xmx[i*p7G_NXCELLS+s];
+		}
+	      if (i > 0 && fabs(sum - 1.) > tol) esl_fatal("SSE decoding row %d sums to %f, not 1", i, sum);
+	    }
+
+	  if (esl_opt_GetBoolean(go, "--vv"))
+	    printf("utest_engines: %s seq %d ok\n", (mode == 0 ? "local" : "glocal"), idx);
+	}
+    }
+
+  p7_gmx_Destroy(pp2);
+  p7_gmx_Destroy(pp1);
+  p7_gmx_Destroy(bck);
+  p7_gmx_Destroy(fwd);
+  p7_profile_Destroy(gm);
+  free(dsq);
+}
+#endif /*eslENABLE_SSE*/
 #endif /*p7GENERIC_DECODING_TESTDRIVE*/
 /*--------------------- end, unit tests -------------------------*/
 
@@ -341,8 +549,55 @@ main(int argc, char **argv)
 /*****************************************************************
  * 4. Test driver
  *****************************************************************/
+/* gcc -g -Wall -Dp7GENERIC_DECODING_TESTDRIVE -I. -I../easel -L. -L../easel -o generic_decoding_utest generic_decoding.c -lhmmer -leasel -lm
+ */
 #ifdef p7GENERIC_DECODING_TESTDRIVE
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "p7_config.h"
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "--vv",      eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be very verbose",                                0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for the generic posterior decoding implementation";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_HMM         *hmm  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = 100;
+  int             L    = 200;
+  int             nseq = 20;
+
+  p7_FLogsumInit();
 
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if (p7_hmm_Sample(r, M, abc, &hmm)        != eslOK) esl_fatal("failed to sample an HMM");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+#ifdef eslENABLE_SSE
+  utest_engines(go, r, abc, bg, hmm, nseq, L);
+#endif
+
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
 #endif /*p7GENERIC_DECODING_TESTDRIVE*/
 /*-------------------- end, test driver -------------------------*/
 
@@ -1,19 +1,37 @@
-/* Forward/Backward algorithms; generic (non-SIMD) versions.
+/* Forward/Backward algorithms; generic versions.
  * 
+ * "Generic" refers to the P7_PROFILE/P7_GMX data layout, not to the
+ * code: when HMMER is built with SSE, the M and I cells of each row
+ * and the row-wise D chain are computed four at a time, using the
+ * table-free p7_sse_FLogsum() instead of the p7_FLogsum() lookup
+ * table (the special states too, one at a time). The serial versions
+ * are retained, and are what non-SSE builds use.
+ *
  * Contents:
  *   1. Forward, Backward, Hybrid implementations.  
- *   2. Benchmark driver.
- *   3. Unit tests.
- *   4. Test driver.
- *   5. Example.
+ *   2. Serial and SSE engines.
+ *   3. Benchmark driver.
+ *   4. Unit tests.
+ *   5. Test driver.
+ *   6. Example.
  */
 #include "p7_config.h"
 
+#include <math.h>
+
 #include "easel.h"
 #include "esl_alphabet.h"
+#include "esl_vectorops.h"
 
 #include "hmmer.h"
 
+static int forward_serial (const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc);
+static int backward_serial(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc);
+#ifdef eslENABLE_SSE
+static int forward_sse    (const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc);
+static int backward_sse   (const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc);
+#endif
+
 /*****************************************************************
  * 1. Forward, Backward, Hybrid implementations.
  *****************************************************************/
@@ -43,9 +61,128 @@
  *            opt_sc - optRETURN: Forward lod score in nats
  *           
  * Return:    <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure (SSE version only, which
+ *            needs O(M) workspace).
  */
 int
 p7_GForward(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc)
+{
+#ifdef eslENABLE_SSE
+  return forward_sse(dsq, L, gm, gx, opt_sc);
+#else
+  return forward_serial(dsq, L, gm, gx, opt_sc);
+#endif
+}
+
+
+/* Function:  p7_GBackward()
+ * Synopsis:  The Backward algorithm.
+ *
+ * Purpose:   The Backward dynamic programming algorithm.
+ * 
+ *            Given a digital sequence <dsq> of length <L>, a profile
+ *            <gm>, and DP matrix <gx> allocated for at least <gm->M>
+ *            by <L> cells; calculate the probability of the sequence
+ *            given the model using the Backward algorithm; return the
+ *            Backward matrix in <gx>, and the Backward score in <ret_sc>.
+ *           
+ *            The Backward score is in lod score form. To convert to a
+ *            bitscore, the caller needs to subtract a null model lod
+ *            score, then convert to bits.
+ *
+ * Args:      dsq    - sequence in digitized form, 1..L
+ *            L      - length of dsq
+ *            gm     - profile 
+ *            gx     - DP matrix with room for an MxL alignment
+ *            opt_sc - optRETURN: Backward lod score in nats
+ *           
+ * Return:    <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure (SSE version only).
+ */
+int
+p7_GBackward(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc)
+{
+#ifdef eslENABLE_SSE
+  return backward_sse(dsq, L, gm, gx, opt_sc);
+#else
+  return backward_serial(dsq, L, gm, gx, opt_sc);
+#endif
+}
+
+/* Function:  p7_GHybrid()
+ * Synopsis:  The "hybrid" algorithm.
+ *
+ * Purpose:   The profile HMM version of the Hwa "hybrid" alignment
+ *            algorithm \citep{YuHwa02}. The "hybrid" score is the
+ *            maximum score in the Forward matrix. 
+ *            
+ *            Given a digital sequence <dsq> of length <L>, a profile
+ *            <gm>, and DP matrix <mx> allocated for at least <gm->M>
+ *            by <L> cells; calculate the probability of the sequence
+ *            given the model using the Forward algorithm; return
+ *            the calculated Forward matrix in <mx>, and optionally
+ *            return the Forward score in <opt_fwdscore> and/or the
+ *            Hybrid score in <opt_hybscore>.
+ *           
+ *            This is implemented as a wrapper around <p7_GForward()>.
+ *            The Forward matrix and the Forward score obtained from
+ *            this routine are identical to what <p7_GForward()> would
+ *            return.
+ *           
+ *            The scores are returned in lod form.  To convert to a
+ *            bitscore, the caller needs to subtract a null model lod
+ *            score, then convert to bits.
+ *           
+ * Args:      dsq          - sequence in digitized form, 1..L
+ *            L            - length of dsq
+ *            gm           - profile. 
+ *            gx           - DP matrix with room for an MxL alignment
+ *            opt_fwdscore - optRETURN: Forward lod score in nats.
+ *            opt_hybscore - optRETURN: Hybrid lod score in nats.
+ *
+ * Returns:   <eslOK> on success, and results are in <mx>, <opt_fwdscore>,
+ *            and <opt_hybscore>.
+ */
+int
+p7_GHybrid(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_fwdscore, float *opt_hybscore)
+{
+  float   F    = -eslINFINITY;
+  float   H    = -eslINFINITY;
+  float **dp   = gx->dp;
+  int     i,k;
+  int     status;
+
+  if ((status = p7_GForward(dsq, L, gm, gx, &F)) != eslOK)  goto ERROR;
+  for (i = 1; i <= L; i++)
+    for (k = 1 ; k <= gm->M; k++)
+      H = ESL_MAX(H, MMX(i,k));
+  
+  gx->M = gm->M;
+  gx->L = L;
+  if (opt_fwdscore != NULL) *opt_fwdscore = F;
+  if (opt_hybscore != NULL) *opt_hybscore = H;
+  return eslOK;
+
+ ERROR:
+  if (opt_fwdscore != NULL) *opt_fwdscore = 0;
+  if (opt_hybscore != NULL) *opt_hybscore = 0;
+  return status;
+}
+/*------------- end: forward, backward, hybrid ------------------*/
+
+
+
+/*****************************************************************
+ * 2. Serial and SSE engines.
+ *****************************************************************/
+
+/* forward_serial()
+ * The reference implementation, one cell at a time with p7_FLogsum().
+ */
+static int
+forward_serial(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc)
 {
   float const *tsc  = gm->tsc;
   float      **dp   = gx->dp;
@@ -137,31 +274,11 @@ p7_GForward(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *
 }
 
 
-/* Function:  p7_GBackward()
- * Synopsis:  The Backward algorithm.
- *
- * Purpose:   The Backward dynamic programming algorithm.
- * 
- *            Given a digital sequence <dsq> of length <L>, a profile
- *            <gm>, and DP matrix <gx> allocated for at least <gm->M>
- *            by <L> cells; calculate the probability of the sequence
- *            given the model using the Backward algorithm; return the
- *            Backward matrix in <gx>, and the Backward score in <ret_sc>.
- *           
- *            The Backward score is in lod score form. To convert to a
- *            bitscore, the caller needs to subtract a null model lod
- *            score, then convert to bits.
- *
- * Args:      dsq    - sequence in digitized form, 1..L
- *            L      - length of dsq
- *            gm     - profile 
- *            gx     - DP matrix with room for an MxL alignment
- *            opt_sc - optRETURN: Backward lod score in nats
- *           
- * Return:    <eslOK> on success.
+/* backward_serial()
+ * The reference implementation, one cell at a time with p7_FLogsum().
  */
-int
-p7_GBackward(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc)
+static int
+backward_serial(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc)
 {
   float const *tsc  = gm->tsc;
   float const *rsc  = NULL;
@@ -252,72 +369,422 @@ p7_GBackward(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float
 
 
 
-/* Function:  p7_GHybrid()
- * Synopsis:  The "hybrid" algorithm.
- *
- * Purpose:   The profile HMM version of the Hwa "hybrid" alignment
- *            algorithm \citep{YuHwa02}. The "hybrid" score is the
- *            maximum score in the Forward matrix. 
- *            
- *            Given a digital sequence <dsq> of length <L>, a profile
- *            <gm>, and DP matrix <mx> allocated for at least <gm->M>
- *            by <L> cells; calculate the probability of the sequence
- *            given the model using the Forward algorithm; return
- *            the calculated Forward matrix in <mx>, and optionally
- *            return the Forward score in <opt_fwdscore> and/or the
- *            Hybrid score in <opt_hybscore>.
- *           
- *            This is implemented as a wrapper around <p7_GForward()>.
- *            The Forward matrix and the Forward score obtained from
- *            this routine are identical to what <p7_GForward()> would
- *            return.
- *           
- *            The scores are returned in lod form.  To convert to a
- *            bitscore, the caller needs to subtract a null model lod
- *            score, then convert to bits.
- *           
- * Args:      dsq          - sequence in digitized form, 1..L
- *            L            - length of dsq
- *            gm           - profile. 
- *            gx           - DP matrix with room for an MxL alignment
- *            opt_fwdscore - optRETURN: Forward lod score in nats.
- *            opt_hybscore - optRETURN: Hybrid lod score in nats.
- *
- * Returns:   <eslOK> on success, and results are in <mx>, <opt_fwdscore>,
- *            and <opt_hybscore>.
+#ifdef eslENABLE_SSE
+/* GSSE_WORK: a k-major copy of a profile's scores, and two rows of
+ * M,I,D working storage, for the SSE engines. Each array runs over
+ * k=0..4Q+3 so that a vector starting at any k=1+4q can be loaded at
+ * k-1 or k+1 without running off the end; cells outside 1..M are
+ * -infinity, which lets the engines run the recursions uniformly
+ * over the padding (and over node M, whose missing transitions are
+ * -infinity too).
  */
-int
-p7_GHybrid(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_fwdscore, float *opt_hybscore)
+typedef struct {
+  int     M;			/* model length                                            */
+  int     Q;			/* # of 4-float vectors spanning k=1..M                    */
+  int     Kp;			/* alphabet size, for the emission cache                   */
+  int     nk;			/* allocated length of each k-major array: 4Q+4            */
+  float  *mem;		        /* one allocation for everything but emissions             */
+  float  *tsc[p7P_NTRANS];	/* tsc[s][k] = TSC(s,k), for k=0..M-1                      */
+  float  *esc;			/* local E exit: esc for k<M; 0 for k=M                    */
+  float  *ninf;			/* an all -inf row                                         */
+  float  *row[6];		/* M,I,D for two DP rows                                   */
+  float **msc;			/* msc[x][k] = MSC(k) for residue x, filled on first use   */
+  float **isc;			/* isc[x][k] = ISC(k); shares msc[x]'s allocation          */
+} GSSE_WORK;
+
+static void
+gsse_Destroy(GSSE_WORK *gs)
 {
-  float   F    = -eslINFINITY;
-  float   H    = -eslINFINITY;
-  float **dp   = gx->dp;
-  int     i,k;
-  int     status;
+  int x;
+  if (gs == NULL) return;
+  if (gs->msc != NULL) {
+    for (x = 0; x < gs->Kp; x++) if (gs->msc[x] != NULL) free(gs->msc[x]);
+    free(gs->msc);
+  }
+  if (gs->isc != NULL) free(gs->isc);
+  if (gs->mem != NULL) free(gs->mem);
+  free(gs);
+}
+
+static GSSE_WORK *
+gsse_Create(const P7_PROFILE *gm)
+{
+  GSSE_WORK *gs  = NULL;
+  float     *p;
+  float      esc = p7_profile_IsLocal(gm) ? 0. : -eslINFINITY;
+  int        s, k, x;
+  int        status;
+
+  ESL_ALLOC(gs, sizeof(GSSE_WORK));
+  gs->M   = gm->M;
+  gs->Q   = (gm->M + 3) / 4;
+  gs->Kp  = gm->abc->Kp;
+  gs->nk  = 4 * gs->Q + 4;
+  gs->mem = NULL;
+  gs->msc = gs->isc = NULL;
+
+  ESL_ALLOC(gs->mem, sizeof(float) * gs->nk * (p7P_NTRANS + 8));
+  esl_vec_FSet(gs->mem, gs->nk * (p7P_NTRANS + 8), -eslINFINITY);
+  p = gs->mem;
+  for (s = 0; s < p7P_NTRANS; s++, p += gs->nk) gs->tsc[s] = p;
+  gs->esc  = p;  p += gs->nk;
+  gs->ninf = p;  p += gs->nk;
+  for (s = 0; s < 6; s++, p += gs->nk) gs->row[s] = p;
+
+  for (k = 0; k < gm->M; k++)
+    for (s = 0; s < p7P_NTRANS; s++)
+      gs->tsc[s][k] = gm->tsc[k * p7P_NTRANS + s];
+  for (k = 1; k < gm->M; k++) gs->esc[k] = esc;
+  gs->esc[gm->M] = 0.;
+
+  ESL_ALLOC(gs->msc, sizeof(float *) * gs->Kp);
+  ESL_ALLOC(gs->isc, sizeof(float *) * gs->Kp);
+  for (x = 0; x < gs->Kp; x++) gs->msc[x] = gs->isc[x] = NULL;
+  return gs;
+
+ ERROR:
+  gsse_Destroy(gs);
+  return NULL;
+}
+
+/* gsse_GetEmissions()
+ * Return k-major match and insert emission scores for residue <x>,
+ * building them on first use.
+ */
+static int
+gsse_GetEmissions(GSSE_WORK *gs, const P7_PROFILE *gm, ESL_DSQ x, float **ret_msc, float **ret_isc)
+{
+  const float *rsc = gm->rsc[x];
+  int          k;
+  int          status;
+
+  if (gs->msc[x] == NULL)
+    {
+      ESL_ALLOC(gs->msc[x], sizeof(float) * gs->nk * 2);
+      gs->isc[x] = gs->msc[x] + gs->nk;
+      esl_vec_FSet(gs->msc[x], gs->nk * 2, -eslINFINITY);
+      for (k = 1; k <= gm->M; k++) {
+	gs->msc[x][k] = MSC(k);
+	gs->isc[x][k] = ISC(k);
+      }
+    }
+  *ret_msc = gs->msc[x];
+  *ret_isc = gs->isc[x];
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* gsse_FLogsum()
+ * Scalar table-free log(e^a + e^b), for the special states of the
+ * SSE engines, so that they carry no p7_FLogsum() table error either.
+ */
+static inline float
+gsse_FLogsum(float a, float b)
+{
+  const float max = ESL_MAX(a, b);
+  const float min = ESL_MIN(a, b);
+  return (min == -eslINFINITY) ? max : max + log1pf(expf(min-max));
+}
+
+/* gsse_StoreRow()
+ * Copy k-major working rows <mr>,<ir>,<dr> into row <dpi> of a P7_GMX.
+ */
+static void
+gsse_StoreRow(const GSSE_WORK *gs, const float *mr, const float *ir, const float *dr, float *dpi)
+{
+  int k;
+  for (k = 0; k <= gs->M; k++)
+    {
+      dpi[k * p7G_NSCELLS + p7G_M] = mr[k];
+      dpi[k * p7G_NSCELLS + p7G_I] = ir[k];
+      dpi[k * p7G_NSCELLS + p7G_D] = dr[k];
+    }
+}
+
+/* gsse_ScanRight(), gsse_ScanLeft()
+ * The D cells of a row are a linear chain in log space,
+ * D_k = logsum(a_k, D_{k-1} + b_k) in Forward (and the mirror image,
+ * D_k = logsum(a_k, D_{k+1} + b_k), in Backward). Composing two steps
+ * gives another step of the same form, so a log-space prefix scan
+ * over a vector of (a,b) pairs, in two doubling passes, gives for
+ * each lane the (A,B) such that D = logsum(A, D_carry + B), where
+ * D_carry is the D cell just outside the vector.
+ */
+static inline void
+gsse_ScanRight(__m128 *av, __m128 *bv)
+{
+  __m128 neginfv = _mm_set1_ps(-eslINFINITY);
+  __m128 zerov   = _mm_setzero_ps();
+  __m128 tv;
+
+  tv  = _mm_add_ps(esl_sse_rightshift_ps(*av, neginfv), *bv);
+  *bv = _mm_add_ps(*bv, esl_sse_rightshift_ps(*bv, zerov));
+  *av = p7_sse_FLogsum(*av, tv);
+
+  tv  = _mm_add_ps(_mm_shuffle_ps(neginfv, *av, _MM_SHUFFLE(1,0,0,0)), *bv);  /* [ -inf -inf a0 a1 ] */
+  *bv = _mm_add_ps(*bv, _mm_shuffle_ps(zerov, *bv, _MM_SHUFFLE(1,0,0,0)));
+  *av = p7_sse_FLogsum(*av, tv);
+}
+
+static inline void
+gsse_ScanLeft(__m128 *av, __m128 *bv)
+{
+  __m128 neginfv = _mm_set1_ps(-eslINFINITY);
+  __m128 zerov   = _mm_setzero_ps();
+  __m128 tv;
+
+  tv  = _mm_add_ps(esl_sse_leftshift_ps(*av, neginfv), *bv);
+  *bv = _mm_add_ps(*bv, esl_sse_leftshift_ps(*bv, zerov));
+  *av = p7_sse_FLogsum(*av, tv);
+
+  tv  = _mm_add_ps(_mm_shuffle_ps(*av, neginfv, _MM_SHUFFLE(0,0,3,2)), *bv);  /* [ a2 a3 -inf -inf ] */
+  *bv = _mm_add_ps(*bv, _mm_shuffle_ps(*bv, zerov, _MM_SHUFFLE(0,0,3,2)));
+  *av = p7_sse_FLogsum(*av, tv);
+}
+
+
+/* forward_sse()
+ * Same recursion as forward_serial(). Within row i, M and I cells
+ * depend only on row i-1 and are computed four k at a time; then the
+ * D chain by prefix scan; then E by a vector log-sum reduction.
+ */
+static int
+forward_sse(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc)
+{
+  float      **dp      = gx->dp;
+  float       *xmx     = gx->xmx;
+  int          M       = gm->M;
+  GSSE_WORK   *gs      = NULL;
+  __m128       neginfv = _mm_set1_ps(-eslINFINITY);
+  __m128       xBv, sv, av, bv, dcv, ev, tv;
+  float       *pM, *pI, *pD, *cM, *cI, *cD, *swap;
+  float       *msc, *isc;
+  float      **t;
+  int          i, q, k;
+  int          status;
+
+  if ((gs = gsse_Create(gm)) == NULL) { status = eslEMEM; goto ERROR; }
+  t  = gs->tsc;
+  pM = gs->row[0];  pI = gs->row[1];  pD = gs->row[2];
+  cM = gs->row[3];  cI = gs->row[4];  cD = gs->row[5];
+
+  /* Initialization of the zero row. */
+  XMX(0,p7G_N) = 0;                                           /* S->N, p=1            */
+  XMX(0,p7G_B) = gm->xsc[p7P_N][p7P_MOVE];                    /* S->N->B, no N-tail   */
+  XMX(0,p7G_E) = XMX(0,p7G_C) = XMX(0,p7G_J) = -eslINFINITY;  /* need seq to get here */
+  gsse_StoreRow(gs, pM, pI, pD, dp[0]);
 
-  if ((status = p7_GForward(dsq, L, gm, gx, &F)) != eslOK)  goto ERROR;
   for (i = 1; i <= L; i++)
-    for (k = 1 ; k <= gm->M; k++)
-      H = ESL_MAX(H, MMX(i,k));
-  
-  gx->M = gm->M;
+    {
+      if ((status = gsse_GetEmissions(gs, gm, dsq[i], &msc, &isc)) != eslOK) goto ERROR;
+      xBv = _mm_set1_ps(XMX(i-1,p7G_B));
+
+      /* match and insert states */
+      for (q = 0, k = 1; q < gs->Q; q++, k += 4)
+	{
+	  sv = p7_sse_FLogsum(p7_sse_FLogsum(_mm_add_ps(_mm_loadu_ps(pM+k-1), _mm_loadu_ps(t[p7P_MM]+k-1)),
+					     _mm_add_ps(_mm_loadu_ps(pI+k-1), _mm_loadu_ps(t[p7P_IM]+k-1))),
+			      p7_sse_FLogsum(_mm_add_ps(xBv,                  _mm_loadu_ps(t[p7P_BM]+k-1)),
+					     _mm_add_ps(_mm_loadu_ps(pD+k-1), _mm_loadu_ps(t[p7P_DM]+k-1))));
+	  _mm_storeu_ps(cM+k, _mm_add_ps(sv, _mm_loadu_ps(msc+k)));
+
+	  sv = p7_sse_FLogsum(_mm_add_ps(_mm_loadu_ps(pM+k), _mm_loadu_ps(t[p7P_MI]+k)),
+			      _mm_add_ps(_mm_loadu_ps(pI+k), _mm_loadu_ps(t[p7P_II]+k)));
+	  _mm_storeu_ps(cI+k, _mm_add_ps(sv, _mm_loadu_ps(isc+k)));
+	}
+
+      /* delete states, left to right */
+      dcv = neginfv;
+      for (q = 0, k = 1; q < gs->Q; q++, k += 4)
+	{
+	  av  = _mm_add_ps(_mm_loadu_ps(cM+k-1), _mm_loadu_ps(t[p7P_MD]+k-1));
+	  bv  = _mm_loadu_ps(t[p7P_DD]+k-1);
+	  gsse_ScanRight(&av, &bv);
+	  dcv = p7_sse_FLogsum(av, _mm_add_ps(dcv, bv));
+	  _mm_storeu_ps(cD+k, dcv);
+	  dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(3,3,3,3));
+	}
+
+      /* E state */
+      ev = neginfv;
+      for (q = 0, k = 1; q < gs->Q; q++, k += 4)
+	{
+	  tv = _mm_loadu_ps(gs->esc+k);
+	  ev = p7_sse_FLogsum(ev, p7_sse_FLogsum(_mm_add_ps(_mm_loadu_ps(cM+k), tv),
+						 _mm_add_ps(_mm_loadu_ps(cD+k), tv)));
+	}
+      XMX(i,p7G_E) = p7_sse_FLogsumH(ev);
+
+      gsse_StoreRow(gs, cM, cI, cD, dp[i]);
+
+      /* J state */
+      XMX(i,p7G_J) = gsse_FLogsum(XMX(i-1,p7G_J) + gm->xsc[p7P_J][p7P_LOOP],
+				XMX(i,  p7G_E) + gm->xsc[p7P_E][p7P_LOOP]);
+      /* C state */
+      XMX(i,p7G_C) = gsse_FLogsum(XMX(i-1,p7G_C) + gm->xsc[p7P_C][p7P_LOOP],
+				XMX(i,  p7G_E) + gm->xsc[p7P_E][p7P_MOVE]);
+      /* N state */
+      XMX(i,p7G_N) = XMX(i-1,p7G_N) + gm->xsc[p7P_N][p7P_LOOP];
+
+      /* B state */
+      XMX(i,p7G_B) = gsse_FLogsum(XMX(i,  p7G_N) + gm->xsc[p7P_N][p7P_MOVE],
+				XMX(i,  p7G_J) + gm->xsc[p7P_J][p7P_MOVE]);
+
+      swap = pM; pM = cM; cM = swap;
+      swap = pI; pI = cI; cI = swap;
+      swap = pD; pD = cD; cD = swap;
+    }
+
+  if (opt_sc != NULL) *opt_sc = XMX(L,p7G_C) + gm->xsc[p7P_C][p7P_MOVE];
+  gx->M = M;
   gx->L = L;
-  if (opt_fwdscore != NULL) *opt_fwdscore = F;
-  if (opt_hybscore != NULL) *opt_hybscore = H;
+  gsse_Destroy(gs);
   return eslOK;
 
  ERROR:
-  if (opt_fwdscore != NULL) *opt_fwdscore = 0;
-  if (opt_hybscore != NULL) *opt_hybscore = 0;
+  gsse_Destroy(gs);
   return status;
 }
-/*------------- end: forward, backward, hybrid ------------------*/
+
+
+/* backward_sse()
+ * Same recursion as backward_serial(), vectorized as in forward_sse(),
+ * with the D chain scanned right to left. Row L is the general row
+ * recursion with an empty (all -inf) row L+1.
+ */
+static int
+backward_sse(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMX *gx, float *opt_sc)
+{
+  float      **dp      = gx->dp;
+  float       *xmx     = gx->xmx;
+  int          M       = gm->M;
+  GSSE_WORK   *gs      = NULL;
+  __m128       neginfv = _mm_set1_ps(-eslINFINITY);
+  __m128       Ev, sv, av, bv, dcv, mnv, tv;
+  float       *nM, *nI, *cM, *cI, *cD, *swap;
+  float       *msc, *isc;
+  float      **t;
+  int          i, q, k;
+  int          status;
+
+  if ((gs = gsse_Create(gm)) == NULL) { status = eslEMEM; goto ERROR; }
+  t  = gs->tsc;
+  nM = gs->ninf;    nI = gs->ninf;     
+  cM = gs->row[0];  cI = gs->row[1];  cD = gs->row[2];
+  msc = isc = gs->ninf;
+
+  /* With no residues, nothing can be emitted; and dsq[1] is the sentinel, not a residue to look up emissions for. */
+  if (L == 0)
+    {
+      XMX(0,p7G_N) = XMX(0,p7G_B) = XMX(0,p7G_E) = XMX(0,p7G_C) = XMX(0,p7G_J) = -eslINFINITY;
+      gsse_StoreRow(gs, gs->ninf, gs->ninf, gs->ninf, dp[0]);
+      if (opt_sc != NULL) *opt_sc = -eslINFINITY;
+      gx->M = M;
+      gx->L = L;
+      gsse_Destroy(gs);
+      return eslOK;
+    }
+
+  /* Initialize the L row.  */
+  XMX(L,p7G_J) = XMX(L,p7G_B) = XMX(L,p7G_N) = -eslINFINITY;
+  XMX(L,p7G_C) = gm->xsc[p7P_C][p7P_MOVE];                 /* C<-T          */
+  XMX(L,p7G_E) = XMX(L,p7G_C) + gm->xsc[p7P_E][p7P_MOVE];  /* E<-C, no tail */
+
+  for (i = L; i >= 1; i--)
+    {
+      if (i < L)
+	{
+	  if ((status = gsse_GetEmissions(gs, gm, dsq[i+1], &msc, &isc)) != eslOK) goto ERROR;
+
+	  sv = neginfv;
+	  for (q = 0, k = 1; q < gs->Q; q++, k += 4)
+	    sv = p7_sse_FLogsum(sv, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(nM+k), _mm_loadu_ps(t[p7P_BM]+k-1)), _mm_loadu_ps(msc+k)));
+	  XMX(i,p7G_B) = p7_sse_FLogsumH(sv);
+
+	  XMX(i,p7G_J) = gsse_FLogsum( XMX(i+1,p7G_J) + gm->xsc[p7P_J][p7P_LOOP],
+				     XMX(i,  p7G_B) + gm->xsc[p7P_J][p7P_MOVE]);
+      
+	  XMX(i,p7G_C) = XMX(i+1,p7G_C) + gm->xsc[p7P_C][p7P_LOOP];
+      
+	  XMX(i,p7G_E) = gsse_FLogsum( XMX(i, p7G_J)  + gm->xsc[p7P_E][p7P_LOOP],
+				     XMX(i, p7G_C)  + gm->xsc[p7P_E][p7P_MOVE]);
+      
+	  XMX(i,p7G_N) = gsse_FLogsum( XMX(i+1,p7G_N) + gm->xsc[p7P_N][p7P_LOOP],
+				     XMX(i,  p7G_B) + gm->xsc[p7P_N][p7P_MOVE]);
+	}
+      Ev = _mm_set1_ps(XMX(i,p7G_E));
+
+      /* delete states, right to left; D_M = E comes out of the padding */
+      dcv = neginfv;
+      for (q = gs->Q-1, k = 4*q+1; q >= 0; q--, k -= 4)
+	{
+	  mnv = _mm_add_ps(_mm_loadu_ps(nM+k+1), _mm_loadu_ps(msc+k+1));
+	  av  = p7_sse_FLogsum(_mm_add_ps(mnv, _mm_loadu_ps(t[p7P_DM]+k)),
+			       _mm_add_ps(Ev,  _mm_loadu_ps(gs->esc+k)));
+	  bv  = _mm_loadu_ps(t[p7P_DD]+k);
+	  gsse_ScanLeft(&av, &bv);
+	  dcv = p7_sse_FLogsum(av, _mm_add_ps(dcv, bv));
+	  _mm_storeu_ps(cD+k, dcv);
+	  dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,0,0,0));
+	}
+
+      /* match and insert states */
+      for (q = 0, k = 1; q < gs->Q; q++, k += 4)
+	{
+	  mnv = _mm_add_ps(_mm_loadu_ps(nM+k+1), _mm_loadu_ps(msc+k+1));
+	  tv  = _mm_add_ps(_mm_loadu_ps(nI+k),   _mm_loadu_ps(isc+k));
+
+	  sv = p7_sse_FLogsum(p7_sse_FLogsum(_mm_add_ps(mnv, _mm_loadu_ps(t[p7P_MM]+k)),
+					     _mm_add_ps(tv,  _mm_loadu_ps(t[p7P_MI]+k))),
+			      p7_sse_FLogsum(_mm_add_ps(Ev,  _mm_loadu_ps(gs->esc+k)),
+					     _mm_add_ps(_mm_loadu_ps(cD+k+1), _mm_loadu_ps(t[p7P_MD]+k))));
+	  _mm_storeu_ps(cM+k, sv);
+
+	  sv = p7_sse_FLogsum(_mm_add_ps(mnv, _mm_loadu_ps(t[p7P_IM]+k)),
+			      _mm_add_ps(tv,  _mm_loadu_ps(t[p7P_II]+k)));
+	  _mm_storeu_ps(cI+k, sv);
+	}
+
+      gsse_StoreRow(gs, cM, cI, cD, dp[i]);
+
+      if (i == L) { nM = gs->row[3]; nI = gs->row[4]; }
+      swap = nM; nM = cM; cM = swap;
+      swap = nI; nI = cI; cI = swap;
+    }
+
+  /* At i=0, only N,B states are reachable. */
+  if ((status = gsse_GetEmissions(gs, gm, dsq[1], &msc, &isc)) != eslOK) goto ERROR;
+  sv = neginfv;
+  for (q = 0, k = 1; q < gs->Q; q++, k += 4)
+    sv = p7_sse_FLogsum(sv, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(nM+k), _mm_loadu_ps(t[p7P_BM]+k-1)), _mm_loadu_ps(msc+k)));
+  XMX(0,p7G_B) = p7_sse_FLogsumH(sv);
+  XMX(0,p7G_J) = -eslINFINITY;
+  XMX(0,p7G_C) = -eslINFINITY;
+  XMX(0,p7G_E) = -eslINFINITY;
+  XMX(0,p7G_N) = gsse_FLogsum( XMX(1, p7G_N) + gm->xsc[p7P_N][p7P_LOOP],
+			     XMX(0, p7G_B) + gm->xsc[p7P_N][p7P_MOVE]);
+  gsse_StoreRow(gs, gs->ninf, gs->ninf, gs->ninf, dp[0]);
+
+  if (opt_sc != NULL) *opt_sc = XMX(0,p7G_N);
+  gx->M = M;
+  gx->L = L;
+  gsse_Destroy(gs);
+  return eslOK;
+
+ ERROR:
+  gsse_Destroy(gs);
+  return status;
+}
+#endif /*eslENABLE_SSE*/
+/*------------- end, serial and SSE engines --------------------*/
 
 
 
 
 /*****************************************************************
- * 2. Benchmark driver.
+ * 3. Benchmark driver.
  *****************************************************************/
 #ifdef p7GENERIC_FWDBACK_BENCHMARK
 /*
@@ -431,7 +898,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 3. Unit tests
+ * 4. Unit tests
  *****************************************************************/
 #ifdef p7GENERIC_FWDBACK_TESTDRIVE
 #include <string.h>
@@ -489,6 +956,120 @@ utest_forward(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg,
   return;
 }
 
+#ifdef eslENABLE_SSE
+/* exact_logsum(), exact_forward()
+ * A reference Forward score for utest_engines(): forward_serial()'s
+ * recursion, in double precision with an exact logsum, two rows at
+ * a time.
+ */
+static double
+exact_logsum(double a, double b)
+{
+  double max = ESL_MAX(a, b);
+  double min = ESL_MIN(a, b);
+  return (min == -eslINFINITY) ? max : max + log1p(exp(min-max));
+}
+
+static double
+exact_forward(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm)
+{
+  int     M   = gm->M;
+  double  esc = p7_profile_IsLocal(gm) ? 0. : -eslINFINITY;
+  double *mem;
+  double *pM, *pI, *pD, *cM, *cI, *cD, *swap;
+  double  xN, xB, xE, xC, xJ;
+  int     i, k;
+
+  if ((mem = malloc(sizeof(double) * (M+1) * 6)) == NULL) esl_fatal("malloc failed");
+  pM = mem;         pI = pM + (M+1);  pD = pI + (M+1);
+  cM = pD + (M+1);  cI = cM + (M+1);  cD = cI + (M+1);
+  for (k = 0; k <= M; k++) pM[k] = pI[k] = pD[k] = cM[k] = cI[k] = cD[k] = -eslINFINITY;
+
+  xN = 0.;
+  xB = gm->xsc[p7P_N][p7P_MOVE];
+  xC = xJ = -eslINFINITY;
+  for (i = 1; i <= L; i++)
+    {
+      xE = -eslINFINITY;
+      for (k = 1; k <= M; k++)
+	{
+	  cM[k] = exact_logsum(exact_logsum(pM[k-1] + p7P_TSC(gm, k-1, p7P_MM), pI[k-1] + p7P_TSC(gm, k-1, p7P_IM)),
+			       exact_logsum(xB      + p7P_TSC(gm, k-1, p7P_BM), pD[k-1] + p7P_TSC(gm, k-1, p7P_DM)))
+	          + p7P_MSC(gm, k, dsq[i]);
+	  cI[k] = (k < M ? exact_logsum(pM[k] + p7P_TSC(gm, k, p7P_MI), pI[k] + p7P_TSC(gm, k, p7P_II)) + p7P_ISC(gm, k, dsq[i]) : -eslINFINITY);
+	  cD[k] = exact_logsum(cM[k-1] + p7P_TSC(gm, k-1, p7P_MD), cD[k-1] + p7P_TSC(gm, k-1, p7P_DD));
+	  xE    = exact_logsum(xE, exact_logsum(cM[k], cD[k]) + (k < M ? esc : 0.));
+	}
+      xJ = exact_logsum(xJ + gm->xsc[p7P_J][p7P_LOOP], xE + gm->xsc[p7P_E][p7P_LOOP]);
+      xC = exact_logsum(xC + gm->xsc[p7P_C][p7P_LOOP], xE + gm->xsc[p7P_E][p7P_MOVE]);
+      xN = xN + gm->xsc[p7P_N][p7P_LOOP];
+      xB = exact_logsum(xN + gm->xsc[p7P_N][p7P_MOVE], xJ + gm->xsc[p7P_J][p7P_MOVE]);
+
+      swap = pM; pM = cM; cM = swap;
+      swap = pI; pI = cI; cI = swap;
+      swap = pD; pD = cD; cD = swap;
+    }
+
+  free(mem);
+  return xC + gm->xsc[p7P_C][p7P_MOVE];
+}
+
+/* The "engines" test checks the table-free SSE engines against
+ * exact_forward() on random seqs, local and glocal: both SSE Forward
+ * and SSE Backward must be within 0.001 nats of it. The serial
+ * engines carry p7_FLogsum()'s table error, which accumulates with M
+ * and L, so they can't be held to that; their Forward and Backward
+ * are only checked against each other. It also checks that an empty
+ * sequence scores -inf without the SSE engines reading past it.
+ */
+static void
+utest_engines(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, P7_HMM *hmm, int nseq, int L)
+{
+  P7_PROFILE *gm   = NULL;
+  ESL_DSQ    *dsq  = NULL;
+  P7_GMX     *gx   = NULL;
+  int         mode;
+  int         idx;
+  float       fsc, bsc, vfsc, vbsc;
+  double      xsc;
+  float       tol  = 0.001;
+
+  if ((gm  = p7_profile_Create(hmm->M, abc))        == NULL)  esl_fatal("failed to create profile");
+  if ((dsq = malloc(sizeof(ESL_DSQ) *(L+2)))       == NULL)  esl_fatal("malloc failed");
+  if ((gx  = p7_gmx_Create(hmm->M, L))             == NULL)  esl_fatal("matrix creation failed");
+
+  for (mode = 0; mode < 2; mode++)
+    {
+      if (p7_ProfileConfig(hmm, bg, gm, L, (mode == 0 ? p7_LOCAL : p7_GLOCAL)) != eslOK) esl_fatal("failed to config profile");
+      for (idx = 0; idx < nseq; idx++)
+	{
+	  if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq) != eslOK) esl_fatal("seq generation failed");
+	  if (forward_serial (dsq, L, gm, gx, &fsc)   != eslOK) esl_fatal("serial forward failed");
+	  if (backward_serial(dsq, L, gm, gx, &bsc)   != eslOK) esl_fatal("serial backward failed");
+	  if (forward_sse    (dsq, L, gm, gx, &vfsc)  != eslOK) esl_fatal("SSE forward failed");
+	  if (backward_sse   (dsq, L, gm, gx, &vbsc)  != eslOK) esl_fatal("SSE backward failed");
+	  xsc = exact_forward(dsq, L, gm);
+
+	  if (esl_opt_GetBoolean(go, "--vv"))
+	    printf("utest_engines: %s exact %.4f SSE fwd %.4f bck %.4f serial fwd %.4f bck %.4f\n", (mode == 0 ? "local" : "glocal"), xsc, vfsc, vbsc, fsc, bsc);
+
+	  if (fabs(vfsc - xsc) > tol) esl_fatal("SSE Forward differs from exact: %f %f",    vfsc, xsc);
+	  if (fabs(vbsc - xsc) > tol) esl_fatal("SSE Backward differs from exact: %f %f",   vbsc, xsc);
+	  if (fabs(fsc  - bsc) > tol) esl_fatal("serial Forward/Backward disagree: %f %f", fsc,  bsc);
+	}
+
+      dsq[0] = dsq[1] = eslDSQ_SENTINEL;
+      if (forward_sse (dsq, 0, gm, gx, &vfsc) != eslOK) esl_fatal("SSE forward failed on L=0");
+      if (backward_sse(dsq, 0, gm, gx, &vbsc) != eslOK) esl_fatal("SSE backward failed on L=0");
+      if (vfsc != -eslINFINITY || vbsc != -eslINFINITY) esl_fatal("SSE Forward/Backward of an empty seq aren't -inf: %f %f", vfsc, vbsc);
+    }
+
+  p7_gmx_Destroy(gx);
+  p7_profile_Destroy(gm);
+  free(dsq);
+}
+#endif /*eslENABLE_SSE*/
+
 /* The "generation" test scores sequences generated by the same profile.
  * Each Viterbi and Forward score should be >= the trace score of the emitted seq.
  * The expectation of Forward scores should be positive.
@@ -626,7 +1207,7 @@ utest_enumeration(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int M)
 /*------------------------- end, unit tests ---------------------*/
 
 /*****************************************************************
- * 4. Test driver.
+ * 5. Test driver.
  *****************************************************************/
 
 /* gcc -g -Wall -Dp7GENERIC_FWDBACK_TESTDRIVE -I. -I../easel -L. -L../easel -o generic_fwdback_utest generic_fwdback.c -lhmmer -leasel -lm
@@ -677,6 +1258,9 @@ main(int argc, char **argv)
   utest_forward    (go, r, abc, bg, gm, nseq, L);
   utest_generation (go, r, abc, gm, hmm, bg, nseq);
   utest_enumeration(go, r, abc, 4);	/* can't go much higher than 5; enumeration test is cpu-intensive. */
+#ifdef eslENABLE_SSE
+  utest_engines    (go, r, abc, bg, hmm, nseq, L);
+#endif
 
   p7_profile_Destroy(gm);
   p7_bg_Destroy(bg);
@@ -691,7 +1275,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 5. Example
+ * 6. Example
  *****************************************************************/
 #ifdef p7GENERIC_FWDBACK_EXAMPLE
 /* 
@@ -14,10 +14,15 @@
 #include "esl_sq.h"
 #include "esl_sqio.h"
 #include "esl_vectorops.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
 
 #include "hmmer.h"
 
 static int map_alignment(const char *msafile, const P7_HMM *hmm, ESL_SQ ***ret_sq, P7_TRACE ***ret_tr, int *ret_ntot);
+static int stream_alignment(P7_HMM *hmm, ESL_ALPHABET *abc, const char *seqfile, int infmt, int chunksize, int ncpus, int msaopts, FILE *ofp, int outfmt);
+static int stream_gs_lines(ESL_ALPHABET *abc, const char *seqfile, int infmt, int maxname, int has_acc, int has_desc, FILE *ofp);
 
 
 #define ALPHOPTS "--amino,--dna,--rna"                         /* Exclusive options for alphabet choice */
@@ -34,6 +39,11 @@ static ESL_OPTIONS options[] = {
   { "--rna",       eslARG_NONE,     FALSE,     NULL, NULL, ALPHOPTS,  NULL,  NULL, "assert <seqfile>, <hmmfile> both RNA: no autodetection",      2 },
   { "--informat",  eslARG_STRING,    NULL,     NULL, NULL,   NULL,    NULL,  NULL, "assert <seqfile> is in format <s>: no autodetection",            2 },
   { "--outformat", eslARG_STRING, "Stockholm", NULL, NULL,   NULL,    NULL,  NULL, "output alignment in format <s>",                                    2 },
+  { "--stream",    eslARG_NONE,     FALSE,     NULL, NULL,   NULL,    NULL, "--mapali", "align <seqfile> in two passes, without holding it in memory", 2 },
+  { "--chunk",     eslARG_INT,     "1000",     NULL, "n>0",  NULL, "--stream", NULL, "with --stream: align <n> sequences at a time",               2 },
+#ifdef HMMER_THREADS
+  { "--cpu",       eslARG_INT,    p7_NCPU,"HMMER_NCPU","n>=0",NULL,   NULL,  NULL, "number of parallel CPU workers to use for multithreads",    2 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
@@ -95,6 +105,7 @@ main(int argc, char **argv)
   P7_TRACE    **tr      = NULL;	/* array of tracebacks             */
   ESL_MSA      *msa     = NULL;	/* resulting multiple alignment    */
   int           msaopts = 0;	/* flags to p7_tracealign_Seqs()   */
+  int           ncpus   = 0;	/* # of threads computing traces   */
   int           idx;		/* counter over seqs, traces       */
   int           status;		/* easel/hmmer return code         */
   char          errbuf[eslERRBUFSIZE];
@@ -127,6 +138,19 @@ main(int argc, char **argv)
   outfmt = esl_msafile_EncodeFormat(esl_opt_GetString(go, "--outformat"));
   if (outfmt == eslMSAFILE_UNKNOWN)    cmdline_failure(argv[0], "%s is not a recognized output MSA file format\n", esl_opt_GetString(go, "--outformat"));
 
+  /* --stream writes each chunk as it goes, so it needs a format with one record (or row) per sequence, and reads <seqfile> twice */
+  if (esl_opt_GetBoolean(go, "--stream"))
+    {
+      if (outfmt != eslMSAFILE_STOCKHOLM && outfmt != eslMSAFILE_PFAM && outfmt != eslMSAFILE_A2M && outfmt != eslMSAFILE_AFA)
+	cmdline_failure(argv[0], "--stream can only write Stockholm, Pfam, A2M or aligned FASTA output\n");
+      if (strcmp(seqfile, "-") == 0)
+	cmdline_failure(argv[0], "--stream reads <seqfile> twice, so it can't be '-'\n");
+    }
+
+#ifdef HMMER_THREADS
+  ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+#endif
+
   /* Open output stream */
   if ( (outfile = esl_opt_GetString(go, "-o")) != NULL) 
   {
@@ -158,6 +182,16 @@ main(int argc, char **argv)
   if      (status != eslEOF)       p7_Fail("HMM file %s does not contain just one HMM\n",    hfp->fname);
   p7_hmmfile_Close(hfp);
 
+  if (esl_opt_GetBoolean(go, "--stream"))
+    {
+      stream_alignment(hmm, abc, seqfile, infmt, esl_opt_GetInteger(go, "--chunk"), ncpus, msaopts, ofp, outfmt);
+
+      p7_hmm_Destroy(hmm);
+      if (ofp != stdout) fclose(ofp);
+      esl_alphabet_Destroy(abc);
+      esl_getopts_Destroy(go);
+      return eslOK;
+    }
 
   /* We're going to build up two arrays: sequences and traces.
    * If --mapali option is chosen, the first set of sequences/traces is from the provided alignment
@@ -197,7 +231,7 @@ main(int argc, char **argv)
   for (idx = mapseq; idx < totseq; idx++)
     tr[idx] = p7_trace_CreateWithPP();
 
-  p7_tracealign_computeTraces(hmm, sq, mapseq, totseq - mapseq, tr);
+  p7_tracealign_computeTracesThreaded(hmm, sq, mapseq, totseq - mapseq, tr, ncpus);
 
   p7_tracealign_Seqs(sq, tr, totseq, hmm->M, msaopts, hmm, &msa);
 
@@ -286,3 +320,249 @@ map_alignment(const char *msafile, const P7_HMM *hmm, ESL_SQ ***ret_sq, P7_TRACE
   return status;
 }
 
+
+/* stream_alignment()
+ * 
+ * hmmalign --stream: align the sequences in <seqfile> to <hmm>
+ * without holding them, or their traces, all in memory at once.
+ * 
+ * The file is read twice, <chunksize> sequences at a time. The first
+ * pass computes traces only to collect the column layout (insert
+ * widths; see <p7_tracealign_CountInserts()>). The second pass
+ * recomputes the traces -- OA traces are deterministic, so they're
+ * the same -- and writes each chunk as soon as it's aligned.
+ *
+ * Each chunk is an alignment with the same columns as the whole one
+ * would have. For A2M and aligned FASTA, where an alignment is just
+ * its sequence records in order, each chunk is written with
+ * <esl_msafile_Write()>, and the chunks concatenate to exactly what
+ * writing the whole alignment would have produced.
+ *
+ * Stockholm and Pfam are written here instead, in the layout Easel
+ * gives Pfam format: one block, one row (and one #=GR PP line) per
+ * sequence, with the name field as wide as the longest name. What
+ * depends on all the sequences is gathered on the first pass, like
+ * the insert widths: the longest name, whether any sequence has an
+ * accession or description (#=GS lines, which come before the
+ * block, and are written from a third, names-only read of
+ * <seqfile>), and the posterior probability totals of each match
+ * state for the #=GC PP_cons line at the end. Stockholm output is
+ * therefore one block too, rather than interleaved; Pfam output is
+ * the same as without --stream.
+ */
+static int
+stream_alignment(P7_HMM *hmm, ESL_ALPHABET *abc, const char *seqfile, int infmt, int chunksize, int ncpus, int msaopts, FILE *ofp, int outfmt)
+{
+  ESL_SQFILE  *sqfp     = NULL;
+  ESL_SQ     **sq       = NULL;	/* one chunk of sequences, [0..chunksize-1] */
+  P7_TRACE   **tr       = NULL;	/* and their traces                         */
+  ESL_MSA     *msa      = NULL;	/* alignment of the current chunk           */
+  int         *inscount = NULL;	/* column layout over all sequences: [0..M] */
+  int         *matuse   = NULL;	/*   ... and [1..M]                         */
+  double      *totp     = NULL;	/* Stockholm: total posterior probability of match k, [1..M] */
+  int         *nmat     = NULL;	/*   ... and # of sequences aligned to it, [1..M]            */
+  char        *pp_cons  = NULL;	/*   ... and the PP_cons line made from them                 */
+  char        *rf       = NULL;	/*   ... and copies of the RF and MM lines, same for all chunks */
+  char        *mm       = NULL;
+  int          is_stockholm = (outfmt == eslMSAFILE_STOCKHOLM || outfmt == eslMSAFILE_PFAM);
+  int          maxname  = 0;	/* Stockholm: longest sequence name                         */
+  int          has_acc  = FALSE;/*   ... TRUE if any sequence has an accession (#=GS AC)     */
+  int          has_desc = FALSE;/*   ... or a description (#=GS DE)                          */
+  int          has_pp   = FALSE;/*   ... or posterior probabilities (#=GR PP, #=GC PP_cons)   */
+  int          margin   = 0;	/*   ... width of the name field, including its trailing space */
+  int          nseq     = 0;	/* # of seqs seen on this pass */
+  int          nseq1    = 0;	/* # of seqs seen on pass 1    */
+  int          pass;
+  int          n;
+  int          idx;
+  int          z, k, apos;
+  int          status;
+
+  ESL_ALLOC(sq,       sizeof(ESL_SQ *)   * chunksize);
+  ESL_ALLOC(tr,       sizeof(P7_TRACE *) * chunksize);
+  ESL_ALLOC(inscount, sizeof(int)    * (hmm->M+1));
+  ESL_ALLOC(matuse,   sizeof(int)    * (hmm->M+1));
+  ESL_ALLOC(totp,     sizeof(double) * (hmm->M+1));
+  ESL_ALLOC(nmat,     sizeof(int)    * (hmm->M+1));
+  for (idx = 0; idx < chunksize; idx++)
+    {
+      sq[idx] = esl_sq_CreateDigital(abc);
+      tr[idx] = p7_trace_CreateWithPP();
+    }
+  esl_vec_ISet(inscount, hmm->M+1, 0);
+  esl_vec_ISet(matuse,   hmm->M+1, (msaopts & p7_ALL_CONSENSUS_COLS) ? TRUE : FALSE);
+  esl_vec_DSet(totp,     hmm->M+1, 0.0);
+  esl_vec_ISet(nmat,     hmm->M+1, 0);
+  matuse[0] = FALSE;
+
+  for (pass = 1; pass <= 2; pass++)
+    {
+      status = esl_sqfile_OpenDigital(abc, seqfile, infmt, NULL, &sqfp);
+      if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          seqfile);
+      else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            seqfile);
+      else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, seqfile);
+
+      nseq = 0;
+      do {
+	for (n = 0; n < chunksize; n++)
+	  {
+	    esl_sq_Reuse(sq[n]);
+	    p7_trace_Reuse(tr[n]);
+	    if ((status = esl_sqio_Read(sqfp, sq[n])) != eslOK) break;
+	  }
+	if      (status == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n", 
+						 sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+	else if (status != eslOK && status != eslEOF) esl_fatal("Unexpected error %d reading sequence file %s", status, sqfp->filename);
+	if (n == 0) break;
+
+	p7_tracealign_computeTracesThreaded(hmm, sq, 0, n, tr, ncpus);
+	nseq += n;
+
+	if (pass == 1)
+	  {
+	    p7_tracealign_CountInserts(tr, n, hmm->M, inscount, matuse);
+	    if (is_stockholm)
+	      for (idx = 0; idx < n; idx++)
+		{
+		  maxname = ESL_MAX(maxname, (int) strlen(sq[idx]->name));
+		  if (sq[idx]->acc[0]  != '\0') has_acc  = TRUE;
+		  if (sq[idx]->desc[0] != '\0') has_desc = TRUE;
+		  if (tr[idx]->pp == NULL) continue;
+		  has_pp = TRUE;
+		  for (z = 0; z < tr[idx]->N; z++)
+		    if (tr[idx]->st[z] == p7T_M) { totp[tr[idx]->k[z]] += tr[idx]->pp[z]; nmat[tr[idx]->k[z]]++; }
+		}
+	  }
+	else
+	  {
+	    if (nseq > nseq1) p7_Fail("Sequence file %s changed while it was being aligned\n", seqfile);
+	    if (p7_tracealign_SeqsWithMap(sq, tr, n, hmm->M, msaopts, hmm, inscount, matuse, &msa) != eslOK) p7_Fail("Failed to construct alignment of chunk of %s\n", seqfile);
+	    if (! is_stockholm)
+	      {
+		if (esl_msafile_Write(ofp, msa, outfmt) != eslOK) p7_Fail("Failed to write alignment of chunk of %s\n", seqfile);
+	      }
+	    else
+	      {
+		for (idx = 0; idx < msa->nseq; idx++)
+		  {
+		    fprintf(ofp, "%-*s %s\n", margin-1, msa->sqname[idx], msa->aseq[idx]);
+		    if (msa->pp != NULL && msa->pp[idx] != NULL)
+		      fprintf(ofp, "#=GR %-*s %-*s %s\n", maxname, msa->sqname[idx], margin-maxname-7, "PP", msa->pp[idx]);
+		  }
+		if (rf == NULL                    && esl_strdup(msa->rf, -1, &rf) != eslOK) goto ERROR;
+		if (mm == NULL && msa->mm != NULL && esl_strdup(msa->mm, -1, &mm) != eslOK) goto ERROR;
+	      }
+	    esl_msa_Destroy(msa);
+	    msa = NULL;
+	  }
+      } while (status == eslOK);
+
+      esl_sqfile_Close(sqfp);
+      sqfp = NULL;
+
+      if (pass == 1)
+	{
+	  if (nseq == 0) p7_Fail("No sequences found in %s\n", seqfile);
+	  nseq1 = nseq;
+
+	  /* Easel's Stockholm margin: room for the names, "#=GC PP_cons" or "#=GC RF", and "#=GR <name> PP" */
+	  if (is_stockholm)
+	    {
+	      margin = ESL_MAX(maxname + 1, (has_pp ? 7 : 2) + 6);
+	      if (has_pp) margin = ESL_MAX(margin, maxname + 2 + 7);
+	      fprintf(ofp, "# STOCKHOLM 1.0\n\n");
+	      stream_gs_lines(abc, seqfile, infmt, maxname, has_acc, has_desc, ofp);
+	    }
+	}
+      else if (nseq != nseq1) p7_Fail("Sequence file %s changed while it was being aligned\n", seqfile);
+    }
+
+  /* Column annotation. Consensus posterior probabilities are over all
+   * sequences, only on match columns; match state k is the k'th 'x'
+   * of the RF line.
+   */
+  if (is_stockholm)
+    {
+      if (has_pp)
+	{
+	  ESL_ALLOC(pp_cons, sizeof(char) * (strlen(rf)+1));
+	  for (apos = 0; rf[apos] != '\0'; apos++) pp_cons[apos] = '.';
+	  pp_cons[apos] = '\0';
+	  for (apos = 0, k = 1; k <= hmm->M; k++)
+	    if (matuse[k])
+	      {
+		while (rf[apos] != 'x') apos++;
+		if (nmat[k] > 0) pp_cons[apos] = p7_alidisplay_EncodePostProb(totp[k] / (double) nmat[k]);
+		apos++;
+	      }
+	  fprintf(ofp, "#=GC %-*s %s\n", margin-6, "PP_cons", pp_cons);
+	}
+      fprintf(ofp, "#=GC %-*s %s\n", margin-6, "RF", rf);
+      if (mm != NULL) fprintf(ofp, "#=GC %-*s %s\n", margin-6, "MM", mm);
+      fprintf(ofp, "//\n");
+    }
+
+  for (idx = 0; idx < chunksize; idx++)
+    {
+      esl_sq_Destroy(sq[idx]);
+      p7_trace_Destroy(tr[idx]);
+    }
+  free(sq);
+  free(tr);
+  free(inscount);
+  free(matuse);
+  free(totp);
+  free(nmat);
+  if (pp_cons != NULL) free(pp_cons);
+  if (rf      != NULL) free(rf);
+  if (mm      != NULL) free(mm);
+  return eslOK;
+
+ ERROR:
+  p7_Fail("allocation failure in hmmalign --stream");
+  return status;
+}
+
+
+/* stream_gs_lines()
+ * 
+ * For stream_alignment()'s Stockholm output: write the #=GS AC lines
+ * of all the sequences in <seqfile>, then their #=GS DE lines, each
+ * group followed by a blank line, as Easel does; <has_acc> and
+ * <has_desc> say which groups there are. Names are left justified
+ * in a field of <maxname>. Only names, accessions and descriptions
+ * are read, once per group.
+ */
+static int
+stream_gs_lines(ESL_ALPHABET *abc, const char *seqfile, int infmt, int maxname, int has_acc, int has_desc, FILE *ofp)
+{
+  ESL_SQFILE *sqfp = NULL;
+  ESL_SQ     *sq   = esl_sq_CreateDigital(abc);
+  int         which;		/* 0 = AC, 1 = DE */
+  int         status;
+
+  for (which = 0; which < 2; which++)
+    {
+      if (which == 0 && ! has_acc)  continue;
+      if (which == 1 && ! has_desc) continue;
+
+      status = esl_sqfile_OpenDigital(abc, seqfile, infmt, NULL, &sqfp);
+      if (status != eslOK) p7_Fail("Failed to reopen sequence file %s\n", seqfile);
+
+      while ((status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
+	{
+	  if      (which == 0 && sq->acc[0]  != '\0') fprintf(ofp, "#=GS %-*s AC %s\n", maxname, sq->name, sq->acc);
+	  else if (which == 1 && sq->desc[0] != '\0') fprintf(ofp, "#=GS %-*s DE %s\n", maxname, sq->name, sq->desc);
+	  esl_sq_Reuse(sq);
+	}
+      if      (status == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+      else if (status != eslEOF)     esl_fatal("Unexpected error %d reading sequence file %s", status, sqfp->filename);
+      fprintf(ofp, "\n");
+
+      esl_sqfile_Close(sqfp);
+      sqfp = NULL;
+    }
+
+  esl_sq_Destroy(sq);
+  return eslOK;
+}
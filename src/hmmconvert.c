@@ -21,11 +21,16 @@ static ESL_OPTIONS options[] = {
   { "-b",        eslARG_NONE,   FALSE, NULL, NULL, "-a,-b,-2",      NULL,    NULL, "binary: output models in HMMER3 binary format",                    0 },
   { "-2",        eslARG_NONE,   FALSE, NULL, NULL, "-a,-b,-2",      NULL,    NULL, "HMMER2: output backward compatible HMMER2 ASCII format (ls mode)", 0 },
   { "--outfmt",  eslARG_STRING, NULL,  NULL, NULL,      NULL,       NULL,    "-2", "choose output legacy 3.x file formats by name, such as '3/a'",     0 },
+#ifdef HMMER_THREADS
+  { "--cpu",     eslARG_INT,   p7_NCPU,"HMMER_NCPU","n>=0",NULL,    NULL,    NULL, "number of parallel CPU workers for parsing ASCII input",            0 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile>";
 static char banner[] = "convert profile file to a HMMER format";
 
+#define CONVERT_BLOCKSIZE 256	/* # of models per p7_hmmfile_ReadBlock() */
+
 
 int 
 main(int argc, char **argv)
@@ -34,7 +39,9 @@ main(int argc, char **argv)
   ESL_ALPHABET  *abc     = NULL;
   char          *hmmfile = esl_opt_GetArg(go, 1);
   P7_HMMFILE    *hfp     = NULL;
-  P7_HMM        *hmm     = NULL;
+  P7_HMM        *hmmv[CONVERT_BLOCKSIZE];
+  int            nhmm, i;
+  int            ncpu    = 0;
   FILE          *ofp     = stdout;
   char          *outfmt  = esl_opt_GetString(go, "--outfmt");
   int            fmtcode = -1;	/* -1 = write the current default format */
@@ -56,14 +63,21 @@ main(int argc, char **argv)
   else if (status == eslEFORMAT)   p7_Fail("File format problem in trying to open HMM file %s.\n%s\n",                hmmfile, errbuf);
   else if (status != eslOK)        p7_Fail("Unexpected error %d in opening HMM file %s.\n%s\n",                       status, hmmfile, errbuf);  
 
-  while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
-    {
-      if      (esl_opt_GetBoolean(go, "-a") == TRUE) p7_hmmfile_WriteASCII (ofp, fmtcode, hmm);
-      else if (esl_opt_GetBoolean(go, "-b") == TRUE) p7_hmmfile_WriteBinary(ofp, fmtcode, hmm);
-      else if (esl_opt_GetBoolean(go, "-2") == TRUE) p7_h2io_WriteASCII    (ofp, hmm);
+#ifdef HMMER_THREADS
+  ncpu = esl_opt_GetInteger(go, "--cpu");
+#endif
+
+  do {
+    status = p7_hmmfile_ReadBlock(hfp, ncpu, &abc, hmmv, CONVERT_BLOCKSIZE, &nhmm);
+    for (i = 0; i < nhmm; i++)	/* even on a format error: the models before it are good */
+      {
+	if      (esl_opt_GetBoolean(go, "-a") == TRUE) p7_hmmfile_WriteASCII (ofp, fmtcode, hmmv[i]);
+	else if (esl_opt_GetBoolean(go, "-b") == TRUE) p7_hmmfile_WriteBinary(ofp, fmtcode, hmmv[i]);
+	else if (esl_opt_GetBoolean(go, "-2") == TRUE) p7_h2io_WriteASCII    (ofp, hmmv[i]);
 
-      p7_hmm_Destroy(hmm);
-    }
+	p7_hmm_Destroy(hmmv[i]);
+      }
+  } while (status == eslOK);
   if      (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s",             hmmfile);
   else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   hmmfile);
   else if (status != eslEOF)       p7_Fail("Unexpected error in reading HMMs from %s",   hmmfile);
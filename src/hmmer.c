@@ -12,11 +12,39 @@
 
 #include <math.h>
 #include <float.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "easel.h"
 #include "esl_getopts.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
+
 #include "hmmer.h"
 
+/* p7_ThreadedFor()'s shared state */
+typedef struct {
+  void    *arg;
+  int    (*init_f)(void *arg, int tid, void **ret_tls);
+  int    (*work_f)(void *arg, void *tls, int i, char *errbuf);
+  void   (*fini_f)(void *tls);
+  int      n;
+  int      next;		/* next iteration to hand out             */
+  int      failidx;		/* lowest failed iteration so far, or <n> */
+  int      status;		/* its status, or eslOK                   */
+  char     errbuf[eslERRBUFSIZE];
+#ifdef HMMER_THREADS
+  pthread_mutex_t mutex;
+#endif
+} FOR_WORKSET;
+
+static void for_work(FOR_WORKSET *ws, int tid);
+#ifdef HMMER_THREADS
+static void for_thread(void *arg);
+#endif
+
 /*****************************************************************
  * 1. Miscellaneous functions for H3
  *****************************************************************/
@@ -183,6 +211,206 @@ p7_AminoFrequencies(float *f)
   return eslOK;
 }
 
+/* Function:  p7_TmpfileNamed()
+ * Synopsis:  Create a uniquely named tmp file, for unit tests.
+ *
+ * Purpose:   Create a new tmp file in the current directory with
+ *            <esl_tmpfile_named()>, and put its name in <tmpfile>,
+ *            which the caller provides with room for at least
+ *            <p7_TMPFILE_NAMELEN> chars. If <opt_fp> is non-<NULL>,
+ *            return the file in <*opt_fp>, open for writing;
+ *            otherwise close it, for callers that only need a unique
+ *            name to open later. Either way the caller removes the
+ *            file when done.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslESYS> if the file can't be created; <tmpfile> is
+ *            undefined, and <*opt_fp> is <NULL>.
+ */
+int
+p7_TmpfileNamed(char *tmpfile, FILE **opt_fp)
+{
+  FILE *fp = NULL;
+
+  if (opt_fp) *opt_fp = NULL;
+  strcpy(tmpfile, "esltmpXXXXXX");
+  if (esl_tmpfile_named(tmpfile, &fp) != eslOK) ESL_EXCEPTION(eslESYS, "failed to create tmp file");
+  if (opt_fp) *opt_fp = fp;
+  else        fclose(fp);
+  return eslOK;
+}
+
+/* Function:  p7_FileSize()
+ * Synopsis:  Size of a file, in bytes.
+ *
+ * Purpose:   Return the size of file <filename>, in bytes, in
+ *            <*ret_size>. The indexes that identify targets by their
+ *            ordinal in a sequence database (seed indexes, cluster
+ *            maps) record the database's size, so a search can check
+ *            that an index and a database go together before it
+ *            starts.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslFAIL> if <filename> doesn't exist or isn't a regular
+ *            file (it's "-" for stdin, say); <*ret_size> is 0.
+ */
+int
+p7_FileSize(const char *filename, uint64_t *ret_size)
+{
+  struct stat st;
+
+  if (stat(filename, &st) != 0 || ! S_ISREG(st.st_mode)) { *ret_size = 0; return eslFAIL; }
+  *ret_size = (uint64_t) st.st_size;
+  return eslOK;
+}
+
+/* Function:  p7_ThreadedFor()
+ * Synopsis:  Run the iterations of a loop on several threads.
+ *
+ * Purpose:   Call <work_f(arg, tls, i, errbuf)> for each <i> =
+ *            0..<n>-1, on up to <ncpus> threads (the calling thread
+ *            included). Iterations are handed out in increasing <i>
+ *            from a shared counter, so <work_f> must write its
+ *            result somewhere of its own, such as slot <i> of an
+ *            array in <arg>; then results don't depend on which
+ *            thread did which iteration.
+ *
+ *            Each thread that does work first calls
+ *            <init_f(arg, tid, &tls)>, if <init_f> is non-<NULL>, to
+ *            make its own scratch state <tls> (profiles, DP
+ *            matrices, an RNG); and <fini_f(tls)> when it's done, if
+ *            <fini_f> is non-<NULL>. <tid> is 0 for the calling
+ *            thread and 1.. for the others, so a caller can hand
+ *            out per-thread structures it already has.
+ *
+ *            With <ncpus> $\leq 1$, or without <HMMER_THREADS>, the
+ *            iterations run in order in the calling thread.
+ *
+ *            When an iteration fails (<work_f> returns other than
+ *            <eslOK>, after putting a message in <errbuf>), no more
+ *            are handed out; ones in progress finish. The failure
+ *            with the lowest <i> is returned, with <i> in
+ *            <*opt_failidx> and its message in <opt_errbuf>, if
+ *            those are non-<NULL>. Every iteration below it has
+ *            succeeded; some above it may have run, too. If it was a
+ *            thread's <init_f> that failed, <*opt_failidx> is -1.
+ *            On success, <*opt_failidx> is <n>, and <opt_errbuf> is
+ *            left alone.
+ *
+ * Returns:   <eslOK> on success; otherwise the status of the lowest
+ *            failure, as above.
+ *
+ * Throws:    <eslESYS> if the thread lock can't be created;
+ *            <*opt_failidx> is -1.
+ */
+int
+p7_ThreadedFor(int ncpus, int n, void *arg,
+	       int  (*init_f)(void *arg, int tid, void **ret_tls),
+	       int  (*work_f)(void *arg, void *tls, int i, char *errbuf),
+	       void (*fini_f)(void *tls),
+	       int *opt_failidx, char *opt_errbuf)
+{
+  FOR_WORKSET  ws;
+#ifdef HMMER_THREADS
+  ESL_THREADS *threadObj = NULL;
+  int          nw        = ESL_MIN(ncpus, n);
+  int          t;
+#endif
+
+  ws.arg       = arg;
+  ws.init_f    = init_f;
+  ws.work_f    = work_f;
+  ws.fini_f    = fini_f;
+  ws.n         = n;
+  ws.next      = 0;
+  ws.failidx   = n;
+  ws.status    = eslOK;
+  ws.errbuf[0] = '\0';
+  if (opt_failidx) *opt_failidx = -1;
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_init(&ws.mutex, NULL) != 0) ESL_EXCEPTION(eslESYS, "mutex init failed");
+  if (nw > 1)
+    {
+      threadObj = esl_threads_Create(&for_thread);
+      for (t = 1; t < nw; t++) esl_threads_AddThread(threadObj, &ws);
+      esl_threads_WaitForStart(threadObj);
+      for_work(&ws, 0);
+      esl_threads_WaitForFinish(threadObj);
+      esl_threads_Destroy(threadObj);
+    }
+  else for_work(&ws, 0);
+  pthread_mutex_destroy(&ws.mutex);
+#else
+  for_work(&ws, 0);
+#endif
+
+  if (opt_failidx) *opt_failidx = ws.failidx;
+  if (opt_errbuf && ws.status != eslOK) strcpy(opt_errbuf, ws.errbuf);
+  return ws.status;
+}
+
+/* for_work()
+ * One thread's share of p7_ThreadedFor(): take iterations from
+ * <ws> until there are none left, or something has failed.
+ */
+static void
+for_work(FOR_WORKSET *ws, int tid)
+{
+  void        *tls     = NULL;
+  int          has_tls = FALSE;
+  int          i       = -1;
+  char         errbuf[eslERRBUFSIZE];
+  int          status;
+
+  errbuf[0] = '\0';
+  if (ws->init_f && (status = ws->init_f(ws->arg, tid, &tls)) != eslOK) goto ERROR;
+  has_tls = TRUE;
+
+  while (1)
+    {
+#ifdef HMMER_THREADS
+      if (pthread_mutex_lock(&ws->mutex)   != 0) esl_fatal("mutex lock failed");
+#endif
+      i = (ws->status == eslOK ? ws->next++ : ws->n);
+#ifdef HMMER_THREADS
+      if (pthread_mutex_unlock(&ws->mutex) != 0) esl_fatal("mutex unlock failed");
+#endif
+      if (i >= ws->n) break;
+
+      if ((status = ws->work_f(ws->arg, tls, i, errbuf)) != eslOK) goto ERROR;
+    }
+  if (ws->fini_f) ws->fini_f(tls);
+  return;
+
+ ERROR:
+#ifdef HMMER_THREADS
+  if (pthread_mutex_lock(&ws->mutex)   != 0) esl_fatal("mutex lock failed");
+#endif
+  if (i < ws->failidx) { ws->failidx = i; ws->status = status; strcpy(ws->errbuf, errbuf); }
+#ifdef HMMER_THREADS
+  if (pthread_mutex_unlock(&ws->mutex) != 0) esl_fatal("mutex unlock failed");
+#endif
+  if (has_tls && ws->fini_f) ws->fini_f(tls);
+}
+
+#ifdef HMMER_THREADS
+static void
+for_thread(void *arg)
+{
+  ESL_THREADS *obj = (ESL_THREADS *) arg;
+  int          workeridx;
+
+  impl_Init();
+  esl_threads_Started(obj, &workeridx);
+  for_work((FOR_WORKSET *) esl_threads_GetData(obj, workeridx), workeridx+1);
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+#endif /*HMMER_THREADS*/
+
 /*****************************************************************
  * 2. Unit tests
  *****************************************************************/
@@ -199,6 +427,90 @@ utest_alphabet_config(int alphatype)
   if (abc->Kp > p7_MAXCODE)                           esl_fatal(msg);
   esl_alphabet_Destroy(abc);
 }
+
+/* utest_threaded_for()
+ * p7_ThreadedFor() does each iteration once, on no more than <ncpus>
+ * threads; and on failures, reports the lowest failed iteration,
+ * after all the ones below it have been done.
+ */
+struct for_utest_s {
+  int *done;			/* [0..n-1] # of times each iteration ran */
+  int *count;			/* [0..ncpus-1] # of iterations per thread */
+  int  nthreads;		/* size of <count>                         */
+  int  fail1, fail2;		/* iterations that fail, or -1             */
+  int  initfail;		/* TRUE to fail every thread's init        */
+};
+
+static int
+for_utest_init(void *arg, int tid, void **ret_tls)
+{
+  struct for_utest_s *u = (struct for_utest_s *) arg;
+
+  if (u->initfail)                  return eslEMEM;
+  if (tid < 0 || tid >= u->nthreads) esl_fatal("p7_ThreadedFor() unit test failed: bad tid %d", tid);
+  *ret_tls = &(u->count[tid]);
+  return eslOK;
+}
+
+static int
+for_utest_work(void *arg, void *tls, int i, char *errbuf)
+{
+  struct for_utest_s *u = (struct for_utest_s *) arg;
+
+  if (i == u->fail1 || i == u->fail2) ESL_FAIL(eslEINVAL, errbuf, "iteration %d failed", i);
+  u->done[i]++;
+  (*(int *) tls)++;
+  return eslOK;
+}
+
+static void
+utest_threaded_for(int ncpus)
+{
+  char               *msg      = "p7_ThreadedFor() unit test failed";
+  struct for_utest_s  u;
+  int                 n        = 1000;
+  int                 failidx;
+  int                 total;
+  int                 i;
+  char                errbuf[eslERRBUFSIZE];
+  char                expect[eslERRBUFSIZE];
+  int                 status;
+
+  u.nthreads = ESL_MAX(1, ncpus);
+  if ((u.done  = calloc(n,          sizeof(int))) == NULL) esl_fatal(msg);
+  if ((u.count = calloc(u.nthreads, sizeof(int))) == NULL) esl_fatal(msg);
+  u.fail1    = u.fail2 = -1;
+  u.initfail = FALSE;
+
+  /* every iteration runs exactly once */
+  status = p7_ThreadedFor(ncpus, n, &u, for_utest_init, for_utest_work, NULL, &failidx, errbuf);
+  if (status != eslOK || failidx != n) esl_fatal(msg);
+  for (i = 0; i < n; i++) if (u.done[i] != 1) esl_fatal(msg);
+  for (total = 0, i = 0; i < u.nthreads; i++) total += u.count[i];
+  if (total != n) esl_fatal(msg);
+
+  /* the lowest failure is reported, and everything below it was done */
+  for (i = 0; i < n; i++) u.done[i] = 0;
+  u.fail1 = 737;
+  u.fail2 = 137;
+  status = p7_ThreadedFor(ncpus, n, &u, for_utest_init, for_utest_work, NULL, &failidx, errbuf);
+  if (status != eslEINVAL || failidx != 137) esl_fatal(msg);
+  snprintf(expect, eslERRBUFSIZE, "iteration %d failed", 137);
+  if (strcmp(errbuf, expect) != 0) esl_fatal(msg);
+  for (i = 0; i < 137; i++) if (u.done[i] != 1) esl_fatal(msg);
+  for (i = 137; i < n; i++) if (u.done[i] >  1) esl_fatal(msg);
+
+  /* a failed init stops everything */
+  for (i = 0; i < n; i++) u.done[i] = 0;
+  u.fail1 = u.fail2 = -1;
+  u.initfail = TRUE;
+  status = p7_ThreadedFor(ncpus, n, &u, for_utest_init, for_utest_work, NULL, &failidx, NULL);
+  if (status != eslEMEM || failidx != -1) esl_fatal(msg);
+  for (i = 0; i < n; i++) if (u.done[i] != 0) esl_fatal(msg);
+
+  free(u.done);
+  free(u.count);
+}
 #endif /*p7HMMER_TESTDRIVE*/
 
   
@@ -232,6 +544,10 @@ main(int argc, char **argv)
   utest_alphabet_config(eslCOINS);
   utest_alphabet_config(eslDICE);
 
+  utest_threaded_for(0);
+  utest_threaded_for(1);
+  utest_threaded_for(4);
+
   esl_getopts_Destroy(go);
   return 0;
 }
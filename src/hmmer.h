@@ -16,9 +16,11 @@
  *   12. P7_SCOREDATA:     data used in diagonal recovery and extension
  *   13. P7_HMM_WINDOW:  data used to track lists of sequence windows
  *   14. Inclusion of the architecture-specific optimized implementation.
- *   16. P7_PIPELINE:    H3's accelerated seq/profile comparison pipeline
- *   17. P7_BUILDER:     configuration options for new HMM construction.
- *   18. Declaration of functions in HMMER's exposed API.
+ *   16. P7_SEEDINDEX:   k-mer seed index of a protein target database
+ *   17. P7_CLUMAP:      cluster membership of a redundant target database
+ *   18. P7_PIPELINE:    H3's accelerated seq/profile comparison pipeline
+ *   19. P7_BUILDER:     configuration options for new HMM construction.
+ *   20. Declaration of functions in HMMER's exposed API.
  *   
  * Also, see impl_{sse,vmx}/impl_{sse,vmx}.h for additional API
  * specific to the acceleration layer; in particular, the P7_OPROFILE
@@ -51,6 +53,7 @@
 #include "esl_random.h"		/* ESL_RANDOMNESS        */
 #include "esl_rand64.h" /* ESL_RAND64 */
 #include "esl_sq.h"		/* ESL_SQ                */
+#include "esl_sqio.h"		/* ESL_SQFILE            */
 #include "esl_scorematrix.h"    /* ESL_SCOREMATRIX       */
 #include "esl_stopwatch.h"      /* ESL_STOPWATCH         */
 
@@ -426,6 +429,11 @@ typedef struct p7_hmmfile_s {
   /* If <is_pressed>, we can read optimized profiles directly, via:  */
   FILE         *ffp;		/* MSV part of the optimized profile */
   FILE         *pfp;		/* rest of the optimized profile     */
+  FILE         *cfp;		/* profile clusters (optional; NULL if none) */
+
+  /* An ASCII file read with p7_hmmfile_ReadBlock() is memory mapped: */
+  char         *mbuf;		/* the file, or NULL if not mapped   */
+  off_t         msize;		/* its size in bytes                 */
 
 #ifdef HMMER_THREADS
   int              syncRead;
@@ -654,8 +662,10 @@ typedef struct p7_domaindef_s {
   ESL_RANDOMNESS *r;		/* random number generator                                 */
   int             do_reseeding;	/* TRUE to reset the RNG, make results reproducible        */
   P7_SPENSEMBLE  *sp;		/* an ensemble of sampled segment pairs (domain endpoints) */
-  P7_TRACE       *tr;		/* reusable space for a trace of a domain                  */
   P7_TRACE       *gtr;		/* reusable space for a traceback of the entire target seq */
+  P7_TRACE      **ens;		/* reusable space for <nsamples> sampled traces of a region */
+  struct p7_omx_s *ckpp;	/* checkpointed posteriors for an envelope too big for full DP */
+  struct p7_omx_s *ckoa;	/* checkpointed OA scores, likewise; both made when needed  */
 
   /* Heuristic thresholds that control the region definition process */
   /* "rt" = "region threshold", for lack of better term  */
@@ -675,6 +685,8 @@ typedef struct p7_domaindef_s {
   P7_DOMAIN *dcl;
   int        ndom;	 /* number of domains defined, in the end.         */
   int        nalloc;     /* number of domain structures allocated in <dcl> */
+  P7_TRACE **dtr;	 /* dtr[d] = OA trace of dcl[d], kept until its alidisplay is made */
+  int        ndtralloc;  /* number of traces allocated in <dtr>             */
 
   /* Additional results storage */
   float  nexpected;     /* posterior expected number of domains in the sequence (from posterior arrays) */
@@ -1167,7 +1179,76 @@ typedef union {
 #endif  // if  defined (eslENABLE_SSE)
 
 /*****************************************************************
- * 16. P7_PIPELINE: H3's accelerated seq/profile comparison pipeline
+ * 16. P7_SEEDINDEX: k-mer seed index of a protein target database
+ *****************************************************************/
+
+#define p7_SEEDIDX_PATTERN  "11011011"  /* default spaced seed: weight 6, span 8         */
+#define p7_SEEDIDX_MAXW     8           /* max weight; the index has p7_SEEDIDX_K^w words  */
+#define p7_SEEDIDX_MAXSPAN  16          /* max span of a seed pattern                    */
+#define p7_SEEDIDX_K        10          /* size of the reduced amino acid alphabet       */
+
+/* An inverted index from the spaced words of a target protein
+ * database, in a reduced alphabet, to the targets that contain
+ * them. Targets are identified by their ordinal position in the
+ * database (0..nseq-1). Built by makehmmerdb --kmer; used by
+ * hmmsearch and phmmer --seedidx to skip targets that have no word
+ * scoring well against the query.
+ */
+typedef struct p7_seedindex_s {
+  int       span;                   /* length of the seed pattern                          */
+  int       w;                      /* # of care positions in it: its weight               */
+  int       pos[p7_SEEDIDX_MAXW];   /* offsets of the care positions, in 0..span-1         */
+  int8_t   *rmap;                   /* [0..Kp-1]: residue -> reduced residue; -1 if none    */
+  uint64_t  nwords;                 /* p7_SEEDIDX_K^w                                      */
+
+  uint64_t  nseq;                   /* # of target sequences indexed                       */
+  uint64_t  nres;                   /* # of residues in them                               */
+  uint64_t  dbsize;                 /* size of the indexed sequence file, in bytes         */
+  uint64_t *woff;                   /* [0..nwords]: targets of word c are tidx[woff[c]..woff[c+1]-1] */
+  uint32_t *tidx;                   /* target ordinals; ascending within each word's list  */
+
+  const ESL_ALPHABET *abc;          /* reference to the (amino) alphabet                   */
+} P7_SEEDINDEX;
+
+/* The targets that one query selects in a P7_SEEDINDEX, as bit
+ * arrays over target ordinals.
+ */
+typedef struct p7_seedsel_s {
+  uint64_t  nseq;                   /* # of targets in the index                           */
+  uint64_t *cand;                   /* bit i set: target i has a seed word for the query   */
+  uint64_t *samp;                   /* bit i set: target i isn't a candidate, but is in the random sample */
+  uint64_t  nwords;                 /* # of distinct words the query seeded                */
+  uint64_t  ncand;                  /* # of candidate targets                              */
+  uint64_t  nsamp;                  /* # of sampled targets                                */
+} P7_SEEDSEL;
+
+#define p7_SEEDSEL_TEST(a, i)  (((a)[(i) >> 6] >> ((i) & 63)) & 1)
+
+
+/*****************************************************************
+ * 17. P7_CLUMAP: cluster membership of a redundant target database
+ *****************************************************************/
+
+/* Which cluster each target of a redundant database (UniRef100, say)
+ * belongs to, and which target represents each cluster. Targets are
+ * identified by their ordinal position in the database (0..nseq-1);
+ * a target that wasn't listed in any cluster is a singleton cluster,
+ * its own representative. Built by makehmmerdb --clusters; used by
+ * hmmsearch --clusters to expand only the clusters whose
+ * representative comes close to passing the filters.
+ */
+typedef struct p7_clumap_s {
+  uint64_t  nseq;                   /* # of target sequences                               */
+  uint64_t  nres;                   /* # of residues in them                               */
+  uint64_t  dbsize;                 /* size of the mapped sequence file, in bytes          */
+  uint64_t  nclust;                 /* # of clusters, including singletons                 */
+  uint32_t *clu;                    /* [0..nseq-1]: cluster of target i, 0..nclust-1       */
+  uint32_t *rep;                    /* [0..nclust-1]: ordinal of cluster c's representative */
+} P7_CLUMAP;
+
+
+/*****************************************************************
+ * 18. P7_PIPELINE: H3's accelerated seq/profile comparison pipeline
  *****************************************************************/
 
 enum p7_pipemodes_e { p7_SEARCH_SEQS = 0, p7_SCAN_MODELS = 1 };
@@ -1220,6 +1301,10 @@ typedef struct p7_pipeline_s {
   int     B3;               /* window length for biased-composition modifier - Forward*/
   int     do_biasfilter;	/* TRUE to use biased comp HMM filter       */
   int     do_null2;		/* TRUE to use null2 score corrections      */
+  const P7_SEEDSEL *seedsel;    /* search mode: targets selected by a seed index, by <sq->idx>; NULL if none */
+  const P7_CLUMAP  *clumap;     /* search mode: cluster map of the targets, by <sq->idx>; NULL if none */
+  uint8_t          *cluopen;    /* [0..clumap->nclust-1]: TRUE if cluster is expanded; shared by threads */
+  int               clu_reppass;/* TRUE: screening representatives, to set <cluopen>; FALSE: skipping closed clusters */
 
   /* Accounting. (reduceable in threaded/MPI parallel version)              */
   uint64_t      nmodels;        /* # of HMMs searched                       */
@@ -1230,12 +1315,27 @@ typedef struct p7_pipeline_s {
   uint64_t      n_past_bias;	/* # comparisons that pass bias filter      */
   uint64_t      n_past_vit;	/* # comparisons that pass ViterbiFilter()  */
   uint64_t      n_past_fwd;	/* # comparisons that pass ForwardFilter()  */
+  uint64_t      nres_bias;	/* # residues scored by the bias filter     */
   uint64_t      n_output;	    /* # alignments that make it to the final output (used for nhmmer) */
   uint64_t      pos_past_msv;	/* # positions that pass MSVFilter()  (used for nhmmer) */
   uint64_t      pos_past_bias;	/* # positions that pass bias filter  (used for nhmmer) */
   uint64_t      pos_past_vit;	/* # positions that pass ViterbiFilter()  (used for nhmmer) */
   uint64_t      pos_past_fwd;	/* # positions that pass ForwardFilter()  (used for nhmmer) */
   uint64_t      pos_output;	    /* # positions that make it to the final output (used for nhmmer) */
+  uint64_t      n_seed_skip;    /* # targets skipped because <seedsel> didn't select them */
+  uint64_t      n_seed_sample;  /* # targets searched only as <seedsel>'s random sample   */
+  uint64_t      n_seed_samplemsv; /* # of those that pass MSVFilter()                     */
+  uint64_t      n_clu_rep;      /* # cluster representatives screened                     */
+  uint64_t      n_clu_open;     /* # of them that opened their cluster                    */
+  uint64_t      n_clu_skip;     /* # targets skipped because their cluster was closed     */
+
+  /* Optional per-stage wall clock accounting (--stagetimes)                           */
+  ESL_STOPWATCH *stagew;        /* stage timer; NULL if stage timing is off */
+  double        t_msv;          /* seconds in MSV/SSV filter                */
+  double        t_bias;         /* seconds in bias filter                   */
+  double        t_vit;          /* seconds in Viterbi filter                */
+  double        t_fwd;          /* seconds in Forward filter                */
+  double        t_dom;          /* seconds in Backward + domain definition  */
 
   enum p7_pipemodes_e mode;    	/* p7_SCAN_MODELS | p7_SEARCH_SEQS          */
   int           long_targets;   /* TRUE if the target sequences are expected to be very long (e.g. dna chromosome search in nhmmer) */
@@ -1247,13 +1347,15 @@ typedef struct p7_pipeline_s {
   int           show_alignments;/* TRUE to output alignments (default)      */
 
   P7_HMMFILE   *hfp;		/* COPY of open HMM database (if scan mode) */
+  int           scan_L;		/* scan mode: query length that <scan_nullsc> is for; -1 if unset  */
+  float         scan_nullsc;	/* scan mode: null1 score of the query, same for every model      */
   char          errbuf[eslERRBUFSIZE];
 } P7_PIPELINE;
 
 
 
 /*****************************************************************
- * 17. P7_BUILDER: pipeline for new HMM construction
+ * 19. P7_BUILDER: pipeline for new HMM construction
  *****************************************************************/
 
 #define p7_DEFAULT_WINDOW_BETA  1e-7
@@ -1312,7 +1414,7 @@ typedef struct p7_builder_s {
 
 
 /*****************************************************************
- * 18. Routines in HMMER's exposed API.
+ * 20. Routines in HMMER's exposed API.
  *****************************************************************/
 
 /* build.c */
@@ -1406,9 +1508,17 @@ extern int   p7_island_Viterbi(ESL_DSQ *dsq, int L, P7_PROFILE *gm, P7_GMX *mx,
 extern int   p7_h2io_WriteASCII(FILE *fp, P7_HMM *hmm);
 
 /* hmmer.c */
+#define p7_TMPFILE_NAMELEN 32   /* room for a p7_TmpfileNamed() name */
 extern void         p7_banner(FILE *fp, const char *progname, char *banner);
 extern ESL_GETOPTS *p7_CreateDefaultApp(ESL_OPTIONS *options, int nargs, int argc, char **argv, char *banner, char *usage);
 extern int          p7_AminoFrequencies(float *f);
+extern int          p7_TmpfileNamed(char *tmpfile, FILE **opt_fp);
+extern int          p7_FileSize(const char *filename, uint64_t *ret_size);
+extern int          p7_ThreadedFor(int ncpus, int n, void *arg,
+				   int  (*init_f)(void *arg, int tid, void **ret_tls),
+				   int  (*work_f)(void *arg, void *tls, int i, char *errbuf),
+				   void (*fini_f)(void *tls),
+				   int *opt_failidx, char *opt_errbuf);
 
 /* logsum.c */
 extern int   p7_FLogsumInit(void);
@@ -1462,6 +1572,9 @@ extern int p7_oprofile_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, i
 extern int p7_tracealign_Seqs(ESL_SQ **sq,           P7_TRACE **tr, int nseq, int M,  int optflags, P7_HMM *hmm, ESL_MSA **ret_msa);
 extern int p7_tracealign_MSA (const ESL_MSA *premsa, P7_TRACE **tr,           int M,  int optflags, ESL_MSA **ret_postmsa);
 extern int p7_tracealign_computeTraces(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRACE  **tr);
+extern int p7_tracealign_computeTracesThreaded(P7_HMM *hmm, ESL_SQ **sq, int offset, int N, P7_TRACE **tr, int ncpus);
+extern int p7_tracealign_CountInserts(P7_TRACE **tr, int nseq, int M, int *inscount, int *matuse);
+extern int p7_tracealign_SeqsWithMap (ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7_HMM *hmm, const int *inscount, const int *matuse, ESL_MSA **ret_msa);
 extern int p7_tracealign_getMSAandStats(P7_HMM *hmm, ESL_SQ  **sq, int N, ESL_MSA **ret_msa, float **ret_pp, float **ret_relent, float **ret_scores );
 
 /* p7_alidisplay.c */
@@ -1512,6 +1625,13 @@ extern int p7_Builder      (P7_BUILDER *bld, ESL_MSA *msa, P7_BG *bg, P7_HMM **o
 extern int p7_SingleBuilder(P7_BUILDER *bld, ESL_SQ *sq,   P7_BG *bg, P7_HMM **opt_hmm, P7_TRACE  **opt_tr,    P7_PROFILE **opt_gm, P7_OPROFILE **opt_om); 
 extern int p7_Builder_MaxLength      (P7_HMM *hmm, double emit_thresh);
 
+/* p7_clumap.c */
+extern int  p7_clumap_Build   (ESL_SQFILE *sqfp, const char *clufile, P7_CLUMAP **ret_cm, char *errbuf);
+extern int  p7_clumap_Write   (FILE *fp, const P7_CLUMAP *cm);
+extern int  p7_clumap_Read    (FILE *fp, P7_CLUMAP **ret_cm, char *errbuf);
+extern int  p7_clumap_Validate(const P7_CLUMAP *cm, const char *dbfile, char *errbuf);
+extern void p7_clumap_Destroy (P7_CLUMAP *cm);
+
 /* p7_domain.c */
 extern P7_DOMAIN *p7_domain_Create_empty();
 extern void p7_domain_Destroy(P7_DOMAIN *obj);
@@ -1532,6 +1652,7 @@ extern int p7_domaindef_ByViterbi            (P7_PROFILE *gm, const ESL_SQ *sq,
 extern int p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *fwd, P7_OMX *bck,
 				                                  P7_DOMAINDEF *ddef, P7_BG *bg, int long_target,
 				                                  P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+extern int p7_domaindef_CreateAlidisplays   (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq);
 
 
 /* p7_gmx.c */
@@ -1603,6 +1724,8 @@ extern int  p7_hmmfile_WriteBinary(FILE *fp, int format, P7_HMM *hmm);
 extern int  p7_hmmfile_WriteASCII (FILE *fp, int format, P7_HMM *hmm);
 extern int  p7_hmmfile_WriteToString (char **s, int format, P7_HMM *hmm);
 extern int  p7_hmmfile_Read(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc,  P7_HMM **opt_hmm);
+extern int  p7_hmmfile_ReadBlock(P7_HMMFILE *hfp, int ncpu, ESL_ALPHABET **ret_abc, P7_HMM **hmmv, int nmax, int *ret_n);
+extern int  p7_hmmfile_ReadOffsets(P7_HMMFILE *hfp, int ncpu, ESL_ALPHABET **ret_abc, const off_t *offset, int n, P7_HMM **hmmv);
 extern int  p7_hmmfile_PositionByKey(P7_HMMFILE *hfp, const char *key);
 extern int  p7_hmmfile_Position(P7_HMMFILE *hfp, const off_t offset);
 
@@ -1618,6 +1741,8 @@ extern P7_SCOREDATA   *p7_hmm_ScoreDataCreate(P7_OPROFILE *om, P7_PROFILE *gm );
 extern P7_SCOREDATA   *p7_hmm_ScoreDataClone(P7_SCOREDATA *src, int K);
 extern int            p7_hmm_ScoreDataComputeRest(P7_OPROFILE *om, P7_SCOREDATA *data );
 extern void           p7_hmm_ScoreDataDestroy( P7_SCOREDATA *data );
+extern int            p7_hmm_ScoreDataWrite(FILE *fp, const P7_SCOREDATA *data, int Kp);
+extern int            p7_hmm_ScoreDataRead(FILE *fp, int M, int Kp, P7_SCOREDATA **ret_data, char *errbuf);
 extern int            p7_hmm_initWindows (P7_HMM_WINDOWLIST *list);
 extern P7_HMM_WINDOW *p7_hmm_newWindow (P7_HMM_WINDOWLIST *list, uint32_t id, uint32_t pos, uint32_t fm_pos, uint16_t k, uint32_t length, float score, uint8_t complementarity);
 
@@ -1641,7 +1766,9 @@ extern int p7_pli_TargetIncludable  (P7_PIPELINE *pli, float score,     double l
 extern int p7_pli_DomainIncludable  (P7_PIPELINE *pli, float dom_score, double lnP);
 extern int p7_pli_NewModel          (P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg);
 extern int p7_pli_NewModelThresholds(P7_PIPELINE *pli, const P7_OPROFILE *om);
+extern int p7_pli_SkipModels        (P7_PIPELINE *pli, uint64_t nmodels, uint64_t nnodes);
 extern int p7_pli_NewSeq            (P7_PIPELINE *pli, const ESL_SQ *sq);
+extern int p7_pli_SetClusters       (P7_PIPELINE *pli, const P7_CLUMAP *cm, uint8_t *cluopen, int is_reppass, double margin);
 extern int p7_Pipeline              (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *th);
 extern int p7_Pipeline_LongTarget   (P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
                                      P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx,
@@ -1677,6 +1804,16 @@ extern int         p7_profile_GetT(const P7_PROFILE *gm, char st1, int k1,
 extern int         p7_profile_Validate(const P7_PROFILE *gm, char *errbuf, float tol);
 extern int         p7_profile_Compare(P7_PROFILE *gm1, P7_PROFILE *gm2, float tol);
 
+/* p7_seedindex.c */
+extern int  p7_seedindex_Create  (const ESL_ALPHABET *abc, const char *pattern, P7_SEEDINDEX **ret_sx, char *errbuf);
+extern int  p7_seedindex_Build   (P7_SEEDINDEX *sx, ESL_SQFILE *sqfp, char *errbuf);
+extern int  p7_seedindex_Write   (FILE *fp, const P7_SEEDINDEX *sx);
+extern int  p7_seedindex_Read    (FILE *fp, const ESL_ALPHABET *abc, P7_SEEDINDEX **ret_sx, char *errbuf);
+extern int  p7_seedindex_Validate(const P7_SEEDINDEX *sx, const char *dbfile, char *errbuf);
+extern void p7_seedindex_Destroy (P7_SEEDINDEX *sx);
+extern int  p7_seedindex_Select  (const P7_SEEDINDEX *sx, const P7_PROFILE *gm, float T, double sample, ESL_RANDOMNESS *rng, P7_SEEDSEL **ret_sel);
+extern void p7_seedsel_Destroy   (P7_SEEDSEL *sel);
+
 /* p7_spensemble.c */
 P7_SPENSEMBLE *p7_spensemble_Create(int init_n, int init_epc, int init_sigc);
 extern int     p7_spensemble_Reuse(P7_SPENSEMBLE *sp);
@@ -55,12 +55,46 @@ static ESL_OPTIONS options[] = {
   { "-o",       eslARG_OUTFILE,FALSE,NULL, NULL, NULL, NULL,"-O,--index",   "output HMM to file <f> instead of stdout",          0 },
   { "-O",       eslARG_NONE,  FALSE, NULL, NULL, NULL, NULL,"-o,-f,--index","output HMM to file named <key>",                    0 },
   { "--index",  eslARG_NONE,  FALSE, NULL, NULL, NULL, NULL, NULL,          "index the <hmmfile>, creating <hmmfile>.ssi",       0 },
+  { "--bulk",   eslARG_NONE,  FALSE, NULL, NULL, NULL, "-f","--index",      "with -f: fetch all keys in file order, in blocks",  0 },
+  { "--press",  eslARG_NONE,  FALSE, NULL, NULL, NULL, "-o","--index",      "write a pressed database <f>.h3{m,i,f,p} for -o <f>", 0 },
+#ifdef HMMER_THREADS
+  { "--cpu",    eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,NULL,"--index","number of parallel CPU workers for parsing",          0 },
+#endif
   { 0,0,0,0,0,0,0,0,0,0 },
 };
 
+#define BULK_BLOCKSIZE 1000	/* # of HMMs per p7_hmmfile_ReadOffsets() / ReadBlock() call */
+
+/* With --press, fetched HMMs go straight into the files of a pressed
+ * database, as hmmpress would make them: four, plus the .h3s score
+ * data for a DNA/RNA database. No .h3c clusters are made (hmmscan
+ * does without them); an existing one must not be left behind.
+ */
+struct pressdb {
+  char       *mfile;    // .h3m file: binary core HMMs
+  char       *ffile;    // .h3f file: binary vectorized profiles, MSV filter part only
+  char       *pfile;    // .h3p file: binary vectorized profiles, remainder
+  char       *ssifile;  // .h3i file: SSI index for retrieval from .h3m
+  char       *sfile;    // .h3s file: binary nhmmscan score data; nucleic alphabets only
+  char       *cfile;    // .h3c file: never written, only checked for
+  FILE       *mfp;
+  FILE       *ffp;
+  FILE       *pfp;
+  FILE       *sfp;
+  ESL_NEWSSI *nssi;
+  uint16_t    fh;
+  P7_BG      *bg;       // created when the first HMM's alphabet is known
+};
+
 static void create_ssi_index(ESL_GETOPTS *go, P7_HMMFILE *hfp);
-static void multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp);
-static void onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, P7_HMMFILE *hfp);
+static void multifetch(ESL_GETOPTS *go, FILE *ofp, struct pressdb *pdb, char *keyfile, P7_HMMFILE *hfp);
+static int  bulkfetch (ESL_GETOPTS *go, FILE *ofp, struct pressdb *pdb, ESL_KEYHASH *keys, P7_HMMFILE *hfp);
+static void onefetch(ESL_GETOPTS *go, FILE *ofp, struct pressdb *pdb, char *key, P7_HMMFILE *hfp);
+static void output_hmm(FILE *ofp, struct pressdb *pdb, P7_HMM *hmm);
+
+static int             pressdb_Open (char *basename, struct pressdb **ret_pdb, char *errbuf);
+static int             pressdb_Add  (struct pressdb *pdb, P7_HMM *hmm, char *errbuf);
+static int             pressdb_Close(struct pressdb *pdb, int status, char *errbuf);
 
 int
 main(int argc, char **argv)
@@ -71,6 +105,7 @@ main(int argc, char **argv)
   char         *keyname = NULL;	/* key name                        */
   P7_HMMFILE   *hfp     = NULL;	/* open HMM file                   */
   FILE         *ofp     = NULL;	/* output stream for HMMs          */
+  struct pressdb *pdb   = NULL;	/* or, with --press, output db     */
   int           status;		/* easel/hmmer return code         */
   char          errbuf[eslERRBUFSIZE];
 
@@ -123,7 +158,11 @@ main(int argc, char **argv)
   else if (status != eslOK)        p7_Fail("Unexpected error %d in opening HMM file %s.\n%s\n",                       status, hmmfile, errbuf);  
 
  /* Open the output file, if any  */
-  if (esl_opt_GetBoolean(go, "-O")) 
+  if (esl_opt_GetBoolean(go, "--press"))
+    {
+      if (pressdb_Open(esl_opt_GetString(go, "-o"), &pdb, errbuf) != eslOK) p7_Fail("Failed to create pressed database %s:\n%s\n", esl_opt_GetString(go, "-o"), errbuf);
+    }
+  else if (esl_opt_GetBoolean(go, "-O")) 
     {
       if (! keyname)                            p7_Fail("No key name? Can't use -O\n"); 
       if ((ofp = fopen(keyname, "w")) == NULL)	p7_Fail("Failed to open output file %s\n", keyname);
@@ -138,14 +177,18 @@ main(int argc, char **argv)
   
   /* Hand off to the appropriate routine */
   if     (esl_opt_GetBoolean(go, "--index"))  create_ssi_index(go, hfp);
-  else if (esl_opt_GetBoolean(go, "-f"))      multifetch(go, ofp, keyfile, hfp);
+  else if (esl_opt_GetBoolean(go, "-f"))      multifetch(go, ofp, pdb, keyfile, hfp);
   else 
     {
-      onefetch(go, ofp, keyname, hfp);
+      onefetch(go, ofp, pdb, keyname, hfp);
       if (ofp != stdout) printf("\n\nRetrieved HMM %s.\n",  keyname);
     }
 
-  if (esl_opt_GetBoolean(go, "-O") || esl_opt_GetString(go, "-o") != NULL) fclose(ofp);
+  if (pdb != NULL) 
+    {
+      if (pressdb_Close(pdb, eslOK, errbuf) != eslOK) p7_Fail("%s\n", errbuf);
+    }
+  else if (esl_opt_GetBoolean(go, "-O") || esl_opt_GetString(go, "-o") != NULL) fclose(ofp);
   p7_hmmfile_Close(hfp);
   esl_getopts_Destroy(go);
   exit(0);
@@ -220,27 +263,37 @@ create_ssi_index(ESL_GETOPTS *go, P7_HMMFILE *hfp)
  * given a file containing lines with one name or key per line;
  * parse the file line-by-line;
  * if we have an SSI index available, retrieve the HMMs by key
- * as we see each line;
+ * as we see each line (or, with --bulk, all at once after
+ * reading the keyfile; see bulkfetch());
  * else, without an SSI index, store the keys in a hash, then
  * read the entire HMM file in a single pass, outputting HMMs
  * that are in our keylist. 
  * 
  * Note that with an SSI index, you get the HMMs in the order they
- * appear in the <keyfile>, but without an SSI index, you get HMMs in
- * the order they occur in the HMM file.
+ * appear in the <keyfile>, but without an SSI index or with --bulk,
+ * you get HMMs in the order they occur in the HMM file. With --bulk,
+ * a key may be repeated; each HMM is still fetched once.
  */
 static void
-multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp)
+multifetch(ESL_GETOPTS *go, FILE *ofp, struct pressdb *pdb, char *keyfile, P7_HMMFILE *hfp)
 {
   ESL_KEYHASH    *keys   = esl_keyhash_Create();
   ESL_FILEPARSER *efp    = NULL;
   ESL_ALPHABET   *abc    = NULL;
-  P7_HMM         *hmm    = NULL;
+  P7_HMM         *hmmv[BULK_BLOCKSIZE];
+  int             do_bulk = esl_opt_GetBoolean(go, "--bulk");
+  int             ncpu   = 0;
   int             nhmm   = 0;
+  int             nread  = 0;
+  int             i;
   char           *key;
   int             keylen;
   int             keyidx;
   int             status;
+
+#ifdef HMMER_THREADS
+  ncpu = esl_opt_GetInteger(go, "--cpu");
+#endif
   
   if (esl_fileparser_Open(keyfile, NULL, &efp) != eslOK)  p7_Fail("Failed to open key file %s\n", keyfile);
   esl_fileparser_SetCommentChar(efp, '#');
@@ -251,29 +304,34 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp)
 	p7_Fail("Failed to read HMM name on line %d of file %s\n", efp->linenumber, keyfile);
       
       status = esl_keyhash_Store(keys, key, -1, &keyidx);
-      if (status == eslEDUP) p7_Fail("HMM key %s occurs more than once in file %s\n", key, keyfile);
+      if (status == eslEDUP && ! do_bulk) p7_Fail("HMM key %s occurs more than once in file %s\n", key, keyfile);
 	
-      if (hfp->ssi != NULL) { onefetch(go, ofp, key, hfp);  nhmm++; }
+      if (hfp->ssi != NULL && ! do_bulk) { onefetch(go, ofp, pdb, key, hfp);  nhmm++; }
     }
 
-  if (hfp->ssi == NULL) 
+  if (hfp->ssi != NULL && do_bulk)
     {
-      while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) != eslEOF)
-	{
-	  if      (status == eslEOD)       p7_Fail("read failed, HMM file %s may be truncated?", hfp->fname);
-	  else if (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s",             hfp->fname);
-	  else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   hfp->fname);
-	  else if (status != eslOK)        p7_Fail("Unexpected error in reading HMMs from %s",   hfp->fname);
-
-	  if (esl_keyhash_Lookup(keys, hmm->name, -1, &keyidx) == eslOK || 
-	      ((hmm->acc) && esl_keyhash_Lookup(keys, hmm->acc, -1, &keyidx) == eslOK))
-	    {
-	      p7_hmmfile_WriteASCII(ofp, -1, hmm);
-	      nhmm++;
-	    }
-
-	  p7_hmm_Destroy(hmm);
-	}
+      nhmm = bulkfetch(go, ofp, pdb, keys, hfp);
+    }
+  else if (hfp->ssi == NULL) 
+    {
+      do {
+	status = p7_hmmfile_ReadBlock(hfp, ncpu, &abc, hmmv, BULK_BLOCKSIZE, &nread);
+	if      (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s:\n%s",      hfp->fname, hfp->errbuf);
+	else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   hfp->fname);
+	else if (status != eslOK && status != eslEOF) p7_Fail("Unexpected error in reading HMMs from %s", hfp->fname);
+
+	for (i = 0; i < nread; i++)
+	  {
+	    if (esl_keyhash_Lookup(keys, hmmv[i]->name, -1, &keyidx) == eslOK || 
+		((hmmv[i]->acc) && esl_keyhash_Lookup(keys, hmmv[i]->acc, -1, &keyidx) == eslOK))
+	      {
+		output_hmm(ofp, pdb, hmmv[i]);
+		nhmm++;
+	      }
+	    p7_hmm_Destroy(hmmv[i]);
+	  }
+      } while (status == eslOK);
     }
   
   if (ofp != stdout) printf("\nRetrieved %d HMMs.\n", nhmm);
@@ -292,7 +350,7 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp)
  * the one we're after.
  */
 static void
-onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, P7_HMMFILE *hfp)
+onefetch(ESL_GETOPTS *go, FILE *ofp, struct pressdb *pdb, char *key, P7_HMMFILE *hfp)
 {
   ESL_ALPHABET *abc  = NULL;
   P7_HMM       *hmm  = NULL;
@@ -320,10 +378,261 @@ onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, P7_HMMFILE *hfp)
   
   if (status == eslOK) 
     {
-      p7_hmmfile_WriteASCII(ofp, -1, hmm);
+      output_hmm(ofp, pdb, hmm);
       p7_hmm_Destroy(hmm);
     }
   else p7_Fail("HMM %s not found in file %s\n", key, hfp->fname);
 
   esl_alphabet_Destroy(abc);
 }
+
+
+/* cmp_offset()
+ * qsort() comparison for sorting disk offsets, ascending.
+ */
+static int
+cmp_offset(const void *a, const void *b)
+{
+  off_t x = *(const off_t *) a;
+  off_t y = *(const off_t *) b;
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+/* bulkfetch():
+ * With an SSI index, look up every key first, sort the HMMs' disk
+ * offsets, and read them in file order a block at a time with
+ * p7_hmmfile_ReadOffsets(): sequential i/o, and for an ASCII file,
+ * parallel parsing. HMMs come out in file order, and an HMM named in
+ * <keys> by both name and accession is fetched once. Returns the
+ * number of HMMs fetched.
+ */
+static int
+bulkfetch(ESL_GETOPTS *go, FILE *ofp, struct pressdb *pdb, ESL_KEYHASH *keys, P7_HMMFILE *hfp)
+{
+  ESL_ALPHABET *abc    = NULL;
+  P7_HMM       *hmmv[BULK_BLOCKSIZE];
+  off_t        *offset = NULL;
+  int           nkeys  = esl_keyhash_GetNumber(keys);
+  int           ncpu   = 0;
+  int           n, nb;
+  int           i, j;
+  uint16_t      fh;
+  int           status;
+
+#ifdef HMMER_THREADS
+  ncpu = esl_opt_GetInteger(go, "--cpu");
+#endif
+
+  if (nkeys == 0) return 0;
+  if ((offset = malloc(sizeof(off_t) * nkeys)) == NULL) p7_Fail("allocation failed");
+
+  for (i = 0; i < nkeys; i++)
+    {
+      status = esl_ssi_FindName(hfp->ssi, esl_keyhash_Get(keys, i), &fh, &(offset[i]), NULL, NULL);
+      if      (status == eslENOTFOUND) p7_Fail("HMM %s not found in SSI index for file %s\n", esl_keyhash_Get(keys, i), hfp->fname);
+      else if (status == eslEFORMAT)   p7_Fail("Failed to parse SSI index for %s\n", hfp->fname);
+      else if (status != eslOK)        p7_Fail("Failed to look up location of HMM %s in SSI index of file %s\n", esl_keyhash_Get(keys, i), hfp->fname);
+    }
+
+  qsort(offset, nkeys, sizeof(off_t), cmp_offset);
+  for (n = 0, i = 0; i < nkeys; i++)
+    if (n == 0 || offset[i] != offset[n-1]) offset[n++] = offset[i];
+
+  for (i = 0; i < n; i += nb)
+    {
+      nb     = ESL_MIN(BULK_BLOCKSIZE, n-i);
+      status = p7_hmmfile_ReadOffsets(hfp, ncpu, &abc, offset+i, nb, hmmv);
+      if      (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s:\n%s",    hfp->fname, hfp->errbuf);
+      else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets", hfp->fname);
+      else if (status != eslOK)        p7_Fail("Unexpected error in reading HMMs from %s", hfp->fname);
+
+      for (j = 0; j < nb; j++)
+	{
+	  output_hmm(ofp, pdb, hmmv[j]);
+	  p7_hmm_Destroy(hmmv[j]);
+	}
+    }
+
+  if (abc) esl_alphabet_Destroy(abc);
+  free(offset);
+  return n;
+}
+
+
+/* output_hmm()
+ * Write one fetched HMM: as ASCII to <ofp>, or with --press, into
+ * the pressed database <pdb>.
+ */
+static void
+output_hmm(FILE *ofp, struct pressdb *pdb, P7_HMM *hmm)
+{
+  char errbuf[eslERRBUFSIZE];
+
+  if (pdb == NULL) p7_hmmfile_WriteASCII(ofp, -1, hmm);
+  else if (pressdb_Add(pdb, hmm, errbuf) != eslOK)
+    {
+      pressdb_Close(pdb, eslFAIL, NULL);
+      p7_Fail("%s\n", errbuf);
+    }
+}
+
+
+/* pressdb_Open()
+ * Create the four files of a new pressed database <basename>.h3{m,i,f,p},
+ * and return it in <*ret_pdb>; the .h3s file is created by the first
+ * pressdb_Add(), once the alphabet is known. Returns <eslEOVERWRITE>
+ * if any of them, or a .h3c, exists already (and leaves it alone),
+ * or another error code if
+ * they can't be created; in either case with a message in <errbuf>,
+ * and <*ret_pdb> is NULL.
+ */
+static int
+pressdb_Open(char *basename, struct pressdb **ret_pdb, char *errbuf)
+{
+  struct pressdb *pdb = NULL;
+  int             status;
+
+  if ((pdb = malloc(sizeof(struct pressdb))) == NULL) p7_Die("malloc() failed");
+  pdb->mfile   = pdb->ffile = pdb->pfile = pdb->ssifile = pdb->sfile = pdb->cfile = NULL;
+  pdb->mfp     = pdb->ffp   = pdb->pfp   = pdb->sfp     = NULL;
+  pdb->nssi    = NULL;
+  pdb->bg      = NULL;
+
+  if (esl_sprintf(&(pdb->ssifile), "%s.h3i", basename) != eslOK) ESL_XFAIL(eslEMEM, errbuf, "allocation failed");
+  if (esl_sprintf(&(pdb->mfile),   "%s.h3m", basename) != eslOK) ESL_XFAIL(eslEMEM, errbuf, "allocation failed");
+  if (esl_sprintf(&(pdb->ffile),   "%s.h3f", basename) != eslOK) ESL_XFAIL(eslEMEM, errbuf, "allocation failed");
+  if (esl_sprintf(&(pdb->pfile),   "%s.h3p", basename) != eslOK) ESL_XFAIL(eslEMEM, errbuf, "allocation failed");
+  if (esl_sprintf(&(pdb->sfile),   "%s.h3s", basename) != eslOK) ESL_XFAIL(eslEMEM, errbuf, "allocation failed");
+  if (esl_sprintf(&(pdb->cfile),   "%s.h3c", basename) != eslOK) ESL_XFAIL(eslEMEM, errbuf, "allocation failed");
+
+  /* Check them all before creating any, so a failure never touches an existing database */
+  if (esl_FileExists(pdb->ssifile)) ESL_XFAIL(eslEOVERWRITE, errbuf, "SSI index file %s already exists;\nDelete old hmmpress indices first",        pdb->ssifile);
+  if (esl_FileExists(pdb->mfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary HMM file %s already exists;\nDelete old hmmpress indices first",       pdb->mfile);
+  if (esl_FileExists(pdb->ffile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary MSV filter file %s already exists\nDelete old hmmpress indices first", pdb->ffile);
+  if (esl_FileExists(pdb->pfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary profile file %s already exists\nDelete old hmmpress indices first",    pdb->pfile);
+  if (esl_FileExists(pdb->sfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary score data file %s already exists\nDelete old hmmpress indices first", pdb->sfile);
+  if (esl_FileExists(pdb->cfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary cluster file %s already exists\nDelete old hmmpress indices first",    pdb->cfile);
+
+  if ((status = esl_newssi_Open(pdb->ssifile, FALSE, &(pdb->nssi)))     != eslOK) ESL_XFAIL(status, errbuf, "Failed to open SSI index file %s", pdb->ssifile);
+  if ((status = esl_newssi_AddFile(pdb->nssi, basename, 0, &(pdb->fh))) != eslOK) ESL_XFAIL(status, errbuf, "Failed to add %s to SSI index", basename);
+  if ((pdb->mfp = fopen(pdb->mfile, "wb")) == NULL) ESL_XFAIL(eslFAIL, errbuf, "Failed to open binary HMM file %s for writing",       pdb->mfile);
+  if ((pdb->ffp = fopen(pdb->ffile, "wb")) == NULL) ESL_XFAIL(eslFAIL, errbuf, "Failed to open binary MSV filter file %s for writing", pdb->ffile);
+  if ((pdb->pfp = fopen(pdb->pfile, "wb")) == NULL) ESL_XFAIL(eslFAIL, errbuf, "Failed to open binary profile file %s for writing",    pdb->pfile);
+  *ret_pdb = pdb;
+  return eslOK;
+
+ ERROR:
+  pressdb_Close(pdb, eslFAIL, NULL);
+  *ret_pdb = NULL;
+  return status;
+}
+
+
+/* pressdb_Add()
+ * Append <hmm> to pressed database <pdb>, configured and vectorized
+ * the same way hmmpress does it.
+ */
+static int
+pressdb_Add(struct pressdb *pdb, P7_HMM *hmm, char *errbuf)
+{
+  P7_PROFILE   *gm = NULL;
+  P7_OPROFILE  *om = NULL;
+  P7_SCOREDATA *sd = NULL;
+  int           status;
+
+  if (pdb->bg == NULL) {
+    if ((pdb->bg = p7_bg_Create(hmm->abc)) == NULL) ESL_XFAIL(eslEMEM, errbuf, "failed to create null model");
+    p7_bg_SetLength(pdb->bg, 400);
+    if ((hmm->abc->type == eslDNA || hmm->abc->type == eslRNA) && (pdb->sfp = fopen(pdb->sfile, "wb")) == NULL)
+      ESL_XFAIL(eslEWRITE, errbuf, "Failed to open binary score data file %s for writing", pdb->sfile);
+  }
+
+  if ((gm = p7_profile_Create(hmm->M, hmm->abc)) == NULL) ESL_XFAIL(eslEMEM, errbuf, "failed to create profile");
+  p7_ProfileConfig(hmm, pdb->bg, gm, 400, p7_LOCAL);
+  if ((om = p7_oprofile_Create(gm->M, hmm->abc)) == NULL) ESL_XFAIL(eslEMEM, errbuf, "failed to create optimized profile");
+  p7_oprofile_Convert(gm, om);
+
+  if ((om->offs[p7_MOFFSET] = ftello(pdb->mfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of HMM db file");
+  if ((om->offs[p7_FOFFSET] = ftello(pdb->ffp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of MSV db file");
+  if ((om->offs[p7_POFFSET] = ftello(pdb->pfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of profile db file");
+
+  if ((status = esl_newssi_AddKey(pdb->nssi, hmm->name, pdb->fh, om->offs[p7_MOFFSET], 0, 0)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to add key %s to SSI index", hmm->name);
+  if (hmm->acc) {
+    if ((status = esl_newssi_AddAlias(pdb->nssi, hmm->acc, hmm->name))                      != eslOK) ESL_XFAIL(status, errbuf, "Failed to add secondary key %s to SSI index", hmm->acc);
+  }
+
+  if ((status = p7_hmmfile_WriteBinary(pdb->mfp, -1, hmm))    != eslOK) ESL_XFAIL(status, errbuf, "Failed to write binary HMM %s", hmm->name);
+  if ((status = p7_oprofile_Write(pdb->ffp, pdb->pfp, om))    != eslOK) ESL_XFAIL(status, errbuf, "Failed to write pressed profile %s", hmm->name);
+
+  if (pdb->sfp) {
+    if ((sd = p7_hmm_ScoreDataCreate(om, NULL))                  == NULL)  ESL_XFAIL(eslEMEM, errbuf, "Failed to create score data for %s", hmm->name);
+    if ((status = p7_hmm_ScoreDataComputeRest(om, sd))           != eslOK) { sd = NULL; ESL_XFAIL(status, errbuf, "Failed to compute score data for %s", hmm->name); } /* it free'd <sd> */
+    if ((status = p7_hmm_ScoreDataWrite(pdb->sfp, sd, hmm->abc->Kp)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to write score data for %s", hmm->name);
+  }
+
+  p7_hmm_ScoreDataDestroy(sd);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  return eslOK;
+
+ ERROR:
+  p7_hmm_ScoreDataDestroy(sd);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  return status;
+}
+
+
+/* pressdb_Close()
+ * Finish the pressed database: write its SSI index if <status> is
+ * eslOK; otherwise remove the partial files that this <pdb> created
+ * (never ones that were already there). Free <pdb>.
+ * Returns the status of the SSI write, with a message in <errbuf>
+ * if <errbuf> is non-NULL.
+ */
+static int
+pressdb_Close(struct pressdb *pdb, int status, char *errbuf)
+{
+  int wstatus = eslOK;
+  int made_m, made_f, made_p, made_s;
+
+  if (pdb == NULL) return eslOK;
+  made_m = (pdb->mfp != NULL);  /* pressdb_Open() only opens a file after checking it didn't exist */
+  made_f = (pdb->ffp != NULL);
+  made_p = (pdb->pfp != NULL);
+  made_s = (pdb->sfp != NULL);
+
+  if (status == eslOK)
+    {
+      wstatus = esl_newssi_Write(pdb->nssi);
+      if (wstatus != eslOK && errbuf) {
+	if      (wstatus == eslEDUP)   snprintf(errbuf, eslERRBUFSIZE, "SSI index construction failed:\n  %s", pdb->nssi->errbuf);
+	else if (wstatus == eslERANGE) snprintf(errbuf, eslERRBUFSIZE, "SSI index file size exceeds maximum allowed by your filesystem");
+	else                           snprintf(errbuf, eslERRBUFSIZE, "SSI indexing failed:\n  %s", pdb->nssi->errbuf);
+      }
+    }
+
+  if (pdb->mfp)  fclose(pdb->mfp);
+  if (pdb->ffp)  fclose(pdb->ffp);
+  if (pdb->pfp)  fclose(pdb->pfp);
+  if (pdb->sfp)  fclose(pdb->sfp);
+  if (pdb->nssi) esl_newssi_Close(pdb->nssi);
+
+  if (status != eslOK || wstatus != eslOK)
+    {
+      if (made_m) remove(pdb->mfile);
+      if (made_f) remove(pdb->ffile);
+      if (made_p) remove(pdb->pfile);
+      if (made_s) remove(pdb->sfile);
+    }
+
+  p7_bg_Destroy(pdb->bg);
+  free(pdb->mfile);
+  free(pdb->ffile);
+  free(pdb->pfile);
+  free(pdb->ssifile);
+  free(pdb->sfile);
+  free(pdb->cfile);
+  free(pdb);
+  return wstatus;
+}
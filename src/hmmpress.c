@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -16,28 +17,51 @@ static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",          0 },
   { "-f",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "force: overwrite any previous pressed files",   0 },
+  { "--clust",   eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "also save clusters of similar models for hmmscan's prefilter", 0 },
+#ifdef HMMER_THREADS
+  { "--cpu",     eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>=0",NULL,    NULL,    NULL, "number of parallel CPU workers for parsing",    0 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile>";
 static char banner[] = "prepare an HMM database for faster hmmscan searches";
 
-/* hmmpress creates four output files. 
- * Bundling their info into a structure streamlines creation and cleanup.
+#define PRESS_BLOCKSIZE 256	/* # of models per p7_hmmfile_ReadBlock() */
+
+/* --clust: a model joins the cluster of the models just before it in
+ * the file if it's similar to the cluster's first model, the "leader":
+ * its length within CLUST_MAXMDIFF of the leader's, and its match
+ * scores, aligned by node index, within a mean CLUST_MAXDIST nats.
+ * Only clusters of 2 or more models are saved.
+ */
+#define CLUST_MAXSIZE  16
+#define CLUST_MAXMDIFF 0.1
+#define CLUST_MAXDIST  0.5
+
+/* hmmpress creates four output files, plus a fifth (.h3s) for a
+ * DNA/RNA database, and a sixth (.h3c) with --clust. Bundling their
+ * info into a structure streamlines creation and cleanup.
  */
 struct dbfiles {
   char       *mfile;    // .h3m file: binary core HMMs
   char       *ffile;    // .h3f file: binary vectorized profiles, MSV filter part only
   char       *pfile;    // .h3p file: binary vectorized profiles, remainder (excluding MSV filter part)
   char       *ssifile;  // .h3i file: SSI index for retrieval from .h3m
+  char       *sfile;    // .h3s file: binary nhmmscan score data (P7_SCOREDATA); nucleic alphabets only
+  char       *cfile;    // .h3c file: binary profile clusters for hmmscan's prefilter (P7_OM_CLUSTER); --clust only
 
   FILE       *mfp;
   FILE       *ffp;
   FILE       *pfp;
+  FILE       *sfp;
+  FILE       *cfp;
   ESL_NEWSSI *nssi;
 };
   
 static struct dbfiles *open_dbfiles (ESL_GETOPTS *go, char *basename);
 static void            close_dbfiles(struct dbfiles *dbf, int status);
+static int             clust_Joins  (const P7_PROFILE *lead, const P7_PROFILE *gm);
+static int             clust_Flush  (FILE *cfp, P7_PROFILE **cgm, int n, off_t foff, off_t fend, int *nclust, int *nclustered, char *errbuf);
 
 int
 main(int argc, char **argv)
@@ -47,9 +71,19 @@ main(int argc, char **argv)
   char           *hmmfile = esl_opt_GetArg(go, 1);
   P7_HMMFILE     *hfp     = NULL;
   P7_HMM         *hmm     = NULL;
+  P7_HMM         *hmmv[PRESS_BLOCKSIZE];
+  int             nhmm    = 0;
+  int             i       = 0;
+  int             ncpu    = 0;
   P7_BG          *bg      = NULL;
   P7_PROFILE     *gm      = NULL;
   P7_OPROFILE    *om      = NULL;
+  P7_SCOREDATA   *sd      = NULL;
+  P7_PROFILE     *cgm[CLUST_MAXSIZE];   /* --clust: profiles of the current cluster, in file order */
+  int             ncgm    = 0;
+  off_t           cfoff   = 0;          /* .h3f offset of its first member */
+  int             nclust  = 0;
+  int             nclustered = 0;
   struct dbfiles *dbf     = NULL;
   uint16_t        fh      = 0;
   int             nmodel  = 0;
@@ -71,46 +105,81 @@ main(int argc, char **argv)
   if (( status = esl_newssi_AddFile(dbf->nssi, hfp->fname, 0, &fh)) != eslOK) /* 0 = format code (HMMs don't have any yet) */
      ESL_XFAIL(status, errbuf, "Failed to add HMM file %s to new SSI index\n", hfp->fname);
 
+#ifdef HMMER_THREADS
+  ncpu = esl_opt_GetInteger(go, "--cpu");
+#endif
+
   printf("Working...    "); 
   fflush(stdout);
 
-  while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
-    {
-      if (hmm->name == NULL) ESL_XFAIL(eslEINVAL, errbuf, "Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel+1); 
-
-      if (nmodel == 0) { 	/* first time initialization, now that alphabet known */
-	bg = p7_bg_Create(abc);
-	p7_bg_SetLength(bg, 400);
-      }
-
-      nmodel++;
-      totM += hmm->M;
-
-      gm = p7_profile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL);
-      om = p7_oprofile_Create(gm->M, abc);
-      p7_oprofile_Convert(gm, om);
-      
-      if ((om->offs[p7_MOFFSET] = ftello(dbf->mfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of HMM db file");
-      if ((om->offs[p7_FOFFSET] = ftello(dbf->ffp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of MSV db file");   
-      if ((om->offs[p7_POFFSET] = ftello(dbf->pfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of profile db file"); 
-
-      if ((status = esl_newssi_AddKey(dbf->nssi, hmm->name, fh, om->offs[p7_MOFFSET], 0, 0)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to add key %s to SSI index", hmm->name); 
-      if (hmm->acc) {
-	if ((status = esl_newssi_AddAlias(dbf->nssi, hmm->acc, hmm->name))                   != eslOK) ESL_XFAIL(status, errbuf, "Failed to add secondary key %s to SSI index", hmm->acc); 
+  /* Models are parsed a block at a time (in parallel, for an ASCII file), then pressed in order. */
+  while ((status = p7_hmmfile_ReadBlock(hfp, ncpu, &abc, hmmv, PRESS_BLOCKSIZE, &nhmm)) == eslOK)
+    for (i = 0; i < nhmm; i++)
+      {
+	hmm = hmmv[i];
+
+	if (hmm->name == NULL) ESL_XFAIL(eslEINVAL, errbuf, "Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel+1); 
+
+	if (nmodel == 0) {      /* first time initialization, now that alphabet known */
+	  bg = p7_bg_Create(abc);
+	  p7_bg_SetLength(bg, 400);
+	  if ((abc->type == eslDNA || abc->type == eslRNA) && (dbf->sfp = fopen(dbf->sfile, "wb")) == NULL)
+	    ESL_XFAIL(eslEWRITE, errbuf, "Failed to open binary score data file %s for writing", dbf->sfile);
+	}
+
+	nmodel++;
+	totM += hmm->M;
+
+	gm = p7_profile_Create(hmm->M, abc);
+	p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL);
+	om = p7_oprofile_Create(gm->M, abc);
+	p7_oprofile_Convert(gm, om);
+
+	if ((om->offs[p7_MOFFSET] = ftello(dbf->mfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of HMM db file");
+	if ((om->offs[p7_FOFFSET] = ftello(dbf->ffp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of MSV db file");   
+	if ((om->offs[p7_POFFSET] = ftello(dbf->pfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of profile db file"); 
+
+	if ((status = esl_newssi_AddKey(dbf->nssi, hmm->name, fh, om->offs[p7_MOFFSET], 0, 0)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to add key %s to SSI index", hmm->name); 
+	if (hmm->acc) {
+	  if ((status = esl_newssi_AddAlias(dbf->nssi, hmm->acc, hmm->name))                   != eslOK) ESL_XFAIL(status, errbuf, "Failed to add secondary key %s to SSI index", hmm->acc); 
+	}
+
+	p7_hmmfile_WriteBinary(dbf->mfp, -1, hmm);
+	p7_oprofile_Write(dbf->ffp, dbf->pfp, om);
+
+	/* nhmmscan's SSV seeds and window extension need the score data; save it complete */
+	if (dbf->sfp) {
+	  if ((sd = p7_hmm_ScoreDataCreate(om, NULL))          == NULL)  ESL_XFAIL(eslEMEM, errbuf, "Failed to create score data for %s", hmm->name);
+	  if ((status = p7_hmm_ScoreDataComputeRest(om, sd))   != eslOK) { sd = NULL; ESL_XFAIL(status, errbuf, "Failed to compute score data for %s", hmm->name); } /* it free'd <sd> */
+	  if ((status = p7_hmm_ScoreDataWrite(dbf->sfp, sd, abc->Kp)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to write score data for %s", hmm->name);
+	  p7_hmm_ScoreDataDestroy(sd);
+	  sd = NULL;
+	}
+
+	/* hmmscan's prefilter: close the current cluster if <gm> doesn't join it; the profile belongs to the cluster now */
+	if (dbf->cfp) {
+	  if (ncgm > 0 && (ncgm == CLUST_MAXSIZE || ! clust_Joins(cgm[0], gm))) {
+	    if ((status = clust_Flush(dbf->cfp, cgm, ncgm, cfoff, om->offs[p7_FOFFSET], &nclust, &nclustered, errbuf)) != eslOK) { ncgm = 0; goto ERROR; }
+	    ncgm = 0;
+	  }
+	  if (ncgm == 0) cfoff = om->offs[p7_FOFFSET];
+	  cgm[ncgm++] = gm;
+	  gm          = NULL;
+	}
+
+	p7_profile_Destroy(gm);  gm      = NULL;
+	p7_oprofile_Destroy(om); om      = NULL;
+	p7_hmm_Destroy(hmm);     hmmv[i] = NULL;
       }
-
-      p7_hmmfile_WriteBinary(dbf->mfp, -1, hmm);
-      p7_oprofile_Write(dbf->ffp, dbf->pfp, om);
-
-      p7_profile_Destroy(gm);
-      p7_oprofile_Destroy(om);
-      p7_hmm_Destroy(hmm);
-    }
   if      (status == eslEFORMAT)   ESL_XFAIL(status, errbuf, "bad file format in HMM file %s",             hmmfile); 
   else if (status == eslEINCOMPAT) ESL_XFAIL(status, errbuf, "HMM file %s contains different alphabets",   hmmfile); 
   else if (status != eslEOF)       ESL_XFAIL(status, errbuf, "Unexpected error in reading HMMs from %s",   hmmfile); 
 
+  if (ncgm > 0) {
+    if ((status = clust_Flush(dbf->cfp, cgm, ncgm, cfoff, ftello(dbf->ffp), &nclust, &nclustered, errbuf)) != eslOK) { ncgm = 0; goto ERROR; }
+    ncgm = 0;
+  }
+
   status = esl_newssi_Write(dbf->nssi);
   if      (status == eslEDUP)     ESL_XFAIL(status, errbuf, "SSI index construction failed:\n  %s", dbf->nssi->errbuf);        
   else if (status == eslERANGE)   ESL_XFAIL(status, errbuf, "SSI index file size exceeds maximum allowed by your filesystem"); 
@@ -126,6 +195,10 @@ main(int argc, char **argv)
   printf("SSI index for binary model file:   %s\n", dbf->ssifile);
   printf("Profiles (MSV part) pressed into:  %s\n", dbf->ffile);
   printf("Profiles (remainder) pressed into: %s\n", dbf->pfile);
+  if (dbf->sfp)
+    printf("nhmmscan score data pressed into:  %s\n", dbf->sfile);
+  if (dbf->cfp)
+    printf("Clusters of similar HMMs into:     %s (%d clusters of %d HMMs)\n", dbf->cfile, nclust, nclustered);
 
   close_dbfiles(dbf, eslOK);
   p7_bg_Destroy(bg);
@@ -136,6 +209,11 @@ main(int argc, char **argv)
 
  ERROR:
   fprintf(stderr, "%s\n", errbuf);
+  for (i = 0; i < nhmm; i++) p7_hmm_Destroy(hmmv[i]);  /* the rest of a block we failed in, or the good HMMs before a bad record */
+  for (i = 0; i < ncgm; i++) p7_profile_Destroy(cgm[i]);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  p7_hmm_ScoreDataDestroy(sd);
   close_dbfiles(dbf, status);
   p7_bg_Destroy(bg);
   p7_hmmfile_Close(hfp);
@@ -158,20 +236,30 @@ open_dbfiles(ESL_GETOPTS *go, char *basename)
   dbf->ffile   = NULL;
   dbf->pfile   = NULL;
   dbf->ssifile = NULL;
+  dbf->sfile   = NULL;
+  dbf->cfile   = NULL;
   dbf->mfp     = NULL;
   dbf->ffp     = NULL;
   dbf->pfp     = NULL;
+  dbf->sfp     = NULL;
+  dbf->cfp     = NULL;
   dbf->nssi    = NULL;
 
   if ( (status = esl_sprintf(&(dbf->ssifile), "%s.h3i", basename)) != eslOK) ESL_XFAIL(status, errbuf, "esl_sprintf() failed");
   if ( (status = esl_sprintf(&(dbf->mfile),   "%s.h3m", basename)) != eslOK) ESL_XFAIL(status, errbuf, "esl_sprintf() failed");
   if ( (status = esl_sprintf(&(dbf->ffile),   "%s.h3f", basename)) != eslOK) ESL_XFAIL(status, errbuf, "esl_sprintf() failed");
   if ( (status = esl_sprintf(&(dbf->pfile),   "%s.h3p", basename)) != eslOK) ESL_XFAIL(status, errbuf, "esl_sprintf() failed");
+  if ( (status = esl_sprintf(&(dbf->sfile),   "%s.h3s", basename)) != eslOK) ESL_XFAIL(status, errbuf, "esl_sprintf() failed");
+  if ( (status = esl_sprintf(&(dbf->cfile),   "%s.h3c", basename)) != eslOK) ESL_XFAIL(status, errbuf, "esl_sprintf() failed");
 
   if (! allow_overwrite && esl_FileExists(dbf->ssifile)) ESL_XFAIL(eslEOVERWRITE, errbuf, "SSI index file %s already exists;\nDelete old hmmpress indices first",        dbf->ssifile);
   if (! allow_overwrite && esl_FileExists(dbf->mfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary HMM file %s already exists;\nDelete old hmmpress indices first",       dbf->mfile);   
   if (! allow_overwrite && esl_FileExists(dbf->ffile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary MSV filter file %s already exists\nDelete old hmmpress indices first", dbf->ffile);   
   if (! allow_overwrite && esl_FileExists(dbf->pfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary profile file %s already exists\nDelete old hmmpress indices first",    dbf->pfile);   
+  if (! allow_overwrite && esl_FileExists(dbf->sfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary score data file %s already exists\nDelete old hmmpress indices first", dbf->sfile);   
+  if (! allow_overwrite && esl_FileExists(dbf->cfile))   ESL_XFAIL(eslEOVERWRITE, errbuf, "Binary cluster file %s already exists\nDelete old hmmpress indices first",    dbf->cfile);   
+  if (  allow_overwrite && esl_FileExists(dbf->sfile))   remove(dbf->sfile);  /* .h3s is only rewritten for a DNA/RNA database; don't leave a stale one */
+  if (  allow_overwrite && esl_FileExists(dbf->cfile))   remove(dbf->cfile);  /* ... and .h3c only with --clust */
 
   status = esl_newssi_Open(dbf->ssifile, allow_overwrite, &(dbf->nssi));
   if      (status == eslENOTFOUND)   ESL_XFAIL(status, errbuf, "failed to open SSI index %s", dbf->ssifile); 
@@ -181,6 +269,8 @@ open_dbfiles(ESL_GETOPTS *go, char *basename)
   if ((dbf->mfp = fopen(dbf->mfile, "wb")) == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "Failed to open binary HMM file %s for writing",        dbf->mfile);
   if ((dbf->ffp = fopen(dbf->ffile, "wb")) == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "Failed to open binary MSV filter file %s for writing", dbf->ffile); 
   if ((dbf->pfp = fopen(dbf->pfile, "wb")) == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "Failed to open binary profile file %s for writing",    dbf->pfile); 
+  if (esl_opt_GetBoolean(go, "--clust") && 
+      (dbf->cfp = fopen(dbf->cfile, "wb")) == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "Failed to open binary cluster file %s for writing",    dbf->cfile); 
 
   return dbf;
 
@@ -191,7 +281,7 @@ open_dbfiles(ESL_GETOPTS *go, char *basename)
 }
 
 /* If status != eslOK, then in addition to free'ing memory, also
- * remove the four output files.
+ * remove the output files.
  */
 static void
 close_dbfiles(struct dbfiles *dbf, int status)
@@ -202,6 +292,8 @@ close_dbfiles(struct dbfiles *dbf, int status)
       if (dbf->mfp)     fclose(dbf->mfp);
       if (dbf->ffp)     fclose(dbf->ffp);
       if (dbf->pfp)     fclose(dbf->pfp);
+      if (dbf->sfp)     fclose(dbf->sfp);
+      if (dbf->cfp)     fclose(dbf->cfp);
       if (dbf->nssi)    esl_newssi_Close(dbf->nssi);
 
       /* Then remove them, if status isn't OK. esl_newssi_Write() takes care of the ssifile. */
@@ -210,15 +302,66 @@ close_dbfiles(struct dbfiles *dbf, int status)
           if (esl_FileExists(dbf->mfile))   remove(dbf->mfile);
           if (esl_FileExists(dbf->ffile))   remove(dbf->ffile);
           if (esl_FileExists(dbf->pfile))   remove(dbf->pfile);
+          if (esl_FileExists(dbf->sfile))   remove(dbf->sfile);
+          if (esl_FileExists(dbf->cfile))   remove(dbf->cfile);
         }
 
       /* Finally free their names, and the structure. */
       if (dbf->mfile)   free(dbf->mfile);
       if (dbf->ffile)   free(dbf->ffile);
       if (dbf->pfile)   free(dbf->pfile);
+      if (dbf->sfile)   free(dbf->sfile);
+      if (dbf->cfile)   free(dbf->cfile);
       if (dbf->ssifile) free(dbf->ssifile);  
       free(dbf);
     }
 
 }
 
+
+/* clust_Joins()
+ * Returns TRUE if profile <gm> is similar enough to the leader <lead>
+ * of the current cluster to join it; see CLUST_MAXMDIFF, CLUST_MAXDIST.
+ */
+static int
+clust_Joins(const P7_PROFILE *lead, const P7_PROFILE *gm)
+{
+  int    M = ESL_MIN(lead->M, gm->M);
+  double d = 0.;
+  int    k, x;
+
+  if (fabs((double) (gm->M - lead->M)) > CLUST_MAXMDIFF * lead->M) return FALSE;
+
+  for (k = 1; k <= M; k++)
+    for (x = 0; x < gm->abc->K; x++)
+      d += fabs(p7P_MSC(gm, k, x) - p7P_MSC(lead, k, x));
+  return (d / (double) (M * gm->abc->K) <= CLUST_MAXDIST);
+}
+
+/* clust_Flush()
+ * Save the cluster of <n> profiles <cgm>, which occupy .h3f offsets
+ * <foff>..<fend>-1, to <cfp>, if it has more than one member (a
+ * singleton's representative would just be the model itself); bump
+ * the counts <*nclust> and <*nclustered>. Free the profiles either way.
+ */
+static int
+clust_Flush(FILE *cfp, P7_PROFILE **cgm, int n, off_t foff, off_t fend, int *nclust, int *nclustered, char *errbuf)
+{
+  P7_OM_CLUSTER *clu = NULL;
+  int            i;
+  int            status;
+
+  if (n > 1)
+    {
+      if ((clu = p7_oprofile_CreateCluster(cgm, n, foff, fend)) == NULL)  ESL_XFAIL(eslEMEM, errbuf, "Failed to create cluster representative for %s", cgm[0]->name);
+      if ((status = p7_oprofile_WriteCluster(cfp, clu))         != eslOK) ESL_XFAIL(status,  errbuf, "Failed to write cluster of %s", cgm[0]->name);
+      (*nclust)++;
+      (*nclustered) += n;
+    }
+  status = eslOK;
+
+ ERROR:
+  p7_oprofile_DestroyCluster(clu);
+  for (i = 0; i < n; i++) p7_profile_Destroy(cgm[i]);
+  return status;
+}
@@ -14,6 +14,7 @@
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
+#include "esl_gumbel.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
 #include "esl_stopwatch.h"
@@ -41,19 +42,42 @@ typedef struct {
   P7_TOPHITS       *th;          /* top hit results                         */
 } WORKER_INFO;
 
+/* State of the cluster prefilter (hmmpress --clust) over the database
+ * for one query; only the reader of the .h3f file uses it.
+ */
+typedef struct {
+  P7_OM_CLUSTER      *clu;       /* next cluster in the .h3c file; NULL if no more   */
+  const ESL_ALPHABET *abc;
+  const ESL_SQ       *qsq;       /* query sequence                                   */
+  P7_OMX             *oxf;       /* one-row DP matrix for representatives' MSV       */
+  float               nullsc;    /* null1 score of the query                         */
+  double              F1;        /* MSV filter threshold, from the pipeline          */
+  uint64_t            nmodels;   /* # of models skipped                              */
+  uint64_t            nnodes;    /* ...and their total M                             */
+} CLUSTER_SCAN;
+
+/* Longest query, in residues, that the cluster prefilter is used for.
+ * The representative's MSV score is an 8-bit, multihit score with the
+ * best match score of up to 16 members at each node, so on a long
+ * (typically multidomain) query it saturates, and a saturated bound
+ * can't skip anything: scoring representatives would only add a pass
+ * per cluster. Above this length every model is read and filtered as
+ * usual; hits are the same either way, since the prefilter only skips
+ * models that can't pass F1.
+ */
+#define CLUSTER_MAXL 100000
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
-#if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
-#else
+/* --cpu and --mpi may be combined: each MPI worker then runs its own
+ * pool of <--cpu> pipeline threads (hybrid MPI/threads mode).
+ */
 #define CPUOPTS     NULL
 #define MPIOPTS     NULL
-#endif
 
 static ESL_OPTIONS options[] = {
   /* name           type          default  env  range toggles  reqs   incomp                         help                                           docgroup*/
@@ -87,8 +111,10 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,  "1e-3", NULL, NULL,    NULL,  NULL, "--max",          "Vit threshold: promote hits w/ P <= F2",                        7 },
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,    NULL,  NULL, "--max",          "Fwd threshold: promote hits w/ P <= F3",                        7 },
   { "--nobias",     eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                              7 },
+  { "--noclust",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,            "don't use model clusters (hmmpress --clust) to skip models",    7 },
   /* Other options */
   { "--nonull2",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",                12 },
+  { "--stagetimes", eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,            "report wall time spent in each pipeline stage",                12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",           12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",    12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
@@ -116,18 +142,23 @@ struct cfg_s {
   int              do_mpi;            /* TRUE if we're doing MPI parallelization         */
   int              nproc;             /* how many MPI processes, total                   */
   int              my_rank;           /* who am I, in 0..nproc-1                         */
+  int              mpi_threads;       /* TRUE if MPI allows worker threads (hybrid mode) */
 };
 
 static char usage[]  = "[-options] <hmmdb> <seqfile>";
 static char banner[] = "search sequence(s) against a profile database";
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
-static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp);
+static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp, CLUSTER_SCAN *cs);
+
+static int  cluster_scan_Create (P7_HMMFILE *hfp, const ESL_ALPHABET *abc, WORKER_INFO *info, CLUSTER_SCAN **ret_cs);
+static int  cluster_scan_Skip   (CLUSTER_SCAN *cs, P7_HMMFILE *hfp);
+static void cluster_scan_Destroy(CLUSTER_SCAN *cs);
 
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, CLUSTER_SCAN *cs);
 static void pipeline_thread(void *arg);
 #endif
 
@@ -237,6 +268,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",            esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stagetimes") && fprintf(ofp, "# pipeline stage timing:           on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",          esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",          esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
@@ -271,6 +303,7 @@ main(int argc, char **argv)
   cfg.do_mpi     = FALSE;	           /* this gets reset below, if we init MPI */
   cfg.nproc      = 0;		           /* this gets reset below, if we init MPI */
   cfg.my_rank    = 0;		           /* this gets reset below, if we init MPI */
+  cfg.mpi_threads= FALSE;	           /* this gets reset below, if we init MPI */
 
   process_commandline(argc, argv, &go, &cfg.hmmfile, &cfg.seqfile);    
 
@@ -286,11 +319,18 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "--mpi")) 
     {
+      int mpi_thread_level;
+
       cfg.do_mpi     = TRUE;
-      MPI_Init(&argc, &argv);
+      MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &mpi_thread_level); /* only the main thread of a rank calls MPI */
       MPI_Comm_rank(MPI_COMM_WORLD, &(cfg.my_rank));
       MPI_Comm_size(MPI_COMM_WORLD, &(cfg.nproc));
 
+      /* hybrid mode needs threads beside MPI; without that, workers run serially */
+      cfg.mpi_threads = (mpi_thread_level >= MPI_THREAD_FUNNELED);
+      if (! cfg.mpi_threads && cfg.my_rank == 0 && esl_opt_IsUsed(go, "--cpu"))
+	fprintf(stderr, "Warning: MPI library doesn't support MPI_THREAD_FUNNELED; ignoring --cpu, MPI workers run serially\n");
+
       if (cfg.my_rank > 0)  status = mpi_worker(go, &cfg);
       else 		    status = mpi_master(go, &cfg);
 
@@ -339,6 +379,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  CLUSTER_SCAN    *cs       = NULL;
 #ifdef HMMER_THREADS
   P7_OM_BLOCK     *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -451,6 +492,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
 	  p7_pli_NewSeq(info[i].pli, qsq);
+	  p7_bg_SetLength(info[i].bg, qsq->n); /* same for every model; bias filter setup in the pipeline keeps it */
 	  info[i].qsq = qsq;
 
 #ifdef HMMER_THREADS
@@ -458,11 +500,19 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 	}
 
+      /* Clusters of models, if hmmpress --clust made them: the reader skips the ones the query can't reach */
+      if (hfp->cfp && ! esl_opt_GetBoolean(go, "--noclust") && qsq->n > 0 && qsq->n <= CLUSTER_MAXL)
+	{
+	  status = cluster_scan_Create(hfp, abc, info, &cs);
+	  if      (status == eslEFORMAT) p7_Fail("bad format, binary cluster file, %s:\n%s", cfg->hmmfile, hfp->errbuf);
+	  else if (status != eslOK)      p7_Fail("Unexpected error %d reading clusters of %s\n%s", status, cfg->hmmfile, hfp->errbuf);
+	}
+
 #ifdef HMMER_THREADS
-      if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp);
-      else	      hstatus = serial_loop(info, hfp);
+      if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp, cs);
+      else	      hstatus = serial_loop(info, hfp, cs);
 #else
-      hstatus = serial_loop(info, hfp);
+      hstatus = serial_loop(info, hfp, cs);
 #endif
       switch(hstatus)
 	{
@@ -482,6 +532,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  p7_tophits_Destroy(info[i].th);
 	}
 
+      /* models skipped with their clusters were still compared to the query */
+      if (cs)
+	{
+	  p7_pli_SkipModels(info->pli, cs->nmodels, cs->nnodes);
+	  cluster_scan_Destroy(cs);
+	  cs = NULL;
+	}
+
       /* Print results */
       p7_tophits_SortBySortkey(info->th);
       p7_tophits_Threshold(info->th, info->pli);
@@ -616,9 +674,49 @@ typedef struct {
   int        size;
   int        current;
   int        last;
+  uint64_t   max_length;      /* target size of one block, in bytes of the file */
   MSV_BLOCK *blocks;
 } BLOCK_LIST;
 
+/* mpi_block_length()
+ * Size of the work units the master hands out. In hybrid MPI/threads
+ * mode (--cpu given with --mpi, and MPI supports threads:
+ * <cfg->mpi_threads>) each worker keeps <--cpu> pipeline threads
+ * busy, so the blocks are scaled up accordingly; this also cuts down
+ * the number of messages the master has to handle.
+ */
+static uint64_t
+mpi_block_length(ESL_GETOPTS *go, const struct cfg_s *cfg)
+{
+  uint64_t length = MAX_BLOCK_SIZE;
+
+#ifdef HMMER_THREADS
+  if (cfg->mpi_threads && esl_opt_IsUsed(go, "--cpu") && esl_opt_GetInteger(go, "--cpu") > 1)
+    length *= esl_opt_GetInteger(go, "--cpu");
+#endif
+  return length;
+}
+
+static void mpi_serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp, struct cfg_s *cfg, MSV_BLOCK *block);
+#ifdef HMMER_THREADS
+static void mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, struct cfg_s *cfg, MSV_BLOCK *block);
+#endif
+
+/* mpi_prefetch_block()
+ * Called by a worker as soon as it has received a nonempty block: ask
+ * the master for the next block right away and post a nonblocking
+ * receive for it, so the next work unit is in flight while this one
+ * is being searched. The caller waits on <req> when it is done.
+ */
+static void
+mpi_prefetch_block(MSV_BLOCK *next, MPI_Request *req)
+{
+  int status = 0;
+
+  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+  MPI_Irecv(next, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, req);
+}
+
 /* this routine parses the database keeping track of the blocks
  * offset within the file, number of sequences and the length
  * of the block.  These blocks are passed as work units to the
@@ -660,7 +758,7 @@ int next_block(P7_HMMFILE *hfp, BLOCK_LIST *list, MSV_BLOCK *block)
   block->length = 0;
   block->count = 0;
 
-  while (block->length < MAX_BLOCK_SIZE && (status = p7_oprofile_ReadInfoMSV(hfp, &abc, &om)) == eslOK)
+  while (block->length < list->max_length && (status = p7_oprofile_ReadInfoMSV(hfp, &abc, &om)) == eslOK)
     {
       if (block->count == 0) block->offset = om->roff;
       block->length = om->eoff - block->offset + 1;
@@ -788,11 +886,12 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
  
-  ESL_ALLOC(list, sizeof(MSV_BLOCK));
+  ESL_ALLOC(list, sizeof(BLOCK_LIST));
   list->complete = 0;
   list->size     = 0;
   list->current  = 0;
   list->last     = 0;
+  list->max_length = mpi_block_length(go, cfg);
   list->blocks   = NULL;
 
   output_header(ofp, go, cfg->hmmfile, cfg->seqfile);
@@ -869,7 +968,11 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       block.length = 0;
       block.count  = 0;
 
-      /* wait for all workers to finish up their work blocks */
+      /* collect each worker's outstanding READY: the prefetch request it
+       * sent on starting its last block (or its first request, if it got
+       * no block). The empty block sent below answers it. Workers may
+       * still be searching that last block at this point.
+       */
       for (i = 1; i < cfg->nproc; ++i)
 	{
 	  if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
@@ -891,16 +994,20 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
 	}
 
-      /* merge the results of the search results */
+      /* send an empty block to signal the workers they are done */
       for (dest = 1; dest < cfg->nproc; ++dest)
+	MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+
+      /* merge the search results, taking each worker's as soon as it arrives */
+      for (i = 1; i < cfg->nproc; ++i)
 	{
 	  P7_PIPELINE     *mpi_pli   = NULL;
 	  P7_TOPHITS      *mpi_th    = NULL;
 
-	  /* send an empty block to signal the worker they are done */
-	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+	  if (MPI_Probe(MPI_ANY_SOURCE, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpistatus) != 0)
+	    mpi_failure("MPI error %d receiving tophits\n", mpistatus.MPI_ERROR);
+	  dest = mpistatus.MPI_SOURCE;
 
-	  /* wait for the results */
 	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
 
@@ -994,7 +1101,6 @@ static int
 mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 {
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
-  P7_BG           *bg       = NULL;	         /* null model                                      */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
   P7_HMMFILE      *hfp      = NULL;		 /* open HMM database file                          */
   ESL_ALPHABET    *abc      = NULL;              /* sequence alphabet                               */
@@ -1004,10 +1110,19 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              status   = eslOK;
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
+  int              i;
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures */
   int              mpi_size = 0;                 /* size of the allocated buffer */
 
+  int              ncpus    = 0;                 /* >0: hybrid mode, this rank runs <ncpus> threads */
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+#ifdef HMMER_THREADS
+  P7_OM_BLOCK     *block    = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+#endif
   MPI_Status       mpistatus;
   char             errbuf[eslERRBUFSIZE];
 
@@ -1036,15 +1151,49 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status != eslOK)        mpi_failure("Unexpected error %d opening sequence file %s\n", status, cfg->seqfile);
 
   qsq = esl_sq_CreateDigital(abc);
-  bg = p7_bg_Create(abc);
+
+#ifdef HMMER_THREADS
+  /* hybrid MPI/threads: only when --cpu or HMMER_NCPU was set
+   * (esl_opt_IsUsed() is true for either, false for the compiled-in
+   * default), so that plain one-rank-per-core MPI runs don't
+   * oversubscribe the node; and only if the MPI library supports
+   * MPI_THREAD_FUNNELED (cfg->mpi_threads).
+   */
+  if (esl_opt_IsUsed(go, "--cpu") && cfg->mpi_threads)
+    ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue = esl_workqueue_Create(ncpus * 2);
+    }
+#endif
+
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  if ((info = calloc(infocnt, sizeof(*info))) == NULL) mpi_failure("Failed to allocate worker info\n"); /* zeroed: bg etc. stay NULL if no HMM is read */
+
+  for (i = 0; i < infocnt; ++i)
+    {
+      info[i].bg    = p7_bg_Create(abc);
+#ifdef HMMER_THREADS
+      info[i].queue = queue;
+#endif
+    }
+
+#ifdef HMMER_THREADS
+  for (i = 0; i < ncpus * 2; ++i)
+    {
+      block = p7_oprofile_CreateBlock(BLOCK_SIZE);
+      if (block == NULL)    mpi_failure("Failed to allocate sequence block");
+
+      status = esl_workqueue_Init(queue, block);
+      if (status != eslOK)  mpi_failure("Failed to add block to work queue");
+    }
+#endif
 
   /* Outside loop: over each query sequence in <seqfile>. */
   while ((sstatus = esl_sqio_Read(sqfp, qsq)) == eslOK)
     {
-      P7_PIPELINE     *pli     = NULL;		/* processing pipeline                      */
-      P7_TOPHITS      *th      = NULL;        	/* top-scoring sequence hits                */
-
-      MSV_BLOCK        block;
+      MSV_BLOCK        mblock;
 
       esl_stopwatch_Start(w);
 
@@ -1054,81 +1203,61 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Open the target profile database */
       status = p7_hmmfile_OpenE(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
       if (status != eslOK) mpi_failure("Unexpected error %d in opening hmm file %s.\n", status, cfg->hmmfile);  
-  
-      /* Create processing pipeline and hit list */
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
-      pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
-
-      p7_pli_NewSeq(pli, qsq);
 
-      /* receive a sequence block from the master */
-      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-      while (block.count > 0)
+#ifdef HMMER_THREADS
+      /* if we are threaded, create a lock to prevent multiple readers */
+      if (ncpus > 0)
 	{
-	  uint64_t length = 0;
-	  uint64_t count  = block.count;
-
-	  hstatus = p7_oprofile_Position(hfp, block.offset);
-	  if (hstatus != eslOK) mpi_failure("Cannot position optimized model to %ld\n", block.offset);
-
-	  while (count > 0 && (hstatus = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
-	    {
-	      length = om->eoff - block.offset + 1;
+	  status = p7_hmmfile_CreateLock(hfp);
+	  if (status != eslOK) mpi_failure("Unexpected error %d creating lock\n", status);
+	}
+#endif
+  
+      for (i = 0; i < infocnt; ++i)
+	{
+	  /* Create processing pipeline and hit list */
+	  info[i].th  = p7_tophits_Create(); 
+	  info[i].pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
-	      p7_pli_NewModel(pli, om, bg);
-	      p7_bg_SetLength(bg, qsq->n);
-	      p7_oprofile_ReconfigLength(om, qsq->n);
-	      
-	      p7_Pipeline(pli, om, bg, qsq, NULL, th);
-	      
-	      p7_oprofile_Destroy(om);
-	      p7_pipeline_Reuse(pli);
+	  p7_pli_NewSeq(info[i].pli, qsq);
+	  p7_bg_SetLength(info[i].bg, qsq->n); /* same for every model; bias filter setup in the pipeline keeps it */
+	  info[i].qsq = qsq;
 
-	      --count;
-	    }
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
 
-	  /* check the status of reading the hmm */
+      /* receive the first block of models from the master */
+      MPI_Recv(&mblock, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
 
-	  /* lets do a little bit of sanity checking here to make sure the blocks are the same */
-	  if (count > 0)              
-	    {
-	      switch(hstatus)
-		{
-		case eslEFORMAT:
-		  mpi_failure("bad file format in HMM file %s",              cfg->hmmfile);
-		  break;
-		case eslEINCOMPAT:
-		  mpi_failure("HMM file %s contains different alphabets",    cfg->hmmfile);
-		  break;
-		case eslOK:
-		case eslEOF:
-		  mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n", block.count, block.count-count, block.offset);
-		  break;
-		default:
-		  mpi_failure("Unexpected error %d in reading HMMs from %s", hstatus, cfg->hmmfile); 
-		}
-	    }
-	  if (block.length != length) 
-	    mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length, block.offset);
+#ifdef HMMER_THREADS
+      if (ncpus > 0) mpi_thread_loop(threadObj, queue, hfp, cfg, &mblock);
+      else           mpi_serial_loop(info, hfp, cfg, &mblock);
+#else
+      mpi_serial_loop(info, hfp, cfg, &mblock);
+#endif
 
-	  /* inform the master we need another block of sequences */
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      /* merge the results of this rank's threads */
+      for (i = 1; i < infocnt; ++i)
+	{
+	  p7_tophits_Merge(info[0].th, info[i].th);
+	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
-	  /* wait for the next block of sequences */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
 	}
 
       esl_stopwatch_Stop(w);
 
       /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_tophits_MPISend(info->th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_pipeline_MPISend(info->pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
 
       p7_hmmfile_Close(hfp);
-      p7_pipeline_Destroy(pli);
-      p7_tophits_Destroy(th);
+      p7_pipeline_Destroy(info->pli);
+      p7_tophits_Destroy(info->th);
       esl_sq_Reuse(qsq);
     } /* end outer loop over query HMMs */
   if (sstatus == eslEFORMAT) 
@@ -1141,7 +1270,21 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   if (mpi_buf != NULL) free(mpi_buf);
 
-  p7_bg_Destroy(bg);
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+	p7_oprofile_DestroyBlock(block);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+
+  free(info);
 
   esl_sq_Destroy(qsq);
   esl_stopwatch_Destroy(w);
@@ -1150,21 +1293,186 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   return eslOK;
 }
+
+/* mpi_block_failure()
+ * A worker read fewer models than the master said were in a block;
+ * report why.
+ */
+static void
+mpi_block_failure(struct cfg_s *cfg, MSV_BLOCK *block, uint64_t count, int hstatus)
+{
+  switch(hstatus)
+    {
+    case eslEFORMAT:
+      mpi_failure("bad file format in HMM file %s",              cfg->hmmfile);
+      break;
+    case eslEINCOMPAT:
+      mpi_failure("HMM file %s contains different alphabets",    cfg->hmmfile);
+      break;
+    case eslOK:
+    case eslEOF:
+      mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n", block->count, block->count-count, block->offset);
+      break;
+    default:
+      mpi_failure("Unexpected error %d in reading HMMs from %s", hstatus, cfg->hmmfile); 
+    }
+}
+
+/* mpi_serial_loop()
+ * Search the query against the blocks of models the master hands this
+ * (unthreaded) worker, starting with <block>, which the caller has
+ * already received. Returns when the master sends an empty block.
+ */
+static void
+mpi_serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp, struct cfg_s *cfg, MSV_BLOCK *block)
+{
+  P7_OPROFILE   *om  = NULL;
+  ESL_ALPHABET  *abc = NULL;
+  MSV_BLOCK      next;
+  MPI_Request    req;
+  MPI_Status     mpistatus;
+  uint64_t       length;
+  uint64_t       count;
+  int            hstatus = eslOK;
+
+  while (block->count > 0)
+    {
+      mpi_prefetch_block(&next, &req);
+
+      length = 0;
+      count  = block->count;
+
+      hstatus = p7_oprofile_Position(hfp, block->offset);
+      if (hstatus != eslOK) mpi_failure("Cannot position optimized model to %ld\n", block->offset);
+
+      while (count > 0 && (hstatus = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
+	{
+	  length = om->eoff - block->offset + 1;
+
+	  p7_pli_NewModel(info->pli, om, info->bg);
+	  p7_oprofile_ReconfigMSVLength(om, info->qsq->n); /* the pipeline does the rest, if the model gets that far */
+	      
+	  p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
+	      
+	  p7_oprofile_Destroy(om);
+	  p7_pipeline_Reuse(info->pli);
+
+	  --count;
+	}
+
+      /* lets do a little bit of sanity checking here to make sure the blocks are the same */
+      if (count > 0)               mpi_block_failure(cfg, block, count, hstatus);
+      if (block->length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block->length, length, block->offset);
+
+      /* the next block of models should be waiting for us by now */
+      MPI_Wait(&req, &mpistatus);
+      *block = next;
+    }
+
+  esl_alphabet_Destroy(abc);
+}
+
+#ifdef HMMER_THREADS
+/* mpi_thread_loop()
+ * Hybrid MPI/threads version of mpi_serial_loop(): the rank's main
+ * thread reads the MSV part of the models in each block the master
+ * hands out and feeds them, in P7_OM_BLOCKs, to the same
+ * pipeline_thread() workers used by the threaded serial version. All
+ * MPI communication stays in this (main) thread.
+ */
+static void
+mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, struct cfg_s *cfg, MSV_BLOCK *block)
+{
+  P7_OM_BLOCK   *omblock;
+  ESL_ALPHABET  *abc = NULL;
+  void          *newBlock;
+  MSV_BLOCK      next;
+  MPI_Request    req;
+  MPI_Status     mpistatus;
+  uint64_t       length;
+  uint64_t       count;
+  int            status;
+  int            hstatus = eslOK;
+  int            i;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  while (block->count > 0)
+    {
+      mpi_prefetch_block(&next, &req);
+
+      length = 0;
+      count  = block->count;
+
+      hstatus = p7_oprofile_Position(hfp, block->offset);
+      if (hstatus != eslOK) mpi_failure("Cannot position optimized model to %ld\n", block->offset);
+
+      while (count > 0 && hstatus == eslOK)
+	{
+	  omblock = (P7_OM_BLOCK *) newBlock;
+	  omblock->count = 0;
+	  while (omblock->count < omblock->listSize && count > 0)
+	    {
+	      hstatus = p7_oprofile_ReadMSV(hfp, &abc, &omblock->list[omblock->count]);
+	      if (hstatus != eslOK) break;
+
+	      length = omblock->list[omblock->count]->eoff - block->offset + 1;
+	      omblock->count++;
+	      --count;
+	    }
+
+	  if (omblock->count > 0)
+	    {
+	      status = esl_workqueue_ReaderUpdate(queue, omblock, &newBlock);
+	      if (status != eslOK) mpi_failure("Work queue reader failed");
+	    }
+	}
+
+      if (count > 0)               mpi_block_failure(cfg, block, count, hstatus);
+      if (block->length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block->length, length, block->offset);
+
+      MPI_Wait(&req, &mpistatus);
+      *block = next;
+    }
+
+  /* an empty block tells each pipeline thread that this query is done */
+  for (i = 0; i < esl_threads_GetWorkerCount(obj); ++i)
+    {
+      omblock = (P7_OM_BLOCK *) newBlock;
+      omblock->count = 0;
+      status = esl_workqueue_ReaderUpdate(queue, omblock, &newBlock);
+      if (status != eslOK) mpi_failure("Work queue reader failed");
+    }
+  omblock = (P7_OM_BLOCK *) newBlock;
+  omblock->count = 0;
+  status = esl_workqueue_ReaderUpdate(queue, omblock, NULL);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);
+
+  esl_alphabet_Destroy(abc);
+}
+#endif /*HMMER_THREADS*/
 #endif /*HMMER_MPI*/
 
 static int
-serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
+serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp, CLUSTER_SCAN *cs)
 {
   int            status;
 
   P7_OPROFILE   *om;
   ESL_ALPHABET  *abc = NULL;
   /* Main loop: */
-  while ((status = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
+  while ((status = (cs ? cluster_scan_Skip(cs, hfp) : eslOK)) == eslOK &&
+	 (status = p7_oprofile_ReadMSV(hfp, &abc, &om))       == eslOK)
     {
       p7_pli_NewModel(info->pli, om, info->bg);
-      p7_bg_SetLength(info->bg, info->qsq->n);
-      p7_oprofile_ReconfigLength(om, info->qsq->n);
+      p7_oprofile_ReconfigMSVLength(om, info->qsq->n); /* the pipeline does the rest, if the model gets that far */
 
       status = p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
       if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
@@ -1178,9 +1486,126 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
   return status;
 }
 
+
+/* cluster_scan_Create()
+ * Set up the cluster prefilter for query <info->qsq>, scanning
+ * against the open database <hfp> in alphabet <abc>: read its first
+ * cluster. Returns <eslOK> and the new state in <*ret_cs>; or
+ * <eslEFORMAT>/<eslEINCOMPAT>, with a message in <hfp->errbuf>, if
+ * the .h3c file is bad.
+ */
+static int
+cluster_scan_Create(P7_HMMFILE *hfp, const ESL_ALPHABET *abc, WORKER_INFO *info, CLUSTER_SCAN **ret_cs)
+{
+  CLUSTER_SCAN *cs = NULL;
+  int           status;
+
+  ESL_ALLOC(cs, sizeof(CLUSTER_SCAN));
+  cs->clu     = NULL;
+  cs->abc     = abc;
+  cs->qsq     = info->qsq;
+  cs->oxf     = NULL;
+  cs->F1      = info->pli->F1;
+  cs->nmodels = 0;
+  cs->nnodes  = 0;
+  p7_bg_NullOne(info->bg, cs->qsq->dsq, cs->qsq->n, &(cs->nullsc));  /* as in the pipeline; <bg> length is already set to the query's */
+
+  if ((cs->oxf = p7_omx_Create(100, 0, cs->qsq->n)) == NULL) { status = eslEMEM; goto ERROR; }
+  status = p7_oprofile_ReadCluster(hfp, abc, &(cs->clu));
+  if (status != eslOK && status != eslEOF) goto ERROR;
+
+  *ret_cs = cs;
+  return eslOK;
+
+ ERROR:
+  cluster_scan_Destroy(cs);
+  *ret_cs = NULL;
+  return status;
+}
+
+/* cluster_scan_Skip()
+ * Called before reading each profile from the .h3f file of <hfp>. If
+ * the next profile starts a cluster, score the cluster's
+ * representative; if its MSV score is too low to pass the F1
+ * threshold for any member (see p7_oprofile_CreateCluster() for why
+ * it's an upper bound), reposition <hfp> past the cluster and count
+ * the members as skipped. The next cluster may start right there, so
+ * repeat. Returns <eslOK>, or an error from reading the .h3c file or
+ * repositioning <hfp>.
+ */
+static int
+cluster_scan_Skip(CLUSTER_SCAN *cs, P7_HMMFILE *hfp)
+{
+  P7_OM_CLUSTER *clu;
+  off_t          off;
+  float          usc, sc;
+  int            i;
+  int            status;
+
+  while ((clu = cs->clu) != NULL)
+    {
+      if ((off = ftello(hfp->ffp)) == -1) ESL_EXCEPTION(eslESYS, "ftello() failed");
+      if (clu->foff > off) break;
+
+      if (clu->foff == off)
+	{
+	  p7_omx_GrowTo(cs->oxf, clu->rep->M, 0, cs->qsq->n);
+	  p7_oprofile_ReconfigMSVLength(clu->rep, cs->qsq->n);
+	  p7_MSVFilter(cs->qsq->dsq, cs->qsq->n, clu->rep, cs->oxf, &usc);
+	  sc = (usc - cs->nullsc) / eslCONST_LOG2;
+
+	  for (i = 0; i < clu->nmodels; i++)
+	    if (esl_gumbel_surv(sc, clu->mmu[i], clu->mlambda[i]) <= cs->F1) break;
+	  if (i == clu->nmodels)
+	    {
+	      if ((status = p7_oprofile_Position(hfp, clu->fend)) != eslOK) return status;
+	      cs->nmodels += clu->nmodels;
+	      cs->nnodes  += clu->nnodes;
+	    }
+	}
+
+      p7_oprofile_DestroyCluster(clu);
+      status = p7_oprofile_ReadCluster(hfp, cs->abc, &(cs->clu));
+      if (status != eslOK && status != eslEOF) return status;
+    }
+  return eslOK;
+}
+
+static void
+cluster_scan_Destroy(CLUSTER_SCAN *cs)
+{
+  if (cs == NULL) return;
+  p7_oprofile_DestroyCluster(cs->clu);
+  p7_omx_Destroy(cs->oxf);
+  free(cs);
+}
+
+
 #ifdef HMMER_THREADS
+/* cluster_ReadBlockMSV()
+ * p7_oprofile_ReadBlockMSV(), skipping clusters with cluster_scan_Skip().
+ */
+static int
+cluster_ReadBlockMSV(P7_HMMFILE *hfp, CLUSTER_SCAN *cs, ESL_ALPHABET **byp_abc, P7_OM_BLOCK *block)
+{
+  int i;
+  int status = eslOK;
+
+  block->count = 0;
+  for (i = 0; i < block->listSize; ++i)
+    {
+      if ((status = cluster_scan_Skip(cs, hfp))                          != eslOK) break;
+      if ((status = p7_oprofile_ReadMSV(hfp, byp_abc, &block->list[i])) != eslOK) break;
+      ++block->count;
+    }
+
+  /* EOF will be returned only in the case were no profiles were read */
+  if (status == eslEOF && i > 0) status = eslOK;
+  return status;
+}
+
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, CLUSTER_SCAN *cs)
 {
   int  status   = eslOK;
   int  sstatus  = eslOK;
@@ -1199,7 +1624,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
   while (sstatus == eslOK)
     {
       block = (P7_OM_BLOCK *) newBlock;
-      sstatus = p7_oprofile_ReadBlockMSV(hfp, &abc, block);
+      sstatus = (cs ? cluster_ReadBlockMSV(hfp, cs, &abc, block) : p7_oprofile_ReadBlockMSV(hfp, &abc, block));
       if (sstatus == eslEOF)
 	{
 	  if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
@@ -1258,8 +1683,7 @@ pipeline_thread(void *arg)
       P7_OPROFILE *om = block->list[i];
 
       p7_pli_NewModel(info->pli, om, info->bg);
-      p7_bg_SetLength(info->bg, info->qsq->n);
-      p7_oprofile_ReconfigLength(om, info->qsq->n);
+      p7_oprofile_ReconfigMSVLength(om, info->qsq->n); /* the pipeline does the rest, if the model gets that far */
 
       status = p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
       if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
@@ -49,13 +49,11 @@ typedef struct {
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
-#if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
-#else
+/* --cpu and --mpi may be combined: each MPI worker then runs its own
+ * pool of <--cpu> pipeline threads (hybrid MPI/threads mode).
+ */
 #define CPUOPTS     NULL
 #define MPIOPTS     NULL
-#endif
 
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles   reqs   incomp              help                                                      docgroup*/
@@ -90,9 +88,15 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,  "1e-3", NULL, NULL,    NULL,  NULL, "--max",          "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,    NULL,  NULL, "--max",          "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                             7 },
+  { "--seedidx",    eslARG_INFILE,  NULL, NULL, NULL,    NULL,  NULL, "--max",          "skip targets with no seed word in k-mer index <f> (makehmmerdb --kmer)", 7 },
+  { "--seedT",      eslARG_REAL,  "10.0", NULL, NULL,    NULL,"--seedidx", NULL,        "seed index: bit score threshold for the query's seed words",    7 },
+  { "--seedsample", eslARG_REAL,   "0.0", NULL, "0<=x<=1",NULL,"--seedidx", NULL,       "seed index: also search random fraction <x> of other targets",  7 },
+  { "--clusters",   eslARG_INFILE,  NULL, NULL, NULL,    NULL,  NULL, "--max",          "search clustered targets via representatives, w/ map <f> (makehmmerdb --clusters)", 7 },
+  { "--clumargin",  eslARG_REAL, "100.0", NULL, "x>=1",  NULL,"--clusters", NULL,       "expand clusters whose representative passes filters at P <= F1,F2 * <x>", 7 },
 
 /* Other options */
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",               12 },
+  { "--stagetimes", eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "report wall time spent in each pipeline stage",               12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
@@ -133,6 +137,7 @@ struct cfg_s {
   int              do_mpi;            /* TRUE if we're doing MPI parallelization         */
   int              nproc;             /* how many MPI processes, total                   */
   int              my_rank;           /* who am I, in 0..nproc-1                         */
+  int              mpi_threads;       /* TRUE if MPI allows worker threads (hybrid mode) */
 
   char             *firstseq_key;     /* name of the first sequence in the restricted db range */
   int              n_targetseq;       /* number of sequences in the restricted range */
@@ -248,11 +253,17 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--F2")         && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")         && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")     && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seedidx")    && fprintf(ofp, "# k-mer seed index of targets:     %s\n",             esl_opt_GetString(go, "--seedidx"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seedT")      && fprintf(ofp, "# seed word score threshold:       >= %g bits\n",    esl_opt_GetReal(go, "--seedT"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seedsample") && fprintf(ofp, "# seed index random sample:        %g\n",             esl_opt_GetReal(go, "--seedsample"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--clusters")   && fprintf(ofp, "# cluster map of targets:          %s\n",             esl_opt_GetString(go, "--clusters"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--clumargin")  && fprintf(ofp, "# cluster expansion margin:        %g x F1,F2\n",     esl_opt_GetReal(go, "--clumargin"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") && fprintf(ofp, "# Restrict db to start at seq key: %s\n",            esl_opt_GetString(go, "--restrictdb_stkey"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_n")     && fprintf(ofp, "# Restrict db to # target seqs:    %d\n",            esl_opt_GetInteger(go, "--restrictdb_n")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--ssifile")          && fprintf(ofp, "# Override ssi file to:            %s\n",            esl_opt_GetString(go, "--ssifile"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stagetimes") && fprintf(ofp, "# pipeline stage timing:           on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
@@ -287,6 +298,7 @@ main(int argc, char **argv)
   cfg.do_mpi     = FALSE;	           /* this gets reset below, if we init MPI */
   cfg.nproc      = 0;		           /* this gets reset below, if we init MPI */
   cfg.my_rank    = 0;		           /* this gets reset below, if we init MPI */
+  cfg.mpi_threads= FALSE;	           /* this gets reset below, if we init MPI */
   cfg.firstseq_key = NULL;
   cfg.n_targetseq  = -1;
 
@@ -302,6 +314,12 @@ main(int argc, char **argv)
   if ( cfg.n_targetseq != -1 && cfg.n_targetseq < 1 )
     p7_Fail("--restrictdb_n must be >= 1\n");
 
+  /* a seed index identifies targets by their ordinal position in the whole database */
+  if (esl_opt_IsOn(go, "--seedidx") && (cfg.firstseq_key != NULL || cfg.n_targetseq != -1))
+    p7_Fail("--seedidx can't be used with --restrictdb_stkey or --restrictdb_n\n");
+  if (esl_opt_IsOn(go, "--clusters") && (cfg.firstseq_key != NULL || cfg.n_targetseq != -1))
+    p7_Fail("--clusters can't be used with --restrictdb_stkey or --restrictdb_n\n");
+
 
   /* Figure out who we are, and send control there: 
    * we might be an MPI master, an MPI worker, or a serial program.
@@ -315,11 +333,21 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "--mpi")) 
     {
+      int mpi_thread_level;
+
+      if (esl_opt_IsOn(go, "--seedidx"))  p7_Fail("--seedidx can't be used with --mpi\n");
+      if (esl_opt_IsOn(go, "--clusters")) p7_Fail("--clusters can't be used with --mpi\n");
+
       cfg.do_mpi     = TRUE;
-      MPI_Init(&argc, &argv);
+      MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &mpi_thread_level); /* only the main thread of a rank calls MPI */
       MPI_Comm_rank(MPI_COMM_WORLD, &(cfg.my_rank));
       MPI_Comm_size(MPI_COMM_WORLD, &(cfg.nproc));
 
+      /* hybrid mode needs threads beside MPI; without that, workers run serially */
+      cfg.mpi_threads = (mpi_thread_level >= MPI_THREAD_FUNNELED);
+      if (! cfg.mpi_threads && cfg.my_rank == 0 && esl_opt_IsUsed(go, "--cpu"))
+	fprintf(stderr, "Warning: MPI library doesn't support MPI_THREAD_FUNNELED; ignoring --cpu, MPI workers run serially\n");
+
       if (cfg.my_rank > 0)  status = mpi_worker(go, &cfg);
       else 		    status = mpi_master(go, &cfg);
 
@@ -371,6 +399,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_SEEDINDEX    *sx       = NULL;              /* k-mer seed index of the targets (--seedidx)     */
+  P7_SEEDSEL      *sel      = NULL;              /* targets it selects for the current query        */
+  ESL_RANDOMNESS  *seedrng  = NULL;              /* for its random sample of other targets          */
+  P7_CLUMAP       *cm       = NULL;              /* cluster map of the targets (--clusters)         */
+  uint8_t         *cluopen  = NULL;              /* [0..cm->nclust-1]: cluster expanded for this query */
+  uint64_t         nclurep  = 0;                 /* # representatives screened, this query          */
+  uint64_t         ncluopen = 0;                 /* # clusters expanded, this query                 */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -439,6 +474,33 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       output_header(ofp, go, cfg->hmmfile, cfg->dbfile);
       esl_sqfile_SetDigital(dbfp, abc); //ReadBlock requires knowledge of the alphabet to decide how best to read blocks
 
+      if (esl_opt_IsOn(go, "--seedidx"))
+	{
+	  FILE *sxfp;
+
+	  if ((sxfp = fopen(esl_opt_GetString(go, "--seedidx"), "rb")) == NULL) p7_Fail("Failed to open seed index %s for reading\n", esl_opt_GetString(go, "--seedidx"));
+	  status = p7_seedindex_Read(sxfp, abc, &sx, errbuf);
+	  if (status != eslOK) p7_Fail("Failed to read seed index %s:\n%s\n", esl_opt_GetString(go, "--seedidx"), errbuf);
+	  status = p7_seedindex_Validate(sx, cfg->dbfile, errbuf);
+	  if (status != eslOK) p7_Fail("Seed index %s doesn't go with %s:\n%s\nRebuild it with makehmmerdb --kmer\n", esl_opt_GetString(go, "--seedidx"), cfg->dbfile, errbuf);
+	  fclose(sxfp);
+	  seedrng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "--seed"));
+	}
+
+      if (esl_opt_IsOn(go, "--clusters"))
+	{
+	  FILE *cmfp;
+
+	  if (! esl_sqfile_IsRewindable(dbfp)) p7_Fail("Target sequence file %s isn't rewindable; can't search it with --clusters\n", cfg->dbfile);
+	  if ((cmfp = fopen(esl_opt_GetString(go, "--clusters"), "rb")) == NULL) p7_Fail("Failed to open cluster map %s for reading\n", esl_opt_GetString(go, "--clusters"));
+	  status = p7_clumap_Read(cmfp, &cm, errbuf);
+	  if (status != eslOK) p7_Fail("Failed to read cluster map %s:\n%s\n", esl_opt_GetString(go, "--clusters"), errbuf);
+	  status = p7_clumap_Validate(cm, cfg->dbfile, errbuf);
+	  if (status != eslOK) p7_Fail("Cluster map %s doesn't go with %s:\n%s\nRebuild it with makehmmerdb --clusters\n", esl_opt_GetString(go, "--clusters"), cfg->dbfile, errbuf);
+	  fclose(cmfp);
+	  ESL_ALLOC(cluopen, sizeof(uint8_t) * ESL_MAX(1, cm->nclust));
+	}
+
       for (i = 0; i < infocnt; ++i)
 	{
 	  info[i].bg    = p7_bg_Create(abc);
@@ -494,12 +556,61 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
       p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
 
+      /* Targets the seed index can't rule out for this query (--seedidx) */
+      if (sx && p7_seedindex_Select(sx, gm, esl_opt_GetReal(go, "--seedT"), esl_opt_GetReal(go, "--seedsample"), seedrng, &sel) != eslOK)
+        p7_Fail("Seed index selection failed for query %s\n", hmm->name);
+
+      /* With a cluster map (--clusters), a first pass over the targets
+       * screens only the cluster representatives, with the filters at
+       * thresholds relaxed by --clumargin, and expands the clusters of
+       * those that pass; the ordinary pass below then skips the members
+       * of the other clusters.
+       */
+      if (cm)
+	{
+	  memset(cluopen, 0, sizeof(uint8_t) * cm->nclust);
+	  for (i = 0; i < infocnt; ++i)
+	    {
+	      info[i].th  = p7_tophits_Create();
+	      info[i].om  = p7_oprofile_Clone(om);
+	      info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	      info[i].pli->seedsel = sel;
+	      status = p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+	      if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
+	      p7_pli_SetClusters(info[i].pli, cm, cluopen, TRUE, esl_opt_GetReal(go, "--clumargin"));
+#ifdef HMMER_THREADS
+	      if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	    }
+
+#ifdef HMMER_THREADS
+	  if (ncpus > 0)  sstatus = thread_loop(threadObj, queue, dbfp, cfg->n_targetseq);
+	  else            sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+#else
+	  sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+#endif
+	  if      (sstatus == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+	  else if (sstatus != eslEOF)     esl_fatal("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
+
+	  for (nclurep = ncluopen = 0, i = 0; i < infocnt; ++i)
+	    {
+	      nclurep  += info[i].pli->n_clu_rep;
+	      ncluopen += info[i].pli->n_clu_open;
+	      p7_pipeline_Destroy(info[i].pli);
+	      p7_tophits_Destroy(info[i].th);
+	      p7_oprofile_Destroy(info[i].om);
+	    }
+	  esl_sqfile_Position(dbfp, 0);
+	}
+
       for (i = 0; i < infocnt; ++i)
       {
         /* Create processing pipeline and hit list */
         info[i].th  = p7_tophits_Create();
         info[i].om  = p7_oprofile_Clone(om);
         info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+        info[i].pli->seedsel = sel;
+        if (cm) p7_pli_SetClusters(info[i].pli, cm, cluopen, FALSE, 1.0);
         status = p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
         if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
 
@@ -538,6 +649,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         p7_oprofile_Destroy(info[i].om);
       }
 
+      /* The file's size was checked against the seed index's and the cluster
+       * map's before searching; this catches an edit that kept the size, which
+       * would have skipped the wrong targets.
+       */
+      if (sx && (info->pli->nseqs != sx->nseq || info->pli->nres != sx->nres))
+        p7_Fail("Seed index %s was built for %" PRIu64 " sequences (%" PRIu64 " residues), but %s has %" PRIu64 " (%" PRIu64 "); rebuild it with makehmmerdb --kmer\n",
+                esl_opt_GetString(go, "--seedidx"), sx->nseq, sx->nres, cfg->dbfile, info->pli->nseqs, info->pli->nres);
+      if (cm && (info->pli->nseqs != cm->nseq || info->pli->nres != cm->nres))
+        p7_Fail("Cluster map %s was built for %" PRIu64 " sequences (%" PRIu64 " residues), but %s has %" PRIu64 " (%" PRIu64 "); rebuild it with makehmmerdb --clusters\n",
+                esl_opt_GetString(go, "--clusters"), cm->nseq, cm->nres, cfg->dbfile, info->pli->nseqs, info->pli->nres);
+      if (cm) { info->pli->n_clu_rep = nclurep; info->pli->n_clu_open = ncluopen; } /* from the first pass */
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(info->th);
       p7_tophits_Threshold(info->th, info->pli);
@@ -578,6 +701,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_oprofile_Destroy(info->om);
       p7_oprofile_Destroy(om);
       p7_profile_Destroy(gm);
+      p7_seedsel_Destroy(sel);
+      sel = NULL;
       p7_hmm_Destroy(hmm);
 
       hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
@@ -616,6 +741,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  p7_seedindex_Destroy(sx);
+  if (seedrng) esl_randomness_Destroy(seedrng);
+  p7_clumap_Destroy(cm);
+  free(cluopen);
   p7_hmmfile_Close(hfp);
   esl_sqfile_Close(dbfp);
   esl_alphabet_Destroy(abc);
@@ -701,9 +830,49 @@ typedef struct {
   int        size;
   int        current;
   int        last;
+  uint64_t   max_length;      /* target size of one block, in bytes of the file */
   SEQ_BLOCK *blocks;
 } BLOCK_LIST;
 
+/* mpi_block_length()
+ * Size of the work units the master hands out. In hybrid MPI/threads
+ * mode (--cpu given with --mpi, and MPI supports threads:
+ * <cfg->mpi_threads>) each worker keeps <--cpu> pipeline threads
+ * busy, so the blocks are scaled up accordingly; this also cuts down
+ * the number of messages the master has to handle.
+ */
+static uint64_t
+mpi_block_length(ESL_GETOPTS *go, const struct cfg_s *cfg)
+{
+  uint64_t length = MAX_BLOCK_SIZE;
+
+#ifdef HMMER_THREADS
+  if (cfg->mpi_threads && esl_opt_IsUsed(go, "--cpu") && esl_opt_GetInteger(go, "--cpu") > 1)
+    length *= esl_opt_GetInteger(go, "--cpu");
+#endif
+  return length;
+}
+
+static void mpi_serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, ESL_SQ *dbsq, SEQ_BLOCK *block);
+#ifdef HMMER_THREADS
+static void mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, SEQ_BLOCK *block);
+#endif
+
+/* mpi_prefetch_block()
+ * Called by a worker as soon as it has received a nonempty block: ask
+ * the master for the next block right away and post a nonblocking
+ * receive for it, so the next work unit is in flight while this one
+ * is being searched. The caller waits on <req> when it is done.
+ */
+static void
+mpi_prefetch_block(SEQ_BLOCK *next, MPI_Request *req)
+{
+  int status = 0;
+
+  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+  MPI_Irecv(next, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, req);
+}
+
 /* this routine parses the database keeping track of the blocks
  * offset within the file, number of sequences and the length
  * of the block.  These blocks are passed as work units to the
@@ -745,7 +914,7 @@ int next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block,
 
   esl_sq_Reuse(sq);
   if (n_targetseqs == 0) status = eslEOF; //this is to handle the end-case of a restrictdb scenario, where no more targets are required, and we want to mark the list as complete
-  while (block->length < MAX_BLOCK_SIZE && (n_targetseqs <0 || block->count < n_targetseqs) && (status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
+  while (block->length < list->max_length && (n_targetseqs <0 || block->count < n_targetseqs) && (status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
     {
       if (block->count == 0) block->offset = sq->roff;
       block->length = sq->eoff - block->offset + 1;
@@ -887,6 +1056,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   list->size     = 0;
   list->current  = 0;
   list->last     = 0;
+  list->max_length = mpi_block_length(go, cfg);
   list->blocks   = NULL;
 
   /* <abc> is not known 'til first HMM is read. */
@@ -981,7 +1151,11 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       block.length = 0;
       block.count  = 0;
 
-      /* wait for all workers to finish up their work blocks */
+      /* collect each worker's outstanding READY: the prefetch request it
+       * sent on starting its last block (or its first request, if it got
+       * no block). The empty block sent below answers it. Workers may
+       * still be searching that last block at this point.
+       */
       for (i = 1; i < cfg->nproc; ++i)
 	{
 	  if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
@@ -1003,16 +1177,20 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
 	}
 
-      /* merge the results of the search results */
+      /* send an empty block to signal the workers they are done */
       for (dest = 1; dest < cfg->nproc; ++dest)
+	MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+
+      /* merge the search results, taking each worker's as soon as it arrives */
+      for (i = 1; i < cfg->nproc; ++i)
 	{
 	  P7_PIPELINE     *mpi_pli   = NULL;
 	  P7_TOPHITS      *mpi_th    = NULL;
 
-	  /* send an empty block to signal the worker they are done */
-	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+	  if (MPI_Probe(MPI_ANY_SOURCE, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpistatus) != 0)
+	    mpi_failure("MPI error %d receiving tophits\n", mpistatus.MPI_ERROR);
+	  dest = mpistatus.MPI_SOURCE;
 
-	  /* wait for the results */
 	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
 
@@ -1136,18 +1314,25 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   P7_HMM          *hmm      = NULL;              /* one HMM query                                   */
   ESL_SQ          *dbsq     = NULL;              /* one target sequence (digital)                   */
   ESL_ALPHABET    *abc      = NULL;              /* digital alphabet                                */
-  P7_BG           *bg       = NULL;	         /* null model                                      */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
   int              dbfmt    = eslSQFILE_UNKNOWN; /* format code for sequence database file          */
   ESL_STOPWATCH   *w;
   int              status   = eslOK;
   int              hstatus  = eslOK;
-  int              sstatus  = eslOK;
+  int              i;
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures           */
   int              mpi_size = 0;                 /* size of the allocated buffer                    */
 
+  int              ncpus    = 0;                 /* >0: hybrid mode, this rank runs <ncpus> threads */
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+#ifdef HMMER_THREADS
+  ESL_SQ_BLOCK    *block    = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+#endif
   MPI_Status       mpistatus;
   char             errbuf[eslERRBUFSIZE];
 
@@ -1166,14 +1351,51 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   mpi_failure("File format problem in trying to open HMM file %s.\n%s\n",                cfg->hmmfile, errbuf);
   else if (status != eslOK)        mpi_failure("Unexpected error %d in opening HMM file %s.\n%s\n",               status, cfg->hmmfile, errbuf);  
 
+#ifdef HMMER_THREADS
+  /* hybrid MPI/threads: only when --cpu or HMMER_NCPU was set
+   * (esl_opt_IsUsed() is true for either, false for the compiled-in
+   * default), so that plain one-rank-per-core MPI runs don't
+   * oversubscribe the node; and only if the MPI library supports
+   * MPI_THREAD_FUNNELED (cfg->mpi_threads).
+   */
+  if (esl_opt_IsUsed(go, "--cpu") && cfg->mpi_threads)
+    ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue = esl_workqueue_Create(ncpus * 2);
+    }
+#endif
+
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  if ((info = calloc(infocnt, sizeof(*info))) == NULL) mpi_failure("Failed to allocate worker info\n"); /* zeroed: bg etc. stay NULL if no HMM is read */
+
   /* <abc> is not known 'til first HMM is read. */
   hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
   if (hstatus == eslOK)
     {
       /* One-time initializations after alphabet <abc> becomes known */
       dbsq = esl_sq_CreateDigital(abc);
-      bg = p7_bg_Create(abc);
       esl_sqfile_SetDigital(dbfp, abc);
+
+      for (i = 0; i < infocnt; ++i)
+	{
+	  info[i].bg    = p7_bg_Create(abc);
+#ifdef HMMER_THREADS
+	  info[i].queue = queue;
+#endif
+	}
+
+#ifdef HMMER_THREADS
+      for (i = 0; i < ncpus * 2; ++i)
+	{
+	  block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
+	  if (block == NULL)            mpi_failure("Failed to allocate sequence block");
+
+	  status = esl_workqueue_Init(queue, block);
+	  if (status != eslOK)          mpi_failure("Failed to add block to work queue");
+	}
+#endif
     }
   
   /* Outer loop: over each query HMM in <hmmfile>. */
@@ -1181,10 +1403,8 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       P7_PROFILE      *gm      = NULL;
       P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
-      P7_PIPELINE     *pli     = NULL;
-      P7_TOPHITS      *th      = NULL;
 
-      SEQ_BLOCK        block;
+      SEQ_BLOCK        sblock;
 
       esl_stopwatch_Start(w);
 
@@ -1194,59 +1414,51 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Convert to an optimized model */
       gm = p7_profile_Create (hmm->M, abc);
       om = p7_oprofile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL);
+      p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL);
       p7_oprofile_Convert(gm, om);
 
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-      p7_pli_NewModel(pli, om, bg);
-
-      /* receive a sequence block from the master */
-      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-      while (block.count > 0)
+      for (i = 0; i < infocnt; ++i)
 	{
-	  uint64_t length = 0;
-	  uint64_t count  = block.count;
+	  info[i].th  = p7_tophits_Create();
+	  info[i].om  = p7_oprofile_Clone(om);
+	  info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	  p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
-	  status = esl_sqfile_Position(dbfp, block.offset);
-	  if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
-
-	  while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
-	    {
-	      length = dbsq->eoff - block.offset + 1;
-
-	      p7_pli_NewSeq(pli, dbsq);
-	      p7_bg_SetLength(bg, dbsq->n);
-	      p7_oprofile_ReconfigLength(om, dbsq->n);
-      
-	      p7_Pipeline(pli, om, bg, dbsq, NULL, th);
-
-	      esl_sq_Reuse(dbsq);
-	      p7_pipeline_Reuse(pli);
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
 
-	      --count;
-	    }
+      /* receive the first sequence block from the master */
+      MPI_Recv(&sblock, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
 
-	  /* lets do a little bit of sanity checking here to make sure the blocks are the same */
-	  if (count > 0)              mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block.count,  block.count - count, block.offset);
-	  if (block.length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length,              block.offset);
+#ifdef HMMER_THREADS
+      if (ncpus > 0) mpi_thread_loop(threadObj, queue, dbfp, &sblock);
+      else           mpi_serial_loop(info, dbfp, dbsq, &sblock);
+#else
+      mpi_serial_loop(info, dbfp, dbsq, &sblock);
+#endif
 
-	  /* inform the master we need another block of sequences */
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      /* merge the results of this rank's threads */
+      for (i = 1; i < infocnt; ++i)
+	{
+	  p7_tophits_Merge(info[0].th, info[i].th);
+	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
-	  /* wait for the next block of sequences */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
+	  p7_oprofile_Destroy(info[i].om);
 	}
 
       esl_stopwatch_Stop(w);
 
       /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_tophits_MPISend(info->th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_pipeline_MPISend(info->pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
 
-      p7_pipeline_Destroy(pli);
-      p7_tophits_Destroy(th);
+      p7_pipeline_Destroy(info->pli);
+      p7_tophits_Destroy(info->th);
+      p7_oprofile_Destroy(info->om);
       p7_oprofile_Destroy(om);
       p7_profile_Destroy(gm);
       p7_hmm_Destroy(hmm);
@@ -1274,15 +1486,158 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   if (mpi_buf != NULL) free(mpi_buf);
 
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+	esl_sq_DestroyBlock(block);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+
+  free(info);
   p7_hmmfile_Close(hfp);
   esl_sqfile_Close(dbfp);
 
-  p7_bg_Destroy(bg);
   esl_sq_Destroy(dbsq);
+  esl_alphabet_Destroy(abc);
   esl_stopwatch_Destroy(w);
 
   return eslOK;
 }
+
+/* mpi_serial_loop()
+ * Search the blocks the master hands this (unthreaded) worker for the
+ * current query, starting with <block>, which the caller has already
+ * received. Returns when the master sends an empty block.
+ */
+static void
+mpi_serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, ESL_SQ *dbsq, SEQ_BLOCK *block)
+{
+  SEQ_BLOCK    next;
+  MPI_Request  req;
+  MPI_Status   mpistatus;
+  uint64_t     length;
+  uint64_t     count;
+  int          status;
+  int          sstatus = eslOK;
+
+  while (block->count > 0)
+    {
+      mpi_prefetch_block(&next, &req);
+
+      length = 0;
+      count  = block->count;
+
+      status = esl_sqfile_Position(dbfp, block->offset);
+      if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block->offset);
+
+      while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+	{
+	  length = dbsq->eoff - block->offset + 1;
+
+	  p7_pli_NewSeq(info->pli, dbsq);
+	  p7_bg_SetLength(info->bg, dbsq->n);
+	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
+
+	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+
+	  esl_sq_Reuse(dbsq);
+	  p7_pipeline_Reuse(info->pli);
+
+	  --count;
+	}
+
+      /* lets do a little bit of sanity checking here to make sure the blocks are the same */
+      if (count > 0)               mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block->count,  block->count - count, block->offset);
+      if (block->length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block->length, length,               block->offset);
+
+      /* the next block of sequences should be waiting for us by now */
+      MPI_Wait(&req, &mpistatus);
+      *block = next;
+    }
+}
+
+#ifdef HMMER_THREADS
+/* mpi_thread_loop()
+ * Hybrid MPI/threads version of mpi_serial_loop(): the rank's main
+ * thread reads the sequences of each block the master hands out and
+ * feeds them, in ESL_SQ_BLOCKs, to the same pipeline_thread() workers
+ * used by the threaded serial version. All MPI communication stays in
+ * this (main) thread.
+ */
+static void
+mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, SEQ_BLOCK *block)
+{
+  ESL_SQ_BLOCK *sqblock;
+  void         *newBlock;
+  SEQ_BLOCK     next;
+  MPI_Request   req;
+  MPI_Status    mpistatus;
+  uint64_t      length;
+  uint64_t      count;
+  int           status;
+  int           sstatus = eslOK;
+  int           i;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  while (block->count > 0)
+    {
+      mpi_prefetch_block(&next, &req);
+
+      length = 0;
+      count  = block->count;
+
+      status = esl_sqfile_Position(dbfp, block->offset);
+      if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block->offset);
+
+      while (count > 0)
+	{
+	  sqblock = (ESL_SQ_BLOCK *) newBlock;
+	  sstatus = esl_sqio_ReadBlock(dbfp, sqblock, -1, (int) ESL_MIN(count, (uint64_t) BLOCK_SIZE), /*max_init_window=*/FALSE, FALSE);
+	  if (sstatus != eslOK) break;
+
+	  length = sqblock->list[sqblock->count-1].eoff - block->offset + 1;
+	  count -= sqblock->count;
+
+	  status = esl_workqueue_ReaderUpdate(queue, sqblock, &newBlock);
+	  if (status != eslOK) mpi_failure("Work queue reader failed");
+	}
+
+      if (count > 0)               mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block->count,  block->count - count, block->offset);
+      if (block->length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block->length, length,               block->offset);
+
+      MPI_Wait(&req, &mpistatus);
+      *block = next;
+    }
+
+  /* an empty block tells each pipeline thread that this query is done */
+  for (i = 0; i < esl_threads_GetWorkerCount(obj); ++i)
+    {
+      sqblock = (ESL_SQ_BLOCK *) newBlock;
+      sqblock->count = 0;
+      status = esl_workqueue_ReaderUpdate(queue, sqblock, &newBlock);
+      if (status != eslOK) mpi_failure("Work queue reader failed");
+    }
+  sqblock = (ESL_SQ_BLOCK *) newBlock;
+  sqblock->count = 0;
+  status = esl_workqueue_ReaderUpdate(queue, sqblock, NULL);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);
+}
+#endif /*HMMER_THREADS*/
 #endif /*HMMER_MPI*/
 
 static int
@@ -1297,6 +1652,7 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
   /* Main loop: */
   while ( (n_targetseqs==-1 || seq_cnt<n_targetseqs) &&  (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
   {
+      dbsq->idx = seq_cnt;   /* ordinal in the database, for a seed index */
       p7_pli_NewSeq(info->pli, dbsq);
       p7_bg_SetLength(info->bg, dbsq->n);
       p7_oprofile_ReconfigLength(info->om, dbsq->n);
@@ -1323,6 +1679,8 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
   int  status  = eslOK;
   int  sstatus = eslOK;
   int  eofCount = 0;
+  int64_t nread  = 0;
+  int  i;
   ESL_SQ_BLOCK *block;
   void         *newBlock;
 
@@ -1344,6 +1702,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
       } else {
         sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
         n_targetseqs -= block->count;
+        for (i = 0; i < block->count; i++) block->list[i].idx = nread++; /* ordinals in the database, for a seed index */
       }
 
       if (sstatus == eslEOF)
@@ -28,9 +28,19 @@
 #include "esl_ratematrix.h"
 #include "esl_stopwatch.h"
 #include "esl_vectorops.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
 
 #include "hmmer.h"
 
+/* The N random sequences for each model are generated in blocks of
+ * this many, each block from its own random number stream seeded
+ * from --seed and the block number; so the sequences (and scores)
+ * are the same whichever thread or process scores each block.
+ */
+#define SIM_BLOCKSIZE 100
+
 #define ALGORITHMS "--fwd,--vit,--hyb,--msv"           /* Exclusive choice for scoring algorithms */
 #define STYLES     "--fs,--sw,--ls,--s"	               /* Exclusive choice for alignment mode     */
 
@@ -41,6 +51,9 @@ static ESL_OPTIONS options[] = {
   { "-v",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "verbose: print scores",                             1 },
   { "-L",        eslARG_INT,    "100", NULL, "n>0",     NULL,  NULL, NULL, "length of random target seqs",                      1 },
   { "-N",        eslARG_INT,   "1000", NULL, "n>0",     NULL,  NULL, NULL, "number of random target seqs",                      1 },
+#ifdef HMMER_THREADS
+  { "--cpu",     eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL, NULL, "number of parallel CPU workers to use for multithreads", 1 },
+#endif
 #ifdef HMMER_MPI
   { "--mpi",     eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "run as an MPI parallel program",                    1 },
 #endif
@@ -123,12 +136,20 @@ struct cfg_s {
 static int  init_master_cfg(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf);
 
 static void serial_master  (ESL_GETOPTS *go, struct cfg_s *cfg);
+#ifdef HMMER_THREADS
+static void thread_master  (ESL_GETOPTS *go, struct cfg_s *cfg, int ncpus);
+#endif
 #ifdef HMMER_MPI
 static void mpi_master     (ESL_GETOPTS *go, struct cfg_s *cfg);
 static void mpi_worker     (ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  minimum_mpi_working_buffer(ESL_GETOPTS *go, int N, int *ret_wn);
 #endif 
 static int process_workunit   (ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double *ret_mu, double *ret_lambda);
+static int setup_workunit     (ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, P7_BG *bg, ESL_RANDOMNESS *r,
+			       P7_PROFILE **ret_gm, P7_OPROFILE **ret_om, uint32_t *ret_seed, double *ret_mu, double *ret_lambda);
+static int simulate_block     (ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, uint32_t seed, int b,
+			       double *scores, int *alilens);
+static uint32_t block_seed    (uint32_t seed, int b);
 static int output_result      (ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double mu, double lambda);
 static int output_filter_power(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, double mu, double lambda);
 
@@ -140,6 +161,9 @@ main(int argc, char **argv)
   ESL_GETOPTS     *go	   = NULL;   
   ESL_STOPWATCH   *w       = esl_stopwatch_Create();
   struct cfg_s     cfg;
+#ifdef HMMER_THREADS
+  int              ncpus;
+#endif
 
 
   /* Process command line options.
@@ -243,8 +267,16 @@ main(int argc, char **argv)
     }
   else
 #endif /*HMMER_MPI*/
+#ifdef HMMER_THREADS
+  if ((ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount())) > 0)
+    {
+      thread_master(go, &cfg, ncpus);
+      esl_stopwatch_Stop(w);
+    }
+  else
+#endif /*HMMER_THREADS*/
     {		
-      /* No MPI? Then we're just the serial master. */
+      /* No MPI or threads? Then we're just the serial master. */
       serial_master(go, &cfg);
       esl_stopwatch_Stop(w);
     }      
@@ -390,6 +422,161 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 }
 
 
+#ifdef HMMER_THREADS
+/* thread_master()
+ * The threaded version of hmmsim.
+ *
+ * Work units are split into tasks: a setup (profile configuration
+ * and E-value parameter fits, see setup_workunit()) and then the
+ * blocks of N sequences (simulate_block()), which may be done
+ * concurrently. The master reads up to <ncpus> models at a time;
+ * p7_ThreadedFor() does their setups, then all their blocks, oldest
+ * model first, on <ncpus> threads; then the master outputs them in
+ * input order.
+ *
+ * Scores are the same as in serial or MPI mode, for any <ncpus>.
+ */
+typedef struct {
+  P7_HMM      *hmm;
+  P7_BG       *bg;		/* own copy of cfg->bg: --bgcomp changes it */
+  P7_PROFILE  *gm;
+  P7_OPROFILE *om;
+  uint32_t     seed;		/* block RNG streams are derived from this */
+  double       mu, lambda;
+  double      *xv;		/* results: array of N scores */
+  int         *av;		/* optional results: array of N alignment lengths */
+} SIM_MODEL;
+
+typedef struct {
+  ESL_GETOPTS     *go;
+  struct cfg_s    *cfg;
+  SIM_MODEL      **win;		/* models read this round, in input order */
+  int              nmodels;	/* # of models in <win>                   */
+  int              nblocks;	/* # of blocks of sequences per model     */
+} SIM_WORKSET;
+
+static void
+sim_model_Destroy(SIM_MODEL *m)
+{
+  if (m == NULL) return;
+  p7_hmm_Destroy(m->hmm);
+  p7_bg_Destroy(m->bg);
+  p7_profile_Destroy(m->gm);
+  p7_oprofile_Destroy(m->om);
+  if (m->xv != NULL) free(m->xv);
+  if (m->av != NULL) free(m->av);
+  free(m);
+}
+
+/* Setups use a per-thread RNG, reseeded by each setup_workunit(). */
+static int
+sim_setup_init(void *arg, int tid, void **ret_tls)
+{
+  ESL_RANDOMNESS *r = esl_randomness_Create(0);
+
+  *ret_tls = r;
+  return (r == NULL ? eslEMEM : eslOK);
+}
+
+static void
+sim_setup_fini(void *tls)
+{
+  esl_randomness_Destroy((ESL_RANDOMNESS *) tls);
+}
+
+static int
+sim_setup_work(void *arg, void *tls, int i, char *errbuf)
+{
+  SIM_WORKSET *ws = (SIM_WORKSET *) arg;
+  SIM_MODEL   *m  = ws->win[i];
+
+  return setup_workunit(ws->go, ws->cfg, errbuf, m->hmm, m->bg, (ESL_RANDOMNESS *) tls, &(m->gm), &(m->om), &(m->seed), &(m->mu), &(m->lambda));
+}
+
+/* Iteration <i> is block <i % nblocks> of model <i / nblocks>. */
+static int
+sim_block_work(void *arg, void *tls, int i, char *errbuf)
+{
+  SIM_WORKSET *ws = (SIM_WORKSET *) arg;
+  SIM_MODEL   *m  = ws->win[i / ws->nblocks];
+
+  return simulate_block(ws->go, ws->cfg, errbuf, m->gm, m->om, m->bg, m->seed, i % ws->nblocks, m->xv, m->av);
+}
+
+static void
+thread_master(ESL_GETOPTS *go, struct cfg_s *cfg, int ncpus)
+{
+  SIM_WORKSET   ws;
+  SIM_MODEL    *m         = NULL;
+  P7_HMM       *hmm       = NULL;
+  int           have_work = TRUE;
+  int           i;
+  char          errbuf[eslERRBUFSIZE];
+  int           status;
+
+  if ((status = init_master_cfg(go, cfg, errbuf)) != eslOK) p7_Fail(errbuf);
+
+  ws.go      = go;
+  ws.cfg     = cfg;
+  ws.nmodels = 0;
+  ws.nblocks = (cfg->N + SIM_BLOCKSIZE - 1) / SIM_BLOCKSIZE;
+  ESL_ALLOC(ws.win, sizeof(SIM_MODEL *) * ncpus); /* enough models to give every thread a setup */
+
+  while (have_work)
+    {
+      /* Read the next round of models */
+      for (ws.nmodels = 0; ws.nmodels < ncpus; ws.nmodels++)
+	{
+	  status = p7_hmmfile_Read(cfg->hfp, &(cfg->abc), &hmm);
+	  if      (status == eslEOF)       { have_work = FALSE; break; }
+	  else if (status == eslEOD)       p7_Fail("read failed, HMM file %s may be truncated?", cfg->hmmfile);
+	  else if (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s",             cfg->hmmfile);
+	  else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   cfg->hmmfile);
+	  else if (status != eslOK)        p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile);
+
+	  if (cfg->bg == NULL) {
+	    if (esl_opt_GetBoolean(go, "--bgflat")) cfg->bg = p7_bg_CreateUniform(cfg->abc);
+	    else                                    cfg->bg = p7_bg_Create(cfg->abc);
+	    p7_bg_SetLength(cfg->bg, esl_opt_GetInteger(go, "-L"));  /* set the null model background length in both master and workers. */
+	  }
+
+	  ESL_ALLOC(m, sizeof(SIM_MODEL));
+	  m->hmm = hmm;
+	  m->bg  = p7_bg_Clone(cfg->bg);
+	  m->gm  = NULL;
+	  m->om  = NULL;
+	  m->xv  = NULL;
+	  m->av  = NULL;
+	  ESL_ALLOC(m->xv, sizeof(double) * cfg->N);
+	  if (esl_opt_GetBoolean(go, "-a")) ESL_ALLOC(m->av, sizeof(int) * cfg->N);
+	  if (m->bg == NULL) p7_Fail("allocation failed");
+	  ws.win[ws.nmodels] = m;
+	  hmm = NULL;
+	  m   = NULL;
+	}
+      if (ws.nmodels == 0) break;
+
+      if (p7_ThreadedFor(ncpus, ws.nmodels,              &ws, sim_setup_init, sim_setup_work, sim_setup_fini, NULL, errbuf) != eslOK) p7_Fail(errbuf);
+      if (p7_ThreadedFor(ncpus, ws.nmodels * ws.nblocks, &ws, NULL,           sim_block_work, NULL,           NULL, errbuf) != eslOK) p7_Fail(errbuf);
+
+      for (i = 0; i < ws.nmodels; i++)
+	{
+	  m = ws.win[i];
+	  if (output_result(go, cfg, errbuf, m->hmm, m->xv, m->av, m->mu, m->lambda) != eslOK) p7_Fail(errbuf);
+	  sim_model_Destroy(m);
+	}
+      m = NULL;
+    }
+
+  free(ws.win);
+  return;
+
+ ERROR:
+  p7_Fail("Allocation error in thread_master");
+}
+#endif /*HMMER_THREADS*/
+
+
 #ifdef HMMER_MPI
 /* mpi_master()
  * The MPI version of hmmsim.
@@ -608,18 +795,41 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 static int
 process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double *ret_mu, double *ret_lambda)
 {
-  int             L   = esl_opt_GetInteger(go, "-L");
   P7_PROFILE     *gm  = NULL;
   P7_OPROFILE    *om  = NULL;
-  P7_GMX         *gx  = NULL;
-  P7_OMX         *ox  = NULL;
-  P7_TRACE       *tr  = NULL;
-  ESL_DSQ        *dsq = NULL;
-  int             i;
+  uint32_t        seed;
+  int             b;
   int             status;
-  int    scounts[p7T_NSTATETYPES]; /* state usage counts from a trace */
-  float  sc;
-  float  nullsc;
+
+  if ((status = setup_workunit(go, cfg, errbuf, hmm, cfg->bg, cfg->r, &gm, &om, &seed, ret_mu, ret_lambda)) != eslOK) goto ERROR;
+
+  for (b = 0; b * SIM_BLOCKSIZE < cfg->N; b++)
+    if ((status = simulate_block(go, cfg, errbuf, gm, om, cfg->bg, seed, b, scores, alilens)) != eslOK) goto ERROR;
+
+  status = eslOK;
+ ERROR:
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  return status;
+}
+
+
+/* setup_workunit()
+ *
+ * First half of a work unit: configure the profiles <*ret_gm>,
+ * <*ret_om> for <hmm> and the background <bg>, and determine the
+ * E-value parameters <*ret_mu>, <*ret_lambda>, using the RNG <r>
+ * reseeded to --seed. <*ret_seed> is the seed that the N sequences'
+ * block streams are derived from (see simulate_block()); it's --seed,
+ * or the arbitrary seed chosen for --seed 0.
+ */
+static int
+setup_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, P7_BG *bg, ESL_RANDOMNESS *r,
+	       P7_PROFILE **ret_gm, P7_OPROFILE **ret_om, uint32_t *ret_seed, double *ret_mu, double *ret_lambda)
+{
+  int             L   = esl_opt_GetInteger(go, "-L");
+  P7_PROFILE     *gm  = NULL;
+  P7_OPROFILE    *om  = NULL;
   double mu, lambda;
   int    EmL          = esl_opt_GetInteger(go, "--EmL");
   int    EmN          = esl_opt_GetInteger(go, "--EmN");
@@ -628,11 +838,11 @@ process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm,
   int    EfL          = esl_opt_GetInteger(go, "--EfL");
   int    EfN          = esl_opt_GetInteger(go, "--EfN");
   double Eft          = esl_opt_GetReal   (go, "--Eft");
-  float  nu           = esl_opt_GetReal   (go, "--nu");
+  int    status;
 
 
   // reseed the RNG to its initial value, to allow reproduction of results
-  esl_randomness_Init(cfg->r, esl_opt_GetInteger(go, "--seed"));
+  esl_randomness_Init(r, esl_opt_GetInteger(go, "--seed"));
   /* Optionally set a custom background, determined by model composition;
    * an experimental hack. 
    */
@@ -641,44 +851,90 @@ process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm,
       float *p = NULL;
       float  KL;
 
-      p7_hmm_CompositionKLD(hmm, cfg->bg, &KL, &p);
-      esl_vec_FCopy(p, cfg->abc->K, cfg->bg->f);
+      p7_hmm_CompositionKLD(hmm, bg, &KL, &p);
+      esl_vec_FCopy(p, cfg->abc->K, bg->f);
     }
 
   /* First pass: configure gm, om for local until after we've determined mu, lambda, tau params */
-  gm = p7_profile_Create(hmm->M, cfg->abc);
-  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_LOCAL);
-  om = p7_oprofile_Create(gm->M, cfg->abc);
+  if ((gm = p7_profile_Create(hmm->M, cfg->abc)) == NULL) ESL_XFAIL(eslEMEM, errbuf, "allocation failure");
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  if ((om = p7_oprofile_Create(gm->M, cfg->abc)) == NULL) ESL_XFAIL(eslEMEM, errbuf, "allocation failure");
   p7_oprofile_Convert(gm, om);
 
   /* Determine E-value parameters (in addition to any that are already in the HMM structure)  */
-  p7_Lambda(hmm, cfg->bg, &lambda);
-  if      (esl_opt_GetBoolean(go, "--vit"))  p7_ViterbiMu(cfg->r, om, cfg->bg, EvL, EvN, lambda,      &mu);
-  else if (esl_opt_GetBoolean(go, "--msv"))  p7_MSVMu    (cfg->r, om, cfg->bg, EmL, EmN, lambda,      &mu);
-  else if (esl_opt_GetBoolean(go, "--fwd"))  p7_Tau      (cfg->r, om, cfg->bg, EfL, EfN, lambda, Eft, &mu);
+  p7_Lambda(hmm, bg, &lambda);
+  if      (esl_opt_GetBoolean(go, "--vit"))  p7_ViterbiMu(r, om, bg, EvL, EvN, lambda,      &mu);
+  else if (esl_opt_GetBoolean(go, "--msv"))  p7_MSVMu    (r, om, bg, EmL, EmN, lambda,      &mu);
+  else if (esl_opt_GetBoolean(go, "--fwd"))  p7_Tau      (r, om, bg, EfL, EfN, lambda, Eft, &mu);
   else    mu = 0.0;		/* undetermined, for Hybrid, at least for now. */
 
   /* Now reconfig the models however we were asked to */
-  if      (esl_opt_GetBoolean(go, "--fs"))  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_LOCAL);
-  else if (esl_opt_GetBoolean(go, "--sw"))  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_UNILOCAL);
-  else if (esl_opt_GetBoolean(go, "--ls"))  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_GLOCAL);
-  else if (esl_opt_GetBoolean(go, "--s"))   p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_UNIGLOCAL);
+  if      (esl_opt_GetBoolean(go, "--fs"))  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  else if (esl_opt_GetBoolean(go, "--sw"))  p7_ProfileConfig(hmm, bg, gm, L, p7_UNILOCAL);
+  else if (esl_opt_GetBoolean(go, "--ls"))  p7_ProfileConfig(hmm, bg, gm, L, p7_GLOCAL);
+  else if (esl_opt_GetBoolean(go, "--s"))   p7_ProfileConfig(hmm, bg, gm, L, p7_UNIGLOCAL);
 
-  if (esl_opt_GetBoolean(go, "--x-no-lengthmodel")) elide_length_model(gm, cfg->bg);
+  if (esl_opt_GetBoolean(go, "--x-no-lengthmodel")) elide_length_model(gm, bg);
 
   p7_oprofile_Convert(gm, om);
-  p7_bg_SetLength    (cfg->bg, L);
+  p7_bg_SetLength    (bg, L);
+
+  *ret_gm     = gm;
+  *ret_om     = om;
+  *ret_seed   = esl_randomness_GetSeed(r);
+  *ret_mu     = mu;
+  *ret_lambda = lambda;
+  return eslOK;
+
+ ERROR:
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  *ret_gm = NULL;
+  *ret_om = NULL;
+  return status;
+}
+
 
-  /* Remaining allocations */
+/* simulate_block()
+ *
+ * Second half of a work unit: score block <b> of the N random
+ * sequences against the configured profiles <gm>, <om>, putting
+ * results in <scores[i]> (and <alilens[i]> with -a) for sequences 
+ * i = b*SIM_BLOCKSIZE .. up to the next block or N-1.
+ *
+ * Each block's sequences come from their own RNG, seeded from <seed>
+ * and <b>, so blocks can be done in any order, by any thread.
+ * <gm>, <om>, <bg> aren't changed.
+ */
+static int
+simulate_block(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, uint32_t seed, int b,
+	       double *scores, int *alilens)
+{
+  int             L   = esl_opt_GetInteger(go, "-L");
+  ESL_RANDOMNESS *r   = NULL;
+  P7_GMX         *gx  = NULL;
+  P7_OMX         *ox  = NULL;
+  P7_TRACE       *tr  = NULL;
+  ESL_DSQ        *dsq = NULL;
+  int             i;
+  int             status;
+  int    scounts[p7T_NSTATETYPES]; /* state usage counts from a trace */
+  float  sc;
+  float  nullsc;
+  float  nu           = esl_opt_GetReal   (go, "--nu");
+
+  /* Allocations */
+  r  = esl_randomness_Create(block_seed(seed, b));
   gx = p7_gmx_Create(gm->M, L);
   ox = p7_omx_Create(gm->M, 0, L);
   ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
   tr = p7_trace_Create();
+  if (r == NULL || gx == NULL || ox == NULL || tr == NULL) { status = eslEMEM; goto ERROR; }
 
-  /* Collect scores from N random sequences of length L  */
-  for (i = 0; i < cfg->N; i++)
+  /* Collect scores from this block of random sequences of length L  */
+  for (i = b * SIM_BLOCKSIZE; i < cfg->N && i < (b+1) * SIM_BLOCKSIZE; i++)
     {
-      esl_rsq_xfIID(cfg->r, cfg->bg->f, cfg->abc->K, L, dsq);
+      esl_rsq_xfIID(r, bg->f, cfg->abc->K, L, dsq);
 
       if (esl_opt_GetBoolean(go, "--fast")) 
 	{
@@ -711,25 +967,39 @@ process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm,
 	  p7_trace_Reuse(tr);
 	}
 
-      p7_bg_NullOne(cfg->bg, dsq, L, &nullsc);
+      p7_bg_NullOne(bg, dsq, L, &nullsc);
       scores[i] = (sc - nullsc) / eslCONST_LOG2;
     }
 
-  *ret_mu     = mu;
-  *ret_lambda = lambda;
   status      = eslOK;
 
  ERROR:
   if (dsq != NULL) free(dsq);
+  if (r   != NULL) esl_randomness_Destroy(r);
   p7_omx_Destroy(ox);
-  p7_oprofile_Destroy(om);
-  p7_profile_Destroy(gm);
   p7_gmx_Destroy(gx);
   p7_trace_Destroy(tr);
   if (status == eslEMEM) sprintf(errbuf, "allocation failure");
   return status;
 }
 
+/* block_seed()
+ * The seed for block <b>'s RNG, given the work unit's <seed>: the two
+ * are mixed by a 32-bit integer hash (the MurmurHash3 finalizer), so
+ * neighboring blocks don't get neighboring seeds. Never 0, which
+ * would ask Easel for an arbitrary seed.
+ */
+static uint32_t
+block_seed(uint32_t seed, int b)
+{
+  uint32_t x = seed ^ (0x9e3779b9u * (uint32_t) (b+1));
+
+  x ^= x >> 16;  x *= 0x85ebca6bu;
+  x ^= x >> 13;  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return (x == 0 ? 1 : x);
+}
+
 
 static int 
 output_result(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double pmu, double plambda)
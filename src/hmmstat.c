@@ -1,4 +1,10 @@
 /* hmmstat: display summary statistics for an HMM database.
+ *
+ * Models are read a block at a time (p7_hmmfile_ReadBlock()), and
+ * statistics for the models in a block are computed in parallel,
+ * then printed in file order. The optional --fwd statistic samples
+ * sequences from each model and scores them with the striped SIMD
+ * Forward parser.
  */
 #include "p7_config.h"
 
@@ -9,18 +15,62 @@
 
 #include "easel.h"
 #include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_sq.h"
 
 #include "hmmer.h"
 
 static ESL_OPTIONS options[] = {
   /* name           type       default   env  range    toggles    reqs       incomp  help   docgroup*/
   { "-h",        eslARG_NONE,    FALSE,  NULL, NULL,    NULL,  NULL,           NULL, "show brief help on version and usage",            0 },
+  { "--fwd",     eslARG_NONE,    FALSE,  NULL, NULL,    NULL,  NULL,           NULL, "add mean Forward bit score of sampled sequences",  0 },
+  { "--maxlen",  eslARG_NONE,    FALSE,  NULL, NULL,    NULL,  NULL,           NULL, "add maximum expected hit length (nhmmer W)",       0 },
+  { "--nsample", eslARG_INT,     "100",  NULL, "n>0",   NULL,  "--fwd",        NULL, "number of sequences sampled per model for --fwd",  0 },
+  { "--seed",    eslARG_INT,      "42",  NULL, "n>=0",  NULL,  NULL,           NULL, "set RNG seed to <n> (0: one-time arbitrary seed)",0 },
+#ifdef HMMER_THREADS
+  { "--cpu",     eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,           NULL, "number of parallel CPU workers to use",           0 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
 static char usage[]  = "[-options] <hmmfile>";
 static char banner[] = "display summary statistics for a profile file";
 
+#define STAT_BLOCKSIZE 256	/* # of models per p7_hmmfile_ReadBlock() */
+#define STAT_SAMPLE_L  350	/* target length model for --fwd, as p7_MeanForwardScore() */
+
+/* One row of the output table. */
+struct modelstats {
+  double relent;		/* mean match relative entropy (bits)        */
+  double info;			/* mean match information content (bits)     */
+  double prelE;			/* mean positional relative entropy (bits)   */
+  float  KL;			/* composition KL divergence from bg (bits)  */
+  double fwdsc;			/* --fwd: mean Forward bit score of samples  */
+  int    maxlen;		/* --maxlen: p7_Builder_MaxLength()          */
+};
+
+/* Statistics for one block of models, shared by the threads of
+ * p7_ThreadedFor(); each thread has its own STAT_WORKER.
+ */
+typedef struct {
+  ESL_GETOPTS        *go;
+  const P7_BG        *bg;
+  P7_HMM            **hmmv;
+  struct modelstats  *statv;
+  int                 first;	/* overall index of hmmv[0], for RNG seeding */
+} STAT_WORKSET;
+
+typedef struct {
+  P7_BG              *bg;	/* own copy: --fwd changes its length model */
+  ESL_RANDOMNESS     *r;
+} STAT_WORKER;
+
+static int  stat_init(void *arg, int tid, void **ret_tls);
+static int  stat_work(void *arg, void *tls, int i, char *errbuf);
+static void stat_fini(void *tls);
+static int  model_stats(ESL_GETOPTS *go, P7_HMM *hmm, P7_BG *bg, ESL_RANDOMNESS *r, struct modelstats *st);
+static int  mean_forward_score(const P7_HMM *hmm, P7_BG *bg, ESL_RANDOMNESS *r, int N, double *ret_sc);
+
 
 int
 main(int argc, char **argv)
@@ -30,10 +80,14 @@ main(int argc, char **argv)
   char            *hmmfile = NULL;
   P7_HMMFILE      *hfp     = NULL;
   P7_HMM          *hmm     = NULL;
+  P7_HMM          *hmmv[STAT_BLOCKSIZE];
+  struct modelstats statv[STAT_BLOCKSIZE];
+  STAT_WORKSET     ws;
   P7_BG           *bg      = NULL;
   int              nhmm;	
-  double           x;
-  float            KL;
+  int              nread;
+  int              ncpu    = 0;
+  int              i;
   char             errbuf[eslERRBUFSIZE];
   int              status;
 
@@ -83,43 +137,67 @@ main(int argc, char **argv)
   else if (status != eslOK)        p7_Fail("Unexpected error %d in opening HMM file %s.\n%s\n",               status, hmmfile, errbuf);  
 
 
+#ifdef HMMER_THREADS
+  ncpu = esl_opt_GetInteger(go, "--cpu");
+#endif
+  impl_Init();
+  p7_FLogsumInit();
+
   /* Output header 
    */
   printf("#\n");
-  printf("# %-4s %-20s %-12s %8s %8s %6s %6s %6s %6s %6s\n", "idx",  "name",                 "accession",    "nseq",     "eff_nseq", "M",      "relent", "info",   "p relE", "compKL");
-  printf("# %-4s %-20s %-12s %8s %8s %6s %6s %6s %6s %6s\n", "----", "--------------------", "------------", "--------", "--------", "------", "------", "------", "------", "------");
+  printf("# %-4s %-20s %-12s %8s %8s %6s %6s %6s %6s %6s", "idx",  "name",                 "accession",    "nseq",     "eff_nseq", "M",      "relent", "info",   "p relE", "compKL");
+  if (esl_opt_GetBoolean(go, "--fwd"))    printf(" %6s", "fwdsc");
+  if (esl_opt_GetBoolean(go, "--maxlen")) printf(" %6s", "maxL");
+  printf("\n");
+  printf("# %-4s %-20s %-12s %8s %8s %6s %6s %6s %6s %6s", "----", "--------------------", "------------", "--------", "--------", "------", "------", "------", "------", "------");
+  if (esl_opt_GetBoolean(go, "--fwd"))    printf(" %6s", "------");
+  if (esl_opt_GetBoolean(go, "--maxlen")) printf(" %6s", "------");
+  printf("\n");
 
 
-  /* Main body: read HMMs one at a time, print one line of stats per profile
+  /* Main body: read HMMs a block at a time, compute their stats in
+   * parallel, print one line of stats per profile in file order.
    */
   nhmm = 0;
-  while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) != eslEOF) 
+  while ((status = p7_hmmfile_ReadBlock(hfp, ncpu, &abc, hmmv, STAT_BLOCKSIZE, &nread)) == eslOK)
     {
-      if      (status == eslEOD)       esl_fatal("read failed, HMM file %s may be truncated?", hmmfile);
-      else if (status == eslEFORMAT)   esl_fatal("bad file format in HMM file %s",             hmmfile);
-      else if (status == eslEINCOMPAT) esl_fatal("HMM file %s contains different alphabets",   hmmfile);
-      else if (status != eslOK)        esl_fatal("Unexpected error in reading HMMs from %s",   hmmfile);
-      nhmm++;
-
       if (bg == NULL) bg = p7_bg_Create(abc);
 
-      p7_MeanPositionRelativeEntropy(hmm, bg, &x); 
-      p7_hmm_CompositionKLD(hmm, bg, &KL, NULL);
-
-      printf("%-6d %-20s %-12s %8d %8.2f %6d %6.2f %6.2f %6.2f %6.2f\n",
-	     nhmm,
-	     hmm->name,
-	     hmm->acc == NULL ? "-" : hmm->acc,
-	     hmm->nseq,
-	     hmm->eff_nseq,
-	     hmm->M,
-	     p7_MeanMatchRelativeEntropy(hmm, bg),
-	     p7_MeanMatchInfo(hmm, bg),
-	     x,
-	     KL);
-
-      p7_hmm_Destroy(hmm);
+      ws.go    = go;
+      ws.bg    = bg;
+      ws.hmmv  = hmmv;
+      ws.statv = statv;
+      ws.first = nhmm;
+      if (p7_ThreadedFor(ncpu, nread, &ws, stat_init, stat_work, stat_fini, NULL, NULL) != eslOK) esl_fatal("Failed to calculate statistics for HMMs in %s", hmmfile);
+
+      for (i = 0; i < nread; i++)
+	{
+	  hmm = hmmv[i];
+	  nhmm++;
+
+	  printf("%-6d %-20s %-12s %8d %8.2f %6d %6.2f %6.2f %6.2f %6.2f",
+		 nhmm,
+		 hmm->name,
+		 hmm->acc == NULL ? "-" : hmm->acc,
+		 hmm->nseq,
+		 hmm->eff_nseq,
+		 hmm->M,
+		 statv[i].relent,
+		 statv[i].info,
+		 statv[i].prelE,
+		 statv[i].KL);
+	  if (esl_opt_GetBoolean(go, "--fwd"))    printf(" %6.2f", statv[i].fwdsc);
+	  if (esl_opt_GetBoolean(go, "--maxlen")) printf(" %6d",   statv[i].maxlen);
+	  printf("\n");
+
+	  p7_hmm_Destroy(hmm);
+	}
     }
+  if      (status == eslEOD)       esl_fatal("read failed, HMM file %s may be truncated?", hmmfile);
+  else if (status == eslEFORMAT)   esl_fatal("bad file format in HMM file %s",             hmmfile);
+  else if (status == eslEINCOMPAT) esl_fatal("HMM file %s contains different alphabets",   hmmfile);
+  else if (status != eslEOF)       esl_fatal("Unexpected error in reading HMMs from %s",   hmmfile);
 
   p7_bg_Destroy(bg);
   esl_alphabet_Destroy(abc);
@@ -127,3 +205,141 @@ main(int argc, char **argv)
   esl_getopts_Destroy(go);
   exit(0);
 }
+
+
+
+/* model_stats()
+ * Calculate the statistics for one <hmm>, using background <bg>
+ * (whose length model --fwd changes) and RNG <r>.
+ */
+static int
+model_stats(ESL_GETOPTS *go, P7_HMM *hmm, P7_BG *bg, ESL_RANDOMNESS *r, struct modelstats *st)
+{
+  int status;
+
+  st->relent = p7_MeanMatchRelativeEntropy(hmm, bg);
+  st->info   = p7_MeanMatchInfo(hmm, bg);
+  st->fwdsc  = 0.0;
+  st->maxlen = 0;
+  if ((status = p7_MeanPositionRelativeEntropy(hmm, bg, &(st->prelE))) != eslOK) return status;
+  if ((status = p7_hmm_CompositionKLD(hmm, bg, &(st->KL), NULL))       != eslOK) return status;
+
+  if (esl_opt_GetBoolean(go, "--fwd") &&
+      (status = mean_forward_score(hmm, bg, r, esl_opt_GetInteger(go, "--nsample"), &(st->fwdsc))) != eslOK) return status;
+
+  if (esl_opt_GetBoolean(go, "--maxlen"))
+    {
+      if ((status = p7_Builder_MaxLength(hmm, p7_DEFAULT_WINDOW_BETA)) != eslOK) return status;
+      st->maxlen = hmm->max_length;
+    }
+  return eslOK;
+}
+
+
+/* mean_forward_score()
+ * As p7_MeanForwardScore(): the mean Forward bit score of <N>
+ * sequences emitted from <hmm>'s local profile, configured for
+ * length STAT_SAMPLE_L. Samples are scored with the striped SIMD
+ * Forward parser, falling back to the generic Forward only in the
+ * rare case that the parser's scaled floats overflow.
+ */
+static int
+mean_forward_score(const P7_HMM *hmm, P7_BG *bg, ESL_RANDOMNESS *r, int N, double *ret_sc)
+{
+  P7_PROFILE     *gm  = NULL;
+  P7_OPROFILE    *om  = NULL;
+  P7_OMX         *ox  = NULL;
+  P7_GMX         *gx  = NULL;
+  ESL_SQ         *sq  = NULL;
+  float           fsc;
+  float           nullsc;
+  double          sum = 0.;
+  int             i;
+  int             status;
+
+  if ((gm = p7_profile_Create (hmm->M, hmm->abc))        == NULL) { status = eslEMEM; goto ERROR; }
+  if ((om = p7_oprofile_Create(hmm->M, hmm->abc))        == NULL) { status = eslEMEM; goto ERROR; }
+  if ((ox = p7_omx_Create(hmm->M, 0, STAT_SAMPLE_L))     == NULL) { status = eslEMEM; goto ERROR; }
+  if ((sq = esl_sq_CreateDigital(hmm->abc))              == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = p7_ProfileConfig(hmm, bg, gm, STAT_SAMPLE_L, p7_LOCAL)) != eslOK) goto ERROR;
+  if ((status = p7_oprofile_Convert(gm, om))                           != eslOK) goto ERROR;
+
+  for (i = 0; i < N; i++)
+    {
+      if ((status = p7_ProfileEmit(r, hmm, gm, bg, sq, NULL))         != eslOK) goto ERROR;
+      if ((status = p7_oprofile_ReconfigLength(om, sq->n))            != eslOK) goto ERROR;
+      if ((status = p7_omx_GrowTo(ox, om->M, 0, sq->n))               != eslOK) goto ERROR;
+      status = p7_ForwardParser(sq->dsq, sq->n, om, ox, &fsc);
+      if (status == eslERANGE)
+	{
+	  if (gx == NULL && (gx = p7_gmx_Create(gm->M, sq->n)) == NULL) { status = eslEMEM; goto ERROR; }
+	  if ((status = p7_gmx_GrowTo(gx, gm->M, sq->n))              != eslOK) goto ERROR;
+	  if ((status = p7_ReconfigLength(gm, sq->n))                 != eslOK) goto ERROR;
+	  if ((status = p7_GForward(sq->dsq, sq->n, gm, gx, &fsc))    != eslOK) goto ERROR;
+	  if ((status = p7_ReconfigLength(gm, STAT_SAMPLE_L))         != eslOK) goto ERROR;
+	}
+      else if (status != eslOK) goto ERROR;
+      if ((status = p7_bg_SetLength(bg, sq->n))                       != eslOK) goto ERROR;
+      if ((status = p7_bg_NullOne(bg, sq->dsq, sq->n, &nullsc))       != eslOK) goto ERROR;
+
+      sum += (fsc - nullsc) / eslCONST_LOG2;
+    }
+
+  *ret_sc = sum / (double) N;
+  status  = eslOK;
+ ERROR:
+  esl_sq_Destroy(sq);
+  p7_gmx_Destroy(gx);
+  p7_omx_Destroy(ox);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  return status;
+}
+
+
+/* stat_init(), stat_work(), stat_fini()
+ * Calculate <ws->statv[i]> for each model <ws->hmmv[i]> in a block,
+ * with p7_ThreadedFor(). Each model's RNG is seeded from --seed and
+ * its index in the file, so results don't depend on <ncpu> or the
+ * blocking.
+ */
+static int
+stat_init(void *arg, int tid, void **ret_tls)
+{
+  STAT_WORKSET *ws = (STAT_WORKSET *) arg;
+  STAT_WORKER  *w  = NULL;
+  int           status;
+
+  ESL_ALLOC(w, sizeof(STAT_WORKER));
+  w->bg = p7_bg_Clone(ws->bg);
+  w->r  = esl_randomness_Create(esl_opt_GetInteger(ws->go, "--seed"));
+  if (w->bg == NULL || w->r == NULL) { status = eslEMEM; goto ERROR; }
+  *ret_tls = w;
+  return eslOK;
+
+ ERROR:
+  stat_fini(w);
+  return status;
+}
+
+static int
+stat_work(void *arg, void *tls, int i, char *errbuf)
+{
+  STAT_WORKSET *ws   = (STAT_WORKSET *) arg;
+  STAT_WORKER  *w    = (STAT_WORKER *) tls;
+  int           seed = esl_opt_GetInteger(ws->go, "--seed");
+
+  if (seed) esl_randomness_Init(w->r, seed + ws->first + i);
+  return model_stats(ws->go, ws->hmmv[i], w->bg, w->r, &(ws->statv[i]));
+}
+
+static void
+stat_fini(void *tls)
+{
+  STAT_WORKER *w = (STAT_WORKER *) tls;
+
+  if (w == NULL) return;
+  esl_randomness_Destroy(w->r);
+  p7_bg_Destroy(w->bg);
+  free(w);
+}
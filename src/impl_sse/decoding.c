@@ -20,6 +20,9 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
+static        void decode_init(const P7_OPROFILE *om, int L, P7_OMX *pp);
+static inline void decode_row (const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_OMX *pp, int i, float scaleproduct, int do_counts);
+
 /*****************************************************************
  * 1. Posterior decoding algorithms.
  *****************************************************************/
@@ -75,20 +78,194 @@
 int
 p7_Decoding(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp)
 {
-  __m128 *ppv;
-  __m128 *fv;
-  __m128 *bv;
-  __m128  totrv;
   int    L  = oxf->L;
-  int    M  = om->M;
-  int    Q  = p7O_NQF(M);	
-  int    i,q;
+  int    i;
+  float  scaleproduct = 1.0 / oxb->xmx[p7X_N];
+
+  decode_init(om, L, pp);
+  for (i = 1; i <= L; i++)
+    {
+      decode_row(om, oxf, oxb, pp, i, scaleproduct, FALSE);
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+
+  if (isinf(scaleproduct)) return eslERANGE;
+  else                     return eslOK;
+}
+
+
+/* Function:  p7_DecodingNull2()
+ * Synopsis:  Posterior decoding, and null2 by expectation, in one pass.
+ *
+ * Purpose:   Same as <p7_Decoding()> followed by
+ *            <p7_Null2_ByExpectation(om, pp, null2)>, but the expected
+ *            state usage counts that null2 needs are summed up while
+ *            each row of <pp> is being decoded, instead of in a
+ *            second pass over the finished posterior matrix. The sums
+ *            are kept in row 0 of <pp>, which decoding otherwise
+ *            leaves zeroed and which <p7_OptimalAccuracy()> doesn't
+ *            use. The additions are done in the same order, so <null2>
+ *            is identical to what <p7_Null2_ByExpectation()> would
+ *            give.
+ *
+ * Args:      om    - profile (must be the same that was used to fill <oxf>, <oxb>).
+ *            oxf   - filled Forward matrix 
+ *            oxb   - filled Backward matrix
+ *            pp    - RESULT: posterior decoding matrix.
+ *            null2 - RESULT: null2 odds ratios per residue; <0..Kp-1>; caller allocated space
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> on numeric overflow; see <p7_Decoding()>. 
+ *            In this case neither <pp> nor <null2> may be used.
+ *
+ * Throws:    (no abnormal error conditions)
+ */
+int
+p7_DecodingNull2(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, float *null2)
+{
+  int    L  = oxf->L;
+  int    i;
   float  scaleproduct = 1.0 / oxb->xmx[p7X_N];
 
-  pp->M = M;
+  decode_init(om, L, pp);
+  for (i = 1; i <= L; i++)
+    {
+      decode_row(om, oxf, oxb, pp, i, scaleproduct, TRUE);
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+  if (isinf(scaleproduct)) return eslERANGE;
+
+  return p7_Null2_ByExpectedCounts(om, pp, null2);
+}
+
+
+/* Function:  p7_DecodingCheckpointed()
+ * Synopsis:  Posterior decoding, with a checkpointed Forward matrix.
+ *
+ * Purpose:   Same as <p7_Decoding()>, but <oxf> is a checkpointed
+ *            Forward matrix for digital sequence <dsq>, as filled by
+ *            <p7_ForwardCheckpointed()>. Each block of Forward rows
+ *            is recalculated from its checkpoint (overwriting the
+ *            working rows of <oxf>) and decoded right away, so the
+ *            cost is one extra Forward pass. The posterior
+ *            probabilities in <pp> are identical to <p7_Decoding()>'s.
+ *
+ *            <oxb> is a full Backward matrix, calculated with <oxf>
+ *            as its <fwd> (only the special state rows of <fwd> are
+ *            needed for that). As with <p7_Decoding()>, <pp> may be
+ *            <oxb>, to decode in place.
+ *
+ * Args:      dsq  - digital sequence, 1..L
+ *            om   - profile (must be the same that was used to fill <oxf>, <oxb>).
+ *            oxf  - filled checkpointed Forward matrix 
+ *            oxb  - filled Backward matrix
+ *            pp   - RESULT: posterior decoding matrix.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> on numeric overflow; see <p7_Decoding()>.
+ *
+ * Throws:    (no abnormal error conditions)
+ */
+int
+p7_DecodingCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp)
+{
+  int    L  = oxf->L;
+  int    W  = p7_omx_CheckpointStride(L);
+  int    a, b, i;
+  float  scaleproduct = 1.0 / oxb->xmx[p7X_N];
+  int    status;
+
+  decode_init(om, L, pp);
+  for (a = 0; a < L; a += W)
+    {
+      b = ESL_MIN(a+W, L);
+      if ((status = p7_ForwardSegment(dsq, L, om, oxf, a, b)) != eslOK) return status;
+      for (i = a+1; i <= b; i++)
+	{
+	  decode_row(om, oxf, oxb, pp, i, scaleproduct, FALSE);
+	  if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	}
+    }
+
+  if (isinf(scaleproduct)) return eslERANGE;
+  else                     return eslOK;
+}
+
+
+/* Function:  p7_DecodingSegment()
+ * Synopsis:  Posterior decoding of a block of rows.
+ *
+ * Purpose:   Decode rows <i0..i1> of <pp> from rows <i0..i1> of
+ *            <oxf> and <oxb>, which may be checkpointed matrices
+ *            whose blocks of rows were just recalculated by
+ *            <p7_ForwardSegment()> and <p7_BackwardSegment()>. Other
+ *            rows of <pp> are left alone; <pp> must not be <oxb>
+ *            here, since a checkpointed <oxb> still needs its rows.
+ *            The values are identical to what <p7_Decoding()>
+ *            calculates for those rows.
+ *
+ *            <i0> = 0 means to start a new posterior matrix: set its
+ *            dimensions and zero row 0, then decode from row 1.
+ *
+ *            If <do_counts> is TRUE, the M, I and N, C, J posteriors
+ *            of each decoded row are also added into row 0, so that
+ *            after decoding each row 1..L exactly once, <pp> is
+ *            ready for <p7_Null2_ByExpectedCounts()>.
+ *
+ * Args:      om        - profile (must be the same that was used to fill <oxf>, <oxb>).
+ *            oxf       - Forward matrix, rows <i0..i1> filled
+ *            oxb       - Backward matrix, rows <i0..i1> filled
+ *            pp        - RESULT: rows <i0..i1> of posterior decoding matrix
+ *            i0, i1    - first and last row to decode
+ *            do_counts - TRUE to sum expected state usage in row 0
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> on numeric overflow; see <p7_Decoding()>.
+ *
+ * Throws:    (no abnormal error conditions)
+ */
+int
+p7_DecodingSegment(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_OMX *pp, int i0, int i1, int do_counts)
+{
+  float  scaleproduct = 1.0 / oxb->xmx[p7X_N];
+  int    i;
+
+  if (i0 == 0) { decode_init(om, oxf->L, pp); i0 = 1; }
+
+  /* the product of scale factors up to <i0>, multiplied in the same order as p7_Decoding() does */
+  if (oxb->has_own_scales)
+    for (i = 1; i < i0; i++)
+      scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+
+  for (i = i0; i <= i1; i++)
+    {
+      decode_row(om, oxf, oxb, pp, i, scaleproduct, do_counts);
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+
+  if (isinf(scaleproduct)) return eslERANGE;
+  else                     return eslOK;
+}
+
+
+/* decode_init(), decode_row()
+ *
+ * The guts of posterior decoding: zero row 0 of <pp>; decode row <i>
+ * of <pp> from rows <i> of <oxf>, <oxb> (<pp> may be <oxb>), given the
+ * product of scale factors so far, <scaleproduct>. If <do_counts> is
+ * TRUE, also add the new M, I and N,C,J posteriors into row 0, to
+ * collect expected state usage for null2.
+ */
+static void
+decode_init(const P7_OPROFILE *om, int L, P7_OMX *pp)
+{
+  __m128 *ppv = pp->dpf[0];
+  int     Q   = p7O_NQF(om->M);
+  int     q;
+
+  pp->M = om->M;
   pp->L = L;
 
-  ppv = pp->dpf[0];
   for (q = 0; q < Q; q++) {
     *ppv = _mm_setzero_ps(); ppv++;
     *ppv = _mm_setzero_ps(); ppv++;
@@ -99,41 +276,49 @@ p7_Decoding(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp)
   pp->xmx[p7X_J] = 0.0;
   pp->xmx[p7X_C] = 0.0;
   pp->xmx[p7X_B] = 0.0;
+}
 
-  for (i = 1; i <= L; i++)
+static inline void
+decode_row(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_OMX *pp, int i, float scaleproduct, int do_counts)
+{
+  __m128 *ppv   =  pp->dpf[i];
+  __m128 *cv    =  pp->dpf[0];
+  __m128 *fv    = oxf->dpf[i];
+  __m128 *bv    = oxb->dpf[i];
+  __m128  totrv = _mm_set1_ps(scaleproduct * oxf->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+  int     Q     = p7O_NQF(om->M);
+  int     q;
+
+  for (q = 0; q < Q; q++)
     {
-      ppv   =  pp->dpf[i];
-      fv    = oxf->dpf[i];
-      bv    = oxb->dpf[i];
-      totrv = _mm_set1_ps(scaleproduct * oxf->xmx[i*p7X_NXCELLS+p7X_SCALE]);
-
-      for (q = 0; q < Q; q++)
-	{
-	  /* M */
-	  *ppv = _mm_mul_ps(*fv,  *bv);
-	  *ppv = _mm_mul_ps(*ppv,  totrv);
-	  ppv++;  fv++;  bv++;
-
-	  /* D */
-	  *ppv = _mm_setzero_ps();
-	  ppv++;  fv++;  bv++;
-
-	  /* I */
-	  *ppv = _mm_mul_ps(*fv,  *bv);
-	  *ppv = _mm_mul_ps(*ppv,  totrv);
-	  ppv++;  fv++;  bv++;
-	}
-      pp->xmx[i*p7X_NXCELLS+p7X_E] = 0.0;
-      pp->xmx[i*p7X_NXCELLS+p7X_N] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_N] * oxb->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
-      pp->xmx[i*p7X_NXCELLS+p7X_J] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_J] * oxb->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
-      pp->xmx[i*p7X_NXCELLS+p7X_C] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_C] * oxb->xmx[i*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
-      pp->xmx[i*p7X_NXCELLS+p7X_B] = 0.0;
-
-      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+      /* M */
+      *ppv = _mm_mul_ps(*fv,  *bv);
+      *ppv = _mm_mul_ps(*ppv,  totrv);
+      if (do_counts) cv[p7X_M] = _mm_add_ps(*ppv, cv[p7X_M]);
+      ppv++;  fv++;  bv++;
+
+      /* D */
+      *ppv = _mm_setzero_ps();
+      ppv++;  fv++;  bv++;
+
+      /* I */
+      *ppv = _mm_mul_ps(*fv,  *bv);
+      *ppv = _mm_mul_ps(*ppv,  totrv);
+      if (do_counts) cv[p7X_I] = _mm_add_ps(*ppv, cv[p7X_I]);
+      ppv++;  fv++;  bv++;
+      cv += 3;
     }
-
-  if (isinf(scaleproduct)) return eslERANGE;
-  else                     return eslOK;
+  pp->xmx[i*p7X_NXCELLS+p7X_E] = 0.0;
+  pp->xmx[i*p7X_NXCELLS+p7X_N] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_N] * oxb->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
+  pp->xmx[i*p7X_NXCELLS+p7X_J] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_J] * oxb->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
+  pp->xmx[i*p7X_NXCELLS+p7X_C] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_C] * oxb->xmx[i*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
+  pp->xmx[i*p7X_NXCELLS+p7X_B] = 0.0;
+
+  if (do_counts) {
+    pp->xmx[p7X_N] += pp->xmx[i*p7X_NXCELLS+p7X_N];
+    pp->xmx[p7X_C] += pp->xmx[i*p7X_NXCELLS+p7X_C];
+    pp->xmx[p7X_J] += pp->xmx[i*p7X_NXCELLS+p7X_J];
+  }
 }
 
 /* Function:  p7_DomainDecoding()
@@ -356,6 +541,56 @@ utest_decoding(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, in
   p7_profile_Destroy(gm);
   p7_hmm_Destroy(hmm);
 }
+
+/* compare checkpointed decoding to full-matrix p7_Decoding(): 
+ * both decode the same Forward rows, so results must be identical.
+ */
+static void
+utest_checkpointed(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char        *msg  = "checkpointed decoding unit test failed";
+  P7_HMM      *hmm  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  ESL_DSQ     *dsq  = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *fwd  = p7_omx_Create(M, L, L);
+  P7_OMX      *cfwd = p7_omx_Create(M, 0, L);
+  P7_OMX      *bck  = p7_omx_Create(M, L, L);
+  P7_OMX      *pp1  = p7_omx_Create(M, L, L);
+  P7_OMX      *pp2  = p7_omx_Create(M, L, L);
+  P7_GMX      *gxp1 = p7_gmx_Create(M, L);
+  P7_GMX      *gxp2 = p7_gmx_Create(M, L);
+  float        fsc1, fsc2, bsc;
+
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
+  if (p7_omx_GrowToCheckpointed(cfwd, M, L)                != eslOK) esl_fatal(msg);
+  while (N--)
+    {
+      if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq)            != eslOK) esl_fatal(msg);
+      if (p7_Forward            (dsq, L, om, fwd,  &fsc1)     != eslOK) esl_fatal(msg);
+      if (p7_ForwardCheckpointed(dsq, L, om, cfwd, &fsc2)     != eslOK) esl_fatal(msg);
+      if (fsc1 != fsc2)                                                  esl_fatal(msg);
+
+      if (p7_Backward(dsq, L, om, cfwd, bck, &bsc)           != eslOK) esl_fatal(msg);
+      if (p7_Decoding(om, fwd, bck, pp1)                     != eslOK) esl_fatal(msg);
+      if (p7_DecodingCheckpointed(dsq, om, cfwd, bck, pp2)   != eslOK) esl_fatal(msg);
+      if (p7_omx_FDeconvert(pp1, gxp1)                       != eslOK) esl_fatal(msg);
+      if (p7_omx_FDeconvert(pp2, gxp2)                       != eslOK) esl_fatal(msg);
+      if (p7_gmx_Compare(gxp1, gxp2, 0.0)                    != eslOK) esl_fatal(msg);
+    }
+
+  p7_gmx_Destroy(gxp1);
+  p7_gmx_Destroy(gxp2);
+  p7_omx_Destroy(fwd);
+  p7_omx_Destroy(cfwd);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(pp1);
+  p7_omx_Destroy(pp2);
+  free(dsq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
 #endif /*p7DECODING_TESTDRIVE*/
 /*--------------------- end, unit tests -------------------------*/
 
@@ -411,7 +646,8 @@ main(int argc, char **argv)
   
   p7_FLogsumInit();
 
-  utest_decoding(r, abc, bg, M, L, N, tol);
+  utest_decoding    (r, abc, bg, M, L, N, tol);
+  utest_checkpointed(r, abc, bg, M, L, N);
   
   esl_getopts_Destroy(go);
   esl_randomness_Destroy(r);
@@ -19,9 +19,16 @@
  * high-probability "regions" are, the first step of identifying the
  * domain structure of a target sequence.
  * 
+ * A third mode, "checkpointed", keeps the MDI rows only at every Wth
+ * row (W ~ sqrt(L)) plus all the special state rows, and recalculates
+ * the rows in between a block at a time when they're needed. That's
+ * O(M sqrt(L)) memory for about one extra Forward pass; it's what
+ * domain definition uses when a full matrix would be too large.
+ * 
  * Contents:
  *   1. Forward/Backward wrapper API
  *   2. Forward and Backward engine implementations
+ *   3. Checkpointed Forward and Backward.
  *   4. Benchmark driver.
  *   5. Unit tests.
  *   6. Test driver.
@@ -43,8 +50,8 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
-static int forward_engine (int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
-static int backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+static int forward_engine (int do_full, const ESL_DSQ *dsq, int L, int i0, int i1, const P7_OPROFILE *om, P7_OMX *fwd, float *opt_sc);
+static int backward_engine(int do_full, const ESL_DSQ *dsq, int L, int i0, int i1, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
 
 
 /*****************************************************************
@@ -96,7 +103,7 @@ p7_Forward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *
   if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
-  return forward_engine(TRUE, dsq, L, om, ox, opt_sc);
+  return forward_engine(TRUE, dsq, L, 0, L, om, ox, opt_sc);
 }
 
 /* Function:  p7_ForwardParser()
@@ -138,7 +145,7 @@ p7_ForwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, f
   if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
-  return forward_engine(FALSE, dsq, L, om, ox, opt_sc);
+  return forward_engine(FALSE, dsq, L, 0, L, om, ox, opt_sc);
 }
 
 
@@ -197,7 +204,7 @@ p7_Backward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd,
   if (! p7_oprofile_IsLocal(om))  ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
- return backward_engine(TRUE, dsq, L, om, fwd, bck, opt_sc);
+ return backward_engine(TRUE, dsq, L, 0, L, om, fwd, bck, opt_sc);
 }
 
 
@@ -243,7 +250,7 @@ p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX
   if (! p7_oprofile_IsLocal(om))  ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
-  return backward_engine(FALSE, dsq, L, om, fwd, bck, opt_sc);
+  return backward_engine(FALSE, dsq, L, 0, L, om, fwd, bck, opt_sc);
 }
 
 
@@ -252,8 +259,16 @@ p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX
  * 2. Forward/Backward engine implementations (called thru API)
  *****************************************************************/
 
+/* forward_engine()
+ * 
+ * Fills rows <i0>+1..<i1> of <ox>. A whole calculation is <i0>=0,
+ * <i1>=L, and returns the score. Otherwise the engine resumes from
+ * the stored row <i0> and its specials, recalculating rows that were
+ * calculated before (with identical results); <ox->totscale> is left
+ * alone and no score is returned.
+ */
 static int
-forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+forward_engine(int do_full, const ESL_DSQ *dsq, int L, int i0, int i1, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
 {
   register __m128 mpv, dpv, ipv;   /* previous row values                                       */
   register __m128 sv;		   /* temp storage of 1 curr row value in progress              */
@@ -266,6 +281,7 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
   int q;			   /* counter over quads 0..nq-1                                */
   int j;			   /* counter over DD iterations (4 is full serialization)      */
   int Q       = p7O_NQF(om->M);	   /* segment length: # of vectors                              */
+  int whole   = (i0 == 0 && i1 == L); /* TRUE for a complete calculation, not a resumed segment   */
   __m128 *dpc = ox->dpf[0];        /* current row, for use in {MDI}MO(dpp,q) access macro       */
   __m128 *dpp;                     /* previous row, for use in {MDI}MO(dpp,q) access macro      */
   __m128 *rp;			   /* will point at om->rfv[x] for residue x[i]                 */
@@ -276,22 +292,34 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
   ox->L  = L;
   ox->has_own_scales = TRUE; 	/* all forward matrices control their own scalefactors */
   zerov  = _mm_setzero_ps();
-  for (q = 0; q < Q; q++)
-    MMO(dpc,q) = IMO(dpc,q) = DMO(dpc,q) = zerov;
-  xE    = ox->xmx[p7X_E] = 0.;
-  xN    = ox->xmx[p7X_N] = 1.;
-  xJ    = ox->xmx[p7X_J] = 0.;
-  xB    = ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
-  xC    = ox->xmx[p7X_C] = 0.;
+  if (i0 == 0)
+    {
+      for (q = 0; q < Q; q++)
+	MMO(dpc,q) = IMO(dpc,q) = DMO(dpc,q) = zerov;
+      xE    = ox->xmx[p7X_E] = 0.;
+      xN    = ox->xmx[p7X_N] = 1.;
+      xJ    = ox->xmx[p7X_J] = 0.;
+      xB    = ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
+      xC    = ox->xmx[p7X_C] = 0.;
 
-  ox->xmx[p7X_SCALE] = 1.0;
-  ox->totscale       = 0.0;
+      ox->xmx[p7X_SCALE] = 1.0;
+      if (whole) ox->totscale = 0.0;
 
 #if eslDEBUGLEVEL > 0
-  if (ox->debugging) p7_omx_DumpFBRow(ox, TRUE, 0, 9, 5, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=0, width=8, precision=5*/
+      if (ox->debugging) p7_omx_DumpFBRow(ox, TRUE, 0, 9, 5, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=0, width=8, precision=5*/
 #endif
+    }
+  else
+    {				/* resume from stored row i0: these are exactly the values carried out of it */
+      dpc = ox->dpf[do_full * i0];
+      xE  = ox->xmx[i0*p7X_NXCELLS+p7X_E];
+      xN  = ox->xmx[i0*p7X_NXCELLS+p7X_N];
+      xJ  = ox->xmx[i0*p7X_NXCELLS+p7X_J];
+      xB  = ox->xmx[i0*p7X_NXCELLS+p7X_B];
+      xC  = ox->xmx[i0*p7X_NXCELLS+p7X_C];
+    }
 
-  for (i = 1; i <= L; i++)
+  for (i = i0+1; i <= i1; i++)
     {
       dpp   = dpc;                      
       dpc   = ox->dpf[do_full * i];     /* avoid conditional, use do_full as kronecker delta */
@@ -429,7 +457,7 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 	      IMO(dpc,q) = _mm_mul_ps(IMO(dpc,q), xEv);
 	    }
 	  ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = xE;
-	  ox->totscale += log(xE);
+	  if (whole) ox->totscale += log(xE);
 	  xE = 1.0;		
 	}
       else ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = 1.0;
@@ -449,6 +477,8 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 #endif
     } /* end loop over sequence residues 1..L */
 
+  if (! whole) return eslOK;	/* recalculated a segment; the score was done the first time */
+
   /* finally C->T, and flip total score back to log space (nats) */
   /* On overflow, xC is inf or nan (nan arises because inf*0 = nan). */
   /* On an underflow (which shouldn't happen), we counterintuitively return infinity:
@@ -464,8 +494,18 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 
 
 
+/* backward_engine()
+ *
+ * Fills rows <i1>..<i0>+1 of <bck>. A whole calculation is <i0>=0,
+ * <i1>=L, which also does row 0's specials and returns the score.
+ * Otherwise no score is returned and <bck->totscale> is left alone;
+ * if <i1> < L, the engine resumes from the stored row <i1> and its
+ * specials, and rows <i1-1>..<i0+1> are recalculated. A segment
+ * reuses the scale factors already in <bck> instead of choosing them
+ * again, so results are identical to the first calculation.
+ */
 static int 
-backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+backward_engine(int do_full, const ESL_DSQ *dsq, int L, int i0, int i1, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
 {
   register __m128 mpv, ipv, dpv;      /* previous row values                                       */
   register __m128 mcv, dcv;           /* current row values                                        */
@@ -482,86 +522,99 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
   __m128  *dpp;			      /* next ("previous") DP row                                  */
   __m128  *rp;			      /* will point into om->rfv[x] for residue x[i+1]             */
   __m128  *tp;		              /* will point into (and step thru) om->tfv transition scores */
+  int      whole   = (i0 == 0 && i1 == L); /* TRUE for a complete calculation, not a resumed segment */
 
-  /* initialize the L row. */
   bck->M = om->M;
   bck->L = L;
-  bck->has_own_scales = FALSE;	/* backwards scale factors are *usually* given by <fwd> */
-  dpc    = bck->dpf[L * do_full];
-  xJ     = 0.0;
-  xB     = 0.0;
-  xN     = 0.0;
-  xC     = om->xf[p7O_C][p7O_MOVE];      /* C<-T */
-  xE     = xC * om->xf[p7O_E][p7O_MOVE]; /* E<-C, no tail */
-  xEv    = _mm_set1_ps(xE); 
+  if (whole) bck->has_own_scales = FALSE;	/* backwards scale factors are *usually* given by <fwd> */
   zerov  = _mm_setzero_ps();  
   dcv    = zerov;		/* solely to silence a compiler warning */
-  for (q = 0; q < Q; q++) MMO(dpc,q) = DMO(dpc,q) = xEv;
-  for (q = 0; q < Q; q++) IMO(dpc,q) = zerov;
-
-  /* init row L's DD paths, 1) first segment includes xE, from DMO(q) */
-  tp  = om->tfv + 8*Q - 1;	                        /* <*tp> now the [4 8 12 x] TDD quad         */
-  dpv = _mm_move_ss(DMO(dpc,Q-1), zerov);               /* start leftshift: [1 5 9 13] -> [x 5 9 13] */
-  dpv = _mm_shuffle_ps(dpv, dpv, _MM_SHUFFLE(0,3,2,1)); /* finish leftshift:[x 5 9 13] -> [5 9 13 x] */
-  for (q = Q-1; q >= 0; q--)
-    {
-      dcv        = _mm_mul_ps(dpv, *tp);      tp--;
-      DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
-      dpv        = DMO(dpc,q);
+
+  if (i1 < L)
+    {				/* resume from stored row i1: these are exactly the values carried out of it */
+      xE  = bck->xmx[i1*p7X_NXCELLS+p7X_E];
+      xN  = bck->xmx[i1*p7X_NXCELLS+p7X_N];
+      xJ  = bck->xmx[i1*p7X_NXCELLS+p7X_J];
+      xB  = bck->xmx[i1*p7X_NXCELLS+p7X_B];
+      xC  = bck->xmx[i1*p7X_NXCELLS+p7X_C];
     }
-  /* 2) three more passes, only extending DD component (dcv only; no xE contrib from DMO(q)) */
-  for (j = 1; j < 4; j++)
+  else
     {
-      tp  = om->tfv + 8*Q - 1;	                            /* <*tp> now the [4 8 12 x] TDD quad         */
-      dcv = _mm_move_ss(dcv, zerov);                        /* start leftshift: [1 5 9 13] -> [x 5 9 13] */
-      dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1)); /* finish leftshift:[x 5 9 13] -> [5 9 13 x] */
+      /* initialize the L row. */
+      dpc    = bck->dpf[L * do_full];
+      xJ     = 0.0;
+      xB     = 0.0;
+      xN     = 0.0;
+      xC     = om->xf[p7O_C][p7O_MOVE];      /* C<-T */
+      xE     = xC * om->xf[p7O_E][p7O_MOVE]; /* E<-C, no tail */
+      xEv    = _mm_set1_ps(xE); 
+      for (q = 0; q < Q; q++) MMO(dpc,q) = DMO(dpc,q) = xEv;
+      for (q = 0; q < Q; q++) IMO(dpc,q) = zerov;
+
+      /* init row L's DD paths, 1) first segment includes xE, from DMO(q) */
+      tp  = om->tfv + 8*Q - 1;	                        /* <*tp> now the [4 8 12 x] TDD quad         */
+      dpv = _mm_move_ss(DMO(dpc,Q-1), zerov);               /* start leftshift: [1 5 9 13] -> [x 5 9 13] */
+      dpv = _mm_shuffle_ps(dpv, dpv, _MM_SHUFFLE(0,3,2,1)); /* finish leftshift:[x 5 9 13] -> [5 9 13 x] */
       for (q = Q-1; q >= 0; q--)
 	{
-	  dcv        = _mm_mul_ps(dcv, *tp); tp--;
+	  dcv        = _mm_mul_ps(dpv, *tp);      tp--;
 	  DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
+	  dpv        = DMO(dpc,q);
+	}
+      /* 2) three more passes, only extending DD component (dcv only; no xE contrib from DMO(q)) */
+      for (j = 1; j < 4; j++)
+	{
+	  tp  = om->tfv + 8*Q - 1;	                            /* <*tp> now the [4 8 12 x] TDD quad         */
+	  dcv = _mm_move_ss(dcv, zerov);                        /* start leftshift: [1 5 9 13] -> [x 5 9 13] */
+	  dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1)); /* finish leftshift:[x 5 9 13] -> [5 9 13 x] */
+	  for (q = Q-1; q >= 0; q--)
+	    {
+	      dcv        = _mm_mul_ps(dcv, *tp); tp--;
+	      DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
+	    }
+	}
+      /* now MD init */
+      tp  = om->tfv + 7*Q - 3;	                        /* <*tp> now the [4 8 12 x] Mk->Dk+1 quad    */
+      dcv = _mm_move_ss(DMO(dpc,0), zerov);                 /* start leftshift: [1 5 9 13] -> [x 5 9 13] */
+      dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1)); /* finish leftshift:[x 5 9 13] -> [5 9 13 x] */
+      for (q = Q-1; q >= 0; q--)
+	{
+	  MMO(dpc,q) = _mm_add_ps(MMO(dpc,q), _mm_mul_ps(dcv, *tp)); tp -= 7;
+	  dcv        = DMO(dpc,q);
 	}
-    }
-  /* now MD init */
-  tp  = om->tfv + 7*Q - 3;	                        /* <*tp> now the [4 8 12 x] Mk->Dk+1 quad    */
-  dcv = _mm_move_ss(DMO(dpc,0), zerov);                 /* start leftshift: [1 5 9 13] -> [x 5 9 13] */
-  dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1)); /* finish leftshift:[x 5 9 13] -> [5 9 13 x] */
-  for (q = Q-1; q >= 0; q--)
-    {
-      MMO(dpc,q) = _mm_add_ps(MMO(dpc,q), _mm_mul_ps(dcv, *tp)); tp -= 7;
-      dcv        = DMO(dpc,q);
-    }
 
-  /* Sparse rescaling: same scale factors as fwd matrix */
-  if (fwd->xmx[L*p7X_NXCELLS+p7X_SCALE] > 1.0)
-    {
-      xE  = xE / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
-      xN  = xN / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
-      xC  = xC / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
-      xJ  = xJ / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
-      xB  = xB / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
-      xEv = _mm_set1_ps(1.0 / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE]);
-      for (q = 0; q < Q; q++) {
-	MMO(dpc,q) = _mm_mul_ps(MMO(dpc,q), xEv);
-	DMO(dpc,q) = _mm_mul_ps(DMO(dpc,q), xEv);
-	IMO(dpc,q) = _mm_mul_ps(IMO(dpc,q), xEv);
-      }
-    }
-  bck->xmx[L*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
-  bck->totscale                     = log(bck->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+      /* Sparse rescaling: same scale factors as fwd matrix */
+      if (fwd->xmx[L*p7X_NXCELLS+p7X_SCALE] > 1.0)
+	{
+	  xE  = xE / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+	  xN  = xN / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+	  xC  = xC / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+	  xJ  = xJ / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+	  xB  = xB / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+	  xEv = _mm_set1_ps(1.0 / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+	  for (q = 0; q < Q; q++) {
+	    MMO(dpc,q) = _mm_mul_ps(MMO(dpc,q), xEv);
+	    DMO(dpc,q) = _mm_mul_ps(DMO(dpc,q), xEv);
+	    IMO(dpc,q) = _mm_mul_ps(IMO(dpc,q), xEv);
+	  }
+	}
+      bck->xmx[L*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      if (whole) bck->totscale          = log(bck->xmx[L*p7X_NXCELLS+p7X_SCALE]);
 
-  /* Stores */
-  bck->xmx[L*p7X_NXCELLS+p7X_E] = xE;
-  bck->xmx[L*p7X_NXCELLS+p7X_N] = xN;
-  bck->xmx[L*p7X_NXCELLS+p7X_J] = xJ;
-  bck->xmx[L*p7X_NXCELLS+p7X_B] = xB;
-  bck->xmx[L*p7X_NXCELLS+p7X_C] = xC;
+      /* Stores */
+      bck->xmx[L*p7X_NXCELLS+p7X_E] = xE;
+      bck->xmx[L*p7X_NXCELLS+p7X_N] = xN;
+      bck->xmx[L*p7X_NXCELLS+p7X_J] = xJ;
+      bck->xmx[L*p7X_NXCELLS+p7X_B] = xB;
+      bck->xmx[L*p7X_NXCELLS+p7X_C] = xC;
 
 #if eslDEBUGLEVEL > 0
-  if (bck->debugging) p7_omx_DumpFBRow(bck, TRUE, L, 9, 4, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=L, width=9, precision=4*/
+      if (bck->debugging) p7_omx_DumpFBRow(bck, TRUE, L, 9, 4, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=L, width=9, precision=4*/
 #endif
+    }
 
   /* main recursion */
-  for (i = L-1; i >= 1; i--)	/* backwards stride */
+  for (i = i1-1; i > i0; i--)	/* backwards stride */
     {
       /* phase 1. B(i) collected. Old row destroyed, new row contains
        *    complete I(i,k), partial {MD}(i,k) w/ no {MD}->{DE} paths yet.
@@ -656,10 +709,13 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
        * from those in <fwd>. This will complicate subsequent
        * posterior decoding routines.
        */
-      if (xB > 1.0e16) bck->has_own_scales = TRUE;
+      if (whole)
+	{			/* a resumed segment reuses the scale factors chosen the first time */
+	  if (xB > 1.0e16) bck->has_own_scales = TRUE;
 
-      if      (bck->has_own_scales)  bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = (xB > 1.0e4) ? xB : 1.0;
-      else                           bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  if      (bck->has_own_scales)  bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = (xB > 1.0e4) ? xB : 1.0;
+	  else                           bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	}
 
       if (bck->xmx[i*p7X_NXCELLS+p7X_SCALE] > 1.0)
 	{
@@ -674,7 +730,7 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 	    DMO(dpc,q) = _mm_mul_ps(DMO(dpc,q), xBv);
 	    IMO(dpc,q) = _mm_mul_ps(IMO(dpc,q), xBv);
 	  }
-	  bck->totscale += log(bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	  if (whole) bck->totscale += log(bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
 	}
 
       /* Stores are separate only for pedagogical reasons: easy to
@@ -692,6 +748,8 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 #endif
     } /* thus ends the loop over sequence positions i */
 
+  if (! whole) return eslOK;	/* recalculated a segment; the score was done the first time */
+
   /* Termination at i=0, where we can only reach N,B states. */
   dpp = bck->dpf[1 * do_full];
   tp  = om->tfv;          /* <*tp> is now the [1 5 9 13] TBMk transition quad  */
@@ -735,6 +793,154 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 
 
 
+/*****************************************************************
+ * 3. Checkpointed Forward and Backward.
+ *****************************************************************/
+
+/* Function:  p7_ForwardCheckpointed()
+ * Synopsis:  The Forward algorithm, checkpointed O(M sqrt(L)) version.
+ *
+ * Purpose:   Same as <p7_Forward()>, but <ox> only keeps the MDI
+ *            rows at the checkpoints 0, W, 2W... (W =
+ *            <p7_omx_CheckpointStride(L)>); the rows in between share
+ *            W-1 rows of working memory. All special state rows
+ *            0..L are kept, including the scale factors, so <ox> can
+ *            serve as the <fwd> argument of <p7_Backward()>.
+ *
+ *            Upon return, the working rows hold the last block of
+ *            the matrix; any other block <a+1..a+W-1> can be
+ *            recalculated from its checkpoint with
+ *            <p7_ForwardSegment(dsq, L, om, ox, a, a+W)>. Results are
+ *            bit-identical to <p7_Forward()>'s.
+ *
+ *            The caller lays out <ox> with
+ *            <p7_omx_GrowToCheckpointed(ox, M, L)>.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            ox      - RETURN: checkpointed Forward DP matrix
+ *            opt_sc  - RETURN: Forward score (in nats)          
+ *
+ * Returns:   <eslOK> on success. 
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, or if the profile
+ *            isn't in local alignment mode.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int
+p7_ForwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+#if eslDEBUGLEVEL > 0		
+  if (om->M >  ox->allocQ4*4)    ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
+  if (L     >= ox->allocR)       ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few MDI row pointers)");
+  if (L     >= ox->allocXR)      ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few X rows)");
+  if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
+#endif
+
+  return forward_engine(TRUE, dsq, L, 0, L, om, ox, opt_sc);
+}
+
+
+/* Function:  p7_ForwardSegment()
+ * Synopsis:  Recalculate a block of a checkpointed Forward matrix.
+ *
+ * Purpose:   Given a Forward matrix <ox> for <dsq> of length <L>,
+ *            as filled by <p7_ForwardCheckpointed()> (or
+ *            <p7_Forward()>), recalculate MDI rows <i0+1..i1> from
+ *            the stored row <i0>. The special states and scale
+ *            factors are rewritten with the same values they already
+ *            had.
+ *
+ *            In a checkpointed matrix, <i0> must be a checkpoint row
+ *            and <i1> at most the next one, <i0+W>; then rows
+ *            <i0..i1> are all addressable in <ox->dpf[]> upon return.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_ForwardSegment(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, int i0, int i1)
+{
+  if (i1 <= i0) return eslOK;
+  return forward_engine(TRUE, dsq, L, i0, i1, om, ox, NULL);
+}
+
+
+/* Function:  p7_BackwardCheckpointed()
+ * Synopsis:  The Backward algorithm, checkpointed O(M sqrt(L)) version.
+ *
+ * Purpose:   Same as <p7_Backward()>, but <bck> is laid out with
+ *            <p7_omx_GrowToCheckpointed(bck, M, L)> and only keeps
+ *            the MDI rows at the checkpoints 0, W, 2W...; all
+ *            special state rows and scale factors are kept. <fwd>
+ *            may be checkpointed too, since only its scale factors
+ *            are used.
+ *
+ *            Any block of Backward rows <a+1..b> between two
+ *            checkpoints (or between the last checkpoint and <L>)
+ *            can then be recalculated with
+ *            <p7_BackwardSegment(dsq, L, om, fwd, bck, a, b)>.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            fwd     - filled Forward DP matrix, for scale factors
+ *            bck     - RETURN: checkpointed Backward matrix
+ *            opt_sc  - optRETURN: Backward score (in nats)          
+ *
+ * Returns:   <eslOK> on success. 
+ *
+ * Throws:    <eslEINVAL> if <bck> allocation is too small, or if the profile
+ *            isn't in local alignment mode.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int
+p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
+#if eslDEBUGLEVEL > 0		
+  if (om->M >  bck->allocQ4*4)    ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
+  if (L     >= bck->allocR)       ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few MDI row pointers)");
+  if (L     >= bck->allocXR)      ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few X rows)");
+  if (L     != fwd->L)            ESL_EXCEPTION(eslEINVAL, "fwd matrix size doesn't agree with length L");
+  if (! p7_oprofile_IsLocal(om))  ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
+#endif
+
+  return backward_engine(TRUE, dsq, L, 0, L, om, fwd, bck, opt_sc);
+}
+
+
+/* Function:  p7_BackwardSegment()
+ * Synopsis:  Recalculate a block of a checkpointed Backward matrix.
+ *
+ * Purpose:   Given a Backward matrix <bck> for <dsq> of length <L>,
+ *            as filled by <p7_BackwardCheckpointed()> (or
+ *            <p7_Backward()>) with Forward matrix <fwd>, recalculate
+ *            MDI rows <i0+1..i1>: from the stored row <i1> if <i1> <
+ *            L, else from scratch. The special states are rewritten
+ *            with the same values they already had, and the scale
+ *            factors that the first calculation chose are reused.
+ *
+ *            In a checkpointed matrix, <i1> must be a checkpoint row
+ *            or <L>, and <i0> at least the previous checkpoint; then
+ *            rows <i0+1..i1> are all addressable in <bck->dpf[]> upon
+ *            return.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_BackwardSegment(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, int i0, int i1)
+{
+  if (i1 <= i0) return eslOK;
+  return backward_engine(TRUE, dsq, L, i0, i1, om, fwd, bck, NULL);
+}
+/*------------- end, checkpointed Forward and Backward ----------*/
+
+
+
 
 
 /*****************************************************************
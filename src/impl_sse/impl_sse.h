@@ -10,6 +10,7 @@
 
 #include "esl_alphabet.h"
 #include "esl_random.h"
+#include "esl_sse.h"
 
 #include <xmmintrin.h>    /* SSE  */
 #include <emmintrin.h>    /* SSE2 */
@@ -147,6 +148,22 @@ typedef struct {
   P7_OPROFILE  **list;        /* array of <P7_OPROFILE> objects               */
 } P7_OM_BLOCK;
 
+/* A cluster of consecutive profiles in a pressed database, saved in
+ * the optional <.h3c> file by <hmmpress --clust>. The representative
+ * <rep> is the max-envelope of the members' match scores, so its MSV
+ * filter score bounds each member's from above: if it can't pass any
+ * member's MSV threshold, hmmscan skips the whole cluster.
+ */
+typedef struct {
+  int           nmodels;      /* number of member profiles                  */
+  uint64_t      nnodes;       /* total M of the members                     */
+  off_t         foff;         /* <.h3f> offset of the first member          */
+  off_t         fend;         /* <.h3f> offset just past the last member    */
+  float        *mmu;          /* members' MSV Gumbel mu's [0..nmodels-1]    */
+  float        *mlambda;      /* members' MSV Gumbel lambdas                */
+  P7_OPROFILE  *rep;          /* representative; MSV filter part only       */
+} P7_OM_CLUSTER;
+
 /* retrieve match odds ratio [k][x]
  * this gets used in p7_alidisplay.c, when we're deciding if a residue is conserved or not */
 static inline float 
@@ -257,6 +274,9 @@ p7_omx_FSetMDI(const P7_OMX *ox, int s, int i, int k, float val)
 /* p7_omx.c */
 extern P7_OMX      *p7_omx_Create(int allocM, int allocL, int allocXL);
 extern int          p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL);
+extern int          p7_omx_GrowToCheckpointed(P7_OMX *ox, int allocM, int L);
+extern int          p7_omx_CheckpointStride(int L);
+extern int          p7_omx_FitsRAMLimit(int M, int L);
 extern int          p7_omx_FDeconvert(P7_OMX *ox, P7_GMX *gx);
 extern int          p7_omx_Reuse  (P7_OMX *ox);
 extern void         p7_omx_Destroy(P7_OMX *ox);
@@ -301,6 +321,9 @@ extern int          p7_oprofile_GetFwdEmissionArray(const P7_OPROFILE *om, P7_BG
 
 /* decoding.c */
 extern int p7_Decoding      (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp);
+extern int p7_DecodingNull2 (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp, float *null2);
+extern int p7_DecodingCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp);
+extern int p7_DecodingSegment(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_OMX *pp, int i0, int i1, int do_counts);
 extern int p7_DomainDecoding(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_DOMAINDEF *ddef);
 
 /* fwdback.c */
@@ -308,6 +331,10 @@ extern int p7_Forward       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,
 extern int p7_ForwardParser (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
 extern int p7_Backward      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
 extern int p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_ForwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *fwd, float *opt_sc);
+extern int p7_ForwardSegment     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *fwd, int i0, int i1);
+extern int p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_BackwardSegment     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, int i0, int i1);
 
 /* io.c */
 extern int p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om);
@@ -320,6 +347,11 @@ extern int p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset);
 extern P7_OM_BLOCK *p7_oprofile_CreateBlock(int size);
 extern void p7_oprofile_DestroyBlock(P7_OM_BLOCK *block);
 
+extern P7_OM_CLUSTER *p7_oprofile_CreateCluster(P7_PROFILE **gmv, int n, off_t foff, off_t fend);
+extern int            p7_oprofile_WriteCluster(FILE *cfp, const P7_OM_CLUSTER *clu);
+extern int            p7_oprofile_ReadCluster(P7_HMMFILE *hfp, const ESL_ALPHABET *abc, P7_OM_CLUSTER **ret_clu);
+extern void           p7_oprofile_DestroyCluster(P7_OM_CLUSTER *clu);
+
 /* ssvfilter.c */
 extern int p7_SSVFilter    (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
 
@@ -330,14 +362,19 @@ extern int p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P
 
 /* null2.c */
 extern int p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
+extern int p7_Null2_ByExpectedCounts(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
 extern int p7_Null2_ByTrace      (const P7_OPROFILE *om, const P7_TRACE *tr, int zstart, int zend, P7_OMX *wrk, float *null2);
 
 /* optacc.c */
 extern int p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp,       P7_OMX *ox, float *ret_e);
 extern int p7_OATrace        (const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *tr);
+extern int p7_OptimalAccuracyCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, float *ret_e);
+extern int p7_OATraceCheckpointed        (const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, P7_TRACE *tr);
 
 /* stotrace.c */
 extern int p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox, P7_TRACE *tr);
+extern int p7_StochasticTraceEnsemble(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox, int N, P7_TRACE **tr);
+extern int p7_StochasticTraceEnsembleCheckpointed(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, int N, P7_TRACE **tr);
 
 /* vitfilter.c */
 extern int p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
@@ -373,6 +410,48 @@ impl_Init(void)
   _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 #endif
 }
+
+
+/*****************************************************************
+ * 5. Table-free vector log-sum, for generic DP routines
+ *****************************************************************/
+
+/* Function:  p7_sse_FLogsum()
+ * Synopsis:  Approximate $\log(e^a + e^b)$ in four lanes.
+ *
+ * Purpose:   SIMD counterpart of <p7_FLogsum()> for the log-space
+ *            generic DP routines: returns $\max + \log(1 + e^{\min-\max})$
+ *            lanewise, using Easel's vector <logf>/<expf> instead of
+ *            the <p7_FLogsum()> lookup table, so it is at least as
+ *            accurate (see <p7_FLogsumError()>).
+ *
+ *            Lanes of <a> and <b> may be $-\infty$ (both, even), but
+ *            not $+\infty$ or NaN.
+ */
+static inline __m128
+p7_sse_FLogsum(__m128 a, __m128 b)
+{
+  __m128 max  = _mm_max_ps(a, b);
+  __m128 min  = _mm_min_ps(a, b);
+  __m128 mask = _mm_cmpeq_ps(min, _mm_set1_ps(-eslINFINITY));   /* lanes where the answer is just <max>   */
+  __m128 d    = _mm_andnot_ps(mask, _mm_sub_ps(min, max));        /* <= 0; zeroed where -inf-(-inf) is NaN  */
+
+  d = esl_sse_logf(_mm_add_ps(_mm_set1_ps(1.0f), esl_sse_expf(d)));
+  return esl_sse_select_ps(_mm_add_ps(max, d), max, mask);
+}
+
+/* Function:  p7_sse_FLogsumH()
+ * Synopsis:  Horizontal log-sum of the four lanes of <a>.
+ */
+static inline float
+p7_sse_FLogsumH(__m128 a)
+{
+  float x;
+  a = p7_sse_FLogsum(a, _mm_movehl_ps(a, a));
+  a = p7_sse_FLogsum(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1,1,1,1)));
+  _mm_store_ss(&x, a);
+  return x;
+}
 #endif /* P7_IMPL_SSE_INCLUDED */
 
 
@@ -0,0 +1,311 @@
+/* Speed benchmark for the SSE implementation's DP kernels, together.
+ *
+ * Each of the component benchmarks (msvfilter_benchmark,
+ * vitfilter_benchmark, etc.) times one kernel on one model, and
+ * reports in its own format. This driver times all of them on the
+ * same random sequences, over a sweep of model lengths M and target
+ * lengths L, with replicates, and writes one CSV table: so that
+ * regressions can be tracked across compilers and CPUs by comparing
+ * tables, without parsing each driver's output.
+ *
+ * Contents:
+ *   1. Benchmark driver.
+ */
+#include "p7_config.h"
+
+/*****************************************************************
+ * 1. Benchmark driver.
+ *****************************************************************/
+#ifdef p7KERNELS_BENCHMARK
+/*
+   gcc -o kernels_benchmark -std=gnu99 -g -O3 -msse2 -I.. -L.. -I../../easel -L../../easel -Dp7KERNELS_BENCHMARK kernels.c -lhmmer -leasel -lm
+
+   ./kernels_benchmark                                   synthetic models, default M and L sweeps
+   ./kernels_benchmark -M 100,400 -L 400,2000 -R 10      choose sweeps, # of replicates
+   ./kernels_benchmark --hmmfile Pfam-A.seed.hmm         real models, each at its own M
+   ./kernels_benchmark -k ssv,msv,vit                    only some kernels
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <x86intrin.h>		/* __rdtsc() */
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stats.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+/* The kernels, in pipeline order. Each has its own timed call and
+ * untimed preparation (e.g. the Forward matrix that Backward needs);
+ * see run_kernel(). The last three need full M x L matrices, and are
+ * skipped where those don't fit in p7_RAMLIMIT.
+ */
+enum kernel_e { kSSV = 0, kMSV = 1, kBIAS = 2, kVIT = 3, kFWD = 4, kBCK = 5, kDECODING = 6, kNULL2 = 7, kOA = 8 };
+#define NKERNELS 9
+static char *kernel_name[NKERNELS] = { "ssv", "msv", "bias", "vit", "fwd", "bck", "decoding", "null2", "oa" };
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default   env  range toggles reqs incomp  help                                              docgroup*/
+  { "-h",        eslARG_NONE,      FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",                    0 },
+  { "-k",        eslARG_STRING,    "all",  NULL, NULL,  NULL,  NULL, NULL, "comma-separated list of kernels to time, or 'all'",      0 },
+  { "-s",        eslARG_INT,        "42",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                           0 },
+  { "-L",        eslARG_STRING, "100,400,1000,4000", NULL, NULL, NULL, NULL, NULL, "comma-separated sweep of target seq lengths", 0 },
+  { "-M",        eslARG_STRING, "50,100,200,400,800,1600", NULL, NULL, NULL, NULL, NULL, "comma-separated sweep of synthetic model lengths", 0 },
+  { "-N",        eslARG_INT,      "2000",  NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs per replicate",              0 },
+  { "-R",        eslARG_INT,         "5",  NULL, "n>1", NULL,  NULL, NULL, "number of replicates, for mean and std. deviation",       0 },
+  { "--cells",   eslARG_INT,  "200000000", NULL, "n>0", NULL,  NULL, NULL, "cap N so each replicate is at most <n> cells",            0 },
+  { "--hmmfile", eslARG_INFILE,     NULL,  NULL, NULL,  NULL,  NULL, NULL, "time real models from file <f>, not synthetic ones",      0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for all the optimized DP kernels, CSV output";
+
+/* parse_intlist()
+ * Parse a comma-separated list of positive integers <s> into a new
+ * array <*ret_v> of <*ret_n> values.
+ */
+static int
+parse_intlist(const char *s, int **ret_v, int *ret_n)
+{
+  int  *v = NULL;
+  int   n = 0;
+  char *endp;
+  long  x;
+  int   status;
+
+  ESL_ALLOC(v, sizeof(int) * (strlen(s)/2 + 1)); /* at most this many numbers */
+  while (*s != '\0')
+    {
+      x = strtol(s, &endp, 10);
+      if (endp == s || x <= 0 || (*endp != ',' && *endp != '\0')) { status = eslEINVAL; goto ERROR; }
+      v[n++] = (int) x;
+      s = (*endp == ',' ? endp+1 : endp);
+    }
+  if (n == 0) { status = eslEINVAL; goto ERROR; }
+  *ret_v = v;
+  *ret_n = n;
+  return eslOK;
+
+ ERROR:
+  if (v) free(v);
+  *ret_v = NULL;
+  *ret_n = 0;
+  return status;
+}
+
+static double
+now_seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double) t.tv_sec + 1e-9 * (double) t.tv_nsec;
+}
+
+/* run_kernel()
+ * Run kernel <k> on <dsq> of length <L>, adding its time to <*sec>
+ * and its time stamp counter ticks to <*ticks>. Whatever it depends
+ * on is computed first, untimed. For kDECODING, kNULL2 and kOA,
+ * <fwd>, <bck>, <pp>, <oa> must be allocated for full M x L matrices.
+ */
+static void
+run_kernel(int k, const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_BG *bg, P7_OMX *fwd, P7_OMX *bck, P7_OMX *pp, P7_OMX *oa,
+	   float *null2, double *sec, double *ticks)
+{
+  double   t0;
+  uint64_t c0;
+  float    sc;
+
+  switch (k) {
+  case kBCK:      p7_ForwardParser(dsq, L, om, fwd, NULL);  break;
+  case kDECODING: p7_Forward (dsq, L, om, fwd, NULL);  p7_Backward(dsq, L, om, fwd, bck, NULL);  break;
+  case kNULL2:
+  case kOA:       p7_Forward (dsq, L, om, fwd, NULL);  p7_Backward(dsq, L, om, fwd, bck, NULL);  p7_Decoding(om, fwd, bck, pp); break;
+  default:        break;
+  }
+
+  t0 = now_seconds();
+  c0 = __rdtsc();
+  switch (k) {
+  case kSSV:      p7_SSVFilter     (dsq, L, om,           &sc); break;
+  case kMSV:      p7_MSVFilter     (dsq, L, om, fwd,      &sc); break;
+  case kBIAS:     p7_bg_FilterScore(bg, dsq, L,           &sc); break;
+  case kVIT:      p7_ViterbiFilter (dsq, L, om, fwd,      &sc); break;
+  case kFWD:      p7_ForwardParser (dsq, L, om, fwd,      &sc); break;
+  case kBCK:      p7_BackwardParser(dsq, L, om, fwd, bck, &sc); break;
+  case kDECODING: p7_Decoding(om, fwd, bck, pp);                break;
+  case kNULL2:    p7_Null2_ByExpectation(om, pp, null2);        break;
+  case kOA:       p7_OptimalAccuracy(om, pp, oa, &sc);          break;
+  }
+  *ticks += (double) (__rdtsc() - c0);
+  *sec   += now_seconds() - t0;
+}
+
+/* benchmark_model()
+ * Time the selected kernels <do_kernel[]> for one model <hmm>, at each
+ * target length in <Lv[0..nL-1]>, writing one CSV line per kernel
+ * and length.
+ */
+static void
+benchmark_model(ESL_GETOPTS *go, P7_HMM *hmm, const char *name, P7_BG *bg, const int *do_kernel, const int *Lv, int nL)
+{
+  ESL_RANDOMNESS *r     = NULL;
+  P7_PROFILE     *gm    = p7_profile_Create (hmm->M, hmm->abc);
+  P7_OPROFILE    *om    = p7_oprofile_Create(hmm->M, hmm->abc);
+  P7_OMX         *fwd   = p7_omx_Create(hmm->M, 0, 0);
+  P7_OMX         *bck   = p7_omx_Create(hmm->M, 0, 0);
+  P7_OMX         *pp    = p7_omx_Create(hmm->M, 0, 0);
+  P7_OMX         *oa    = p7_omx_Create(hmm->M, 0, 0);
+  float          *null2 = malloc(sizeof(float) * hmm->abc->Kp);
+  ESL_DSQ        *dsq   = NULL;
+  double         *mcs   = NULL;	/* Mcells/sec for each replicate  */
+  double         *cpc   = NULL;	/* ticks/cell for each replicate  */
+  int             R     = esl_opt_GetInteger(go, "-R");
+  int             N;
+  int             L;
+  int             li, k, rep, i;
+  int             do_full;	/* TRUE if we need full matrices for decoding, null2, oa */
+  double          cells, sec, ticks;
+  double          mcs_mean, mcs_var, cpc_mean, cpc_var;
+
+  if (gm == NULL || om == NULL || fwd == NULL || bck == NULL || pp == NULL || oa == NULL || null2 == NULL) p7_Fail("allocation failed");
+  if ((mcs = malloc(sizeof(double) * R)) == NULL || (cpc = malloc(sizeof(double) * R)) == NULL)          p7_Fail("allocation failed");
+  p7_hmm_SetComposition(hmm);
+
+  for (li = 0; li < nL; li++)
+    {
+      L = Lv[li];
+      N = ESL_MIN(esl_opt_GetInteger(go, "-N"), ESL_MAX(1, esl_opt_GetInteger(go, "--cells") / ((long) hmm->M * L)));
+
+      p7_bg_SetFilter(bg, hmm->M, hmm->compo); /* SetFilter() resets the filter HMM's expected length, so SetLength() must follow it; see bug #h85 */
+      p7_bg_SetLength(bg, L);
+      p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+      p7_oprofile_Convert(gm, om);
+      p7_oprofile_ReconfigLength(om, L);
+
+      do_full = (do_kernel[kDECODING] || do_kernel[kNULL2] || do_kernel[kOA]) && p7_omx_FitsRAMLimit(hmm->M, L);
+      if (p7_omx_GrowTo(fwd, hmm->M, (do_full ? L : 0), L) != eslOK || p7_omx_GrowTo(bck, hmm->M, (do_full ? L : 0), L) != eslOK) p7_Fail("allocation failed");
+      if (do_full && (p7_omx_GrowTo(pp, hmm->M, L, L)      != eslOK || p7_omx_GrowTo(oa,  hmm->M, L, L) != eslOK))                      p7_Fail("allocation failed");
+
+      /* The same N sequences, from the same seed, for every kernel and every model at this L */
+      if ((dsq = realloc(dsq, sizeof(ESL_DSQ) * (L+2) * N)) == NULL) p7_Fail("allocation failed");
+      r = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+      for (i = 0; i < N; i++) esl_rsq_xfIID(r, bg->f, hmm->abc->K, L, dsq + i*(L+2));
+      esl_randomness_Destroy(r);
+
+      for (k = 0; k < NKERNELS; k++)
+	{
+	  if (! do_kernel[k]) continue;
+	  if (k >= kDECODING && ! do_full) { fprintf(stderr, "# skipping %s for M=%d L=%d: full matrices exceed p7_RAMLIMIT\n", kernel_name[k], hmm->M, L); continue; }
+	  cells = (k == kBIAS ? (double) L : (double) hmm->M * (double) L); /* bias filter is a 2-state HMM: L cells */
+
+	  sec = ticks = 0.;
+	  run_kernel(k, dsq, L, om, bg, fwd, bck, pp, oa, null2, &sec, &ticks); /* warm up caches, untimed */
+	  for (rep = 0; rep < R; rep++)
+	    {
+	      sec = ticks = 0.;
+	      for (i = 0; i < N; i++)
+		run_kernel(k, dsq + i*(L+2), L, om, bg, fwd, bck, pp, oa, null2, &sec, &ticks);
+	      mcs[rep] = cells * N / sec / 1e6;
+	      cpc[rep] = ticks / (cells * N);
+	    }
+	  esl_stats_DMean(mcs, R, &mcs_mean, &mcs_var);
+	  esl_stats_DMean(cpc, R, &cpc_mean, &cpc_var);
+
+	  printf("%s,%s,%d,%d,%d,%d,%.2f,%.2f,%.4f,%.4f\n",
+		 kernel_name[k], name, hmm->M, L, N, R, mcs_mean, sqrt(mcs_var), cpc_mean, sqrt(cpc_var));
+	}
+      fflush(stdout);
+    }
+
+  free(mcs);
+  free(cpc);
+  free(dsq);
+  free(null2);
+  p7_omx_Destroy(oa);
+  p7_omx_Destroy(pp);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetString(go, "--hmmfile");
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  int            *Mv      = NULL;
+  int            *Lv      = NULL;
+  int             nM, nL;
+  int             do_kernel[NKERNELS];
+  char           *klist   = esl_opt_GetString(go, "-k");
+  char           *tok;
+  int             k, mi;
+  int             status;
+
+  if (parse_intlist(esl_opt_GetString(go, "-L"), &Lv, &nL) != eslOK) p7_Fail("-L takes a comma-separated list of lengths > 0");
+  if (parse_intlist(esl_opt_GetString(go, "-M"), &Mv, &nM) != eslOK) p7_Fail("-M takes a comma-separated list of lengths > 0");
+
+  for (k = 0; k < NKERNELS; k++) do_kernel[k] = (strcmp(klist, "all") == 0 ? TRUE : FALSE);
+  if (strcmp(klist, "all") != 0)
+    for (tok = strtok(klist, ","); tok != NULL; tok = strtok(NULL, ","))
+      {
+	for (k = 0; k < NKERNELS; k++) if (strcmp(tok, kernel_name[k]) == 0) break;
+	if (k == NKERNELS) p7_Fail("no such kernel %s; choose from ssv,msv,bias,vit,fwd,bck,decoding,null2,oa", tok);
+	do_kernel[k] = TRUE;
+      }
+
+  /* Header. Ticks are from the time stamp counter, which runs at the
+   * nominal clock rate; with frequency scaling or turbo, it's not the
+   * core's own cycle count.
+   */
+  printf("# %s %s (%s); compiled by %s\n", "kernels_benchmark", HMMER_VERSION, HMMER_DATE, __VERSION__);
+  printf("kernel,model,M,L,N,reps,mcells_per_sec,mcells_per_sec_sd,ticks_per_cell,ticks_per_cell_sd\n");
+
+  if (hmmfile != NULL)
+    {
+      status = p7_hmmfile_OpenE(hmmfile, NULL, &hfp, NULL);
+      if (status != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+      while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
+	{
+	  if (bg == NULL) bg = p7_bg_Create(abc);
+	  benchmark_model(go, hmm, hmm->name, bg, do_kernel, Lv, nL);
+	  p7_hmm_Destroy(hmm);
+	}
+      if (status != eslEOF) p7_Fail("Failed to read HMMs from %s", hmmfile);
+      p7_hmmfile_Close(hfp);
+    }
+  else
+    {
+      abc = esl_alphabet_Create(eslAMINO);
+      bg  = p7_bg_Create(abc);
+      for (mi = 0; mi < nM; mi++)
+	{
+	  if (p7_hmm_Sample(r, Mv[mi], abc, &hmm) != eslOK) p7_Fail("failed to sample an HMM");
+	  benchmark_model(go, hmm, "synthetic", bg, do_kernel, Lv, nL);
+	  p7_hmm_Destroy(hmm);
+	}
+    }
+
+  free(Lv);
+  free(Mv);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7KERNELS_BENCHMARK*/
+/*------------------ end, benchmark driver ----------------------*/
@@ -47,11 +47,7 @@ p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
   int      Ld   = pp->L;
   int      Q    = p7O_NQF(M);
   float   *xmx  = pp->xmx;	/* enables use of XMXo(i,s) macro */
-  float    norm;
-  __m128  *rp;
-  __m128   sv;
-  float    xfactor;
-  int      i,q,x;
+  int      i,q;
   
   /* Calculate expected # of times that each emitting state was used
    * in generating the Ld residues in this domain.
@@ -74,6 +70,42 @@ p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
       XMXo(0,p7X_J) += XMXo(i,p7X_J); 
     }
 
+  return p7_Null2_ByExpectedCounts(om, pp, null2);
+}
+
+
+/* Function:  p7_Null2_ByExpectedCounts()
+ * Synopsis:  Calculate null2 model from expected state usage counts.
+ *
+ * Purpose:   The second half of <p7_Null2_ByExpectation()>: given
+ *            a posterior probability matrix <pp> for an envelope of
+ *            length <pp->L>, whose row 0 holds the sums of the
+ *            posteriors in rows <1..pp->L> for the M, I, N, C, J
+ *            states, calculate the null2 odds ratios <null2>.
+ *            <p7_DecodingNull2()> collects these sums while it
+ *            decodes, so the finished posterior matrix doesn't have
+ *            to be read a second time.
+ *
+ *            Row 0 of <pp> is overwritten with frequencies.
+ *
+ * Args:      om    - profile, in any mode, target length model set to <L>
+ *            pp    - posterior prob matrix, with expected counts in row 0
+ *            null2 - RETURN: null2 log odds scores per residue; <0..Kp-1>; caller allocated space
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_Null2_ByExpectedCounts(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
+{
+  int      Ld   = pp->L;
+  int      Q    = p7O_NQF(om->M);
+  float   *xmx  = pp->xmx;	/* enables use of XMXo(i,s) macro */
+  float    norm;
+  __m128  *rp;
+  __m128   sv;
+  float    xfactor;
+  int      q,x;
+
   /* Convert those expected #'s to frequencies, to use as posterior weights. */
   norm = 1.0 / (float) Ld;
   sv   = _mm_set1_ps(norm);
@@ -391,10 +423,11 @@ utest_null2_expectation(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M,
   P7_GMX      *gpp  = p7_gmx_Create(M, L);
   float       *on2  = malloc(sizeof(float) * abc->Kp);
   float       *gn2  = malloc(sizeof(float) * abc->Kp);
+  float       *fn2  = malloc(sizeof(float) * abc->Kp);
   float fsc1, fsc2;
   float bsc1, bsc2;
 
-  if (!gn2 || !on2) esl_fatal(msg);
+  if (!gn2 || !on2 || !fn2) esl_fatal(msg);
 
   if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
   while (N--)
@@ -411,6 +444,10 @@ utest_null2_expectation(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M,
       if (p7_GNull2_ByExpectation(gm, gpp, gn2)          != eslOK) esl_fatal(msg);
 
       if (esl_vec_FCompare(gn2, on2, abc->Kp, tolerance) != eslOK) esl_fatal(msg);
+
+      /* null2 collected during decoding must agree with the two-pass version */
+      if (p7_DecodingNull2(om, fwd, bck, bck, fn2)       != eslOK) esl_fatal(msg);
+      if (esl_vec_FCompare(on2, fn2, abc->Kp, tolerance) != eslOK) esl_fatal(msg);
     }
 
   p7_gmx_Destroy(gpp);
@@ -421,6 +458,7 @@ utest_null2_expectation(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M,
   p7_omx_Destroy(bck);
   free(on2);
   free(gn2);
+  free(fn2);
   free(dsq);
   p7_oprofile_Destroy(om);
   p7_profile_Destroy(gm);
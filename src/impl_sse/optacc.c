@@ -22,6 +22,10 @@
 #include "esl_vectorops.h"
 
 #include "hmmer.h"
+#include "impl_sse.h"
+
+static        void oa_init(const P7_OPROFILE *om, int L, P7_OMX *ox);
+static inline void oa_row (const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, int i);
 
 
 /*****************************************************************
@@ -56,6 +60,106 @@
  */
 int
 p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *ret_e)
+{
+  int i;
+
+  oa_init(om, pp->L, ox);
+  for (i = 1; i <= pp->L; i++)
+    oa_row(om, pp, ox, i);
+
+  *ret_e = ox->xmx[pp->L*p7X_NXCELLS+p7X_C];
+  return eslOK;
+}
+
+
+/* Function:  p7_OptimalAccuracyCheckpointed()
+ * Synopsis:  OA DP fill in O(M sqrt(L)) memory.
+ *
+ * Purpose:   Same as <p7_OptimalAccuracy()>, for a long target
+ *            sequence <dsq> of length <L>, without ever holding a
+ *            full posterior or OA matrix. <oxf> and <oxb> are the
+ *            checkpointed Forward and Backward matrices for <dsq>,
+ *            as filled by <p7_ForwardCheckpointed()> and
+ *            <p7_BackwardCheckpointed()>. <pp> and <ox> are laid out
+ *            by the caller with <p7_omx_GrowToCheckpointed(.., M, L)>
+ *            as well.
+ *
+ *            One block of rows between checkpoints at a time, the
+ *            Forward and Backward rows are recalculated, decoded
+ *            into <pp>, and used for that block of the OA fill; only
+ *            the checkpoint rows of <ox> are kept. Each row is
+ *            decoded exactly once, so on return row 0 of <pp> holds
+ *            the expected state usage counts, and the caller can get
+ *            the null2 model with <p7_Null2_ByExpectedCounts()>.
+ *
+ *            <p7_OATraceCheckpointed()> then recovers the OA trace.
+ *            The OA score and trace are identical to what
+ *            <p7_OptimalAccuracy()> and <p7_OATrace()> give with full
+ *            matrices.
+ *
+ * Args:      dsq   - digital target sequence, 1..L
+ *            om    - profile
+ *            oxf   - checkpointed Forward matrix
+ *            oxb   - checkpointed Backward matrix
+ *            pp    - checkpointed space for posterior probabilities
+ *            ox    - RESULT: checkpointed OA matrix
+ *            ret_e - RETURN: expected number of correctly decoded positions 
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> on numeric overflow in posterior decoding;
+ *            see <p7_Decoding()>. Then the OA matrix must not be used.
+ */
+int
+p7_OptimalAccuracyCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, float *ret_e)
+{
+  int L = oxf->L;
+  int W = p7_omx_CheckpointStride(L);
+  int a, b, i;
+  int status;
+
+  oa_init(om, L, ox);
+  for (a = 0; a < L; a += W)
+    {
+      b = ESL_MIN(a+W, L);
+      p7_ForwardSegment (dsq, L, om, oxf,      a, b);
+      p7_BackwardSegment(dsq, L, om, oxf, oxb, a, b);
+      if ((status = p7_DecodingSegment(om, oxf, oxb, pp, (a == 0 ? 0 : a+1), b, TRUE)) != eslOK) return status;
+      for (i = a+1; i <= b; i++)
+	oa_row(om, pp, ox, i);
+    }
+
+  *ret_e = ox->xmx[L*p7X_NXCELLS+p7X_C];
+  return eslOK;
+}
+
+
+/* oa_init(), oa_row()
+ *
+ * The guts of the OA fill: initialize row 0 of <ox> for a target of
+ * length <L>; fill row <i> of <ox> from its row <i-1> and row <i>
+ * of posterior probabilities <pp>.
+ */
+static void
+oa_init(const P7_OPROFILE *om, int L, P7_OMX *ox)
+{
+  float  *xmx  = ox->xmx;
+  __m128 *dpc  = ox->dpf[0];
+  __m128  infv = _mm_set1_ps(-eslINFINITY);
+  int     Q    = p7O_NQF(om->M);
+  int     q;
+
+  ox->M = om->M;
+  ox->L = L;
+  for (q = 0; q < Q; q++) MMO(dpc, q) = IMO(dpc,q) = DMO(dpc,q) = infv;
+  XMXo(0, p7X_E)    = -eslINFINITY;
+  XMXo(0, p7X_N)    = 0.;
+  XMXo(0, p7X_J)    = -eslINFINITY;
+  XMXo(0, p7X_B)    = 0.;
+  XMXo(0, p7X_C)    = -eslINFINITY;
+}
+
+static inline void
+oa_row(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, int i)
 {
   register __m128 mpv, dpv, ipv;   /* previous row values                                       */
   register __m128 sv;		   /* temp storage of 1 curr row value in progress              */
@@ -63,110 +167,89 @@ p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *r
   register __m128 xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
   register __m128 dcv;
   float  *xmx = ox->xmx;
-  __m128 *dpc = ox->dpf[0];        /* current row, for use in {MDI}MO(dpp,q) access macro       */
-  __m128 *dpp;                     /* previous row, for use in {MDI}MO(dpp,q) access macro      */
-  __m128 *ppp;			   /* quads in the <pp> posterior probability matrix            */
-  __m128 *tp;			   /* quads in the <om->tfv> transition scores                  */
+  __m128 *dpc = ox->dpf[i];        /* current DP row in OA matrix                               */
+  __m128 *dpp = ox->dpf[i-1];      /* previous DP row in OA matrix                              */
+  __m128 *ppp = pp->dpf[i];        /* current row in the posterior probabilities per position   */
+  __m128 *tp  = om->tfv;           /* quads in the <om->tfv> transition scores                  */
   __m128 zerov = _mm_setzero_ps();
   __m128 infv  = _mm_set1_ps(-eslINFINITY);
-  int M = om->M;
-  int Q = p7O_NQF(M);
+  int Q = p7O_NQF(om->M);
   int q;
   int j;
-  int i;
   float t1, t2;
 
-  ox->M = om->M;
-  ox->L = pp->L;
-  for (q = 0; q < Q; q++) MMO(dpc, q) = IMO(dpc,q) = DMO(dpc,q) = infv;
-  XMXo(0, p7X_E)    = -eslINFINITY;
-  XMXo(0, p7X_N)    = 0.;
-  XMXo(0, p7X_J)    = -eslINFINITY;
-  XMXo(0, p7X_B)    = 0.;
-  XMXo(0, p7X_C)    = -eslINFINITY;
+  dcv = infv;
+  xEv = infv;
+  xBv = _mm_set1_ps(XMXo(i-1, p7X_B));
 
-  for (i = 1; i <= pp->L; i++)
+  mpv = esl_sse_rightshift_ps(MMO(dpp,Q-1), infv);  /* Right shifts by 4 bytes. 4,8,12,x becomes x,4,8,12. */
+  dpv = esl_sse_rightshift_ps(DMO(dpp,Q-1), infv);
+  ipv = esl_sse_rightshift_ps(IMO(dpp,Q-1), infv);
+  for (q = 0; q < Q; q++)
     {
-      dpp = dpc;		/* previous DP row in OA matrix */
-      dpc = ox->dpf[i];   	/* current DP row in OA matrix  */
-      ppp = pp->dpf[i];		/* current row in the posterior probabilities per position */
-      tp  = om->tfv;		/* transition probabilities */
-      dcv = infv;
-      xEv = infv;
-      xBv = _mm_set1_ps(XMXo(i-1, p7X_B));
-
-      mpv = esl_sse_rightshift_ps(MMO(dpp,Q-1), infv);  /* Right shifts by 4 bytes. 4,8,12,x becomes x,4,8,12. */
-      dpv = esl_sse_rightshift_ps(DMO(dpp,Q-1), infv);
-      ipv = esl_sse_rightshift_ps(IMO(dpp,Q-1), infv);
-      for (q = 0; q < Q; q++)
-	{
-	  sv  =                _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), xBv);  tp++;
-	  sv  = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), mpv)); tp++;
-	  sv  = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), ipv)); tp++;
-	  sv  = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), dpv)); tp++;
-	  sv  = _mm_add_ps(sv, *ppp);                                      ppp += 2;
-	  xEv = _mm_max_ps(xEv, sv);
+      sv  =                _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), xBv);  tp++;
+      sv  = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), mpv)); tp++;
+      sv  = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), ipv)); tp++;
+      sv  = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), dpv)); tp++;
+      sv  = _mm_add_ps(sv, *ppp);                                      ppp += 2;
+      xEv = _mm_max_ps(xEv, sv);
 	  
-	  mpv = MMO(dpp,q);
-	  dpv = DMO(dpp,q);
-	  ipv = IMO(dpp,q);
+      mpv = MMO(dpp,q);
+      dpv = DMO(dpp,q);
+      ipv = IMO(dpp,q);
 
-	  MMO(dpc,q) = sv;
-	  DMO(dpc,q) = dcv;
+      MMO(dpc,q) = sv;
+      DMO(dpc,q) = dcv;
 
-	  dcv = _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), sv); tp++;
+      dcv = _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), sv); tp++;
 
-	  sv         =                _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), mpv);   tp++;
-	  sv         = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), ipv));  tp++;
-	  IMO(dpc,q) = _mm_add_ps(sv, *ppp);                                       ppp++;
-	}
+      sv         =                _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), mpv);   tp++;
+      sv         = _mm_max_ps(sv, _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), ipv));  tp++;
+      IMO(dpc,q) = _mm_add_ps(sv, *ppp);                                       ppp++;
+    }
       
-      /* dcv has carried through from end of q loop above; store it 
-       * in first pass, we add M->D and D->D path into DMX
-       */
-      dcv = esl_sse_rightshift_ps(dcv, infv); 
-      tp  = om->tfv + 7*Q;	/* set tp to start of the DD's */
+  /* dcv has carried through from end of q loop above; store it 
+   * in first pass, we add M->D and D->D path into DMX
+   */
+  dcv = esl_sse_rightshift_ps(dcv, infv); 
+  tp  = om->tfv + 7*Q;	/* set tp to start of the DD's */
+  for (q = 0; q < Q; q++)
+    {
+      DMO(dpc, q) = _mm_max_ps(dcv, DMO(dpc, q));
+      dcv         = _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), DMO(dpc,q));   tp++;
+    }
+
+  /* fully serialized D->D; can optimize later */
+  for (j = 1; j < 4; j++)
+    {
+      dcv = esl_sse_rightshift_ps(dcv, infv);
+      tp  = om->tfv + 7*Q;	
       for (q = 0; q < Q; q++)
 	{
 	  DMO(dpc, q) = _mm_max_ps(dcv, DMO(dpc, q));
-	  dcv         = _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), DMO(dpc,q));   tp++;
-	}
-
-      /* fully serialized D->D; can optimize later */
-      for (j = 1; j < 4; j++)
-	{
-	  dcv = esl_sse_rightshift_ps(dcv, infv);
-	  tp  = om->tfv + 7*Q;	
-	  for (q = 0; q < Q; q++)
-	    {
-	      DMO(dpc, q) = _mm_max_ps(dcv, DMO(dpc, q));
-	      dcv         = _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), dcv);   tp++;
-	    }
+	  dcv         = _mm_and_ps(_mm_cmpgt_ps(*tp, zerov), dcv);   tp++;
 	}
+    }
 
-      /* D->E paths */
-      for (q = 0; q < Q; q++) xEv = _mm_max_ps(xEv, DMO(dpc,q));
+  /* D->E paths */
+  for (q = 0; q < Q; q++) xEv = _mm_max_ps(xEv, DMO(dpc,q));
       
-      /* Specials */
-      esl_sse_hmax_ps(xEv, &(XMXo(i,p7X_E)));
+  /* Specials */
+  esl_sse_hmax_ps(xEv, &(XMXo(i,p7X_E)));
       
-      t1 = ( (om->xf[p7O_J][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[(i-1)*p7X_NXCELLS+p7X_J] + pp->xmx[i*p7X_NXCELLS+p7X_J]);
-      t2 = ( (om->xf[p7O_E][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[   i *p7X_NXCELLS+p7X_E]);
-      ox->xmx[i*p7X_NXCELLS+p7X_J] = ESL_MAX(t1, t2);
+  t1 = ( (om->xf[p7O_J][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[(i-1)*p7X_NXCELLS+p7X_J] + pp->xmx[i*p7X_NXCELLS+p7X_J]);
+  t2 = ( (om->xf[p7O_E][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[   i *p7X_NXCELLS+p7X_E]);
+  ox->xmx[i*p7X_NXCELLS+p7X_J] = ESL_MAX(t1, t2);
 
-      t1 = ( (om->xf[p7O_C][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[(i-1)*p7X_NXCELLS+p7X_C] + pp->xmx[i*p7X_NXCELLS+p7X_C]);
-      t2 = ( (om->xf[p7O_E][p7O_MOVE] == 0.0) ? 0.0 : ox->xmx[   i *p7X_NXCELLS+p7X_E]);
-      ox->xmx[i*p7X_NXCELLS+p7X_C] = ESL_MAX(t1, t2);
+  t1 = ( (om->xf[p7O_C][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[(i-1)*p7X_NXCELLS+p7X_C] + pp->xmx[i*p7X_NXCELLS+p7X_C]);
+  t2 = ( (om->xf[p7O_E][p7O_MOVE] == 0.0) ? 0.0 : ox->xmx[   i *p7X_NXCELLS+p7X_E]);
+  ox->xmx[i*p7X_NXCELLS+p7X_C] = ESL_MAX(t1, t2);
       
-      ox->xmx[i*p7X_NXCELLS+p7X_N] = ((om->xf[p7O_N][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[(i-1)*p7X_NXCELLS+p7X_N] + pp->xmx[i*p7X_NXCELLS+p7X_N]);
+  ox->xmx[i*p7X_NXCELLS+p7X_N] = ((om->xf[p7O_N][p7O_LOOP] == 0.0) ? 0.0 : ox->xmx[(i-1)*p7X_NXCELLS+p7X_N] + pp->xmx[i*p7X_NXCELLS+p7X_N]);
       
-      t1 = ( (om->xf[p7O_N][p7O_MOVE] == 0.0) ? 0.0 : ox->xmx[i*p7X_NXCELLS+p7X_N]);
-      t2 = ( (om->xf[p7O_J][p7O_MOVE] == 0.0) ? 0.0 : ox->xmx[i*p7X_NXCELLS+p7X_J]);
-      ox->xmx[i*p7X_NXCELLS+p7X_B] = ESL_MAX(t1, t2);
-    }
-
-  *ret_e = ox->xmx[pp->L*p7X_NXCELLS+p7X_C];
-  return eslOK;
+  t1 = ( (om->xf[p7O_N][p7O_MOVE] == 0.0) ? 0.0 : ox->xmx[i*p7X_NXCELLS+p7X_N]);
+  t2 = ( (om->xf[p7O_J][p7O_MOVE] == 0.0) ? 0.0 : ox->xmx[i*p7X_NXCELLS+p7X_J]);
+  ox->xmx[i*p7X_NXCELLS+p7X_B] = ESL_MAX(t1, t2);
 }
 /*------------------- end, OA DP fill ---------------------------*/
 
@@ -262,6 +345,95 @@ p7_OATrace(const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *
   return p7_trace_Reverse(tr);
 }
 
+
+/* Function:  p7_OATraceCheckpointed()
+ * Synopsis:  Optimal accuracy traceback in O(M sqrt(L)) memory.
+ *
+ * Purpose:   Same as <p7_OATrace()>, for a checkpointed OA matrix
+ *            <ox> just filled by <p7_OptimalAccuracyCheckpointed()>
+ *            with the same <dsq>, <oxf>, <oxb>, <pp>. Whenever the
+ *            traceback enters a new block of rows between
+ *            checkpoints in the core model, the Forward, Backward,
+ *            posterior and OA rows of that block are recalculated
+ *            from their checkpoints. Blocks that the trace passes
+ *            through in N, C or J states cost nothing, because the
+ *            special state rows are all kept.
+ *
+ *            The recalculations are identical to the fill stage's,
+ *            so the trace is identical to <p7_OATrace()>'s with full
+ *            matrices. Row 0 of <pp> isn't touched.
+ *
+ * Args:      dsq  - digital target sequence, 1..L
+ *            om   - profile
+ *            oxf  - checkpointed Forward matrix
+ *            oxb  - checkpointed Backward matrix
+ *            pp   - checkpointed posterior probabilities
+ *            ox   - checkpointed OA matrix to trace
+ *            tr   - storage for the recovered traceback
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINVAL> if the trace <tr> isn't empty (needs to be Reuse()'d).
+ */
+int
+p7_OATraceCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, P7_TRACE *tr)
+{
+  int   L   = ox->L;
+  int   W   = p7_omx_CheckpointStride(L);
+  int   a   = 0;		/* current block: MDI rows a..b of <pp>, a+1..b of <ox> are valid ... */
+  int   b   = 0;		/* ... and none are, to start */
+  int   i   = L;		/* position in sequence 1..L */
+  int   k   = 0;		/* position in model 1..M */
+  int   s0, s1;			/* choice of a state */
+  int   r;
+  float postprob;
+  int   status;			
+  
+  if (tr->N != 0) ESL_EXCEPTION(eslEINVAL, "trace not empty; needs to be Reuse()'d?");
+
+  if ((status = p7_trace_AppendWithPP(tr, p7T_T, k, i, 0.0)) != eslOK) return status;
+  if ((status = p7_trace_AppendWithPP(tr, p7T_C, k, i, 0.0)) != eslOK) return status;
+
+  s0 = tr->st[tr->N-1];
+  while (s0 != p7T_S)
+    {
+      /* M,D,I,E at row i need OA rows i-1..i, and posteriors for rows i-1..i */
+      if ((s0 == p7T_M || s0 == p7T_D || s0 == p7T_I || s0 == p7T_E) && (i <= a || i > b))
+	{
+	  a = ((i-1) / W) * W;
+	  b = ESL_MIN(a+W, L);
+	  p7_ForwardSegment (dsq, L, om, oxf,      a, b);
+	  p7_BackwardSegment(dsq, L, om, oxf, oxb, a, b);
+	  if ((status = p7_DecodingSegment(om, oxf, oxb, pp, ESL_MAX(a, 1), b, FALSE)) != eslOK) return status;
+	  for (r = a+1; r <= b; r++)
+	    oa_row(om, pp, ox, r);
+	}
+
+      switch (s0) {
+      case p7T_M: s1 = select_m(om,     ox, i, k);  k--; i--; break;
+      case p7T_D: s1 = select_d(om,     ox, i, k);  k--;      break;
+      case p7T_I: s1 = select_i(om,     ox, i, k);       i--; break;
+      case p7T_N: s1 = select_n(i);                           break;
+      case p7T_C: s1 = select_c(om, pp, ox, i);               break;
+      case p7T_J: s1 = select_j(om, pp, ox, i);               break;
+      case p7T_E: s1 = select_e(om,     ox, i, &k);           break;
+      case p7T_B: s1 = select_b(om,     ox, i);               break;
+      default: ESL_EXCEPTION(eslEINVAL, "bogus state in traceback");
+      }
+      if (s1 == -1) ESL_EXCEPTION(eslEINVAL, "OA traceback choice failed");
+
+      postprob = get_postprob(pp, s1, s0, k, i);
+      if ((status = p7_trace_AppendWithPP(tr, s1, k, i, postprob)) != eslOK) return status;
+
+      if ( (s1 == p7T_N || s1 == p7T_J || s1 == p7T_C) && s1 == s0) i--;
+      s0 = s1;
+    } /* end traceback, at S state */
+  tr->M = om->M;
+  tr->L = L;
+  return p7_trace_Reverse(tr);
+}
+
 static inline float
 get_postprob(const P7_OMX *pp, int scur, int sprv, int k, int i)
 {
@@ -728,6 +900,87 @@ utest_optacc(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, i
   p7_hmm_Destroy(hmm);
 }
 
+/* utest_checkpointed()
+ * 
+ * The checkpointed O(M sqrt L) OA fill and traceback must give the
+ * same OA score, trace, and null2 counts as the full-matrix
+ * versions. Sequences are emitted from the model, so traces pass
+ * through several blocks of rows.
+ */
+static void
+utest_checkpointed(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char        *msg = "checkpointed optimal accuracy unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_SQ      *sq  = esl_sq_CreateDigital(abc);
+  P7_OMX      *fwd = p7_omx_Create(M, L, L);
+  P7_OMX      *bck = p7_omx_Create(M, L, L);
+  P7_OMX      *cf  = p7_omx_Create(M, 0, 0);
+  P7_OMX      *cb  = p7_omx_Create(M, 0, 0);
+  P7_OMX      *cpp = p7_omx_Create(M, 0, 0);
+  P7_OMX      *coa = p7_omx_Create(M, 0, 0);
+  P7_TRACE    *tr1 = p7_trace_CreateWithPP();
+  P7_TRACE    *tr2 = p7_trace_CreateWithPP();
+  float       *n2a = malloc(sizeof(float) * abc->Kp);
+  float       *n2b = malloc(sizeof(float) * abc->Kp);
+  float        fsc1, fsc2, bsc1, bsc2, oasc1, oasc2;
+
+  if (n2a == NULL || n2b == NULL) esl_fatal(msg);
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om)!= eslOK) esl_fatal(msg);
+  while (N--)
+    {
+      do {
+	esl_sq_Reuse(sq);
+	if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL)      != eslOK) esl_fatal(msg);
+      } while (sq->n > L * 3); /* keep the full matrices' size reasonable */
+
+      if (p7_omx_GrowTo(fwd, M, sq->n, sq->n)               != eslOK) esl_fatal(msg);
+      if (p7_omx_GrowTo(bck, M, sq->n, sq->n)               != eslOK) esl_fatal(msg);
+      if (p7_Forward (sq->dsq, sq->n, om, fwd,      &fsc1)  != eslOK) esl_fatal(msg);
+      if (p7_Backward(sq->dsq, sq->n, om, fwd, bck, &bsc1)  != eslOK) esl_fatal(msg);
+      if (p7_Decoding(om, fwd, bck, bck)                    != eslOK) esl_fatal(msg);
+      if (p7_OptimalAccuracy(om, bck, fwd, &oasc1)          != eslOK) esl_fatal(msg);
+      if (p7_OATrace(om, bck, fwd, tr1)                     != eslOK) esl_fatal(msg);
+      if (p7_Null2_ByExpectation(om, bck, n2a)              != eslOK) esl_fatal(msg);
+
+      if (p7_omx_GrowToCheckpointed(cf,  M, sq->n)          != eslOK) esl_fatal(msg);
+      if (p7_omx_GrowToCheckpointed(cb,  M, sq->n)          != eslOK) esl_fatal(msg);
+      if (p7_omx_GrowToCheckpointed(cpp, M, sq->n)          != eslOK) esl_fatal(msg);
+      if (p7_omx_GrowToCheckpointed(coa, M, sq->n)          != eslOK) esl_fatal(msg);
+      if (p7_ForwardCheckpointed (sq->dsq, sq->n, om, cf,     &fsc2)   != eslOK) esl_fatal(msg);
+      if (p7_BackwardCheckpointed(sq->dsq, sq->n, om, cf, cb, &bsc2)   != eslOK) esl_fatal(msg);
+      if (p7_OptimalAccuracyCheckpointed(sq->dsq, om, cf, cb, cpp, coa, &oasc2) != eslOK) esl_fatal(msg);
+      if (p7_Null2_ByExpectedCounts(om, cpp, n2b)                      != eslOK) esl_fatal(msg);
+      if (p7_OATraceCheckpointed(sq->dsq, om, cf, cb, cpp, coa, tr2)   != eslOK) esl_fatal(msg);
+
+      if (fsc1  != fsc2)                                 esl_fatal(msg);
+      if (bsc1  != bsc2)                                 esl_fatal(msg);
+      if (oasc1 != oasc2)                                esl_fatal(msg);
+      if (p7_trace_Validate(tr2, abc, sq->dsq, NULL)    != eslOK) esl_fatal(msg);
+      if (p7_trace_Compare(tr1, tr2, 0.0)               != eslOK) esl_fatal(msg);
+      if (esl_vec_FCompare(n2a, n2b, abc->Kp, 1e-6)     != eslOK) esl_fatal(msg);
+
+      p7_trace_Reuse(tr1);
+      p7_trace_Reuse(tr2);
+    }
+
+  free(n2a);
+  free(n2b);
+  p7_trace_Destroy(tr1);
+  p7_trace_Destroy(tr2);
+  p7_omx_Destroy(coa);
+  p7_omx_Destroy(cpp);
+  p7_omx_Destroy(cb);
+  p7_omx_Destroy(cf);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  esl_sq_Destroy(sq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
 #endif /*p7OPTACC_TESTDRIVE*/
 /*------------------- end, unit tests ---------------------------*/
 
@@ -811,6 +1064,9 @@ main(int argc, char **argv)
   utest_optacc(go, r, abc, bg, 1, L, 10);  
   utest_optacc(go, r, abc, bg, M, 1, 10);  
 
+  utest_checkpointed(r, abc, bg, M, 400, 10); /* checkpointed OA on multidomain targets */
+  utest_checkpointed(r, abc, bg, 1, 400, 10);
+
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
 
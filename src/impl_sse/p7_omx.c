@@ -215,6 +215,103 @@ p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL)
   return status;
 }  
 
+/* Function:  p7_omx_GrowToCheckpointed()
+ * Synopsis:  Lay out a DP matrix for checkpointed Forward.
+ *
+ * Purpose:   Assures that <ox> can hold a checkpointed Forward
+ *            calculation (<p7_ForwardCheckpointed()>) for a model of
+ *            up to <allocM> nodes and a sequence of length <L>,
+ *            reallocating if needed, and sets its row pointers for
+ *            that.
+ *
+ *            With stride <W = p7_omx_CheckpointStride(L)>, MDI rows
+ *            0, W, 2W... (the checkpoints) get their own memory, and
+ *            each block of rows <a+1..a+W-1> in between shares the
+ *            same <W-1> rows of working memory. All <ox->dpf[0..L]>
+ *            are valid pointers, so the block that's currently
+ *            calculated can be addressed as usual. That's
+ *            $O(M \sqrt{L})$ memory, instead of $O(ML)$. Special
+ *            state rows are kept for all of 0..L.
+ *
+ *            The layout is only meaningful to the checkpointed
+ *            routines. A later <p7_omx_GrowTo()> for one or more MDI
+ *            rows resets <ox> to an ordinary layout.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; the contents of <ox>
+ *            must then be assumed invalid.
+ */
+int
+p7_omx_GrowToCheckpointed(P7_OMX *ox, int allocM, int L)
+{
+  void   *p;
+  int     nqf  = p7O_NQF(allocM);
+  int     W    = p7_omx_CheckpointStride(L);
+  int     nchk = L / W + 1;		/* checkpoint rows 0,W,2W.. <= L */
+  int     R    = nchk + W - 1;		/* ... plus working rows for one block */
+  __m128 *dp0;
+  int     i;
+  int     status;
+
+  if ((status = p7_omx_GrowTo(ox, allocM, R-1, L)) != eslOK) return status;
+
+  if (L >= ox->allocR)
+    {
+      ESL_RALLOC(ox->dpb, p, sizeof(__m128i *) * (L+1));
+      ESL_RALLOC(ox->dpw, p, sizeof(__m128i *) * (L+1));
+      ESL_RALLOC(ox->dpf, p, sizeof(__m128  *) * (L+1));
+      ox->allocR = L+1;
+    }
+
+  /* the DP memory holds at least R rows of <nqf> quads; pack them that way */
+  dp0 = (__m128 *) ( ( (unsigned long int) ((char *) ox->dp_mem + 15) & (~0xf)));
+  for (i = 0; i <= L; i++)
+    ox->dpf[i] = dp0 + (size_t) ((i % W) ? nchk + (i % W) - 1 : i / W) * nqf * p7X_NSCELLS;
+
+  /* only row 0 is where an ordinary layout has it; so any GrowTo() to >=1 row resets */
+  ox->validR = 1;
+  ox->M      = 0;
+  ox->L      = 0;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_omx_CheckpointStride()
+ * Synopsis:  Checkpoint spacing for a checkpointed DP matrix.
+ *
+ * Purpose:   Returns the spacing <W> of checkpointed rows in a
+ *            checkpointed DP matrix for a sequence of length <L>:
+ *            $\lceil \sqrt{L} \rceil$, which minimizes the number of
+ *            rows kept (checkpoints plus one block of working rows).
+ */
+int
+p7_omx_CheckpointStride(int L)
+{
+  int W = (int) ceil(sqrt((double) L));
+  return ESL_MAX(W, 1);
+}
+
+
+/* Function:  p7_omx_FitsRAMLimit()
+ * Synopsis:  Check if a full DP matrix is within the RAM limit.
+ *
+ * Purpose:   Returns <TRUE> if a full optimized DP matrix for a model
+ *            of <M> nodes and a sequence of length <L> needs no more
+ *            than <p7_RAMLIMIT> MB for its MDI cells, and <FALSE> if
+ *            the caller should use checkpointed DP instead.
+ */
+int
+p7_omx_FitsRAMLimit(int M, int L)
+{
+  double nbytes = (double) (L+1) * (double) p7O_NQF(M) * p7X_NSCELLS * sizeof(__m128);
+  return (nbytes <= (double) p7_RAMLIMIT * 1048576.0 ? TRUE : FALSE);
+}
+
+
 /* Function:  p7_omx_FDeconvert()
  * Synopsis:  Convert an optimized DP matrix to generic one.
  * Incept:    SRE, Tue Aug 19 17:58:13 2008 [Janelia]
@@ -27,13 +27,32 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
+/* An ensemble of tracebacks from the same Forward matrix tends to
+ * revisit the same E(i) cells. Choosing the M/D predecessor of E(i) is
+ * an O(M) scan, so when we sample many traces at once we cache, for
+ * each row i we visit, the cumulative probabilities over the 2M cells
+ * in the order select_e() scans them; each later visit to that row is
+ * a binary search.
+ */
+struct ecdf_s {
+  int     ncells;		/* 8Q cells per row table: M lanes, then D lanes, for each q */
+  int    *off;		        /* off[i] = index of row i's table in <cdf>, or -1; [0..L]  */
+  double *cdf;			/* tables for rows built so far, ncells each                */
+  int     n;			/* number of row tables built                               */
+  int     nalloc;		/* number of row tables allocated                           */
+};
+
+static int  stochastic_trace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox, struct ecdf_s *ec, P7_TRACE *tr);
+static int  trace_steps(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, struct ecdf_s *ec, int imin, P7_TRACE *tr, int *ret_s0, int *ret_i, int *ret_k);
+
 static inline int select_m(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, int k);
 static inline int select_d(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, int k);
 static inline int select_i(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, int k);
 static inline int select_n(int i);
 static inline int select_c(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i);
 static inline int select_j(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i);
-static inline int select_e(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k);
+static inline int select_e(double roll, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k);
+static        int select_e_cached(double roll, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k, struct ecdf_s *ec);
 static inline int select_b(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i);
 
 
@@ -71,19 +90,228 @@ int
 p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
 		   P7_TRACE *tr)
 {
-  int   i;			/* position in sequence 1..L */
-  int   k;			/* position in model 1..M */
-  int   s0, s1;			/* choice of a state */
+  return stochastic_trace(rng, dsq, L, om, ox, NULL, tr);
+}
+
+
+/* Function:  p7_StochasticTraceEnsemble()
+ * Synopsis:  Sample an ensemble of tracebacks from a Forward matrix.
+ *
+ * Purpose:   Sample <N> tracebacks from Forward matrix <ox> into
+ *            <tr[0..N-1]>, using random number generator <rng>. The
+ *            result is identical to <N> successive calls to
+ *            <p7_StochasticTrace()> with the same <rng>: the same
+ *            random numbers are consumed in the same order.
+ *
+ *            Sampling the ensemble together is faster, because the
+ *            samples share work. The cumulative distribution over the
+ *            2M predecessors of each E(i) state is calculated once,
+ *            the first time any sample reaches row <i>; subsequent
+ *            visits choose by binary search instead of an O(M) scan.
+ *
+ *            Each trace in <tr[]> is provided by the caller, empty
+ *            (newly created or <Reuse()>'d), and is grown as needed
+ *            here.
+ *
+ * Args:      rng - source of random numbers
+ *            dsq - digital sequence being aligned, 1..L
+ *            L   - length of dsq
+ *            om  - profile
+ *            ox  - Forward matrix to trace, LxM
+ *            N   - number of tracebacks to sample
+ *            tr  - array of <N> traces to fill in
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINVAL> on the same problems as <p7_StochasticTrace()>.
+ */
+int
+p7_StochasticTraceEnsemble(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
+			   int N, P7_TRACE **tr)
+{
+  struct ecdf_s ec;
+  int           i, t;
+  int           status;
+
+  ec.ncells = 8 * p7O_NQF(ox->M);
+  ec.off    = NULL;
+  ec.cdf    = NULL;
+  ec.n      = 0;
+  ec.nalloc = 0;
+
+  ESL_ALLOC(ec.off, sizeof(int) * (L+1));
+  for (i = 0; i <= L; i++) ec.off[i] = -1;
+
+  for (t = 0; t < N; t++)
+    if ((status = stochastic_trace(rng, dsq, L, om, ox, &ec, tr[t])) != eslOK) goto ERROR;
+
+  free(ec.off);
+  free(ec.cdf);
+  return eslOK;
+
+ ERROR:
+  if (ec.off) free(ec.off);
+  if (ec.cdf) free(ec.cdf);
+  return status;
+}
+
+
+/* Function:  p7_StochasticTraceEnsembleCheckpointed()
+ * Synopsis:  Sample an ensemble of tracebacks from a checkpointed Forward matrix.
+ *
+ * Purpose:   Same as <p7_StochasticTraceEnsemble()>, but for a
+ *            checkpointed Forward matrix <ox> as left by
+ *            <p7_ForwardCheckpointed()>, in $O(M \sqrt{L})$ memory.
+ *
+ *            The <N> traces are drawn together, block by block from
+ *            the end of the sequence: each block of the Forward
+ *            matrix is recalculated once from its checkpoint, and all
+ *            traces are advanced through it before moving on to the
+ *            next, so the recalculation costs about one more Forward
+ *            pass in total. Because random numbers are consumed in
+ *            that interleaved order, the sample differs from the one
+ *            <p7_StochasticTraceEnsemble()> would draw from a full
+ *            matrix with the same <rng> state, but it is drawn from
+ *            the same distribution, and it is reproducible.
+ *
+ *            The working rows of <ox> are overwritten.
+ *
+ * Args:      rng - source of random numbers
+ *            dsq - digital sequence being aligned, 1..L
+ *            L   - length of dsq
+ *            om  - profile
+ *            ox  - checkpointed Forward matrix to trace
+ *            N   - number of tracebacks to sample
+ *            tr  - array of <N> traces to fill in
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINVAL> on the same problems as <p7_StochasticTrace()>.
+ */
+int
+p7_StochasticTraceEnsembleCheckpointed(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
+				       int N, P7_TRACE **tr)
+{
+  struct ecdf_s ec;
+  int           W   = p7_omx_CheckpointStride(L);
+  int          *s0  = NULL;		/* current state of each trace    */
+  int          *ti  = NULL;		/* ... its current row i          */
+  int          *tk  = NULL;		/* ... and its current node k     */
+  int           a, b, i, t;
+  int           status;
+
+  ec.ncells = 8 * p7O_NQF(ox->M);
+  ec.off    = NULL;
+  ec.cdf    = NULL;
+  ec.n      = 0;
+  ec.nalloc = 0;
+
+  ESL_ALLOC(ec.off, sizeof(int) * (L+1));
+  ESL_ALLOC(s0,     sizeof(int) * N);
+  ESL_ALLOC(ti,     sizeof(int) * N);
+  ESL_ALLOC(tk,     sizeof(int) * N);
+  for (i = 0; i <= L; i++) ec.off[i] = -1;
+
+  for (t = 0; t < N; t++)
+    {
+      if (tr[t]->N != 0) ESL_XEXCEPTION(eslEINVAL, "trace not empty; needs to be Reuse()'d?");
+      if ((status = p7_trace_Append(tr[t], p7T_T, 0, L)) != eslOK) goto ERROR;
+      if ((status = p7_trace_Append(tr[t], p7T_C, 0, L)) != eslOK) goto ERROR;
+      s0[t] = p7T_C;
+      ti[t] = L;
+      tk[t] = 0;
+    }
+
+  /* Blocks a+1..b, top down. The top block is still in the working
+   * rows from the Forward pass; others are recalculated from their checkpoint a.
+   */
+  for (a = (L > 0 ? ((L-1) / W) * W : 0); a >= 0; a -= W)
+    {
+      b = ESL_MIN(a+W, L);
+      if (b < L && (status = p7_ForwardSegment(dsq, L, om, ox, a, b)) != eslOK) goto ERROR;
+
+      for (t = 0; t < N; t++)
+	if ((status = trace_steps(rng, om, ox, &ec, a, tr[t], &(s0[t]), &(ti[t]), &(tk[t]))) != eslOK) goto ERROR;
+
+      /* no trace comes back up to these rows; drop their E(i) tables */
+      for (i = a; i <= b; i++) ec.off[i] = -1;
+      ec.n = 0;
+    }
+
+  for (t = 0; t < N; t++)
+    {
+      tr[t]->M = om->M;
+      tr[t]->L = L;
+      if ((status = p7_trace_Reverse(tr[t])) != eslOK) goto ERROR;
+    }
+
+  free(ec.off);
+  free(ec.cdf);
+  free(s0);
+  free(ti);
+  free(tk);
+  return eslOK;
+
+ ERROR:
+  if (ec.off) free(ec.off);
+  if (ec.cdf) free(ec.cdf);
+  if (s0)     free(s0);
+  if (ti)     free(ti);
+  if (tk)     free(tk);
+  return status;
+}
+
+
+/* stochastic_trace()
+ * 
+ * The traceback itself, shared by p7_StochasticTrace() (<ec> NULL) and
+ * p7_StochasticTraceEnsemble() (<ec> caching E(i) choices across the
+ * ensemble).
+ */
+static int
+stochastic_trace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
+		 struct ecdf_s *ec, P7_TRACE *tr)
+{
+  int   i = L;			/* position in sequence 1..L */
+  int   k = 0;			/* position in model 1..M */
+  int   s0;			/* current state */
   int   status;			
   
   if (tr->N != 0) ESL_EXCEPTION(eslEINVAL, "trace not empty; needs to be Reuse()'d?");
 
-  i = L;			
-  k = 0;
   if ((status = p7_trace_Append(tr, p7T_T, k, i)) != eslOK) return status;
   if ((status = p7_trace_Append(tr, p7T_C, k, i)) != eslOK) return status;
   s0 = tr->st[tr->N-1];
-  while (s0 != p7T_S)
+  if ((status = trace_steps(rng, om, ox, ec, 0, tr, &s0, &i, &k)) != eslOK) return status;
+
+  tr->M = om->M;
+  tr->L = L;
+  return p7_trace_Reverse(tr);
+}
+
+
+/* trace_steps()
+ *
+ * Continue the traceback <tr>, currently in state <*ret_s0> at row
+ * <*ret_i>, node <*ret_k>, for as long as the DP rows it needs are
+ * rows >= <imin>: moving to M(i,k) or I(i,k) reads row i-1; D and E
+ * read row i; N, C, J, B only read special states. With <imin> = 0
+ * that's the whole traceback, down to S. Upon return, <*ret_s0>,
+ * <*ret_i>, <*ret_k> are where the trace stopped.
+ */
+static int
+trace_steps(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, struct ecdf_s *ec, int imin,
+	    P7_TRACE *tr, int *ret_s0, int *ret_i, int *ret_k)
+{
+  int   i  = *ret_i;		/* position in sequence 1..L */
+  int   k  = *ret_k;		/* position in model 1..M */
+  int   s0 = *ret_s0;		/* choice of a state */
+  int   s1;
+  int   status;
+
+  while (s0 != p7T_S && (i > imin || (i == imin && s0 != p7T_M && s0 != p7T_I)))
     {
       switch (s0) {
       case p7T_M: s1 = select_m(rng, om, ox, i, k);  k--; i--; break;
@@ -92,7 +320,7 @@ p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPRO
       case p7T_N: s1 = select_n(i);                            break;
       case p7T_C: s1 = select_c(rng, om, ox, i);               break;
       case p7T_J: s1 = select_j(rng, om, ox, i);               break;
-      case p7T_E: s1 = select_e(rng, om, ox, i, &k);           break;
+      case p7T_E: s1 = (ec ? select_e_cached(esl_random(rng), om, ox, i, &k, ec) : select_e(esl_random(rng), om, ox, i, &k)); break;
       case p7T_B: s1 = select_b(rng, om, ox, i);               break;
       default: ESL_EXCEPTION(eslEINVAL, "bogus state in traceback");
       }
@@ -102,11 +330,12 @@ p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPRO
 
       if ( (s1 == p7T_N || s1 == p7T_J || s1 == p7T_C) && s1 == s0) i--;
       s0 = s1;
-    } /* end traceback, at S state */
+    } /* end traceback, at S state or at the bottom of the rows we have */
 
-  tr->M = om->M;
-  tr->L = L;
-  return p7_trace_Reverse(tr);
+  *ret_s0 = s0;
+  *ret_i  = i;
+  *ret_k  = k;
+  return eslOK;
 }
 /*------------------ end, stochastic traceback ------------------*/
 
@@ -245,13 +474,14 @@ select_j(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i)
  * factor, and implement FChoose's algorithm here for an on-the-fly 
  * calculation.
  * Note that that means double-precision calculation, to be sure 0.0 <= roll < 1.0
+ * The caller draws <roll>, so the cached version below consumes
+ * random numbers identically.
  */
 static inline int
-select_e(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k)
+select_e(double roll, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k)
 {
   int    Q     = p7O_NQF(ox->M);
   double sum   = 0.0;
-  double roll  = esl_random(rng);
   double norm  = 1.0 / ox->xmx[i*p7X_NXCELLS+p7X_E];
   __m128 xEv   = _mm_set1_ps(norm); /* all M, D already scaled exactly the same */
   union { __m128 v; float p[4]; } u;
@@ -278,6 +508,63 @@ select_e(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, in
   ESL_EXCEPTION(-1, "unreached code was reached. universe collapses.");
 } 
 
+/* select_e_cached()
+ * Same choice as select_e(), by binary search of a cumulative table
+ * for row <i> that's built (in select_e()'s scan order, with the same
+ * float products summed in double precision) on the first visit to <i>.
+ * In the rare case that roundoff leaves <roll> beyond the row total,
+ * defer to select_e() so we follow its wraparound exactly.
+ */
+static int
+select_e_cached(double roll, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k, struct ecdf_s *ec)
+{
+  int     Q = p7O_NQF(ox->M);
+  double *cdf;
+  double  sum;
+  __m128  xEv;
+  union { __m128 v; float p[4]; } u;
+  int     lo, hi, mid;
+  int     q, r, n;
+  int     status;
+
+  if (ec->off[i] == -1)
+    {
+      if (ec->n == ec->nalloc) {
+	ec->nalloc = (ec->nalloc ? ec->nalloc * 2 : 16);
+	ESL_REALLOC(ec->cdf, sizeof(double) * ec->ncells * ec->nalloc);
+      }
+      ec->off[i] = ec->n++;
+      cdf = ec->cdf + (size_t) ec->off[i] * ec->ncells;
+      xEv = _mm_set1_ps(1.0 / ox->xmx[i*p7X_NXCELLS+p7X_E]);
+      sum = 0.0;
+      for (n = 0, q = 0; q < Q; q++)
+	{
+	  u.v = _mm_mul_ps(ox->dpf[i][q*3 + p7X_M], xEv);
+	  for (r = 0; r < 4; r++) { sum += u.p[r]; cdf[n++] = sum; }
+	  u.v = _mm_mul_ps(ox->dpf[i][q*3 + p7X_D], xEv);
+	  for (r = 0; r < 4; r++) { sum += u.p[r]; cdf[n++] = sum; }
+	}
+    }
+  else cdf = ec->cdf + (size_t) ec->off[i] * ec->ncells;
+
+  if (roll >= cdf[ec->ncells-1]) return select_e(roll, om, ox, i, ret_k);
+
+  /* first cell with roll < cdf[n] */
+  lo = 0; hi = ec->ncells-1;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (roll < cdf[mid]) hi = mid;
+    else                 lo = mid + 1;
+  }
+  q = lo / 8;
+  r = lo % 8;
+  if (r < 4) { *ret_k = r*Q     + q + 1; return p7T_M; }
+  else       { *ret_k = (r-4)*Q + q + 1; return p7T_D; }
+
+ ERROR:
+  return -1;
+}
+
 /* B(i) is reached from N(i) or J(i). */
 static inline int
 select_b(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i)
@@ -450,6 +737,86 @@ utest_stotrace(ESL_GETOPTS *go, ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_PROFI
   p7_omx_Destroy(ox);
   p7_gmx_Destroy(gx);
 }
+
+/* The ensemble sampler must give exactly the same traces as the
+ * same number of serial p7_StochasticTrace() calls, given
+ * identically seeded RNGs.
+ */
+static void
+utest_ensemble(ESL_GETOPTS *go, uint32_t seed, P7_OPROFILE *om, ESL_DSQ *dsq, int L, int ntrace)
+{
+  ESL_RANDOMNESS *r1  = esl_randomness_CreateFast(seed);
+  ESL_RANDOMNESS *r2  = esl_randomness_CreateFast(seed);
+  P7_OMX         *ox  = NULL;
+  P7_TRACE      **etr = NULL;
+  P7_TRACE       *tr  = NULL;
+  int             idx;
+
+  if ((ox  = p7_omx_Create(om->M, L, L))               == NULL) esl_fatal("optimized DP matrix create failed");
+  if ((tr  = p7_trace_Create())                        == NULL) esl_fatal("trace creation failed");
+  if ((etr = malloc(sizeof(P7_TRACE *) * ntrace))      == NULL) esl_fatal("malloc failed");
+  for (idx = 0; idx < ntrace; idx++)
+    if ((etr[idx] = p7_trace_Create())                 == NULL) esl_fatal("trace creation failed");
+
+  if (p7_Forward(dsq, L, om, ox, NULL)                              != eslOK) esl_fatal("forward failed");
+  if (p7_StochasticTraceEnsemble(r1, dsq, L, om, ox, ntrace, etr)  != eslOK) esl_fatal("ensemble trace failed");
+
+  for (idx = 0; idx < ntrace; idx++)
+    {
+      if (p7_StochasticTrace(r2, dsq, L, om, ox, tr) != eslOK) esl_fatal("stochastic trace failed");
+      if (p7_trace_Compare(tr, etr[idx], 0.)         != eslOK) esl_fatal("ensemble trace %d differs from serial trace", idx);
+      p7_trace_Reuse(tr);
+    }
+
+  for (idx = 0; idx < ntrace; idx++) p7_trace_Destroy(etr[idx]);
+  free(etr);
+  p7_trace_Destroy(tr);
+  p7_omx_Destroy(ox);
+  esl_randomness_Destroy(r1);
+  esl_randomness_Destroy(r2);
+}
+
+/* The checkpointed sampler must give valid traces, and the same ones
+ * again from an identically seeded RNG.
+ */
+static void
+utest_checkpointed(ESL_GETOPTS *go, uint32_t seed, P7_OPROFILE *om, ESL_DSQ *dsq, int L, int ntrace)
+{
+  ESL_RANDOMNESS *r1  = esl_randomness_CreateFast(seed);
+  ESL_RANDOMNESS *r2  = esl_randomness_CreateFast(seed);
+  P7_OMX         *ox  = NULL;
+  P7_TRACE      **tr1 = NULL;
+  P7_TRACE      **tr2 = NULL;
+  char            errbuf[eslERRBUFSIZE];
+  int             idx;
+
+  if ((ox  = p7_omx_Create(om->M, 0, L))               == NULL) esl_fatal("optimized DP matrix create failed");
+  if (p7_omx_GrowToCheckpointed(ox, om->M, L)          != eslOK) esl_fatal("checkpointed DP matrix layout failed");
+  if ((tr1 = malloc(sizeof(P7_TRACE *) * ntrace))      == NULL) esl_fatal("malloc failed");
+  if ((tr2 = malloc(sizeof(P7_TRACE *) * ntrace))      == NULL) esl_fatal("malloc failed");
+  for (idx = 0; idx < ntrace; idx++)
+    {
+      if ((tr1[idx] = p7_trace_Create())               == NULL) esl_fatal("trace creation failed");
+      if ((tr2[idx] = p7_trace_Create())               == NULL) esl_fatal("trace creation failed");
+    }
+
+  if (p7_ForwardCheckpointed(dsq, L, om, ox, NULL)                              != eslOK) esl_fatal("forward failed");
+  if (p7_StochasticTraceEnsembleCheckpointed(r1, dsq, L, om, ox, ntrace, tr1)  != eslOK) esl_fatal("checkpointed ensemble trace failed");
+  if (p7_StochasticTraceEnsembleCheckpointed(r2, dsq, L, om, ox, ntrace, tr2)  != eslOK) esl_fatal("checkpointed ensemble trace failed");
+
+  for (idx = 0; idx < ntrace; idx++)
+    {
+      if (p7_trace_Validate(tr1[idx], om->abc, dsq, errbuf) != eslOK) esl_fatal("checkpointed trace %d invalid:\n%s", idx, errbuf);
+      if (p7_trace_Compare(tr1[idx], tr2[idx], 0.)          != eslOK) esl_fatal("checkpointed trace %d not reproducible", idx);
+    }
+
+  for (idx = 0; idx < ntrace; idx++) { p7_trace_Destroy(tr1[idx]); p7_trace_Destroy(tr2[idx]); }
+  free(tr1);
+  free(tr2);
+  p7_omx_Destroy(ox);
+  esl_randomness_Destroy(r1);
+  esl_randomness_Destroy(r2);
+}
 #endif /*p7STOTRACE_TESTDRIVE*/
 /*----------------- end, unit tests -----------------------------*/
 
@@ -512,6 +879,8 @@ main(int argc, char **argv)
   if ((sq = esl_sq_CreateDigital(abc))             == NULL) esl_fatal("sequence allocation failed");
   if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL)    != eslOK) esl_fatal("profile emission failed");
   utest_stotrace(go, r, abc, gm, om, sq->dsq, sq->n, ntrace);
+  utest_ensemble    (go, esl_opt_GetInteger(go, "-s"), om, sq->dsq, sq->n, ntrace);
+  utest_checkpointed(go, esl_opt_GetInteger(go, "-s"), om, sq->dsq, sq->n, ntrace);
    
   esl_sq_Destroy(sq);
   free(dsq);
@@ -139,6 +139,126 @@ p7_Decoding(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp)
   else                     return eslOK;
 }
 
+/* Function:  p7_DecodingNull2()
+ * Synopsis:  Posterior decoding, and null2 by expectation.
+ *
+ * Purpose:   The VMX implementation doesn't fuse the two; this is
+ *            <p7_Decoding()> followed by <p7_Null2_ByExpectation()>.
+ */
+int
+p7_DecodingNull2(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, float *null2)
+{
+  int status;
+
+  if ((status = p7_Decoding(om, oxf, oxb, pp)) != eslOK) return status;
+  return p7_Null2_ByExpectation(om, pp, null2);
+}
+
+/* Function:  p7_DecodingCheckpointed()
+ * Synopsis:  Posterior decoding, with a checkpointed Forward matrix.
+ *
+ * Purpose:   The VMX implementation has no checkpointed DP; its
+ *            "checkpointed" Forward matrix is a full one, and this
+ *            is <p7_Decoding()>.
+ */
+int
+p7_DecodingCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp)
+{
+  return p7_Decoding(om, oxf, oxb, pp);
+}
+
+/* Function:  p7_DecodingSegment()
+ * Synopsis:  Posterior decoding of a block of rows.
+ *
+ * Purpose:   Identical to the SSE version: decode rows <i0..i1> of
+ *            <pp> (<i0> = 0 starts a new matrix), and with
+ *            <do_counts> TRUE, add their M, I and N, C, J posteriors
+ *            into row 0 for <p7_Null2_ByExpectedCounts()>.
+ */
+int
+p7_DecodingSegment(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_OMX *pp, int i0, int i1, int do_counts)
+{
+  vector float *ppv;
+  vector float *cv;
+  vector float *fv;
+  vector float *bv;
+  vector float  totrv;
+  vector float  zerov;
+  int    Q  = p7O_NQF(om->M);	
+  int    i,q;
+  float  scaleproduct = 1.0 / oxb->xmx[p7X_N];
+
+  zerov = (vector float) vec_splat_u32(0);
+
+  if (i0 == 0)
+    {
+      pp->M = om->M;
+      pp->L = oxf->L;
+      ppv = pp->dpf[0];
+      for (q = 0; q < Q; q++) {
+	*ppv = zerov; ppv++;
+	*ppv = zerov; ppv++;
+	*ppv = zerov; ppv++;
+      }
+      pp->xmx[p7X_E] = 0.0;
+      pp->xmx[p7X_N] = 0.0;
+      pp->xmx[p7X_J] = 0.0;
+      pp->xmx[p7X_C] = 0.0;
+      pp->xmx[p7X_B] = 0.0;
+      i0 = 1;
+    }
+
+  if (oxb->has_own_scales)
+    for (i = 1; i < i0; i++)
+      scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+
+  for (i = i0; i <= i1; i++)
+    {
+      ppv   = pp->dpf[i];
+      cv    = pp->dpf[0];
+      fv    = oxf->dpf[i];
+      bv    = oxb->dpf[i];
+
+      totrv = esl_vmx_set_float(scaleproduct * oxf->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+
+      for (q = 0; q < Q; q++)
+	{
+	  /* M */
+	  *ppv = vec_madd(*fv,  *bv,    zerov);
+	  *ppv = vec_madd(*ppv,  totrv, zerov);
+	  if (do_counts) cv[p7X_M] = vec_add(*ppv, cv[p7X_M]);
+	  ppv++;  fv++;  bv++;
+
+	  /* D */
+	  *ppv = zerov;
+	  ppv++;  fv++;  bv++;
+
+	  /* I */
+	  *ppv = vec_madd(*fv,  *bv,    zerov);
+	  *ppv = vec_madd(*ppv,  totrv, zerov);
+	  if (do_counts) cv[p7X_I] = vec_add(*ppv, cv[p7X_I]);
+	  ppv++;  fv++;  bv++;
+	  cv += 3;
+	}
+      pp->xmx[i*p7X_NXCELLS+p7X_E] = 0.0;
+      pp->xmx[i*p7X_NXCELLS+p7X_N] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_N] * oxb->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_J] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_J] * oxb->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_C] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_C] * oxb->xmx[i*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_B] = 0.0;
+
+      if (do_counts) {
+	pp->xmx[p7X_N] += pp->xmx[i*p7X_NXCELLS+p7X_N];
+	pp->xmx[p7X_C] += pp->xmx[i*p7X_NXCELLS+p7X_C];
+	pp->xmx[p7X_J] += pp->xmx[i*p7X_NXCELLS+p7X_J];
+      }
+
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+
+  if (isinf(scaleproduct)) return eslERANGE;
+  else                     return eslOK;
+}
+
 /* Function:  p7_DomainDecoding()
  * Synopsis:  Posterior decoding of domain location.
  * Incept:    SRE, Tue Aug  5 08:39:07 2008 [Janelia]
@@ -248,6 +248,59 @@ p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX
 }
 
 
+/* Function:  p7_ForwardCheckpointed()
+ * Synopsis:  The Forward algorithm, checkpointed version.
+ *
+ * Purpose:   The VMX implementation has no checkpointed DP; 
+ *            <p7_omx_GrowToCheckpointed()> lays out a full matrix,
+ *            and this is <p7_Forward()>.
+ */
+int
+p7_ForwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+  return p7_Forward(dsq, L, om, ox, opt_sc);
+}
+
+
+/* Function:  p7_ForwardSegment()
+ * Synopsis:  Recalculate a block of a checkpointed Forward matrix.
+ *
+ * Purpose:   A no-op in the VMX implementation, where a
+ *            "checkpointed" Forward matrix is a full one.
+ */
+int
+p7_ForwardSegment(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, int i0, int i1)
+{
+  return eslOK;
+}
+
+
+/* Function:  p7_BackwardCheckpointed()
+ * Synopsis:  The Backward algorithm, checkpointed version.
+ *
+ * Purpose:   In the VMX implementation, this is <p7_Backward()>
+ *            on a full matrix.
+ */
+int
+p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
+  return p7_Backward(dsq, L, om, fwd, bck, opt_sc);
+}
+
+
+/* Function:  p7_BackwardSegment()
+ * Synopsis:  Recalculate a block of a checkpointed Backward matrix.
+ *
+ * Purpose:   A no-op in the VMX implementation, where a
+ *            "checkpointed" Backward matrix is a full one.
+ */
+int
+p7_BackwardSegment(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, int i0, int i1)
+{
+  return eslOK;
+}
+
+
 
 /*****************************************************************
  * 2. Forward/Backward engine implementations (called thru API)
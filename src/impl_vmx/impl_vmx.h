@@ -141,6 +141,22 @@ typedef struct {
   P7_OPROFILE  **list;        /* array of <P7_OPROFILE> objects               */
 } P7_OM_BLOCK;
 
+/* A cluster of consecutive profiles in a pressed database, saved in
+ * the optional <.h3c> file by <hmmpress --clust>. The representative
+ * <rep> is the max-envelope of the members' match scores, so its MSV
+ * filter score bounds each member's from above: if it can't pass any
+ * member's MSV threshold, hmmscan skips the whole cluster.
+ */
+typedef struct {
+  int           nmodels;      /* number of member profiles                  */
+  uint64_t      nnodes;       /* total M of the members                     */
+  off_t         foff;         /* <.h3f> offset of the first member          */
+  off_t         fend;         /* <.h3f> offset just past the last member    */
+  float        *mmu;          /* members' MSV Gumbel mu's [0..nmodels-1]    */
+  float        *mlambda;      /* members' MSV Gumbel lambdas                */
+  P7_OPROFILE  *rep;          /* representative; MSV filter part only       */
+} P7_OM_CLUSTER;
+
 /* retrieve match odds ratio [k][x]
  * this gets used in p7_alidisplay.c, when we're deciding if a residue is conserved or not */
 static inline float 
@@ -250,6 +266,9 @@ p7_omx_FSetMDI(const P7_OMX *ox, int s, int i, int k, float val)
 /* p7_omx.c */
 extern P7_OMX      *p7_omx_Create(int allocM, int allocL, int allocXL);
 extern int          p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL);
+extern int          p7_omx_GrowToCheckpointed(P7_OMX *ox, int allocM, int L);
+extern int          p7_omx_CheckpointStride(int L);
+extern int          p7_omx_FitsRAMLimit(int M, int L);
 extern int          p7_omx_FDeconvert(P7_OMX *ox, P7_GMX *gx);
 extern int          p7_omx_Reuse  (P7_OMX *ox);
 extern void         p7_omx_Destroy(P7_OMX *ox);
@@ -293,6 +312,9 @@ extern int          p7_oprofile_GetFwdEmissionArray(const P7_OPROFILE *om, P7_BG
 
 /* decoding.c */
 extern int p7_Decoding      (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp);
+extern int p7_DecodingNull2 (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp, float *null2);
+extern int p7_DecodingCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp);
+extern int p7_DecodingSegment(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_OMX *pp, int i0, int i1, int do_counts);
 extern int p7_DomainDecoding(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_DOMAINDEF *ddef);
 
 /* fwdback.c */
@@ -300,6 +322,10 @@ extern int p7_Forward       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,
 extern int p7_ForwardParser (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
 extern int p7_Backward      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
 extern int p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_ForwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *fwd, float *opt_sc);
+extern int p7_ForwardSegment     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *fwd, int i0, int i1);
+extern int p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_BackwardSegment     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, int i0, int i1);
 
 /* io.c */
 extern int p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om);
@@ -312,21 +338,33 @@ extern int p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset);
 extern P7_OM_BLOCK *p7_oprofile_CreateBlock(int size);
 extern void p7_oprofile_DestroyBlock(P7_OM_BLOCK *block);
 
+extern P7_OM_CLUSTER *p7_oprofile_CreateCluster(P7_PROFILE **gmv, int n, off_t foff, off_t fend);
+extern int            p7_oprofile_WriteCluster(FILE *cfp, const P7_OM_CLUSTER *clu);
+extern int            p7_oprofile_ReadCluster(P7_HMMFILE *hfp, const ESL_ALPHABET *abc, P7_OM_CLUSTER **ret_clu);
+extern void           p7_oprofile_DestroyCluster(P7_OM_CLUSTER *clu);
+
 /* msvfilter.c */
 extern int p7_MSVFilter    (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 extern int p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist);
 
 /* null2.c */
 extern int p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
+extern int p7_Null2_ByExpectedCounts(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
 extern int p7_Null2_ByTrace      (const P7_OPROFILE *om, const P7_TRACE *tr, int zstart, int zend, P7_OMX *wrk, float *null2);
 
 /* optacc.c */
 extern int p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp,       P7_OMX *ox, float *ret_e);
 extern int p7_OATrace        (const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *tr);
+extern int p7_OptimalAccuracyCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, float *ret_e);
+extern int p7_OATraceCheckpointed        (const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, P7_TRACE *tr);
 
 /* stotrace.c */
 extern int p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
 			      P7_TRACE *tr);
+extern int p7_StochasticTraceEnsemble(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
+				      int N, P7_TRACE **tr);
+extern int p7_StochasticTraceEnsembleCheckpointed(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
+						  int N, P7_TRACE **tr);
 
 /* vitfilter.c */
 extern int p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
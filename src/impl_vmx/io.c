@@ -14,10 +14,11 @@
  *    1. Writing optimized profiles to two files.
  *    2. Reading optimized profiles in two stages.
  *    3. Utility routines.
- *    4. Benchmark driver.
- *    5. Unit tests.
- *    6. Test driver.
- *    7. Example.
+ *    4. Clusters of profiles, for hmmscan's prefilter.
+ *    5. Benchmark driver.
+ *    6. Unit tests.
+ *    7. Test driver.
+ *    8. Example.
  *    
  * TODO:
  *    - crossplatform binary compatibility (endedness and off_t)
@@ -31,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #ifdef HMMER_THREADS
 #include <pthread.h>
@@ -47,6 +49,7 @@
 
 static uint32_t  v3f_fmagic = 0xb3e6e6f6; /* 3/f binary MSV file, VMX:     "3ffv" = 0x 33 66 66 76  + 0x80808080 */
 static uint32_t  v3f_pmagic = 0xb3e6f0f6; /* 3/f binary profile file, VMX: "3fpv" = 0x 33 66 70 76  + 0x80808080 */
+static uint32_t  v3f_cmagic = 0xb3e6e3f6; /* 3/f binary cluster file, VMX: "3fcv" = 0x 33 66 63 76  + 0x80808080 */
 
 static uint32_t  v3e_fmagic = 0xb3e5e6f6; /* 3/e binary MSV file, VMX:     "3efv" = 0x 33 65 66 76  + 0x80808080 */
 static uint32_t  v3e_pmagic = 0xb3e5f0f6; /* 3/e binary profile file, VMX: "3epv" = 0x 33 65 70 76  + 0x80808080 */
@@ -698,7 +701,238 @@ p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset)
 
 
 /*****************************************************************
- * 4. Benchmark driver.
+ * 4. Clusters of profiles, for hmmscan's prefilter.
+ *****************************************************************/
+
+/* Function:  p7_oprofile_CreateCluster()
+ * Synopsis:  Create a cluster and its max-envelope representative.
+ *
+ * Purpose:   Given <n> configured profiles <gmv[0..n-1]>, consecutive
+ *            in a pressed database where the first starts at <.h3f>
+ *            offset <foff> and the last ends just before <fend>,
+ *            create a new cluster with a representative profile
+ *            whose MSV filter score is at least that of any member,
+ *            for any target sequence.
+ *            
+ *            The representative is as long as the longest member.
+ *            Each of its residue scores is the maximum of the
+ *            members' at the same node index, and its local entry
+ *            cost is that of the shortest member. MSV byte scores are
+ *            rounded monotonically, and the representative's bias is
+ *            at least any member's, so the bound survives conversion
+ *            and the saturated arithmetic of the filter (an
+ *            overflowing representative returns an infinite score).
+ *            
+ *            Only the MSV filter part of the representative is
+ *            converted, and it has no name.
+ *
+ * Returns:   a pointer to the new <P7_OM_CLUSTER>. Caller frees with
+ *            <p7_oprofile_DestroyCluster()>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_OM_CLUSTER *
+p7_oprofile_CreateCluster(P7_PROFILE **gmv, int n, off_t foff, off_t fend)
+{
+  P7_OM_CLUSTER *clu  = NULL;
+  P7_PROFILE    *env  = NULL;
+  int            imax = 0;
+  int            Mmin;
+  int            i, k, x, z;
+  float          sc;
+  int            status;
+
+  ESL_ALLOC(clu, sizeof(P7_OM_CLUSTER));
+  clu->nmodels = n;
+  clu->nnodes  = 0;
+  clu->foff    = foff;
+  clu->fend    = fend;
+  clu->mmu     = NULL;
+  clu->mlambda = NULL;
+  clu->rep     = NULL;
+  ESL_ALLOC(clu->mmu,     sizeof(float) * n);
+  ESL_ALLOC(clu->mlambda, sizeof(float) * n);
+
+  Mmin = gmv[0]->M;
+  for (i = 0; i < n; i++)
+    {
+      clu->mmu[i]     = gmv[i]->evparam[p7_MMU];
+      clu->mlambda[i] = gmv[i]->evparam[p7_MLAMBDA];
+      clu->nnodes    += gmv[i]->M;
+      if (gmv[i]->M > gmv[imax]->M) imax = i;
+      Mmin = ESL_MIN(Mmin, gmv[i]->M);
+    }
+
+  /* The envelope: insert scores are maxed too, only so its bias can't
+   * be lower than any member's.
+   */
+  if ((env = p7_profile_Clone(gmv[imax])) == NULL) goto ERROR;
+  for (i = 0; i < n; i++)
+    for (x = 0; x < env->abc->Kp; x++)
+      for (k = 0; k <= gmv[i]->M; k++)
+	for (z = 0; z < p7P_NR; z++)
+	  env->rsc[x][k*p7P_NR + z] = ESL_MAX(env->rsc[x][k*p7P_NR + z], gmv[i]->rsc[x][k*p7P_NR + z]);
+
+  if ((clu->rep = p7_oprofile_Create(env->M, env->abc)) == NULL) goto ERROR;
+  if (p7_oprofile_Convert(env, clu->rep) != eslOK)                goto ERROR;
+  free(clu->rep->name); clu->rep->name = NULL;
+
+  /* B->Mk entry, log(2/(M(M+1))), is cheapest for the shortest member; rounded as in unbiased_byteify() */
+  sc                = -1.0f * roundf(clu->rep->scale_b * logf(2.0f / ((float) Mmin * (float) (Mmin+1))));
+  clu->rep->tbm_b   = (sc > 255.) ? 255 : (uint8_t) sc;
+
+  p7_profile_Destroy(env);
+  return clu;
+
+ ERROR:
+  p7_profile_Destroy(env);
+  p7_oprofile_DestroyCluster(clu);
+  return NULL;
+}
+
+/* Function:  p7_oprofile_WriteCluster()
+ * Synopsis:  Write a profile cluster to a <.h3c> file.
+ *
+ * Purpose:   Write cluster <clu> to open binary stream <cfp>,
+ *            typically the <.h3c> file being created by
+ *            <hmmpress --clust>: the cluster's size and <.h3f>
+ *            extent, its members' MSV E-value parameters, and the
+ *            MSV filter part of its representative.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on any write failure, such as filling
+ *            the disk.
+ */
+int
+p7_oprofile_WriteCluster(FILE *cfp, const P7_OM_CLUSTER *clu)
+{
+  P7_OPROFILE *rep  = clu->rep;
+  int          Q16  = p7O_NQB(rep->M);
+  int          x;
+
+  if (fwrite((char *) &(v3f_cmagic),      sizeof(uint32_t), 1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(clu->nmodels),    sizeof(int),      1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(clu->nnodes),     sizeof(uint64_t), 1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(clu->foff),       sizeof(off_t),    1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(clu->fend),       sizeof(off_t),    1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) clu->mmu,           sizeof(float),    clu->nmodels, cfp) != clu->nmodels) ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) clu->mlambda,       sizeof(float),    clu->nmodels, cfp) != clu->nmodels) ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+
+  if (fwrite((char *) &(rep->M),          sizeof(int),      1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(rep->abc->type),  sizeof(int),      1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(rep->tbm_b),      sizeof(uint8_t),  1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(rep->tec_b),      sizeof(uint8_t),  1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(rep->tjb_b),      sizeof(uint8_t),  1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(rep->scale_b),    sizeof(float),    1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(rep->base_b),     sizeof(uint8_t),  1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(rep->bias_b),     sizeof(uint8_t),  1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  for (x = 0; x < rep->abc->Kp; x++)
+    if (fwrite( (char *) rep->rbv[x],     sizeof(vector unsigned char), Q16, cfp) != Q16)          ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed");
+  if (fwrite((char *) &(v3f_cmagic),      sizeof(uint32_t), 1,            cfp) != 1)            ESL_EXCEPTION_SYS(eslEWRITE, "cluster write failed"); /* sentinel */
+  return eslOK;
+}
+
+/* Function:  p7_oprofile_ReadCluster()
+ * Synopsis:  Read the next profile cluster from a <.h3c> file.
+ *
+ * Purpose:   Read the next cluster from the <.h3c> file associated
+ *            with open HMM file <hfp>, in digital alphabet <abc>
+ *            (already known, from the database's profiles), and
+ *            return it in <*ret_clu>. Clusters are in the same order
+ *            as their members in the <.h3f> file.
+ *            
+ *            When no more clusters remain in the file, return
+ *            <eslEOF>.
+ *
+ * Returns:   <eslOK> on success. <*ret_clu> is allocated here; caller
+ *            frees with <p7_oprofile_DestroyCluster()>.
+ *            
+ *            Returns <eslEFORMAT> if <hfp> has no <.h3c> file open,
+ *            or on any parsing error; <eslEINCOMPAT> if the
+ *            representative's alphabet isn't <abc>. On these errors
+ *            <hfp->errbuf> contains an informative error message.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+p7_oprofile_ReadCluster(P7_HMMFILE *hfp, const ESL_ALPHABET *abc, P7_OM_CLUSTER **ret_clu)
+{
+  P7_OM_CLUSTER *clu = NULL;
+  P7_OPROFILE   *rep = NULL;
+  uint32_t       magic;
+  int            M, Q16;
+  int            alphatype;
+  int            x;
+  int            status;
+
+  hfp->errbuf[0] = '\0';
+  if (hfp->cfp == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no profile cluster file; hmmpress --clust wasn't run");
+
+  if (! fread( (char *) &magic, sizeof(uint32_t), 1, hfp->cfp)) { status = eslEOF; goto ERROR; }
+  if (magic != v3f_cmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not a profile cluster file, or an outdated one?");
+
+  ESL_ALLOC(clu, sizeof(P7_OM_CLUSTER));
+  clu->mmu     = NULL;
+  clu->mlambda = NULL;
+  clu->rep     = NULL;
+  if (! fread((char *) &(clu->nmodels), sizeof(int),      1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read cluster size");
+  if (clu->nmodels < 1)                                                            ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad cluster size");
+  if (! fread((char *) &(clu->nnodes),  sizeof(uint64_t), 1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read cluster's total M");
+  if (! fread((char *) &(clu->foff),    sizeof(off_t),    1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read cluster's first offset");
+  if (! fread((char *) &(clu->fend),    sizeof(off_t),    1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read cluster's end offset");
+  ESL_ALLOC(clu->mmu,     sizeof(float) * clu->nmodels);
+  ESL_ALLOC(clu->mlambda, sizeof(float) * clu->nmodels);
+  if (fread((char *) clu->mmu,          sizeof(float),    clu->nmodels, hfp->cfp) != clu->nmodels) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read members' MSV mu's");
+  if (fread((char *) clu->mlambda,      sizeof(float),    clu->nmodels, hfp->cfp) != clu->nmodels) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read members' MSV lambdas");
+
+  if (! fread((char *) &M,              sizeof(int),      1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read representative's M");
+  if (! fread((char *) &alphatype,      sizeof(int),      1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");
+  if (alphatype != abc->type) 
+    ESL_XFAIL(eslEINCOMPAT, hfp->errbuf, "Alphabet type mismatch: was %s, but cluster representative says %s", 
+	      esl_abc_DecodeType(abc->type), esl_abc_DecodeType(alphatype));
+  Q16  = p7O_NQB(M);
+
+  if ((rep = clu->rep = p7_oprofile_Create(M, abc)) == NULL)                        ESL_XFAIL(eslEMEM, hfp->errbuf, "allocation failed: oprofile");
+  rep->M = M;
+  if (! fread((char *) &(rep->tbm_b),   sizeof(uint8_t),  1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tbm");
+  if (! fread((char *) &(rep->tec_b),   sizeof(uint8_t),  1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tec");
+  if (! fread((char *) &(rep->tjb_b),   sizeof(uint8_t),  1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tjb");
+  if (! fread((char *) &(rep->scale_b), sizeof(float),    1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale");
+  if (! fread((char *) &(rep->base_b),  sizeof(uint8_t),  1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base");
+  if (! fread((char *) &(rep->bias_b),  sizeof(uint8_t),  1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read bias");
+  for (x = 0; x < abc->Kp; x++)
+    if (! fread((char *) rep->rbv[x],   sizeof(vector unsigned char), Q16, hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read msv scores at %d [residue %c]", x, abc->sym[x]); 
+
+  if (! fread( (char *) &magic,         sizeof(uint32_t), 1,            hfp->cfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3c file corrupted?");
+  if (magic != v3f_cmagic)                                                         ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3c file corrupted?");
+
+  *ret_clu = clu;
+  return eslOK;
+
+ ERROR:
+  p7_oprofile_DestroyCluster(clu);
+  *ret_clu = NULL;
+  return status;
+}
+
+/* Function:  p7_oprofile_DestroyCluster()
+ * Synopsis:  Frees a <P7_OM_CLUSTER>.
+ */
+void
+p7_oprofile_DestroyCluster(P7_OM_CLUSTER *clu)
+{
+  if (clu == NULL) return;
+  if (clu->mmu     != NULL) free(clu->mmu);
+  if (clu->mlambda != NULL) free(clu->mlambda);
+  if (clu->rep     != NULL) p7_oprofile_Destroy(clu->rep);
+  free(clu);
+}
+/*------------------- end, profile clusters ---------------------*/
+
+
+/*****************************************************************
+ * 5. Benchmark driver.
  *****************************************************************/
 #ifdef p7IO_BENCHMARK
 /*
@@ -770,7 +1004,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 5. Unit tests.
+ * 6. Unit tests.
  *****************************************************************/
 #ifdef p7IO_TESTDRIVE
 
@@ -859,7 +1093,7 @@ utest_ReadWrite(P7_HMM *hmm, P7_OPROFILE *om)
 
 
 /*****************************************************************
- * 6. Test driver
+ * 7. Test driver
  *****************************************************************/
 #ifdef p7IO_TESTDRIVE
 /* 
@@ -921,7 +1155,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 7. Example.
+ * 8. Example.
  *****************************************************************/
 #ifdef p7IO_EXAMPLE
 /* gcc -g -Wall -Dp7IO_EXAMPLE -I.. -I../../easel -L.. -L../../easel -o io_example io.c -lhmmer -leasel -lm
@@ -48,15 +48,7 @@ p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
   int      Ld   = pp->L;
   int      Q    = p7O_NQF(M);
   float   *xmx  = pp->xmx;	/* enables use of XMXo(i,s) macro */
-  float    norm;
-  float    xfactor;
-  int      i,q,x;
-
-  vector float *rp;
-  vector float  sv;
-  vector float  zerov;
-
-  zerov = (vector float) vec_splat_u32(0);
+  int      i,q;
 
   /* Calculate expected # of times that each emitting state was used
    * in generating the Ld residues in this domain.
@@ -79,6 +71,33 @@ p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
       XMXo(0,p7X_J) += XMXo(i,p7X_J); 
     }
 
+  return p7_Null2_ByExpectedCounts(om, pp, null2);
+}
+
+
+/* Function:  p7_Null2_ByExpectedCounts()
+ * Synopsis:  Calculate null2 model from expected state usage counts.
+ *
+ * Purpose:   Identical to the SSE version: the second half of
+ *            <p7_Null2_ByExpectation()>, given summed posteriors
+ *            for rows <1..pp->L> in row 0 of <pp>.
+ */
+int
+p7_Null2_ByExpectedCounts(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
+{
+  int      Ld   = pp->L;
+  int      Q    = p7O_NQF(om->M);
+  float   *xmx  = pp->xmx;	/* enables use of XMXo(i,s) macro */
+  float    norm;
+  float    xfactor;
+  int      q,x;
+
+  vector float *rp;
+  vector float  sv;
+  vector float  zerov;
+
+  zerov = (vector float) vec_splat_u32(0);
+
   /* Convert those expected #'s to frequencies, to use as posterior weights. */
   norm = 1.0 / (float) Ld;
   sv   = esl_vmx_set_float(norm);
@@ -172,6 +172,24 @@ p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *r
   *ret_e = ox->xmx[pp->L*p7X_NXCELLS+p7X_C];
   return eslOK;
 }
+
+/* Function:  p7_OptimalAccuracyCheckpointed()
+ * Synopsis:  OA DP fill, with checkpointed matrices.
+ *
+ * Purpose:   The VMX implementation has no checkpointed DP; all the
+ *            matrices are full ones. This decodes <pp> from <oxf>,
+ *            <oxb> (summing expected state usage in row 0 for
+ *            <p7_Null2_ByExpectedCounts()>, as the SSE version does),
+ *            then is <p7_OptimalAccuracy()>.
+ */
+int
+p7_OptimalAccuracyCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, float *ret_e)
+{
+  int status;
+
+  if ((status = p7_DecodingSegment(om, oxf, oxb, pp, 0, oxf->L, TRUE)) != eslOK) return status;
+  return p7_OptimalAccuracy(om, pp, ox, ret_e);
+}
 /*------------------- end, OA DP fill ---------------------------*/
 
 
@@ -428,6 +446,18 @@ select_b(const P7_OPROFILE *om, const P7_OMX *ox, int i)
   path[1] = ( (om->xf[p7O_J][p7O_MOVE] == 0.0) ? -eslINFINITY : ox->xmx[i*p7X_NXCELLS+p7X_J]);
   return  ((path[0] > path[1]) ? p7T_N : p7T_J);
 }
+
+/* Function:  p7_OATraceCheckpointed()
+ * Synopsis:  OA traceback, with checkpointed matrices.
+ *
+ * Purpose:   In the VMX implementation, this is <p7_OATrace()> on
+ *            the full matrices.
+ */
+int
+p7_OATraceCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp, P7_OMX *ox, P7_TRACE *tr)
+{
+  return p7_OATrace(om, pp, ox, tr);
+}
 /*---------------------- end, OA traceback ----------------------*/
 
 
@@ -218,6 +218,47 @@ p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL)
   return status;
 }  
 
+/* Function:  p7_omx_GrowToCheckpointed()
+ * Synopsis:  Lay out a DP matrix for checkpointed Forward.
+ *
+ * Purpose:   Assures that <ox> can hold a checkpointed Forward
+ *            calculation for a model of up to <allocM> nodes and a
+ *            sequence of length <L>. The VMX implementation has no
+ *            checkpointed DP; it allocates a full matrix, and the
+ *            checkpointed routines are the ordinary ones.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_omx_GrowToCheckpointed(P7_OMX *ox, int allocM, int L)
+{
+  return p7_omx_GrowTo(ox, allocM, L, L);
+}
+
+/* Function:  p7_omx_CheckpointStride()
+ * Synopsis:  Checkpoint spacing for a checkpointed DP matrix.
+ */
+int
+p7_omx_CheckpointStride(int L)
+{
+  int W = (int) ceil(sqrt((double) L));
+  return ESL_MAX(W, 1);
+}
+
+/* Function:  p7_omx_FitsRAMLimit()
+ * Synopsis:  Check if a full DP matrix is within the RAM limit.
+ *
+ * Purpose:   Always <TRUE> in the VMX implementation, which only
+ *            has full DP matrices.
+ */
+int
+p7_omx_FitsRAMLimit(int M, int L)
+{
+  return TRUE;
+}
+
 /* Function:  p7_omx_FDeconvert()
  * Synopsis:  Convert an optimized DP matrix to generic one.
  * Incept:    SRE, Tue Aug 19 17:58:13 2008 [Janelia]
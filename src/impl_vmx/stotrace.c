@@ -109,6 +109,46 @@ p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPRO
   tr->L = L;
   return p7_trace_Reverse(tr);
 }
+
+/* Function:  p7_StochasticTraceEnsemble()
+ * Synopsis:  Sample an ensemble of tracebacks from a Forward matrix.
+ *
+ * Purpose:   Sample <N> tracebacks from Forward matrix <ox> into
+ *            <tr[0..N-1]>; identical to <N> successive calls to
+ *            <p7_StochasticTrace()> with the same <rng>. (The SSE
+ *            implementation shares E state choices across the
+ *            ensemble; here we simply sample one at a time.)
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINVAL> on the same problems as <p7_StochasticTrace()>.
+ */
+int
+p7_StochasticTraceEnsemble(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
+			   int N, P7_TRACE **tr)
+{
+  int t;
+  int status;
+
+  for (t = 0; t < N; t++)
+    if ((status = p7_StochasticTrace(rng, dsq, L, om, ox, tr[t])) != eslOK) return status;
+  return eslOK;
+}
+
+/* Function:  p7_StochasticTraceEnsembleCheckpointed()
+ * Synopsis:  Sample an ensemble of tracebacks from a checkpointed Forward matrix.
+ *
+ * Purpose:   The VMX implementation has no checkpointed DP (its
+ *            checkpointed matrices are full ones), so this is
+ *            <p7_StochasticTraceEnsemble()>.
+ */
+int
+p7_StochasticTraceEnsembleCheckpointed(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
+				       int N, P7_TRACE **tr)
+{
+  return p7_StochasticTraceEnsemble(rng, dsq, L, om, ox, N, tr);
+}
 /*------------------ end, stochastic traceback ------------------*/
 
 
@@ -411,5 +411,12 @@ main(int argc, char **argv)
  *     calculation to be as efficient as log(x) -- say 100 clocks --
  *     the 4x SIMD vectorization does not compensate for the 10x hit
  *     in speed. [xref SRE:J8/71]
+ *     Since then, Easel has acquired vectorized esl_sse_logf() and
+ *     esl_sse_expf() at ~4 floats per log/exp call, which changes
+ *     the arithmetic. The generic Forward/Backward now use a
+ *     table-free SSE logsum (p7_sse_FLogsum() in impl_sse.h) on
+ *     SSE builds; see generic_fwdback.c. The table remains the
+ *     serial fallback and what the optimized filters' rescaled
+ *     probability-space Forward is validated against.
  */
 
@@ -32,6 +32,13 @@ static ESL_OPTIONS options[] = {
   { "--sa_freq",    eslARG_INT,        "8",   NULL, NULL,    NULL,  NULL,  NULL,        "suffix array sample rate (power of 2)",                     3 },
   { "--block_size", eslARG_INT,        "50",  NULL, NULL,    NULL,  NULL,  NULL,        "input sequence broken into blocks this size (Mbases)",      3 },
 
+  /* Building a k-mer seed index instead of an FM-index */
+  { "--kmer",         eslARG_NONE,     FALSE, NULL, NULL,    NULL,  NULL,  "--dna,--rna,--fwd_only", "build a protein k-mer seed index (hmmsearch/phmmer --seedidx)", 4 },
+  { "--kmer_pattern", eslARG_STRING, p7_SEEDIDX_PATTERN, NULL, NULL, NULL, "--kmer", NULL, "spaced seed <s> of 1's (care) and 0's (don't care)",        4 },
+
+  /* Building a cluster map instead of an FM-index */
+  { "--clusters",     eslARG_INFILE,   NULL,  NULL, NULL,    NULL,  NULL,  "--kmer,--dna,--rna,--fwd_only", "build a cluster map from <f>'s representative/member name pairs (hmmsearch --clusters)", 5 },
+
   /* hidden*/
   { "--fwd_only",   eslARG_NONE,       FALSE, NULL, NULL,    NULL,  NULL,  NULL,        "build FM-index only for forward search (not for HMMER)",    9 },
 
@@ -66,6 +73,12 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_seqf
       if (puts("\nSpecial options:") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
       esl_opt_DisplayHelp(stdout, go, 3, 2, 80); /* 2= group; 2 = indentation; 120=textwidth*/
 
+      if (puts("\nOptions for a k-mer seed index (hmmsearch/phmmer --seedidx):") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 4, 2, 80);
+
+      if (puts("\nOptions for a cluster map (hmmsearch --clusters):") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 5, 2, 80);
+
       exit(0);
   }
 
@@ -113,6 +126,123 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *seqfile, char *fmfile)
 }
 
 
+/* Function:  build_seedindex()
+ * Synopsis:  Build a k-mer seed index of a protein sequence file (--kmer).
+ *
+ * Purpose:   Index the spaced words of every sequence in <seqfile> and
+ *            save the index to <kfile>, for hmmsearch and phmmer
+ *            --seedidx. The sequence file is read twice, so it can't
+ *            be a stream.
+ */
+static int
+build_seedindex(const ESL_GETOPTS *go, char *seqfile, char *kfile)
+{
+  ESL_ALPHABET *abc   = esl_alphabet_Create(eslAMINO);
+  ESL_SQFILE   *sqfp  = NULL;
+  P7_SEEDINDEX *sx    = NULL;
+  FILE         *ofp   = NULL;
+  int           infmt = eslSQFILE_UNKNOWN;
+  char          errbuf[eslERRBUFSIZE];
+  int           status;
+
+  p7_banner(stdout, go->argv[0], banner);
+  if (fprintf(stdout, "# input sequence file:                     %s\n", seqfile)                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(stdout, "# output k-mer seed index:                 %s\n", kfile)                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(stdout, "# spaced seed pattern:                     %s\n", esl_opt_GetString(go, "--kmer_pattern")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(stdout, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n\n")           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  if (esl_opt_GetString(go, "--informat") != NULL) {
+    infmt = esl_sqio_EncodeFormat(esl_opt_GetString(go, "--informat"));
+    if (infmt == eslSQFILE_UNKNOWN) esl_fatal("%s is not a valid input sequence file format for --informat", esl_opt_GetString(go, "--informat"));
+  }
+
+  status = esl_sqfile_OpenDigital(abc, seqfile, infmt, NULL, &sqfp);
+  if      (status == eslENOTFOUND) esl_fatal("No such file %s", seqfile);
+  else if (status == eslEFORMAT)   esl_fatal("Format of seqfile %s unrecognized.", seqfile);
+  else if (status != eslOK)        esl_fatal("Open failed, code %d.", status);
+
+  if ((status = p7_seedindex_Create(abc, esl_opt_GetString(go, "--kmer_pattern"), &sx, errbuf)) != eslOK) esl_fatal("Bad --kmer_pattern: %s\n", errbuf);
+  if ((status = p7_seedindex_Build(sx, sqfp, errbuf))                                          != eslOK) esl_fatal("Failed to index %s:\n%s\n", seqfile, errbuf);
+
+  if ((ofp = fopen(kfile, "wb")) == NULL)     esl_fatal("Failed to open %s for writing\n", kfile);
+  if ((status = p7_seedindex_Write(ofp, sx)) != eslOK) esl_fatal("Failed to write seed index %s\n", kfile);
+  fclose(ofp);
+
+  if (fprintf(stdout, "Indexed %" PRIu64 " sequences (%" PRIu64 " residues) in %" PRIu64 " word-target pairs over %" PRIu64 " words.\n",
+              sx->nseq, sx->nres, sx->woff[sx->nwords], sx->nwords) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  p7_seedindex_Destroy(sx);
+  esl_sqfile_Close(sqfp);
+  esl_alphabet_Destroy(abc);
+  return eslOK;
+}
+
+
+/* Function:  build_clumap()
+ * Synopsis:  Build a cluster map of a sequence file (--clusters).
+ *
+ * Purpose:   Map every sequence in <seqfile> to its cluster, as given
+ *            by the representative/member name pairs in the --clusters
+ *            file, and save the map to <cfile>, for hmmsearch
+ *            --clusters.
+ */
+static int
+build_clumap(const ESL_GETOPTS *go, char *seqfile, char *cfile)
+{
+  ESL_SQFILE *sqfp  = NULL;
+  P7_CLUMAP  *cm    = NULL;
+  FILE       *ofp   = NULL;
+  int         infmt = eslSQFILE_UNKNOWN;
+  uint64_t    nmulti, nmember, c;
+  uint64_t   *size  = NULL;
+  char        errbuf[eslERRBUFSIZE];
+  int         status;
+
+  p7_banner(stdout, go->argv[0], banner);
+  if (fprintf(stdout, "# input sequence file:                     %s\n", seqfile)                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(stdout, "# clusters (representative/member pairs):  %s\n", esl_opt_GetString(go, "--clusters")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(stdout, "# output cluster map:                      %s\n", cfile)                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(stdout, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n\n")       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  if (esl_opt_GetString(go, "--informat") != NULL) {
+    infmt = esl_sqio_EncodeFormat(esl_opt_GetString(go, "--informat"));
+    if (infmt == eslSQFILE_UNKNOWN) esl_fatal("%s is not a valid input sequence file format for --informat", esl_opt_GetString(go, "--informat"));
+  }
+
+  status = esl_sqfile_Open(seqfile, infmt, NULL, &sqfp);
+  if      (status == eslENOTFOUND) esl_fatal("No such file %s", seqfile);
+  else if (status == eslEFORMAT)   esl_fatal("Format of seqfile %s unrecognized.", seqfile);
+  else if (status != eslOK)        esl_fatal("Open failed, code %d.", status);
+
+  if ((status = p7_clumap_Build(sqfp, esl_opt_GetString(go, "--clusters"), &cm, errbuf)) != eslOK) esl_fatal("Failed to build cluster map of %s:\n%s\n", seqfile, errbuf);
+
+  if ((ofp = fopen(cfile, "wb")) == NULL)   esl_fatal("Failed to open %s for writing\n", cfile);
+  if ((status = p7_clumap_Write(ofp, cm)) != eslOK) esl_fatal("Failed to write cluster map %s\n", cfile);
+  fclose(ofp);
+
+  /* redundancy summary: hmmsearch --clusters screens nclust representatives instead of nseq targets */
+  ESL_ALLOC(size, sizeof(uint64_t) * ESL_MAX(1, cm->nclust));
+  memset(size, 0, sizeof(uint64_t) * ESL_MAX(1, cm->nclust));
+  for (c = 0; c < cm->nseq;   c++) size[cm->clu[c]]++;
+  for (nmulti = nmember = 0, c = 0; c < cm->nclust; c++)
+    if (size[c] > 1) { nmulti++; nmember += size[c]; }
+
+  if (fprintf(stdout, "Mapped %" PRIu64 " sequences to %" PRIu64 " clusters (%.2f sequences/cluster); %" PRIu64 " clusters have more than one member, holding %" PRIu64 " sequences.\n",
+              cm->nseq, cm->nclust, (cm->nclust ? (double) cm->nseq / (double) cm->nclust : 0.), nmulti, nmember) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  free(size);
+  p7_clumap_Destroy(cm);
+  esl_sqfile_Close(sqfp);
+  return eslOK;
+
+ ERROR:
+  free(size);
+  p7_clumap_Destroy(cm);
+  esl_sqfile_Close(sqfp);
+  return status;
+}
+
+
 /* Function:  allocateSeqdata()
  * Synopsis:  ensure that space is allocated for the seqdata object
  *            in the FM-index metadata.
@@ -424,6 +554,26 @@ main(int argc, char **argv)
   ESL_RANDOMNESS *r   = esl_randomness_CreateFast(42);
 
 
+  process_commandline(argc, argv, &go, &fname_in, &fname_out);
+
+  /* A k-mer seed index is its own, portable file format; it doesn't need the SSE FM-index code */
+  if (esl_opt_GetBoolean(go, "--kmer"))
+    {
+      status = build_seedindex(go, fname_in, fname_out);
+      esl_randomness_Destroy(r);
+      esl_getopts_Destroy(go);
+      return status;
+    }
+
+  /* So is a cluster map */
+  if (esl_opt_IsOn(go, "--clusters"))
+    {
+      status = build_clumap(go, fname_in, fname_out);
+      esl_randomness_Destroy(r);
+      esl_getopts_Destroy(go);
+      return status;
+    }
+
 #if !defined (eslENABLE_SSE)
     p7_Fail("The hmmerfm sequence database file format is valid only on systems supporting SSE vector instructions\n");
 #endif
@@ -450,8 +600,6 @@ main(int argc, char **argv)
     esl_fatal("unable to allocate memory to store FM sequence data\n");
 
 
-  process_commandline(argc, argv, &go, &fname_in, &fname_out);
-
   if (esl_opt_IsOn(go, "--bin_length")) meta->freq_cnt_b = esl_opt_GetInteger(go, "--bin_length");
   if ( meta->freq_cnt_b < 32 || meta->freq_cnt_b >4096 ||  (meta->freq_cnt_b & (meta->freq_cnt_b - 1))  ) // test power of 2
     esl_fatal("bin_length must be a power of 2, at least 128, and at most 4096\n");
@@ -24,17 +24,13 @@
 
 #include "hmmer.h"
 
-static int p7_hit_MPISend(P7_HIT *hit, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
 static int p7_hit_MPIPackSize(P7_HIT *hit, MPI_Comm comm, int *ret_n);
 static int p7_hit_MPIPack(P7_HIT *hit, char *buf, int n, int *pos, MPI_Comm comm);
 static int p7_hit_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_HIT *hit);
-static int p7_hit_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_HIT *hit);
 
-static int p7_dcl_MPISend(P7_DOMAIN *dcl, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
 static int p7_dcl_MPIPackSize(P7_DOMAIN *dcl, MPI_Comm comm, int *ret_n);
 static int p7_dcl_MPIPack(P7_DOMAIN *dcl, char *buf, int n, int *pos, MPI_Comm comm);
 static int p7_dcl_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_DOMAIN *dcl);
-static int p7_dcl_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_DOMAIN *dcl);
 
 /*****************************************************************
  * 1. Communicating P7_HMM, a core model.
@@ -696,7 +692,9 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
+  if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   if (MPI_Pack_size(1, MPI_DOUBLE,        comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
+  if (MPI_Pack_size(5, MPI_DOUBLE,        comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   
   /* Make sure the buffer is allocated appropriately */
   if (*buf == NULL || n > *nalloc) {
@@ -718,7 +716,13 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
       bogus.n_past_bias = 0;
       bogus.n_past_vit  = 0;
       bogus.n_past_fwd  = 0;
+      bogus.nres_bias   = 0;
       bogus.Z           = 0.0;
+      bogus.t_msv       = 0.0;
+      bogus.t_bias      = 0.0;
+      bogus.t_vit       = 0.0;
+      bogus.t_fwd       = 0.0;
+      bogus.t_dom       = 0.0;
       pli = &bogus;
    } 
 
@@ -734,7 +738,13 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
   if (MPI_Pack(&pli->n_past_bias, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->n_past_vit,  1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->n_past_fwd,  1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->nres_bias,   1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->Z,           1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->t_msv,       1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->t_bias,      1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->t_vit,       1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->t_fwd,       1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->t_dom,       1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
 
   /* Send the packed pipeline to destination  */
   MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm);
@@ -804,7 +814,13 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_bias), 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_vit),  1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_fwd),  1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->nres_bias),   1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->Z),           1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->t_msv),       1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->t_bias),      1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->t_vit),       1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->t_fwd),       1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->t_dom),       1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
 
   *ret_pli = pli;
   return eslOK;
@@ -830,8 +846,15 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
  *            with MPI tag <tag>, for MPI communicator <comm>, as 
  *            the sole workunit or result. 
  *            
- *            After the TOPHITS <th> information has been sent, send
- *            the each hit as an indepentant message.
+ *            A small header message carrying the number of hits is
+ *            sent first. The hits and their domains then follow as
+ *            a stream of packed chunks of about <p7_MPI_CHUNKSIZE>
+ *            bytes; a single hit that doesn't fit in a chunk gets a
+ *            chunk of its own. Chunks are sent with <MPI_Isend()>
+ *            from two alternating buffers, so packing the next chunk
+ *            overlaps with the transfer of the previous one.
+ *            <*buf> is used as one of the two buffers; the other is
+ *            allocated here and freed before returning.
  *            
  * Returns:   <eslOK> on success; <*buf> may have been reallocated and
  *            <*nalloc> may have been increased.
@@ -843,78 +866,87 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
 int
 p7_tophits_MPISend(P7_TOPHITS *th, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
 {
-  int   status;
-  int   sz, n, pos;
-  int   i, j, inx;
-
-  P7_DOMAIN *dcl = NULL;
-  P7_HIT    *hit = NULL;
+  char        *cbuf[2];		/* double buffer: cbuf[0] is the caller's <*buf> */
+  int          calloc_n[2];	/* allocated sizes of the two buffers            */
+  MPI_Request  req[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL };
+  int          status;
+  int          sz, n, pos;
+  int          i, j;
+  int          k = 0;		/* which buffer we're currently packing          */
+  void        *tmp;
+
+  cbuf[0] = *buf;  calloc_n[0] = (*buf == NULL ? 0 : *nalloc);
+  cbuf[1] = NULL;  calloc_n[1] = 0;
+
+  /* The header: N, nreported, nincluded */
+  if (MPI_Pack_size(3, MPI_UINT64_T, comm, &n) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");
+  if (calloc_n[0] < ESL_MAX(n, p7_MPI_CHUNKSIZE)) {
+    ESL_RALLOC(cbuf[0], tmp, sizeof(char) * ESL_MAX(n, p7_MPI_CHUNKSIZE));
+    calloc_n[0] = ESL_MAX(n, p7_MPI_CHUNKSIZE);
+  }
 
-  n  = 0;
-  sz = 0;
+  pos = 0;
+  if (MPI_Pack(&th->N,         1, MPI_UINT64_T, cbuf[0], calloc_n[0], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&th->nreported, 1, MPI_UINT64_T, cbuf[0], calloc_n[0], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&th->nincluded, 1, MPI_UINT64_T, cbuf[0], calloc_n[0], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Send(cbuf[0], pos, MPI_PACKED, dest, tag, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi send failed");
 
-  /* calculate the buffer size needed to hold the largest hit */
-  hit = th->unsrt;
-  for (i = 0; i < th->N; ++i) {
-    for (j = 0; j < th->unsrt[i].ndom; ++j) {
-      if (sz <= hit->dcl[j].ad->memsize) {
-	sz = hit->dcl[j].ad->memsize;
-	dcl = &hit->dcl[j];
+  /* Stream the hits, each followed by its domains, in chunks */
+  pos = 0;
+  for (i = 0; i < th->N; i++)
+    {
+      if ((status = p7_hit_MPIPackSize(&(th->unsrt[i]), comm, &n)) != eslOK) goto ERROR;
+      for (j = 0; j < th->unsrt[i].ndom; j++) {
+	if ((status = p7_dcl_MPIPackSize(&(th->unsrt[i].dcl[j]), comm, &sz)) != eslOK) goto ERROR;
+	n += sz;
       }
-    }
-    ++hit;
-  }
 
-  if (th->N > 0) {
-    if ((status = p7_hit_MPIPackSize(th->unsrt, comm, &n)) != eslOK) goto ERROR;
-    if (dcl != NULL) {
-      if ((status = p7_dcl_MPIPackSize(dcl, comm, &sz))    != eslOK) goto ERROR;
-      n = (n > sz) ? n : sz;
-    }
-  }
-
-  if (MPI_Pack_size(3, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");
-  n = (n > sz) ? n : sz;
+      /* current chunk is full? ship it, and switch to the other buffer once its last send is done */
+      if (pos > 0 && pos + n > calloc_n[k]) {
+	if (MPI_Isend(cbuf[k], pos, MPI_PACKED, dest, tag, comm, &req[k]) != 0) ESL_XEXCEPTION(eslESYS, "mpi isend failed");
+	k   = 1 - k;
+	pos = 0;
+	if (MPI_Wait(&req[k], MPI_STATUS_IGNORE) != 0) ESL_XEXCEPTION(eslESYS, "mpi wait failed");
+      }
 
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n);
-    *nalloc = n; 
-  }
+      if (calloc_n[k] < ESL_MAX(n, p7_MPI_CHUNKSIZE)) {
+	ESL_RALLOC(cbuf[k], tmp, sizeof(char) * ESL_MAX(n, p7_MPI_CHUNKSIZE));
+	calloc_n[k] = ESL_MAX(n, p7_MPI_CHUNKSIZE);
+      }
 
-  pos = 0;
-  if (MPI_Pack(&th->N,         1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&th->nreported, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&th->nincluded, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-
-  /* Send the packed tophits information */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi send failed");
-  if (th->N == 0) return eslOK;
-
-  /* loop through the hit list sending to dest */
-  hit = th->unsrt;
-  for (inx = 0; inx < th->N; ++inx) {
-    if ((status = p7_hit_MPISend(hit, dest, tag, comm, buf, nalloc)) != eslOK) goto ERROR;
-    ++hit;
-  }
+      if ((status = p7_hit_MPIPack(&(th->unsrt[i]), cbuf[k], calloc_n[k], &pos, comm)) != eslOK) goto ERROR;
+      for (j = 0; j < th->unsrt[i].ndom; j++)
+	if ((status = p7_dcl_MPIPack(&(th->unsrt[i].dcl[j]), cbuf[k], calloc_n[k], &pos, comm)) != eslOK) goto ERROR;
+    }
+  if (pos > 0 && MPI_Isend(cbuf[k], pos, MPI_PACKED, dest, tag, comm, &req[k]) != 0) ESL_XEXCEPTION(eslESYS, "mpi isend failed");
+  if (MPI_Waitall(2, req, MPI_STATUSES_IGNORE) != 0) ESL_XEXCEPTION(eslESYS, "mpi wait failed");
 
+  *buf    = cbuf[0];
+  *nalloc = calloc_n[0];
+  free(cbuf[1]);
   return eslOK;
 
  ERROR:
+  MPI_Waitall(2, req, MPI_STATUSES_IGNORE);
+  *buf    = cbuf[0];
+  *nalloc = calloc_n[0];
+  free(cbuf[1]);
   return status;
 }
 
 /* Function:  p7_tophits_MPIRecv()
  * Synopsis:  Receives an TOPHITS as a work unit from an MPI sender.
  *
- * Purpose:   Sends the TOPHITS <th> as a work unit to MPI process
- *            <dest> (where <dest> ranges from 0..<nproc-1>), tagged
- *            with MPI tag <tag>, for MPI communicator <comm>, as 
- *            the sole workunit or result. 
+ * Purpose:   Receive a TOPHITS work unit sent by
+ *            <p7_tophits_MPISend()> from MPI process <source> (or
+ *            <MPI_ANY_SOURCE>), tagged with <tag> (or <MPI_ANY_TAG>),
+ *            for MPI communicator <comm>, and return it in a newly
+ *            allocated <*ret_th>.
  *            
- *            After the TOPHITS <th> information has been sent, send
- *            the each hit as an indepentant message.
+ *            The header message is received first; the hits are
+ *            then unpacked from the following chunks as each chunk
+ *            arrives. Once the header has been seen, the remaining
+ *            chunks are only accepted from that same sender.
  *            
  * Returns:   <eslOK> on success; <*buf> may have been reallocated and
  *            <*nalloc> may have been increased.
@@ -929,6 +961,7 @@ p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
   int         n;
   int         status;
   int         pos;
+  int         j;
   P7_TOPHITS *th    = NULL;
   P7_HIT     *hit   = NULL;
   MPI_Status  mpistatus;
@@ -962,21 +995,42 @@ p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
     *nalloc = n; 
   }
 
-  /* Receive the packed top hits */
+  /* Receive the packed top hits header */
   MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
 
-  /* Unpack it - watching out for the EOD signal of M = -1. */
   pos = 0;
   if ((th = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
   if (MPI_Unpack(*buf, n, &pos, &nhits,         1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
   if (MPI_Unpack(*buf, n, &pos, &th->nreported, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
   if (MPI_Unpack(*buf, n, &pos, &th->nincluded, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
 
-  /* loop through all of the hits sent */
-  for (inx = 0; inx < nhits; ++inx) {
-      if ((status = p7_tophits_CreateNextHit(th, &hit))                  != eslOK) goto ERROR;
-      if ((status = p7_hit_MPIRecv(source, tag, comm, buf, nalloc, hit)) != eslOK) goto ERROR;
+  /* receive chunks until all the hits are in */
+  inx = 0;
+  while (inx < nhits)
+    {
+      MPI_Probe(source, tag, comm, &mpistatus);
+      MPI_Get_count(&mpistatus, MPI_PACKED, &n);
+
+      if (n > *nalloc) {
+	void *tmp;
+	ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
+	*nalloc = n; 
+      }
+      MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
+
+      pos = 0;
+      while (pos < n && inx < nhits)
+	{
+	  if ((status = p7_tophits_CreateNextHit(th, &hit))              != eslOK) goto ERROR;
+	  if ((status = p7_hit_MPIUnpack(*buf, n, &pos, comm, hit))      != eslOK) goto ERROR;
+	  ESL_ALLOC(hit->dcl, sizeof(P7_DOMAIN) * hit->ndom);
+	  for (j = 0; j < hit->ndom; j++)
+	    if ((status = p7_dcl_MPIUnpack(*buf, n, &pos, comm, hit->dcl + j)) != eslOK) goto ERROR;
+	  inx++;
+	}
+      if (pos < n) ESL_XEXCEPTION(eslESYS, "tophits chunk has trailing data");
     }
+
   *ret_th = th;
   return eslOK;
 
@@ -987,89 +1041,6 @@ p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
 }
 
 
-/* Function:  p7_hit_MPISend()
- */
-int
-p7_hit_MPISend(P7_HIT *hit, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
-{
-  int   inx;
-  int   status;
-  int   pos;
-  int   n = *nalloc;
-
-  /* Pack the HIT into the buffer */
-  pos  = 0;
-  if ((status = p7_hit_MPIPack(hit, *buf, n, &pos, comm)) != eslOK) goto ERROR;
-
-  /* Send the packed HIT to the destination. */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0)  ESL_EXCEPTION(eslESYS, "mpi send failed");
-
-  /* loop through all of the domains */
-  for (inx = 0; inx < hit->ndom; ++inx) {
-    if ((status = p7_dcl_MPISend(hit->dcl + inx, dest, tag, comm, buf, nalloc)) != eslOK) goto ERROR;
-  }
-
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-/* Function:  p7_hit_MPIRecv()
- */
-int
-p7_hit_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_HIT *hit)
-{
-  int         n;
-  int         status;
-  int         pos;
-  int         inx;
-  MPI_Status  mpistatus;
-
-  /* Probe first, because we need to know if our buffer is big enough.
-   */
-  MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
-
-  /* make sure we are getting the tag we expect and from whom we expect if from */
-  if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-  if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-
-  /* set the source and tag */
-  tag = mpistatus.MPI_TAG;
-  source = mpistatus.MPI_SOURCE;
-
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
-    *nalloc = n; 
-  }
-
-  /* Receive the packed top hits */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
-
-  /* Unpack it - watching out for the EOD signal of M = -1. */
-  pos = 0;
-  if ((status = p7_hit_MPIUnpack(*buf, n, &pos, comm, hit)) != eslOK) goto ERROR;
-  ESL_ALLOC(hit->dcl, sizeof(P7_DOMAIN) * hit->ndom);
-
-  /* loop through all of the hits sent */
-  for (inx = 0; inx < hit->ndom; ++inx) {
-     if ((status = p7_dcl_MPIRecv(source, tag, comm, buf, nalloc, hit->dcl + inx)) != eslOK) goto ERROR;
-  }
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
 /* Function:  p7_hit_MPIPackSize()
  * Synopsis:  Calculates size needed to pack a HIT.
  *
@@ -1226,29 +1197,6 @@ p7_hit_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_HIT *hit)
   return status;
 }
 
-/* Function:  p7_dcl_MPISend()
- */
-int
-p7_dcl_MPISend(P7_DOMAIN *dcl, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
-{
-  int   status;
-  int   pos;
-  int   n = *nalloc;
-
-  /* Pack the DOMAIN into the buffer */
-  pos  = 0;
-  if ((status = p7_dcl_MPIPack(dcl, *buf, n, &pos, comm)) != eslOK) goto ERROR;
-
-  /* Send the packed HIT to the destination. */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0)  ESL_EXCEPTION(eslESYS, "mpi send failed");
-
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-
 /* Function:  p7_dcl_MPIPackSize()
  */
 int
@@ -1441,53 +1389,6 @@ p7_dcl_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_DOMAIN *dcl)
   return status;
 }
 
-/* Function:  p7_dcl_MPIRecv()
- */
-int
-p7_dcl_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_DOMAIN *dcl)
-{
-  int         status;
-  int         n;
-  int         pos;
-  MPI_Status  mpistatus;
-
-  /* Probe first, because we need to know if our buffer is big enough.
-   */
-  MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
-
-  /* make sure we are getting the tag we expect and from whom we expect if from */
-  if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-  if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-
-  /* set the source and tag */
-  tag = mpistatus.MPI_TAG;
-  source = mpistatus.MPI_SOURCE;
-
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
-    *nalloc = n; 
-  }
-
-  /* Receive the packed dcl */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
-
-  /* Unpack it, looking at the status code prefix for EOD/EOK  */
-  pos = 0;
-  return p7_dcl_MPIUnpack(*buf, *nalloc, &pos, comm, dcl);
-
- ERROR:
-  return status;
-}
-
 /*----------------- end, P7_TOPHITS communication -------------------*/
 
 
@@ -1703,6 +1604,64 @@ utest_ProfileSendRecv(int my_rank, int nproc)
 
 
 
+/* utest_TophitsSendRecv()
+ * Enough sampled hits that the top hits list has to be streamed
+ * in several chunks, so we exercise the double-buffered sends.
+ */
+static void
+utest_TophitsSendRecv(int my_rank, int nproc)
+{
+  ESL_RAND64     *rng  = esl_rand64_Create(42);
+  P7_TOPHITS     *th   = p7_tophits_Create();
+  P7_TOPHITS     *xth  = NULL;
+  P7_HIT         *hit  = NULL;
+  P7_HIT         *shit = NULL;
+  int             N    = 200;
+  char           *wbuf = NULL;
+  int             wn   = 0;
+  int             i, j;
+
+  /* master and worker's sampled hit lists are identical */
+  for (j = 0; j < N; j++)
+    {
+      p7_tophits_CreateNextHit(th, &hit);
+      shit = NULL;
+      p7_hit_TestSample(rng, &shit);
+      *hit = *shit;
+      free(shit);
+    }
+  th->nreported = N / 2;
+  th->nincluded = N / 4;
+
+  if (my_rank == 0)
+    {
+      for (i = 1; i < nproc; i++)
+	{
+	  ESL_DPRINTF1(("Master: receiving test tophits\n"));
+	  p7_tophits_MPIRecv(MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &wbuf, &wn, &xth);
+	  ESL_DPRINTF1(("Master: test tophits received\n"));
+
+	  if (xth == NULL || xth->N != th->N)                           p7_Die("Received tophits has wrong number of hits");
+	  if (xth->nreported != th->nreported || xth->nincluded != th->nincluded) p7_Die("Received tophits has wrong counts");
+	  for (j = 0; j < N; j++)
+	    if (p7_hit_Compare(&(th->unsrt[j]), &(xth->unsrt[j]), 1e-4, 1e-4) != eslOK) p7_Die("Received hit %d not identical to what was sent", j);
+
+	  p7_tophits_Destroy(xth);
+	}
+    }
+  else 
+    {
+      ESL_DPRINTF1(("Worker %d: sending test tophits\n", my_rank));
+      p7_tophits_MPISend(th, 0, 0, MPI_COMM_WORLD, &wbuf, &wn);
+      ESL_DPRINTF1(("Worker %d: test tophits sent\n", my_rank));
+    }
+
+  free(wbuf);
+  p7_tophits_Destroy(th);
+  esl_rand64_Destroy(rng);
+  return;
+}
+
 #endif /*p7MPISUPPORT_TESTDRIVE*/
 /*---------------------- end, unit tests ------------------------*/
 
@@ -1745,6 +1704,7 @@ main(int argc, char **argv)
 
   utest_HMMSendRecv(my_rank, nproc);
   utest_ProfileSendRecv(my_rank, nproc);
+  utest_TophitsSendRecv(my_rank, nproc);
 
   MPI_Finalize();
   return 0;
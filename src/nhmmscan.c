@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -15,6 +16,7 @@
 
 #ifdef HMMER_THREADS
 #include <unistd.h>
+#include <pthread.h>
 #include "esl_threads.h"
 #include "esl_workqueue.h"
 #endif /*HMMER_THREADS*/
@@ -23,10 +25,23 @@
 #include "esl_vectorops.h"
 
 
+/* The model database, held in memory across query sequences (--dbmem).
+ * Profiles are complete (MSV and rest read, --bgfile emissions already
+ * applied), and score data is complete, read from the <.h3s> file that
+ * hmmpress saves for a DNA database or computed once at load.
+ */
+typedef struct {
+  P7_OPROFILE     **om;
+  P7_SCOREDATA    **sd;
+  int               n;
+  int               nalloc;
+} RESIDENT_DB;
+
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
 #endif /*HMMER_THREADS*/
+  RESIDENT_DB      *db;          /* if non-NULL, search these resident models, not <queue>/<hfp> */
   ESL_SQ           *qsq;
   P7_BG            *bg;	         /* null/background model                              */
   P7_BG            *bg_default;  /* The default null/bg model. This should only be set (non-NULL) if bg has been overriden by --bgfile */
@@ -36,6 +51,13 @@ typedef struct {
   float            *fwd_emissions; /* to hold residue emission probabilities in serial order (gathered from the optimized striped <om> with p7_oprofile_GetFwdEmissionArray() ). */
 } WORKER_INFO;
 
+/* One thread's state in a search of a resident database */
+typedef struct {
+  WORKER_INFO      *info;
+  ESL_SQ           *sq_revcmp;   /* reverse complement of the query, or NULL */
+  int               prev_hit_cnt;
+} RESIDENT_WORKER;
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
@@ -77,12 +99,14 @@ static ESL_OPTIONS options[] = {
   /* Other options */
   { "--qformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,             "assert input <seqfile> is in format <s>",                      12 },
   { "--nonull2",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,             "turn off biased composition score corrections",                12 },
+  { "--stagetimes", eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,             "report wall time spent in each pipeline stage",                12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,             "set # of comparisons done, for E-value calculation",           12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,             "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
   { "--w_beta",     eslARG_REAL,    NULL, NULL, NULL,    NULL,  NULL,           NULL,    "tail mass at which window length is determined",               12 },
   { "--w_length",   eslARG_INT,     NULL, NULL, NULL,    NULL,  NULL,           NULL,    "window length - essentially max expected hit length ",                                                12 },
   { "--watson",     eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,       "--crick",  "only search the top strand",                                    12 },
   { "--crick",      eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,       "--watson",  "only search the bottom strand",                                 12 },
+  { "--dbmem",      eslARG_REAL,      "1024", NULL, "x>=0",   NULL,  NULL,           NULL,  "keep <hmmdb> in memory across queries if <= <x> MB (0: don't)",   12 },
 
 
 
@@ -131,6 +155,14 @@ static char banner[] = "search DNA sequence(s) against a DNA profile database";
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp);
+static int  resident_init(void *arg, int tid, void **ret_tls);
+static int  resident_work(void *arg, void *tls, int i, char *errbuf);
+static void resident_fini(void *tls);
+static void search_model (WORKER_INFO *info, P7_OPROFILE *om, P7_SCOREDATA *scoredata, ESL_SQ *sq_revcmp, int *prev_hit_cnt);
+static void search_resident_model(WORKER_INFO *info, int idx, ESL_SQ *sq_revcmp, int *prev_hit_cnt);
+
+static int  resident_Load   (char *hmmfile, ESL_ALPHABET *abc, P7_BG *bg_manual, double maxmb, RESIDENT_DB **ret_db, char *errbuf);
+static void resident_Destroy(RESIDENT_DB *db);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1
 static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp);
@@ -242,6 +274,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--bgfile")     && fprintf(ofp, "# file with custom bg probs:       %s\n",             esl_opt_GetString(go, "--bgfile"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stagetimes") && fprintf(ofp, "# pipeline stage timing:           on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--watson")    && fprintf(ofp, "# search only top strand:          on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--crick") && fprintf(ofp, "# search only bottom strand:       on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -303,6 +336,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *dfamtblfp= NULL;              // output stream for tabular Dfam format (--dfamtblout)
 
   P7_BG           *bg_manual  = NULL;
+  RESIDENT_DB     *db         = NULL;              /* resident model database, if it fits in --dbmem  */
 
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
@@ -362,6 +396,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   p7_oprofile_Destroy(om);
   p7_hmmfile_Close(hfp);
+  hfp = NULL;
 
   /* Open the query sequence database */
   status = esl_sqfile_OpenDigital(abc, cfg->seqfile, seqfmt, NULL, &sqfp);
@@ -381,6 +416,19 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
  
   output_header(ofp, go, cfg->hmmfile, cfg->seqfile);
 
+  if (esl_opt_IsOn(go, "--bgfile")) {
+    bg_manual = p7_bg_Create(abc);
+    status = p7_bg_Read(esl_opt_GetString(go, "--bgfile"), bg_manual, errbuf);
+    if (status != eslOK) p7_Fail("Trouble reading bgfile: %s\n", errbuf);
+  }
+
+  /* If the pressed database fits in the --dbmem budget, read it (and its score data) once,
+   * instead of re-reading every model for every query; otherwise stream it, as before.
+   */
+  status = resident_Load(cfg->hmmfile, abc, bg_manual, esl_opt_GetReal(go, "--dbmem"), &db, errbuf);
+  if      (status == eslEFORMAT) p7_Fail("bad format, binary auxfiles, %s:\n%s", cfg->hmmfile, errbuf);
+  else if (status != eslOK && status != eslERANGE) p7_Fail("Unexpected error %d in reading HMMs from %s:\n%s", status, cfg->hmmfile, errbuf);
+
 #ifdef HMMER_THREADS
   /* initialize thread data */
   ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
@@ -391,17 +439,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     }
 #endif
 
-  if (esl_opt_IsOn(go, "--bgfile")) {
-    bg_manual = p7_bg_Create(abc);
-    status = p7_bg_Read(esl_opt_GetString(go, "--bgfile"), bg_manual, errbuf);
-    if (status != eslOK) p7_Fail("Trouble reading bgfile: %s\n", errbuf);
-  }
-
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
 
   for (i = 0; i < infocnt; ++i)
   {
+    info[i].db = db;
     if (bg_manual != NULL) {
       info[i].bg         = p7_bg_Clone(bg_manual);
       info[i].bg_default = p7_bg_Create(abc);
@@ -436,18 +479,21 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       nquery++;
       esl_stopwatch_Start(w);	                          
 
-      /* Open the target profile database */
-      status = p7_hmmfile_OpenE(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
-      if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
+      /* Open the target profile database, unless it's resident */
+      if (! db)
+      {
+        status = p7_hmmfile_OpenE(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
+        if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
   
 #ifdef HMMER_THREADS
-      /* if we are threaded, create a lock to prevent multiple readers */
-      if (ncpus > 0)
-      {
-        status = p7_hmmfile_CreateLock(hfp);
-        if (status != eslOK) p7_Fail("Unexpected error %d creating lock\n", status);
-      }
+        /* if we are threaded, create a lock to prevent multiple readers */
+        if (ncpus > 0)
+        {
+          status = p7_hmmfile_CreateLock(hfp);
+          if (status != eslOK) p7_Fail("Unexpected error %d creating lock\n", status);
+        }
 #endif
+      }
 
       if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
       if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -458,7 +504,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         /* Create processing pipeline and hit list */
         info[i].th  = p7_tophits_Create();
         info[i].pli = p7_pipeline_Create(go, 100, 100, TRUE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
-        info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+        info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp>; NULL if resident, because profiles are complete */
 
         p7_pli_NewSeq(info[i].pli, qsq);
         info[i].qsq = qsq;
@@ -473,16 +519,15 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         info[i].fwd_emissions = NULL;
 
 #ifdef HMMER_THREADS
-          if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+          if (ncpus > 0 && ! db) esl_threads_AddThread(threadObj, &info[i]);
 #endif
       }
 
+      if      (db)        hstatus = p7_ThreadedFor(ncpus, db->n, info, resident_init, resident_work, resident_fini, NULL, NULL);
 #ifdef HMMER_THREADS
-      if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp);
-      else	      hstatus = serial_loop(info, hfp);
-#else
-      hstatus = serial_loop(info, hfp);
+      else if (ncpus > 0) hstatus = thread_loop(threadObj, queue, hfp);
 #endif
+      else                hstatus = serial_loop(info, hfp);
       switch(hstatus)
       {
         case eslEFORMAT:   p7_Fail("bad file format in HMM file %s",             cfg->hmmfile);	  break;
@@ -547,7 +592,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
       fflush(ofp);
 
-      p7_hmmfile_Close(hfp);
+      if (hfp) p7_hmmfile_Close(hfp);
+      hfp = NULL;
       p7_pipeline_Destroy(info->pli);
       p7_tophits_Destroy(info->th);
       esl_sq_Reuse(qsq);
@@ -585,6 +631,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
  ERROR:
+  resident_Destroy(db);
   p7_bg_Destroy(bg_manual);
   if (info) free(info);
   if (qsq)  esl_sq_Destroy(qsq);
@@ -603,8 +650,6 @@ static int
 serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
 {
   int            status;
-  int i;
-  int seq_len = 0;
   int prev_hit_cnt = 0;
   P7_OPROFILE   *om        = NULL;
   P7_SCOREDATA  *scoredata = NULL;   /* hmm-specific data used by nhmmer */
@@ -622,8 +667,6 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
   /* Main loop: */
   while ((status = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
   {
-      seq_len = 0;
-
       p7_pli_NewModel(info->pli, om, info->bg);
       p7_bg_SetLength(info->bg, info->qsq->n);
       p7_oprofile_ReconfigLength(om, info->qsq->n);
@@ -645,33 +688,7 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
 
       scoredata = p7_hmm_ScoreDataCreate(om, FALSE);
 
-      //reverse complement
-      if (info->pli->strands != p7_STRAND_TOPONLY && info->qsq->abc->complement != NULL )
-      {
-        status = p7_Pipeline_LongTarget(info->pli, om, scoredata, info->bg, info->th, 0, sq_revcmp, p7_COMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
-        if (status != eslOK) p7_Fail(info->pli->errbuf);
-
-        p7_pipeline_Reuse(info->pli); // prepare for next search
-        seq_len = info->qsq->n;
-      }
-
-      if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
-        status = p7_Pipeline_LongTarget(info->pli, om, scoredata, info->bg, info->th, 0, info->qsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
-        if (status != eslOK) p7_Fail(info->pli->errbuf);
-
-        p7_pipeline_Reuse(info->pli);
-        seq_len += info->qsq->n;
-      }
-
-      for (i = prev_hit_cnt; i < info->th->N ; i++)
-      {
-        info->th->unsrt[i].lnP         += log((float)seq_len / (float)om->max_length);
-        info->th->unsrt[i].dcl[0].lnP   = info->th->unsrt[i].lnP;
-        info->th->unsrt[i].sortkey      = -1.0 * info->th->unsrt[i].lnP;
-        info->th->unsrt[i].dcl[0].ad->L =  om->M;
-      }
-
-      prev_hit_cnt = info->th->N;
+      search_model(info, om, scoredata, sq_revcmp, &prev_hit_cnt);
 
       p7_oprofile_Destroy(om);
       p7_hmm_ScoreDataDestroy(scoredata);
@@ -685,6 +702,261 @@ ERROR:
   return status;
 }
 
+/* resident_init(), resident_work(), resident_fini()
+ * The counterpart of serial_loop() and thread_loop() for a resident
+ * database: search the current query against each of <info->db>'s
+ * models, with p7_ThreadedFor(). Thread <tid> collects its hits in
+ * <info[tid]>. A model is searched by only one thread per query, so
+ * configuring its length is safe.
+ */
+static int
+resident_init(void *arg, int tid, void **ret_tls)
+{
+  WORKER_INFO     *info = (WORKER_INFO *) arg + tid;
+  RESIDENT_WORKER *w    = NULL;
+  int              status;
+
+  ESL_ALLOC(w, sizeof(RESIDENT_WORKER));
+  w->info         = info;
+  w->sq_revcmp    = NULL;
+  w->prev_hit_cnt = 0;
+
+  if (info->pli->strands != p7_STRAND_TOPONLY && info->qsq->abc->complement != NULL ) {
+    w->sq_revcmp =  esl_sq_CreateDigital(info->qsq->abc);
+    esl_sq_Copy(info->qsq, w->sq_revcmp);
+    esl_sq_ReverseComplement(w->sq_revcmp);
+
+    info->pli->nres += info->qsq->n;
+  }
+
+  *ret_tls = w;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+static int
+resident_work(void *arg, void *tls, int i, char *errbuf)
+{
+  RESIDENT_WORKER *w = (RESIDENT_WORKER *) tls;
+
+  search_resident_model(w->info, i, w->sq_revcmp, &(w->prev_hit_cnt));
+  return eslOK;
+}
+
+static void
+resident_fini(void *tls)
+{
+  RESIDENT_WORKER *w = (RESIDENT_WORKER *) tls;
+
+  esl_sq_Destroy(w->sq_revcmp);
+  free(w);
+}
+
+
+/* search_model()
+ * Run the long-target pipeline for the current query (both strands,
+ * as configured) against one model <om> that has been configured for
+ * the query length, then correct the P-values of the new hits for
+ * the target length. <*prev_hit_cnt> is the number of hits in
+ * <info->th> before this model; it's updated.
+ */
+static void
+search_model(WORKER_INFO *info, P7_OPROFILE *om, P7_SCOREDATA *scoredata, ESL_SQ *sq_revcmp, int *prev_hit_cnt)
+{
+  int seq_len = 0;
+  int status;
+  int i;
+
+  //reverse complement
+  if (info->pli->strands != p7_STRAND_TOPONLY && info->qsq->abc->complement != NULL )
+  {
+    status = p7_Pipeline_LongTarget(info->pli, om, scoredata, info->bg, info->th, 0, sq_revcmp, p7_COMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
+    if (status != eslOK) p7_Fail(info->pli->errbuf);
+
+    p7_pipeline_Reuse(info->pli); // prepare for next search
+    seq_len = info->qsq->n;
+  }
+
+  if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
+    status = p7_Pipeline_LongTarget(info->pli, om, scoredata, info->bg, info->th, 0, info->qsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
+    if (status != eslOK) p7_Fail(info->pli->errbuf);
+
+    p7_pipeline_Reuse(info->pli);
+    seq_len += info->qsq->n;
+  }
+
+  for (i = *prev_hit_cnt; i < info->th->N ; i++)
+  {
+    info->th->unsrt[i].lnP         += log((float)seq_len / (float)om->max_length);
+    info->th->unsrt[i].dcl[0].lnP   = info->th->unsrt[i].lnP;
+    info->th->unsrt[i].sortkey      = -1.0 * info->th->unsrt[i].lnP;
+    info->th->unsrt[i].dcl[0].ad->L =  om->M;
+  }
+
+  *prev_hit_cnt = info->th->N;
+}
+
+
+/* search_resident_model()
+ * Search the current query with resident model <idx>. The profile
+ * is already complete, so its thresholds are set here rather than
+ * after the pipeline's ReadRest(); only its length config changes.
+ * Each model is searched by one thread at a time.
+ */
+static void
+search_resident_model(WORKER_INFO *info, int idx, ESL_SQ *sq_revcmp, int *prev_hit_cnt)
+{
+  P7_OPROFILE *om = info->db->om[idx];
+
+  p7_pli_NewModel(info->pli, om, info->bg);
+  if (p7_pli_NewModelThresholds(info->pli, om) != eslOK) p7_Fail(info->pli->errbuf);
+  p7_bg_SetLength(info->bg, info->qsq->n);
+  p7_oprofile_ReconfigLength(om, info->qsq->n);
+
+  search_model(info, om, info->db->sd[idx], sq_revcmp, prev_hit_cnt);
+}
+
+
+/* resident_Load()
+ * Read the whole pressed database <hmmfile> into a new RESIDENT_DB,
+ * in <*ret_db>: complete profiles, with the emission scores
+ * recalculated for <bg_manual> if it's non-NULL (--bgfile), and
+ * complete score data, from the <.h3s> file if hmmpress saved one
+ * (and the scores weren't changed by <bg_manual>) or else computed.
+ *
+ * Returns <eslOK> on success.
+ *
+ * Returns <eslERANGE> if <maxmb> is 0, or the database won't fit in
+ * <maxmb> MB; <*ret_db> is NULL, and the caller streams the database
+ * instead. The budget counts the .h3f and .h3p files and the score
+ * data: the .h3s file if it's used, or else the score data computed
+ * as each model is read, counted at the size of the .h3s record it
+ * would have been. Loading stops as soon as that goes over budget.
+ *
+ * Returns <eslEFORMAT> on a read error, with a message in <errbuf>.
+ */
+static int
+resident_Load(char *hmmfile, ESL_ALPHABET *abc, P7_BG *bg_manual, double maxmb, RESIDENT_DB **ret_db, char *errbuf)
+{
+  RESIDENT_DB  *db            = NULL;
+  P7_HMMFILE   *hfp           = NULL;
+  FILE         *sfp           = NULL;
+  char         *sfile         = NULL;
+  P7_BG        *bg_default    = NULL;
+  P7_OPROFILE  *om            = NULL;
+  float        *fwd_emissions = NULL;
+  float        *scores        = NULL;
+  struct stat   st;
+  double        nbytes        = 0.;
+  int           n;
+  int           status;
+
+  *ret_db = NULL;
+  if (maxmb == 0.) return eslERANGE;
+
+  status = p7_hmmfile_OpenE(hmmfile, p7_HMMDBENV, &hfp, errbuf);
+  if (status != eslOK) goto ERROR;
+
+  /* hfp->fname is the .h3m file; the score data file is the .h3s alongside it */
+  n = strlen(hfp->fname);
+  if ((status = esl_strdup(hfp->fname, n, &sfile)) != eslOK) goto ERROR;
+  sfile[n-1] = 's';
+  if (! bg_manual) sfp = fopen(sfile, "rb");
+
+  if (fstat(fileno(hfp->ffp), &st) == 0) nbytes += st.st_size;
+  if (fstat(fileno(hfp->pfp), &st) == 0) nbytes += st.st_size;
+  if (sfp && fstat(fileno(sfp), &st) == 0) nbytes += st.st_size;
+  if (nbytes > maxmb * 1024. * 1024.) { status = eslERANGE; goto ERROR; }
+
+  ESL_ALLOC(db, sizeof(RESIDENT_DB));
+  db->om     = NULL;
+  db->sd     = NULL;
+  db->n      = 0;
+  db->nalloc = 256;
+  ESL_ALLOC(db->om, sizeof(P7_OPROFILE *)  * db->nalloc);
+  ESL_ALLOC(db->sd, sizeof(P7_SCOREDATA *) * db->nalloc);
+
+  if (bg_manual) {
+    bg_default = p7_bg_Create(abc);
+    ESL_ALLOC(scores, sizeof(float) * abc->Kp * 16);
+  }
+
+  while ((status = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
+    {
+      if (db->n == db->nalloc) {
+	db->nalloc *= 2;
+	ESL_REALLOC(db->om, sizeof(P7_OPROFILE *)  * db->nalloc);
+	ESL_REALLOC(db->sd, sizeof(P7_SCOREDATA *) * db->nalloc);
+      }
+      db->om[db->n] = om;
+      db->sd[db->n] = NULL;
+      db->n++;
+
+      if ((status = p7_oprofile_ReadRest(hfp, om)) != eslOK) { strcpy(errbuf, hfp->errbuf); goto ERROR; }
+
+      if (bg_manual) {   /* same recalculation serial_loop() does for each query when streaming */
+	ESL_REALLOC(fwd_emissions, sizeof(float) * abc->Kp * (om->M+1));
+	p7_oprofile_GetFwdEmissionArray(om, bg_default, fwd_emissions);
+	p7_oprofile_UpdateFwdEmissionScores(om, bg_manual, fwd_emissions, scores);
+	p7_oprofile_UpdateVitEmissionScores(om, bg_manual, fwd_emissions, scores);
+	p7_oprofile_UpdateMSVEmissionScores(om, bg_manual, fwd_emissions, scores);
+      }
+
+      if (sfp) {
+	if ((status = p7_hmm_ScoreDataRead(sfp, om->M, abc->Kp, &(db->sd[db->n-1]), errbuf)) != eslOK) {
+	  if (status == eslEOF) ESL_XFAIL(eslEFORMAT, errbuf, "%s has fewer models than %s; hmmpress again?", sfile, hfp->fname);
+	  goto ERROR;
+	}
+      } else {
+	nbytes += (double) (om->M+1) * (abc->Kp * (sizeof(uint8_t) + sizeof(float)) + (p7O_NTRANS + 2) * sizeof(float));
+	if (nbytes > maxmb * 1024. * 1024.) { status = eslERANGE; goto ERROR; }
+	if ((db->sd[db->n-1] = p7_hmm_ScoreDataCreate(om, NULL)) == NULL) { status = eslEMEM; goto ERROR; }
+	if ((status = p7_hmm_ScoreDataComputeRest(om, db->sd[db->n-1])) != eslOK) { db->sd[db->n-1] = NULL; goto ERROR; }
+      }
+    }
+  if      (status == eslEFORMAT)   { strcpy(errbuf, hfp->errbuf); goto ERROR; }
+  else if (status == eslEINCOMPAT) ESL_XFAIL(eslEFORMAT, errbuf, "HMM file %s contains different alphabets", hmmfile);
+  else if (status != eslEOF)       goto ERROR;
+
+  if (sfp) fclose(sfp);
+  free(sfile);
+  free(scores);
+  free(fwd_emissions);
+  p7_bg_Destroy(bg_default);
+  p7_hmmfile_Close(hfp);
+  *ret_db = db;
+  return eslOK;
+
+ ERROR:
+  resident_Destroy(db);
+  if (sfp) fclose(sfp);
+  if (sfile)         free(sfile);
+  if (scores)        free(scores);
+  if (fwd_emissions) free(fwd_emissions);
+  p7_bg_Destroy(bg_default);
+  if (hfp) p7_hmmfile_Close(hfp);
+  return status;
+}
+
+static void
+resident_Destroy(RESIDENT_DB *db)
+{
+  int i;
+
+  if (db)
+    {
+      for (i = 0; i < db->n; i++) {
+	p7_oprofile_Destroy(db->om[i]);
+	p7_hmm_ScoreDataDestroy(db->sd[i]);
+      }
+      if (db->om) free(db->om);
+      if (db->sd) free(db->sd);
+      free(db);
+    }
+}
+
 #ifdef HMMER_THREADS
 static int
 thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
@@ -738,7 +1010,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
 static void 
 pipeline_thread(void *arg)
 {
-  int i, j;
+  int i;
   int status;
   int workeridx;
   WORKER_INFO   *info;
@@ -748,7 +1020,6 @@ pipeline_thread(void *arg)
   P7_OPROFILE   *om        = NULL;
   P7_SCOREDATA  *scoredata = NULL;   /* hmm-specific data used by nhmmer */
 
-  int seq_len = 0;
   int prev_hit_cnt = 0;
   ESL_SQ        *sq_revcmp = NULL;
 
@@ -778,7 +1049,6 @@ pipeline_thread(void *arg)
       for (i = 0; i < block->count; ++i)
       {
         om = block->list[i];
-        seq_len = 0;
 
         p7_pli_NewModel(info->pli, om, info->bg);
         p7_bg_SetLength(info->bg, info->qsq->n);
@@ -801,33 +1071,8 @@ pipeline_thread(void *arg)
 
         scoredata = p7_hmm_ScoreDataCreate(om, FALSE);
 
-        //reverse complement
-        if (info->pli->strands != p7_STRAND_TOPONLY && info->qsq->abc->complement != NULL )
-        {
-          status = p7_Pipeline_LongTarget(info->pli, om, scoredata, info->bg, info->th, 0, sq_revcmp, p7_COMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
-          if (status != eslOK) p7_Fail(info->pli->errbuf);
-
-          p7_pipeline_Reuse(info->pli); // prepare for next search
-          seq_len = info->qsq->n;
-        }
-
-        if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
-          status = p7_Pipeline_LongTarget(info->pli, om, scoredata, info->bg, info->th, 0, info->qsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
-          if (status != eslOK) p7_Fail(info->pli->errbuf);
-
-          p7_pipeline_Reuse(info->pli);
-          seq_len += info->qsq->n;
-        }
+        search_model(info, om, scoredata, sq_revcmp, &prev_hit_cnt);
 
-        for (j = prev_hit_cnt; j < info->th->N ; j++)
-        {
-          info->th->unsrt[j].lnP         += log((float)seq_len / (float)om->max_length);
-          info->th->unsrt[j].dcl[0].lnP   = info->th->unsrt[j].lnP;
-          info->th->unsrt[j].sortkey      = -1.0 * info->th->unsrt[j].lnP;
-          info->th->unsrt[j].dcl[0].ad->L = om->M;
-        }
-
-        prev_hit_cnt = info->th->N;
         p7_hmm_ScoreDataDestroy(scoredata);
         p7_oprofile_Destroy(om);
         block->list[i] = NULL;
@@ -855,6 +1100,7 @@ ERROR:
   esl_fatal("Error allocating memory in work queue");
   return;
 }
+
 #endif   /* HMMER_THREADS */
 
 
@@ -12,6 +12,7 @@
  */
 #include "p7_config.h"
 
+#include <math.h>
 #include <string.h>
 
 #include "easel.h"
@@ -21,6 +22,12 @@
 
 #include "hmmer.h"
 
+/* p7_bg_FilterScore() multiplies out this many segments of the target
+ * independently, and rescales them every p7_BG_RESCALE residues.
+ */
+#define p7_BG_NSEG     4
+#define p7_BG_RESCALE  8
+
 
 /*****************************************************************
  * 1. The P7_BG object: allocation, initialization, destruction.
@@ -392,11 +399,12 @@ p7_bg_NullOne(const P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
  *            The expected length of the filter HMM's generated
  *            sequence is set to a default (about 400). You need a
  *            subsequent call to <p7_bg_SetLength()> to set it to the
- *            target sequence length. In hmmscan, this requires a 
+ *            target sequence length. In a search, this requires a 
  *            call after every new model is read and <p7_pli_NewModel()> 
  *            is called, because <NewModel()> is calling <p7_bg_SetFilter()>
  *            to copy the new model's composition <compo>. [Failure to
- *            do this properly was bug #h85, 14 Dec 2010.]
+ *            do this properly was bug #h85, 14 Dec 2010.] In an hmmscan
+ *            pipeline, <p7_Pipeline()> makes both calls itself.
  *
  * Returns:   <eslOK> on success.
  *
@@ -466,18 +474,96 @@ p7_bg_SetFilter(P7_BG *bg, int M, const float *compo)
  *            The filter null model has no length distribution of its
  *            own; the same geometric length distribution (controlled
  *            by <bg->p1>) that the null1 model uses is imposed.
+ *
+ *            This is <esl_hmm_Forward()> on <bg->fhmm>, reorganized
+ *            for speed: each residue's step of the recursion is a 2x2
+ *            matrix from a lookup table, and since matrix products
+ *            are associative, the target is cut into a few segments
+ *            that are multiplied out independently (so the inner
+ *            loop has no loop-carried dependency from one residue to
+ *            the next), then combined. Rescaling (a log) happens once
+ *            every few residues, not every residue, and no DP matrix
+ *            is allocated. The score agrees with <esl_hmm_Forward()>
+ *            to within floating point roundoff.
  */
 int
 p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
 {
-  ESL_HMX *hmx = esl_hmx_Create(L, bg->fhmm->M); /* optimization target: this can be a 2-row matrix, and it can be stored in <bg>. */
-  float nullsc;		                  	 /* (or it could be passed in as an arg, but for sure it shouldn't be alloc'ed here */
-  
-  esl_hmm_Forward(dsq, L, bg->fhmm, hmx, &nullsc);
+  const ESL_HMM *fhmm = bg->fhmm;
+  float  A[p7_MAXCODE+1][4];	 /* A[x] = T diag(eo[x]), entries 00,01,10,11; A[Kp] is the identity, for padding */
+  float  P[4][p7_BG_NSEG];	 /* running matrix product of each segment; lanes contiguous */
+  double logsc[p7_BG_NSEG];	 /* log of the scale factors taken out of each segment's product */
+  int    start[p7_BG_NSEG];	 /* first residue of each segment  */
+  int    len[p7_BG_NSEG];	 /* ... and its length */
+  float  p00, p01, p10, p11;
+  float  v0, v1, w0, w1, sc;
+  double nullsc;
+  int    Kp = bg->abc->Kp;
+  int    W, j, x, z;
+
+  if (L == 0) { nullsc = 0.0; goto DONE; }
+
+  /* Lookup table: one step of the filter HMM's Forward recursion, as a 2x2 matrix per residue */
+  for (x = 0; x < Kp; x++)
+    {
+      A[x][0] = fhmm->t[0][0] * fhmm->eo[x][0];
+      A[x][1] = fhmm->t[0][1] * fhmm->eo[x][1];
+      A[x][2] = fhmm->t[1][0] * fhmm->eo[x][0];
+      A[x][3] = fhmm->t[1][1] * fhmm->eo[x][1];
+    }
+  A[Kp][0] = A[Kp][3] = 1.0f;
+  A[Kp][1] = A[Kp][2] = 0.0f;
+
+  /* Residues 2..L are cut into p7_BG_NSEG segments, multiplied out in lockstep */
+  W = (L - 1 + p7_BG_NSEG - 1) / p7_BG_NSEG;
+  for (z = 0; z < p7_BG_NSEG; z++)
+    {
+      start[z] = 2 + z*W;
+      len[z]   = ESL_MAX(0, ESL_MIN(W, L+1 - start[z]));
+      P[0][z]  = P[3][z] = 1.0f;
+      P[1][z]  = P[2][z] = 0.0f;
+      logsc[z] = 0.0;
+    }
 
+  for (j = 0; j < W; j++)
+    {
+      for (z = 0; z < p7_BG_NSEG; z++)
+	{
+	  x   = (j < len[z] ? dsq[start[z]+j] : Kp);
+	  p00 = P[0][z] * A[x][0] + P[1][z] * A[x][2];
+	  p01 = P[0][z] * A[x][1] + P[1][z] * A[x][3];
+	  p10 = P[2][z] * A[x][0] + P[3][z] * A[x][2];
+	  p11 = P[2][z] * A[x][1] + P[3][z] * A[x][3];
+	  P[0][z] = p00;  P[1][z] = p01;  P[2][z] = p10;  P[3][z] = p11;
+	}
+
+      if ((j+1) % p7_BG_RESCALE == 0)
+	for (z = 0; z < p7_BG_NSEG; z++)
+	  {
+	    sc = P[0][z] + P[1][z] + P[2][z] + P[3][z];
+	    P[0][z] /= sc;  P[1][z] /= sc;  P[2][z] /= sc;  P[3][z] /= sc;
+	    logsc[z] += logf(sc);
+	  }
+    }
+
+  /* Residue 1 from the initial distribution, then the segments in order, then the end */
+  v0     = fhmm->pi[0] * fhmm->eo[dsq[1]][0];
+  v1     = fhmm->pi[1] * fhmm->eo[dsq[1]][1];
+  nullsc = 0.0;
+  for (z = 0; z < p7_BG_NSEG; z++)
+    {
+      w0 = v0 * P[0][z] + v1 * P[2][z];
+      w1 = v0 * P[1][z] + v1 * P[3][z];
+      sc = w0 + w1;
+      v0 = w0 / sc;
+      v1 = w1 / sc;
+      nullsc += logf(sc) + logsc[z];
+    }
+  nullsc += logf(v0 * fhmm->t[0][2] + v1 * fhmm->t[1][2]);
+
+ DONE:
   /* impose the length distribution */
-  *ret_sc = nullsc + (float) L * logf(bg->p1) + logf(1.-bg->p1);
-  esl_hmx_Destroy(hmx);
+  *ret_sc = (float) nullsc + (float) L * logf(bg->p1) + logf(1.-bg->p1);
   return eslOK;
 }
 
@@ -497,6 +583,9 @@ p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
+#include "esl_hmm.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
 #include "esl_sq.h"
 #include "esl_stopwatch.h"
 
@@ -505,8 +594,10 @@ p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",      0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,      NULL,      NULL,    NULL, "set random number seed to <n>",             0 },
+  { "-x",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "benchmark esl_hmm_Forward() filter score, for comparison", 0 },
   { "-L",        eslARG_INT,    "400", NULL, "n>0",     NULL,      NULL,    NULL, "length of random target seqs",              0 },
-  { "-N",        eslARG_INT,    "100", NULL, "n>0",     NULL,      NULL,    NULL, "number of random target seqs",              0 },
+  { "-N",        eslARG_INT,  "10000", NULL, "n>0",     NULL,      NULL,    NULL, "number of random target seqs",              0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile>";
@@ -517,13 +608,17 @@ main(int argc, char **argv)
 {
   ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
   ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
   char           *hmmfile = esl_opt_GetArg(go, 1);
   ESL_ALPHABET   *abc     = NULL;
   P7_HMMFILE     *hfp     = NULL;
   P7_HMM         *hmm     = NULL;
   P7_BG          *bg      = NULL;
+  ESL_HMX        *hmx     = NULL;
+  ESL_DSQ        *dsq     = NULL;
   int             L       = esl_opt_GetInteger(go, "-L");
   int             N       = esl_opt_GetInteger(go, "-N");
+  float           sc;
   int             i;
  
   /* Read one HMM from <hmmfile> */
@@ -531,14 +626,27 @@ main(int argc, char **argv)
   if (p7_hmmfile_Read(hfp, &abc, &hmm)            != eslOK) p7_Fail("Failed to read HMM");
   p7_hmmfile_Close(hfp);
 
-  bg = p7_bg_Create(abc);
+  bg  = p7_bg_Create(abc);
+  dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  hmx = esl_hmx_Create(L, 2);
+  p7_hmm_SetComposition(hmm);
+  p7_bg_SetFilter(bg, hmm->M, hmm->compo);
+  p7_bg_SetLength(bg, L);
+  esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
 
   esl_stopwatch_Start(w);
   for (i = 0; i < N; i++)
-    p7_bg_SetFilterByHMM(bg, hmm);
+    {
+      if (esl_opt_GetBoolean(go, "-x")) esl_hmm_Forward(dsq, L, bg->fhmm, hmx, &sc);
+      else                              p7_bg_FilterScore(bg, dsq, L, &sc);
+    }
   esl_stopwatch_Stop(w);
   esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# Mres/sec: %.2f\n", (double) N * (double) L / (w->user * 1.0e6));
 
+  esl_hmx_Destroy(hmx);
+  free(dsq);
+  esl_randomness_Destroy(r);
   p7_bg_Destroy(bg);
   p7_hmm_Destroy(hmm);
   esl_alphabet_Destroy(abc);
@@ -587,6 +695,54 @@ utest_ReadWrite(ESL_RANDOMNESS *rng)
   free(fq);
   remove(tmpfile);
 }
+
+/* The filter score must agree with a straightforward esl_hmm_Forward() 
+ * on the filter HMM, for sequences from either of its states, short
+ * and long.
+ */
+static void
+utest_FilterScore(ESL_RANDOMNESS *rng)
+{
+  char          msg[]  = "bg FilterScore unit test failed";
+  ESL_ALPHABET *abc    = NULL;
+  P7_BG        *bg     = NULL;
+  float        *compo  = NULL;
+  ESL_DSQ      *dsq    = NULL;
+  ESL_HMX      *hmx    = NULL;
+  int           Ls[]   = { 1, 2, 3, 7, 33, 400, 5000 };
+  int           nL     = sizeof(Ls) / sizeof(int);
+  int           M      = 1 + esl_rnd_Roll(rng, 500);
+  float         sc1, sc2;
+  int           i, n;
+
+  if ((abc   = esl_alphabet_Create(eslAMINO))                       == NULL)  esl_fatal(msg);
+  if ((bg    = p7_bg_Create(abc))                                   == NULL)  esl_fatal(msg);
+  if ((compo = malloc(sizeof(float) * abc->K))                      == NULL)  esl_fatal(msg);
+  if ((dsq   = malloc(sizeof(ESL_DSQ) * (Ls[nL-1]+2)))              == NULL)  esl_fatal(msg);
+  if (esl_dirichlet_FSampleUniform(rng, abc->K, compo)              != eslOK) esl_fatal(msg);
+  if (p7_bg_SetFilter(bg, M, compo)                                 != eslOK) esl_fatal(msg);
+
+  for (n = 0; n < nL; n++)
+    {
+      if (p7_bg_SetLength(bg, Ls[n])                                != eslOK) esl_fatal(msg);
+      dsq[0] = dsq[Ls[n]+1] = eslDSQ_SENTINEL;
+      for (i = 1; i <= Ls[n]; i++)	/* a biased half, then a background half */
+	dsq[i] = esl_rnd_FChoose(rng, (i <= Ls[n]/2 ? compo : bg->f), abc->K);
+
+      if ((hmx = esl_hmx_Create(Ls[n], bg->fhmm->M))                == NULL)  esl_fatal(msg);
+      if (esl_hmm_Forward(dsq, Ls[n], bg->fhmm, hmx, &sc2)          != eslOK) esl_fatal(msg);
+      sc2 += (float) Ls[n] * logf(bg->p1) + logf(1.-bg->p1);
+      esl_hmx_Destroy(hmx);
+
+      if (p7_bg_FilterScore(bg, dsq, Ls[n], &sc1)                   != eslOK) esl_fatal(msg);
+      if (fabs(sc1 - sc2) > 0.001 + 1e-5 * fabs(sc2))                         esl_fatal("%s: L=%d, %f vs. %f", msg, Ls[n], sc1, sc2);
+    }
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  free(compo);
+  free(dsq);
+}
 #endif /*p7BG_TESTDRIVE*/
 
 
@@ -625,6 +781,7 @@ main(int argc, char **argv)
   if (be_verbose) printf("p7_bg unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
 
   utest_ReadWrite(rng);
+  utest_FilterScore(rng);
 
   esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
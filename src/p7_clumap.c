@@ -0,0 +1,494 @@
+/* P7_CLUMAP: cluster membership of a redundant target database,
+ * for searching it cluster by cluster.
+ *
+ * Databases like UniRef100 or MGnify are highly redundant, and
+ * their clusterings are published along with them (as
+ * representative/member name pairs, for example). A cluster map
+ * records, for each target in the database's own order, which
+ * cluster it is in, and for each cluster, which target represents
+ * it. hmmsearch --clusters screens the representatives with the
+ * filters first, and then searches only the members of the clusters
+ * whose representative came close to passing.
+ *
+ * Contents:
+ *   1. The P7_CLUMAP object: construction, destruction.
+ *   2. Binary i/o.
+ *   3. Unit tests.
+ *   4. Test driver.
+ */
+#include "p7_config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_fileparser.h"
+#include "esl_keyhash.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+
+static uint32_t v3f_cmagic = 0xb3e6e3ec; /* 3/f binary cluster map, "3fcl" = 0x 33 66 63 6c + 0x80808080 */
+
+#define p7_CLUMAP_NONE   UINT32_MAX  /* cluster of a target not (yet) assigned to one */
+#define p7_CLUMAP_MAXSEQ INT_MAX     /* targets are numbered by ESL_KEYHASH, whose indices are int */
+
+
+/*****************************************************************
+ *# 1. The P7_CLUMAP object: construction, destruction.
+ *****************************************************************/
+
+/* Function:  p7_clumap_Build()
+ * Synopsis:  Build a cluster map of a sequence file.
+ *
+ * Purpose:   Read the names of all the sequences in <sqfp>, which is
+ *            open in text mode, and the clustering of them in
+ *            <clufile>, and build a cluster map; return it in
+ *            <*ret_cm>.
+ *
+ *            <clufile> has one line per cluster member, with two
+ *            whitespace-delimited fields: the name of the cluster's
+ *            representative and the name of the member, as in the
+ *            tab-delimited cluster tables that MMseqs2 and CD-HIT
+ *            tools produce. A line with the representative as its
+ *            own member is allowed. Blank lines and lines starting
+ *            with '#' are ignored. Sequences in <sqfp> that aren't
+ *            named in <clufile> become singleton clusters. The number
+ *            of residues and the file's size are recorded too, for
+ *            <p7_clumap_Validate()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEINVAL> if <sqfp> isn't a regular file, whose size
+ *            can be recorded; <eslENOTFOUND> if <clufile> can't be opened;
+ *            <eslEFORMAT> on a sequence file parse error, a bad
+ *            <clufile> line, a name that isn't in <sqfp>, or an
+ *            inconsistent clustering (a sequence in two clusters, or
+ *            a member that is also a representative); <eslEDUP> if
+ *            two sequences in <sqfp> have the same name; <eslERANGE>
+ *            if <sqfp> has more than 2^31-1 sequences. In all cases,
+ *            with a message in <errbuf> (if non-<NULL>), and
+ *            <*ret_cm> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_clumap_Build(ESL_SQFILE *sqfp, const char *clufile, P7_CLUMAP **ret_cm, char *errbuf)
+{
+  P7_CLUMAP      *cm     = NULL;
+  ESL_SQ         *sq     = esl_sq_Create();
+  ESL_KEYHASH    *kh     = esl_keyhash_Create();
+  ESL_FILEPARSER *efp    = NULL;
+  char           *tok[2];
+  int             toklen[2];
+  int             idx[2];
+  uint32_t        r, m;
+  uint64_t        i;
+  int             status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (sq == NULL || kh == NULL) { status = eslEMEM; goto ERROR; }
+
+  ESL_ALLOC(cm, sizeof(P7_CLUMAP));
+  cm->nseq   = 0;
+  cm->nres   = 0;
+  cm->dbsize = 0;
+  cm->nclust = 0;
+  cm->clu    = NULL;
+  cm->rep    = NULL;
+
+  if (p7_FileSize(sqfp->filename, &(cm->dbsize)) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "failed to get the size of sequence file %s", sqfp->filename);
+
+  /* The sequence names, in order: keyhash index = target ordinal */
+  while ((status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
+    {
+      if (cm->nseq == p7_CLUMAP_MAXSEQ) ESL_XFAIL(eslERANGE, errbuf, "too many sequences for one cluster map (max %d); split the database", p7_CLUMAP_MAXSEQ);
+      status = esl_keyhash_Store(kh, sq->name, -1, NULL);
+      if      (status == eslEDUP) ESL_XFAIL(eslEDUP, errbuf, "sequence name %s occurs more than once in the database", sq->name);
+      else if (status != eslOK)   goto ERROR;
+      cm->nseq++;
+      cm->nres += sq->L;
+      esl_sq_Reuse(sq);
+    }
+  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, "sequence file parse failed:\n%s", esl_sqfile_GetErrorBuf(sqfp));
+  else if (status != eslEOF)     goto ERROR;
+
+  ESL_ALLOC(cm->clu, sizeof(uint32_t) * ESL_MAX(1, cm->nseq));
+  ESL_ALLOC(cm->rep, sizeof(uint32_t) * ESL_MAX(1, cm->nseq));
+  for (i = 0; i < cm->nseq; i++) cm->clu[i] = p7_CLUMAP_NONE;
+
+  /* The clustering */
+  if (esl_fileparser_Open(clufile, NULL, &efp) != eslOK) ESL_XFAIL(eslENOTFOUND, errbuf, "failed to open cluster file %s", clufile);
+  esl_fileparser_SetCommentChar(efp, '#');
+  while ((status = esl_fileparser_NextLine(efp)) == eslOK)
+    {
+      if (esl_fileparser_GetTokenOnLine(efp, &(tok[0]), &(toklen[0])) != eslOK ||
+	  esl_fileparser_GetTokenOnLine(efp, &(tok[1]), &(toklen[1])) != eslOK)
+	ESL_XFAIL(eslEFORMAT, errbuf, "line %d of %s: expected <representative> <member>", efp->linenumber, clufile);
+      for (i = 0; i < 2; i++)
+	if (esl_keyhash_Lookup(kh, tok[i], toklen[i], &(idx[i])) != eslOK)
+	  ESL_XFAIL(eslEFORMAT, errbuf, "line %d of %s: no sequence named %.*s in the database", efp->linenumber, clufile, toklen[i], tok[i]);
+      r = (uint32_t) idx[0];
+      m = (uint32_t) idx[1];
+
+      if (cm->clu[r] == p7_CLUMAP_NONE)
+	{
+	  cm->rep[cm->nclust] = r;
+	  cm->clu[r]          = cm->nclust++;
+	}
+      else if (cm->rep[cm->clu[r]] != r)
+	ESL_XFAIL(eslEFORMAT, errbuf, "line %d of %s: %.*s is a member of another cluster, not a representative", efp->linenumber, clufile, toklen[0], tok[0]);
+
+      if      (cm->clu[m] == p7_CLUMAP_NONE) cm->clu[m] = cm->clu[r];
+      else if (cm->clu[m] != cm->clu[r])
+	ESL_XFAIL(eslEFORMAT, errbuf, "line %d of %s: %.*s is already in another cluster", efp->linenumber, clufile, toklen[1], tok[1]);
+    }
+  if (status != eslEOF) ESL_XFAIL(eslEFORMAT, errbuf, "failed to parse cluster file %s", clufile);
+
+  /* Everything else is a singleton */
+  for (i = 0; i < cm->nseq; i++)
+    if (cm->clu[i] == p7_CLUMAP_NONE)
+      {
+	cm->rep[cm->nclust] = (uint32_t) i;
+	cm->clu[i]          = cm->nclust++;
+      }
+
+  esl_fileparser_Close(efp);
+  esl_keyhash_Destroy(kh);
+  esl_sq_Destroy(sq);
+  *ret_cm = cm;
+  return eslOK;
+
+ ERROR:
+  if (efp) esl_fileparser_Close(efp);
+  if (kh)  esl_keyhash_Destroy(kh);
+  if (sq)  esl_sq_Destroy(sq);
+  p7_clumap_Destroy(cm);
+  *ret_cm = NULL;
+  return status;
+}
+
+
+/* Function:  p7_clumap_Destroy()
+ * Synopsis:  Free a cluster map.
+ */
+void
+p7_clumap_Destroy(P7_CLUMAP *cm)
+{
+  if (cm == NULL) return;
+  if (cm->clu) free(cm->clu);
+  if (cm->rep) free(cm->rep);
+  free(cm);
+}
+/*--------------------- end, P7_CLUMAP object -------------------*/
+
+
+
+/*****************************************************************
+ * 2. Binary i/o.
+ *****************************************************************/
+
+/* Function:  p7_clumap_Write()
+ * Synopsis:  Save a cluster map to a binary stream.
+ *
+ * Purpose:   Write cluster map <cm> to open binary stream <fp>, in
+ *            the byte order of this machine.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on any write failure, such as filling the disk.
+ */
+int
+p7_clumap_Write(FILE *fp, const P7_CLUMAP *cm)
+{
+  if (fwrite((char *) &(v3f_cmagic), sizeof(uint32_t), 1,          fp) != 1)          ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  if (fwrite((char *) &(cm->nseq),   sizeof(uint64_t), 1,          fp) != 1)          ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  if (fwrite((char *) &(cm->nres),   sizeof(uint64_t), 1,          fp) != 1)          ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  if (fwrite((char *) &(cm->dbsize), sizeof(uint64_t), 1,          fp) != 1)          ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  if (fwrite((char *) &(cm->nclust), sizeof(uint64_t), 1,          fp) != 1)          ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  if (fwrite((char *) cm->clu,       sizeof(uint32_t), cm->nseq,   fp) != cm->nseq)   ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  if (fwrite((char *) cm->rep,       sizeof(uint32_t), cm->nclust, fp) != cm->nclust) ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  /* ends with magic sentinel, for detecting binary file corruption */
+  if (fwrite((char *) &(v3f_cmagic), sizeof(uint32_t), 1,          fp) != 1)          ESL_EXCEPTION_SYS(eslEWRITE, "cluster map write failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_clumap_Read()
+ * Synopsis:  Read a cluster map from a binary stream.
+ *
+ * Purpose:   Read a cluster map, as written by <p7_clumap_Write()>,
+ *            from open binary stream <fp>. Return the new map in
+ *            <*ret_cm>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> if <fp> isn't a cluster map or is
+ *            corrupted, with a message in <errbuf> (if non-<NULL>),
+ *            and <*ret_cm> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_clumap_Read(FILE *fp, P7_CLUMAP **ret_cm, char *errbuf)
+{
+  P7_CLUMAP *cm = NULL;
+  uint32_t   magic;
+  uint64_t   i;
+  int        status;
+
+  if (errbuf) errbuf[0] = '\0';
+  ESL_ALLOC(cm, sizeof(P7_CLUMAP));
+  cm->nseq   = 0;
+  cm->nres   = 0;
+  cm->dbsize = 0;
+  cm->nclust = 0;
+  cm->clu    = NULL;
+  cm->rep    = NULL;
+
+  if (! fread((char *) &magic, sizeof(uint32_t), 1, fp) || magic != v3f_cmagic) ESL_XFAIL(eslEFORMAT, errbuf, "bad magic; not a HMMER cluster map (makehmmerdb --clusters)?");
+  if (! fread((char *) &(cm->nseq),   sizeof(uint64_t), 1, fp))                 ESL_XFAIL(eslEFORMAT, errbuf, "failed to read number of sequences");
+  if (! fread((char *) &(cm->nres),   sizeof(uint64_t), 1, fp))                 ESL_XFAIL(eslEFORMAT, errbuf, "failed to read number of residues");
+  if (! fread((char *) &(cm->dbsize), sizeof(uint64_t), 1, fp))                 ESL_XFAIL(eslEFORMAT, errbuf, "failed to read size of sequence file");
+  if (! fread((char *) &(cm->nclust), sizeof(uint64_t), 1, fp))                 ESL_XFAIL(eslEFORMAT, errbuf, "failed to read number of clusters");
+  if (cm->nseq > p7_CLUMAP_MAXSEQ || cm->nclust > cm->nseq || (cm->nseq > 0 && cm->nclust == 0))
+    ESL_XFAIL(eslEFORMAT, errbuf, "bad cluster map header; file corrupted?");
+
+  ESL_ALLOC(cm->clu, sizeof(uint32_t) * ESL_MAX(1, cm->nseq));
+  ESL_ALLOC(cm->rep, sizeof(uint32_t) * ESL_MAX(1, cm->nclust));
+  if (fread((char *) cm->clu, sizeof(uint32_t), cm->nseq,   fp) != cm->nseq)    ESL_XFAIL(eslEFORMAT, errbuf, "failed to read clusters of targets");
+  if (fread((char *) cm->rep, sizeof(uint32_t), cm->nclust, fp) != cm->nclust)  ESL_XFAIL(eslEFORMAT, errbuf, "failed to read cluster representatives");
+  if (! fread((char *) &magic, sizeof(uint32_t), 1, fp) || magic != v3f_cmagic) ESL_XFAIL(eslEFORMAT, errbuf, "bad sentinel magic; cluster map corrupted?");
+
+  /* the pipeline indexes with these, so don't trust them */
+  for (i = 0; i < cm->nseq; i++)
+    if (cm->clu[i] >= cm->nclust)                                   ESL_XFAIL(eslEFORMAT, errbuf, "bad cluster index; cluster map corrupted?");
+  for (i = 0; i < cm->nclust; i++)
+    if (cm->rep[i] >= cm->nseq || cm->clu[cm->rep[i]] != i)         ESL_XFAIL(eslEFORMAT, errbuf, "bad cluster representative; cluster map corrupted?");
+
+  *ret_cm = cm;
+  return eslOK;
+
+ ERROR:
+  p7_clumap_Destroy(cm);
+  *ret_cm = NULL;
+  return status;
+}
+
+
+/* Function:  p7_clumap_Validate()
+ * Synopsis:  Check that a cluster map goes with a sequence file.
+ *
+ * Purpose:   Check, before searching, that cluster map <cm> was built
+ *            from sequence file <dbfile>, by the file's size, as
+ *            <p7_seedindex_Validate()> does for a seed index. An edit
+ *            that keeps the size is missed; callers can also check
+ *            the sequences and residues they read against <cm->nseq>
+ *            and <cm->nres> afterwards.
+ *
+ * Returns:   <eslOK> if the sizes match.
+ *
+ *            <eslEINVAL> if <dbfile> isn't a regular file, so it can't
+ *            be checked; <eslEINCOMPAT> if its size differs. Either
+ *            way with a message in <errbuf> (if non-<NULL>).
+ */
+int
+p7_clumap_Validate(const P7_CLUMAP *cm, const char *dbfile, char *errbuf)
+{
+  uint64_t dbsize;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (p7_FileSize(dbfile, &dbsize) != eslOK) ESL_FAIL(eslEINVAL,     errbuf, "%s isn't a file whose size can be checked against the cluster map", dbfile);
+  if (dbsize != cm->dbsize)                   ESL_FAIL(eslEINCOMPAT, errbuf, "cluster map was built from a %" PRIu64 "-byte sequence file, but %s has %" PRIu64 " bytes", cm->dbsize, dbfile, dbsize);
+  return eslOK;
+}
+/*-------------------- end, binary i/o --------------------------*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7CLUMAP_TESTDRIVE
+
+/* utest_build()
+ * Cluster a small database of named sequences: the first <nclu>
+ * clusters have 1..<maxsize> members each, listed (with a comment
+ * and a self line thrown in) in a cluster file; every later
+ * sequence is a singleton. The map must agree, and the binary round
+ * trip must give the same map.
+ */
+static void
+utest_build(ESL_RANDOMNESS *r, int nseq, int nclu, int maxsize, char *tmpfile)
+{
+  char        msg[]   = "cluster map build unit test failed";
+  char        errbuf[eslERRBUFSIZE];
+  char        seqfile[p7_TMPFILE_NAMELEN];
+  char        clufile[p7_TMPFILE_NAMELEN];
+  ESL_SQ     *sq      = esl_sq_CreateFrom("seq", "ACDEFGHIKL", NULL, NULL, NULL);
+  ESL_SQFILE *sqfp    = NULL;
+  P7_CLUMAP  *cm      = NULL;
+  P7_CLUMAP  *cm2     = NULL;
+  FILE       *fp      = NULL;
+  int        *repof   = malloc(sizeof(int) * nseq);   /* repof[i]: ordinal of i's representative */
+  int         i, c, n, size;
+
+  /* the database, and the clusters: consecutive runs of seqs, but listed rep-last to test the bookkeeping */
+  if (p7_TmpfileNamed(seqfile, &fp) != eslOK) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      esl_sq_FormatName(sq, "seq%d", i);
+      if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE) != eslOK) esl_fatal(msg);
+    }
+  fclose(fp);
+
+  if (p7_TmpfileNamed(clufile, &fp) != eslOK) esl_fatal(msg);
+  fprintf(fp, "# representative member\n");
+  for (i = 0, c = 0; c < nclu && i < nseq; c++, i += size)
+    {
+      size = 1 + esl_rnd_Roll(r, maxsize);
+      if (i + size > nseq) size = nseq - i;
+      if (c % 2) fprintf(fp, "seq%d\tseq%d\n", i, i);
+      for (n = size-1; n >= 1; n--) fprintf(fp, "seq%d\tseq%d\n", i, i+n);
+      for (n = 0; n < size; n++) repof[i+n] = i;
+    }
+  for ( ; i < nseq; i++) repof[i] = i;
+  fclose(fp);
+
+  if (esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if (p7_clumap_Build(sqfp, clufile, &cm, errbuf)            != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+  esl_sqfile_Close(sqfp);
+
+  if (cm->nseq != nseq || cm->nres != (uint64_t) nseq * sq->n) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (cm->clu[i] >= cm->nclust)                 esl_fatal(msg);
+      if (cm->rep[cm->clu[i]] != repof[i])          esl_fatal(msg);
+      if (cm->clu[i] != cm->clu[repof[i]])          esl_fatal(msg);
+    }
+
+  /* round trip */
+  if ((fp = fopen(tmpfile, "wb"))           == NULL)  esl_fatal(msg);
+  if (p7_clumap_Write(fp, cm)               != eslOK) esl_fatal(msg);
+  fclose(fp);
+  if ((fp = fopen(tmpfile, "rb"))           == NULL)  esl_fatal(msg);
+  if (p7_clumap_Read(fp, &cm2, errbuf)      != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+  fclose(fp);
+  if (cm2->nseq != cm->nseq || cm2->nclust != cm->nclust)                  esl_fatal(msg);
+  if (cm2->nres != cm->nres || cm2->dbsize != cm->dbsize)                  esl_fatal(msg);
+  if (memcmp(cm2->clu, cm->clu, sizeof(uint32_t) * cm->nseq)   != 0)       esl_fatal(msg);
+  if (memcmp(cm2->rep, cm->rep, sizeof(uint32_t) * cm->nclust) != 0)       esl_fatal(msg);
+
+  /* the map goes with its own sequence file; not with stdin, or with the file once it changes */
+  if (p7_clumap_Validate(cm2, seqfile, errbuf) != eslOK)        esl_fatal("%s\n%s", msg, errbuf);
+  if (p7_clumap_Validate(cm2, "-", errbuf)     != eslEINVAL)    esl_fatal(msg);
+  if ((fp = fopen(seqfile, "a"))               == NULL)         esl_fatal(msg);
+  fprintf(fp, ">extra\nACDEFGHIKL\n");
+  fclose(fp);
+  if (p7_clumap_Validate(cm2, seqfile, errbuf) != eslEINCOMPAT) esl_fatal(msg);
+
+  remove(seqfile);
+  remove(clufile);
+  remove(tmpfile);
+  p7_clumap_Destroy(cm);
+  p7_clumap_Destroy(cm2);
+  esl_sq_Destroy(sq);
+  free(repof);
+}
+
+/* utest_errors()
+ * Inconsistent cluster files are rejected.
+ */
+static void
+utest_errors(char *tmpfile)
+{
+  char        msg[]   = "cluster map error unit test failed";
+  char        errbuf[eslERRBUFSIZE];
+  char        seqfile[p7_TMPFILE_NAMELEN];
+  char       *bad[]   = { "seq0 seq1\nseq2 seq1\n",     /* member in two clusters       */
+			  "seq0 seq1\nseq1 seq2\n",     /* member used as a rep         */
+			  "seq0 seq9\n",                /* no such sequence             */
+			  "seq0\n" };                   /* missing field                */
+  ESL_SQ     *sq      = esl_sq_CreateFrom("seq", "ACDEFGHIKL", NULL, NULL, NULL);
+  ESL_SQFILE *sqfp    = NULL;
+  P7_CLUMAP  *cm      = NULL;
+  FILE       *fp      = NULL;
+  int         i;
+
+  if (p7_TmpfileNamed(seqfile, &fp) != eslOK) esl_fatal(msg);
+  for (i = 0; i < 3; i++)
+    {
+      esl_sq_FormatName(sq, "seq%d", i);
+      if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE) != eslOK) esl_fatal(msg);
+    }
+  fclose(fp);
+
+  for (i = 0; i < 4; i++)
+    {
+      if ((fp = fopen(tmpfile, "w")) == NULL) esl_fatal(msg);
+      fputs(bad[i], fp);
+      fclose(fp);
+      if (esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK)      esl_fatal(msg);
+      if (p7_clumap_Build(sqfp, tmpfile, &cm, errbuf)            != eslEFORMAT) esl_fatal(msg);
+      if (cm != NULL)                                                           esl_fatal(msg);
+      esl_sqfile_Close(sqfp);
+    }
+
+  remove(seqfile);
+  remove(tmpfile);
+  esl_sq_Destroy(sq);
+}
+#endif /*p7CLUMAP_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7CLUMAP_TESTDRIVE
+/*
+  gcc -o p7_clumap_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7CLUMAP_TESTDRIVE p7_clumap.c -lhmmer -leasel -lm
+  ./p7_clumap_utest
+ */
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL, NULL, NULL, NULL, "show brief help on version and usage",              0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                     0 },
+  { "-C",        eslARG_INT,     "50", NULL, NULL, NULL, NULL, NULL, "number of listed clusters",                         0 },
+  { "-K",        eslARG_INT,      "8", NULL, NULL, NULL, NULL, NULL, "max cluster size",                                  0 },
+  { "-N",        eslARG_INT,    "300", NULL, NULL, NULL, NULL, NULL, "number of target seqs",                             0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the P7_CLUMAP cluster map";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  char            tmpfile[p7_TMPFILE_NAMELEN];
+
+  /* we only need a unique name; the utests reopen it */
+  if (p7_TmpfileNamed(tmpfile, NULL) != eslOK) esl_fatal("failed to create tmp file");
+
+  utest_build(r, esl_opt_GetInteger(go, "-N"), esl_opt_GetInteger(go, "-C"), esl_opt_GetInteger(go, "-K"), tmpfile);
+  utest_errors(tmpfile);
+
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7CLUMAP_TESTDRIVE*/
@@ -18,8 +18,8 @@
  * forward and backward matrices <fwd>, <bck>.
  * 
  * The function then chews over this data, using posterior
- * probabilities and heuristics to define, score, and obtain
- * display-ready alignments for individual domains. When it's done,
+ * probabilities and heuristics to define, score, and align
+ * individual domains. When it's done,
  * your <fwd> and <bck> matrices have been effectively destroyed (they
  * get reused for individual domain alignment calculations), and
  * <ddef> contains all the per-domain results you need. It returns to
@@ -27,6 +27,11 @@
  * total per-sequence score derived by a sum of individual domain
  * scores (in <ret_sc>).
  * 
+ * Each domain's alignment is held as its optimal accuracy trace; the
+ * display-ready <P7_ALIDISPLAY> is only made when the caller asks for
+ * it, with <p7_domaindef_CreateAlidisplays()>, once it knows the
+ * target is worth keeping.
+ * 
  * The <P7_DOMAINDEF> structure is a reusable container that manages
  * all the necessary working memory and heuristic thresholds.
  *   
@@ -45,9 +50,14 @@
 #include "hmmer.h"
 
 static int is_multidomain_region  (P7_DOMAINDEF *ddef, int i, int j);
-static int region_trace_ensemble  (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc);
+static int region_trace_ensemble  (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, P7_OMX *fwd, int is_checkpointed, P7_OMX *wrk,
+				   int *ret_nc);
+static P7_TRACE **create_ensemble (int n);
+static int grow_domain_traces     (P7_DOMAINDEF *ddef, int n);
 static int rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *ox1, P7_OMX *ox2,
 				   int i, int j, int null2_is_done, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+static int envelope_alignment     (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2, P7_TRACE *tr,
+				   float *opt_null2, float *ret_envsc, float *ret_oasc);
 
 
 /*****************************************************************
@@ -79,8 +89,11 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->mocc = ddef->btot = ddef->etot = NULL;
   ddef->n2sc = NULL;
   ddef->sp   = NULL;
-  ddef->tr   = NULL;
+  ddef->ens  = NULL;
+  ddef->ckpp = NULL;
+  ddef->ckoa = NULL;
   ddef->dcl  = NULL;
+  ddef->dtr  = NULL;
 
   /* level 2 alloc: posterior prob arrays */
   ESL_ALLOC(ddef->mocc, sizeof(float) * (Lalloc+1));
@@ -94,8 +107,9 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
 
   /* level 2 alloc: results storage */
   ESL_ALLOC(ddef->dcl, sizeof(P7_DOMAIN) * nalloc);
-  ddef->nalloc = nalloc;
-  ddef->ndom   = 0;
+  ddef->nalloc    = nalloc;
+  ddef->ndom      = 0;
+  ddef->ndtralloc = 0;
 
   ddef->nexpected  = 0.0;
   ddef->nregions   = 0;
@@ -116,8 +130,8 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
 
   /* allocate reusable, growable objects that domain def reuses for each seq */
   ddef->sp  = p7_spensemble_Create(1024, 64, 32); /* init allocs = # sampled pairs; max endpoint range; # of domains */
-  ddef->tr  = p7_trace_CreateWithPP();
   ddef->gtr = p7_trace_Create();
+  if ((ddef->ens = create_ensemble(ddef->nsamples)) == NULL) { status = eslEMEM; goto ERROR; }
 
   /* keep a copy of ptr to the RNG */
   ddef->r            = r;  
@@ -174,7 +188,8 @@ p7_domaindef_GrowTo(P7_DOMAINDEF *ddef, int L)
  *            
  * Note:      Because of the way we handle alidisplays, handing them off to
  *            the caller, we don't reuse their memory; any unused
- *            alidisplays are destroyed. It's not really possible to
+ *            alidisplays are destroyed. (The domain traces in
+ *            <ddef->dtr> they're made from are reused.) It's not really possible to
  *            reuse alidisplay memory. We need alidisplays to persist
  *            until all sequences have been processed and we're
  *            writing our final output to the user.
@@ -211,8 +226,7 @@ p7_domaindef_Reuse(P7_DOMAINDEF *ddef)
   ddef->nenvelopes = 0;
 
   p7_spensemble_Reuse(ddef->sp);
-  p7_trace_Reuse(ddef->tr);	/* probable overkill; should already have been called */
-  p7_trace_Reuse(ddef->gtr);	/* likewise */
+  p7_trace_Reuse(ddef->gtr);	/* probable overkill; should already have been called */
   return eslOK;
 
  ERROR:
@@ -299,8 +313,11 @@ p7_domaindef_Destroy(P7_DOMAINDEF *ddef)
   }
 
   p7_spensemble_Destroy(ddef->sp);
-  p7_trace_Destroy(ddef->tr);
   p7_trace_Destroy(ddef->gtr);
+  p7_trace_DestroyArray(ddef->dtr, ddef->ndtralloc);
+  p7_trace_DestroyArray(ddef->ens, ddef->nsamples);
+  if (ddef->ckpp != NULL) p7_omx_Destroy(ddef->ckpp);
+  if (ddef->ckoa != NULL) p7_omx_Destroy(ddef->ckoa);
   free(ddef);
   return;
 }
@@ -373,6 +390,14 @@ p7_domaindef_ByViterbi(P7_PROFILE *gm, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_
  *            Upon return, <ddef> contains the definitions of all the
  *            domains: their bounds, their null-corrected Forward
  *            scores, and their optimal posterior accuracy alignments.
+ *            For a protein search (<long_target> FALSE), the alignments
+ *            are held as traces in <ddef->dtr>, and each domain's
+ *            <ad> is <NULL> until the caller makes the alignment
+ *            displays with <p7_domaindef_CreateAlidisplays()>. Most
+ *            targets that get this far are never reported, so we
+ *            don't format alignments that nobody will see. For
+ *            <long_target> (nhmmer), whose pipeline works on the
+ *            alidisplays directly, they're made here.
  *            
  * Returns:   <eslOK> on success.           
  *            
@@ -392,6 +417,7 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
   int i2,j2;
   int last_j2;
   int nc;
+  int is_checkpointed;
   int saveL     = om->L;	/* Save the length config of <om>; will restore upon return */
   int save_mode = om->mode;	/* Likewise for the mode. */
   int status;
@@ -418,8 +444,6 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
     else if (ddef->mocc[j] - (ddef->etot[j] - ddef->etot[j-1])  <  ddef->rt2)
     {
         /* We have a region i..j to evaluate. */
-        p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
-        p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
         ddef->nregions++;
         if (is_multidomain_region(ddef, i, j))
         {
@@ -434,12 +458,24 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
              * stochastic trace clustering; there is redundancy
              * here; we will consolidate later if null2 strategy
              * works
+             *
+             * If a full Forward matrix for the region would exceed
+             * <p7_RAMLIMIT>, sample from a checkpointed one instead
+             * (O(M sqrt(L)) memory, for about one more Forward pass).
+             * Only the first row of <bck> is used, for null2.
              */
+            is_checkpointed = (p7_omx_FitsRAMLimit(om->M, j-i+1) ? FALSE : TRUE);
+            if (is_checkpointed) p7_omx_GrowToCheckpointed(fwd, om->M, j-i+1);
+            else                 p7_omx_GrowTo            (fwd, om->M, j-i+1, j-i+1);
+            p7_omx_GrowTo(bck, om->M, 0, 0);
+
             p7_oprofile_ReconfigMultihit(om, saveL);
-            p7_Forward(sq->dsq+i-1, j-i+1, om, fwd, NULL);
+            if (is_checkpointed) p7_ForwardCheckpointed(sq->dsq+i-1, j-i+1, om, fwd, NULL);
+            else                 p7_Forward            (sq->dsq+i-1, j-i+1, om, fwd, NULL);
 
-            region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, bck, &nc);
+            status = region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, is_checkpointed, bck, &nc);
             p7_oprofile_ReconfigUnihit(om, saveL);
+            if (status != eslOK) goto ERROR;
             /* ddef->n2sc is now set on i..j by the traceback-dependent method */
 
             last_j2 = 0;
@@ -472,7 +508,6 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
                        last_j2 = j2;
             }
             p7_spensemble_Reuse(ddef->sp);
-            p7_trace_Reuse(ddef->tr);
         }
         else
         {
@@ -490,9 +525,46 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
   if (p7_IsMulti(save_mode)) p7_oprofile_ReconfigMultihit(om, saveL); 
   else                       p7_oprofile_ReconfigUnihit  (om, saveL); 
   return eslOK;
+
+ ERROR:
+  p7_spensemble_Reuse(ddef->sp);
+  if (p7_IsMulti(save_mode)) p7_oprofile_ReconfigMultihit(om, saveL); 
+  else                       p7_oprofile_ReconfigUnihit  (om, saveL); 
+  return status;
 }
 
 
+/* Function:  p7_domaindef_CreateAlidisplays()
+ * Synopsis:  Make the alignment displays for the defined domains.
+ *
+ * Purpose:   After <p7_domaindef_ByPosteriorHeuristics()> has defined
+ *            the domains of target <sq> (with text sequence <ntsq>,
+ *            or <NULL>) against model <om>, make each domain's
+ *            <P7_ALIDISPLAY> from its trace, in <ddef->dcl[d].ad>.
+ *            Domains that already have one are left alone.
+ *
+ *            The caller does this for a target it's keeping, before
+ *            it takes the <ddef->dcl> domain list; the traces stay
+ *            behind in <ddef>, to be reused.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_domaindef_CreateAlidisplays(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq)
+{
+  int d;
+
+  for (d = 0; d < ddef->ndom; d++)
+    {
+      if (ddef->dcl[d].ad != NULL) continue;
+      if ((ddef->dcl[d].ad = p7_alidisplay_Create(ddef->dtr[d], 0, om, sq, ntsq)) == NULL) ESL_EXCEPTION(eslEMEM, "failed to create alidisplay");
+      p7_trace_Reuse(ddef->dtr[d]);
+    }
+  return eslOK;
+}
+
 
 /*****************************************************************
  * 3. Internal routines 
@@ -557,7 +629,10 @@ is_multidomain_region(P7_DOMAINDEF *ddef, int i, int j)
  * configured in multihit mode with its target length distribution
  * set to the total length of <dsq>: i.e., the same model
  * configuration used to score the complete sequence (if it weren't
- * multihit, we wouldn't be worried about multiple domains).
+ * multihit, we wouldn't be worried about multiple domains). If
+ * <is_checkpointed> is TRUE, <fwd> is a checkpointed Forward matrix
+ * (<p7_ForwardCheckpointed()>), whose working rows get recalculated
+ * while the traces are sampled.
  * 
  * Caller also provides a DP matrix in <wrk> containing at least one
  * row, for use as temporary workspace. (This will typically be the
@@ -589,20 +664,24 @@ is_multidomain_region(P7_DOMAINDEF *ddef, int i, int j)
  *    answers, it needs to <esl_spensemble_Reuse()> it before calling
  *    <region_trace_ensemble()> again.
  *    
- * <ddef->tr> is used as working memory for sampled traces.
+ * <ddef->ens> is used as working memory for the <ddef->nsamples>
+ *    sampled traces, which are drawn together by
+ *    <p7_StochasticTraceEnsemble()>; they're Reuse()'d again on return.
  *    
  * <wrk> has had its zero row clobbered as working space for a null2 calculation.
  */
 static int
 region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, 
-		      const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc)
+		      P7_OMX *fwd, int is_checkpointed, P7_OMX *wrk, int *ret_nc)
 {
+  P7_TRACE *tr;
   int    Lr  = jreg-ireg+1;
   int    t, d, d2;
   int    nov, n;
   int    nc;
   int    pos;
   float  null2[p7_MAXCODE];
+  int    status;
 
   esl_vec_FSet(ddef->n2sc+ireg, Lr, 0.0); /* zero the null2 scores in region */
 
@@ -613,28 +692,31 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
     esl_randomness_Init(ddef->r, esl_randomness_GetSeed(ddef->r));
 
   /* Collect an ensemble of sampled traces; calculate null2 odds ratios from these */
+  if (is_checkpointed) status = p7_StochasticTraceEnsembleCheckpointed(ddef->r, dsq+ireg-1, Lr, om, fwd, ddef->nsamples, ddef->ens);
+  else                 status = p7_StochasticTraceEnsemble            (ddef->r, dsq+ireg-1, Lr, om, fwd, ddef->nsamples, ddef->ens);
+  if (status != eslOK) goto ERROR;
   for (t = 0; t < ddef->nsamples; t++)
     {
-      p7_StochasticTrace(ddef->r, dsq+ireg-1, Lr, om, fwd, ddef->tr);
-      p7_trace_Index(ddef->tr);
+      tr = ddef->ens[t];
+      p7_trace_Index(tr);
 
       pos = 1;
-      for (d = 0; d < ddef->tr->ndom; d++)
+      for (d = 0; d < tr->ndom; d++)
 	{
-	  p7_spensemble_Add(ddef->sp, t, ddef->tr->sqfrom[d]+ireg-1, ddef->tr->sqto[d]+ireg-1, ddef->tr->hmmfrom[d], ddef->tr->hmmto[d]);
+	  p7_spensemble_Add(ddef->sp, t, tr->sqfrom[d]+ireg-1, tr->sqto[d]+ireg-1, tr->hmmfrom[d], tr->hmmto[d]);
 
-	  p7_Null2_ByTrace(om, ddef->tr, ddef->tr->tfrom[d], ddef->tr->tto[d], wrk, null2);
+	  p7_Null2_ByTrace(om, tr, tr->tfrom[d], tr->tto[d], wrk, null2);
 	  
 	  /* residues outside domains get bumped +1: because f'(x) = f(x), so f'(x)/f(x) = 1 in these segments */
-	  for (; pos <= ddef->tr->sqfrom[d]; pos++) ddef->n2sc[ireg+pos-1] += 1.0;
+	  for (; pos <= tr->sqfrom[d]; pos++) ddef->n2sc[ireg+pos-1] += 1.0;
 
 	  /* Residues inside domains get bumped by their null2 ratio */
-	  for (; pos <= ddef->tr->sqto[d];   pos++) ddef->n2sc[ireg+pos-1] += null2[dsq[ireg+pos-1]];
+	  for (; pos <= tr->sqto[d];   pos++) ddef->n2sc[ireg+pos-1] += null2[dsq[ireg+pos-1]];
 	}
       /* the remaining residues in the region outside any domains get +1 */
       for (; pos <= Lr; pos++)  ddef->n2sc[ireg+pos-1] += 1.0;
 
-      p7_trace_Reuse(ddef->tr);        
+      p7_trace_Reuse(tr);        
     }
 
   /* Convert the accumulated n2sc[] ratios in this region to log odds null2 scores on each residue. */
@@ -675,6 +757,59 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
   ddef->sp->nc = d;
   *ret_nc = d;
   return eslOK;
+
+ ERROR:
+  for (t = 0; t < ddef->nsamples; t++) p7_trace_Reuse(ddef->ens[t]);
+  *ret_nc = 0;
+  return status;
+}
+
+
+/* create_ensemble()
+ * Allocate <n> empty traces for region_trace_ensemble(); returns NULL
+ * on allocation failure. Free with <p7_trace_DestroyArray(ens, n)>.
+ */
+static P7_TRACE **
+create_ensemble(int n)
+{
+  P7_TRACE **ens = NULL;
+  int        t;
+  int        status;
+
+  ESL_ALLOC(ens, sizeof(P7_TRACE *) * n);
+  for (t = 0; t < n; t++) ens[t] = NULL;
+  for (t = 0; t < n; t++)
+    if ((ens[t] = p7_trace_Create()) == NULL) goto ERROR;
+  return ens;
+
+ ERROR:
+  p7_trace_DestroyArray(ens, n);
+  return NULL;
+}
+
+
+/* grow_domain_traces()
+ * Make sure <ddef->dtr> has at least <n> traces, for domains
+ * <dcl[0..n-1]>.
+ */
+static int
+grow_domain_traces(P7_DOMAINDEF *ddef, int n)
+{
+  int d;
+  int status;
+
+  if (n <= ddef->ndtralloc) return eslOK;
+  ESL_REALLOC(ddef->dtr, sizeof(P7_TRACE *) * n);
+  for (d = ddef->ndtralloc; d < n; d++) ddef->dtr[d] = NULL;
+  for (d = ddef->ndtralloc; d < n; d++)
+    {
+      if ((ddef->dtr[d] = p7_trace_CreateWithPP()) == NULL) { status = eslEMEM; goto ERROR; }
+      ddef->ndtralloc = d+1;
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
 }
 
 
@@ -768,11 +903,11 @@ reparameterize_model (P7_BG *bg, P7_OPROFILE *om, const ESL_SQ *sq, int start, i
  * The alignment is an optimal accuracy alignment (sensu IH Holmes),
  * also obtained in unilocal mode.
  * 
- * The caller provides DP matrices <ox1> and <ox2> with sufficient
- * space to hold Forward and Backward calculations for this domain
- * against the model. (The caller will typically already have matrices
- * sufficient for the complete sequence lying around, and can just use
- * those.) The caller also provides a <P7_DOMAINDEF> object (ddef)
+ * The caller provides DP matrices <ox1> and <ox2>, which are grown
+ * here as needed to hold Forward and Backward calculations for this
+ * domain against the model; checkpointed ones, if full matrices for
+ * the envelope would exceed <p7_RAMLIMIT> (see envelope_alignment()).
+ * The caller also provides a <P7_DOMAINDEF> object (ddef)
  * which is (efficiently, we trust) managing any necessary temporary
  * working space and heuristic thresholds.
  *
@@ -785,13 +920,16 @@ reparameterize_model (P7_BG *bg, P7_OPROFILE *om, const ESL_SQ *sq, int start, i
  * 
  * Returns <eslOK> if a domain was successfully identified, scored,
  * and aligned in the envelope; if so, the per-domain information is
- * registered in <ddef>, in <ddef->dcl>.
+ * registered in <ddef>, in <ddef->dcl>, with its OA trace in the
+ * matching <ddef->dtr>. For <long_target>, the alidisplay is made
+ * here; otherwise the domain's <ad> is left <NULL> for
+ * p7_domaindef_CreateAlidisplays() to make from the trace later.
  * 
  * And here's what's happened to our working memory:
  * 
- * <ddef>: <ddef->tr> has been used, and possibly reallocated, for
- *         the OA trace of the domain. Before exit, we called
- *         <Reuse()> on it.
+ * <ddef>: <ddef->dcl> and <ddef->dtr> have been grown, if needed,
+ *         by one more domain; the trace slot is reused whether or
+ *         not a domain is defined.
  * 
  * <ox1> : happens to be holding OA score matrix for the domain
  *         upon return, but that's not part of the spec; officially
@@ -816,6 +954,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
 			P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr)
 {
   P7_DOMAIN     *dom           = NULL;
+  P7_TRACE      *tr            = NULL;
   int            Ld            = j-i+1;
   float          domcorrection = 0.0;
   float          envsc, oasc;
@@ -825,7 +964,19 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   int            status;
   int            max_env_extra = 20;
   int            orig_L;
+  int            z1, z2;
 
+  /* get ptrs to next empty domain structure in domaindef's results, and its trace */
+  if (ddef->ndom == ddef->nalloc) {
+    ESL_REALLOC(ddef->dcl, sizeof(P7_DOMAIN) * (ddef->nalloc*2));
+    ddef->nalloc *= 2;
+  }
+  if ((status = grow_domain_traces(ddef, ddef->ndom+1)) != eslOK) goto ERROR;
+  dom = &(ddef->dcl[ddef->ndom]);
+  tr  = ddef->dtr[ddef->ndom];
+  dom->ad             = NULL;
+  dom->scores_per_pos = NULL;
+  p7_trace_Reuse(tr);
 
   if (long_target) {
     //temporarily change model length to env_len. The nhmmer pipeline will tack
@@ -840,32 +991,23 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     reparameterize_model (bg, om, sq, i, j-i+1, fwd_emissions_arr, bg_tmp->f, scores_arr);
   }
 
-  p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &envsc);
-  p7_Backward(sq->dsq + i-1, Ld, om, ox1, ox2, NULL);
-
-  status = p7_Decoding(om, ox1, ox2, ox2);      /* <ox2> is now overwritten with post probabilities     */
+  /* Score and align the envelope. If it still needs its null2 (a
+   * simple one-domain region), that's collected during decoding too.
+   */
+  status = envelope_alignment(ddef, om, sq->dsq + i-1, Ld, ox1, ox2, tr, (! long_target && ! null2_is_done) ? null2 : NULL, &envsc, &oasc);
   if (status == eslERANGE) { /* rare: numeric overflow; domain is assumed to be repetitive garbage [J3/119-121] */
-      reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
+      if (long_target && scores_arr != NULL)
+        reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
       status = eslFAIL;
       goto ERROR;
   }
-
-  /* Find an optimal accuracy alignment */
-  p7_OptimalAccuracy(om, ox2, ox1, &oasc);      /* <ox1> is now overwritten with OA scores              */
-  p7_OATrace        (om, ox2, ox1, ddef->tr);   /* <tr>'s seq coords are offset by i-1, rel to orig dsq */
+  else if (status != eslOK) goto ERROR;
 
   /* hack the trace's sq coords to be correct w.r.t. original dsq */
-  for (z = 0; z < ddef->tr->N; z++)
-    if (ddef->tr->i[z] > 0) ddef->tr->i[z] += i-1;
+  for (z = 0; z < tr->N; z++)
+    if (tr->i[z] > 0) tr->i[z] += i-1;
 
-  /* get ptr to next empty domain structure in domaindef's results */
-  if (ddef->ndom == ddef->nalloc) {
-    ESL_REALLOC(ddef->dcl, sizeof(P7_DOMAIN) * (ddef->nalloc*2));
-    ddef->nalloc *= 2;
-  }
-  dom = &(ddef->dcl[ddef->ndom]);
-  dom->ad             = p7_alidisplay_Create(ddef->tr, 0, om, sq, ntsq);
-  dom->scores_per_pos = NULL;
+  if (long_target) dom->ad = p7_alidisplay_Create(tr, 0, om, sq, ntsq);
 
 
   /* For long target DNA, it's common to see a huge envelope (>1Kb longer than alignment), usually
@@ -894,28 +1036,23 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
         reparameterize_model (bg, om, sq, i, Ld, fwd_emissions_arr, bg_tmp->f, scores_arr);
       }
 
-      p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &envsc);
-      p7_Backward(sq->dsq + i-1, Ld, om, ox1, ox2, NULL);
-
-      status = p7_Decoding(om, ox1, ox2, ox2);      /* <ox2> is now overwritten with post probabilities     */
+      p7_trace_Reuse(tr);
+      status = envelope_alignment(ddef, om, sq->dsq + i-1, Ld, ox1, ox2, tr, NULL, &envsc, &oasc);
       if (status == eslERANGE) { /* rare: numeric overflow; domain is assumed to be repetitive garbage [J3/119-121] */
-          reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
+          if (scores_arr != NULL)
+            reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
           status = eslFAIL;
           goto ERROR;
       }
-
-      /* Find an optimal accuracy alignment */
-      p7_OptimalAccuracy(om, ox2, ox1, &oasc);      /* <ox1> is now overwritten with OA scores              */
-      p7_trace_Reuse(ddef->tr);
-      p7_OATrace        (om, ox2, ox1, ddef->tr);   /* <tr>'s seq coords are offset by i-1, rel to orig dsq */
+      else if (status != eslOK) goto ERROR;
 
       /* re-hack the trace's sq coords to be correct w.r.t. original dsq */
-       for (z = 0; z < ddef->tr->N; z++)
-         if (ddef->tr->i[z] > 0) ddef->tr->i[z] += i-1;
+       for (z = 0; z < tr->N; z++)
+         if (tr->i[z] > 0) tr->i[z] += i-1;
 
        /* store the results in it, first destroying the old alidisplay object */
        p7_alidisplay_Destroy(dom->ad);
-       dom->ad            = p7_alidisplay_Create(ddef->tr, 0, om, sq, NULL);
+       dom->ad            = p7_alidisplay_Create(tr, 0, om, sq, NULL);
     }
 
     /* Estimate bias correction, by computing what the score would've been without
@@ -925,7 +1062,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     if (scores_arr!=NULL) { //revert bg and om back to original,
                             //and while I'm at it, capture what the default parameterized score would have been, for "null2"
       reparameterize_model (bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr);
-      p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &domcorrection);
+      p7_ForwardParser(sq->dsq + i-1, Ld, om, ox1, &domcorrection);
     }
 
     p7_oprofile_ReconfigRestLength(om, orig_L);
@@ -942,10 +1079,10 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
      * Is null2 set already for this i..j? (It is, if we're in a domain that
      * was defined by stochastic traceback clustering in a multidomain region;
      * it isn't yet, if we're in a simple one-domain region). If it isn't,
-     * do it now, by the expectation (posterior decoding) method.
+     * envelope_alignment() already did it above, by the expectation
+     * (posterior decoding) method.
      */
       if (!null2_is_done) {
-        p7_Null2_ByExpectation(om, ox2, null2);
         for (pos = i; pos <= j; pos++)
           ddef->n2sc[pos]  = logf(null2[sq->dsq[pos]]);
       }
@@ -957,8 +1094,15 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   }
 
 
-  dom->iali          = dom->ad->sqfrom;
-  dom->jali          = dom->ad->sqto;
+  /* The alignment runs from the first to the last M state in the
+   * trace; the same span p7_alidisplay_Create() shows.
+   */
+  for (z1 = 0;       z1 < tr->N; z1++) if (tr->st[z1] == p7T_M) break;
+  for (z2 = tr->N-1; z2 >= 0;    z2--) if (tr->st[z2] == p7T_M) break;
+  if (z1 == tr->N) { status = eslFAIL; goto ERROR; }  /* no M? corrupt trace */
+
+  dom->iali          = tr->i[z1];
+  dom->jali          = tr->i[z2];
   dom->ienv          = i;
   dom->jenv          = j;
   dom->envsc         = envsc;         /* in units of NATS */
@@ -971,12 +1115,82 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
 
 
   ddef->ndom++;
+  return eslOK;
+
+ ERROR:
+  if (dom != NULL && dom->ad != NULL) { p7_alidisplay_Destroy(dom->ad); dom->ad = NULL; }
+  if (tr  != NULL) p7_trace_Reuse(tr);
+  return status;
+}
+
 
-  p7_trace_Reuse(ddef->tr);
+/* envelope_alignment()
+ *
+ * Forward/Backward, posterior decoding, and optimal accuracy
+ * alignment of one domain envelope <dsq> (offset to start at the
+ * envelope) of length <Ld>, for rescore_isolated_domain(). Returns
+ * the envelope score in <*ret_envsc>, the OA score in <*ret_oasc>,
+ * and the OA trace in <tr>, whose seq coords are relative to <dsq>.
+ * If <opt_null2> is non-NULL, the null2 model for the envelope is
+ * calculated by expectation too.
+ *
+ * Normally <ox1> and <ox2> are grown to full matrices: <ox1> for
+ * Forward and then OA scores, <ox2> for Backward and then posteriors.
+ * An envelope too big for that under <p7_RAMLIMIT> (a long repeat,
+ * or a long domain in a long target) is done in O(M sqrt(Ld)) memory
+ * instead, with <ox1>, <ox2> as checkpointed Forward and Backward
+ * matrices and two more checkpointed matrices, <ddef->ckpp> and
+ * <ddef->ckoa>, for the posteriors and the OA scores. Those are made
+ * the first time they're needed and reused, growing as needed, for
+ * later envelopes and targets. That costs two more Forward/Backward
+ * passes, but gives the same scores and trace.
+ *
+ * Returns <eslOK> on success; <eslERANGE> if posterior decoding
+ * overflows [J3/119-121].
+ *
+ * Throws <eslEMEM> on allocation failure.
+ */
+static int
+envelope_alignment(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2, P7_TRACE *tr,
+		   float *opt_null2, float *ret_envsc, float *ret_oasc)
+{
+  int status;
+
+  if (p7_omx_FitsRAMLimit(om->M, Ld))
+    {
+      if ((status = p7_omx_GrowTo(ox1, om->M, Ld, Ld)) != eslOK) goto ERROR;
+      if ((status = p7_omx_GrowTo(ox2, om->M, Ld, Ld)) != eslOK) goto ERROR;
+
+      p7_Forward (dsq, Ld, om,      ox1, ret_envsc);
+      p7_Backward(dsq, Ld, om, ox1, ox2, NULL);
+
+      /* <ox2> is now overwritten with post probabilities */
+      if (opt_null2) status = p7_DecodingNull2(om, ox1, ox2, ox2, opt_null2);
+      else           status = p7_Decoding     (om, ox1, ox2, ox2);
+      if (status != eslOK) goto ERROR;
+
+      p7_OptimalAccuracy(om, ox2, ox1, ret_oasc);  /* <ox1> is now overwritten with OA scores */
+      if ((status = p7_OATrace(om, ox2, ox1, tr)) != eslOK) goto ERROR;
+    }
+  else
+    {
+      if (ddef->ckpp == NULL && (ddef->ckpp = p7_omx_Create(om->M, 0, 0)) == NULL) { status = eslEMEM; goto ERROR; }
+      if (ddef->ckoa == NULL && (ddef->ckoa = p7_omx_Create(om->M, 0, 0)) == NULL) { status = eslEMEM; goto ERROR; }
+      if ((status = p7_omx_GrowToCheckpointed(ox1,        om->M, Ld)) != eslOK) goto ERROR;
+      if ((status = p7_omx_GrowToCheckpointed(ox2,        om->M, Ld)) != eslOK) goto ERROR;
+      if ((status = p7_omx_GrowToCheckpointed(ddef->ckpp, om->M, Ld)) != eslOK) goto ERROR;
+      if ((status = p7_omx_GrowToCheckpointed(ddef->ckoa, om->M, Ld)) != eslOK) goto ERROR;
+
+      p7_ForwardCheckpointed (dsq, Ld, om,      ox1, ret_envsc);
+      p7_BackwardCheckpointed(dsq, Ld, om, ox1, ox2, NULL);
+
+      if ((status = p7_OptimalAccuracyCheckpointed(dsq, om, ox1, ox2, ddef->ckpp, ddef->ckoa, ret_oasc)) != eslOK) goto ERROR;
+      if (opt_null2) p7_Null2_ByExpectedCounts(om, ddef->ckpp, opt_null2);
+      if ((status = p7_OATraceCheckpointed(dsq, om, ox1, ox2, ddef->ckpp, ddef->ckoa, tr)) != eslOK) goto ERROR;
+    }
   return eslOK;
 
  ERROR:
-  p7_trace_Reuse(ddef->tr);
   return status;
 }
   
@@ -1090,6 +1304,7 @@ main(int argc, char **argv)
   printf("Overall raw likelihood score: %.2f nats\n", overall_sc);
 
   /* retrieve and display results */
+  p7_domaindef_CreateAlidisplays(ddef, om, sq, NULL);
   for (d = 0; d < ddef->ndom; d++)
     {
       printf("domain %-4d : %4" PRId64 " %4" PRId64 "  %6.2f  %6.2f\n", 
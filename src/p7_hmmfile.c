@@ -16,6 +16,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 
 #ifdef HMMER_THREADS
 #include <pthread.h>
@@ -59,6 +66,11 @@ static int read_asc20hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_h
 static int   write_bin_string(FILE *fp, char *s);
 static int   read_bin_string (FILE *fp, char **ret_s);
 static float h2ascii2prob(char *s, float null);
+static double asc2double(const char *s);
+static int   map_hmmfile(P7_HMMFILE *hfp);
+static off_t next_record_end(const char *buf, off_t pos, off_t size);
+static int   parse_asc_record(P7_HMMFILE *hfp, off_t start, off_t end, ESL_ALPHABET **ret_abc, P7_HMM **ret_hmm, char *errbuf);
+static int   block_parse(P7_HMMFILE *hfp, int ncpu, ESL_ALPHABET *abc, const off_t *rstart, const off_t *rend, int first, int nrec, P7_HMM **hmmv, int *ret_n);
 
 
 /*****************************************************************
@@ -230,7 +242,10 @@ p7_hmmfile_OpenBuffer(const char *buffer, int size, P7_HMMFILE **ret_hfp)
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->cfp          = NULL;
   hfp->ssi          = NULL;
+  hfp->mbuf         = NULL;
+  hfp->msize        = 0;
   hfp->errbuf[0]    = '\0';
 
   if ((hfp->efp = esl_fileparser_CreateMapped(buffer, size))         == NULL)   { status = eslEMEM; goto ERROR; }
@@ -300,7 +315,10 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->cfp          = NULL;
   hfp->ssi          = NULL;
+  hfp->mbuf         = NULL;
+  hfp->msize        = 0;
   hfp->errbuf[0]    = '\0';
 
   /* 1. There's two special reading modes that have limited indexing
@@ -405,6 +423,9 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
     dbfile[n-1] = 'p';  /* the remainder of the optimized profiles */
     if ((hfp->pfp = fopen(dbfile, "rb")) == NULL) ESL_XFAIL(eslENOTFOUND, errbuf, "Opened %s, a pressed HMM file; but no .h3p file found", hfp->fname);
 
+    dbfile[n-1] = 'c';  /* profile clusters for hmmscan's prefilter; optional, made by hmmpress --clust */
+    hfp->cfp = fopen(dbfile, "rb");
+
     dbfile[n-1] = 'i';  /* the SSI index for the .h3m file */
     status = esl_ssi_Open(dbfile, &(hfp->ssi));
     if      (status == eslENOTFOUND) ESL_XFAIL(eslENOTFOUND, errbuf, "Opened %s, a pressed HMM file; but no .h3i file found", hfp->fname);
@@ -488,9 +509,13 @@ p7_hmmfile_Close(P7_HMMFILE *hfp)
   if (!hfp->do_gzip && !hfp->do_stdin && hfp->f != NULL) fclose(hfp->f);
   if (hfp->ffp   != NULL) fclose(hfp->ffp);
   if (hfp->pfp   != NULL) fclose(hfp->pfp);
+  if (hfp->cfp   != NULL) fclose(hfp->cfp);
   if (hfp->fname != NULL) free(hfp->fname);
   if (hfp->efp   != NULL) esl_fileparser_Destroy(hfp->efp);
   if (hfp->ssi   != NULL) esl_ssi_Close(hfp->ssi);
+#ifdef HAVE_MMAP
+  if (hfp->mbuf  != NULL) munmap(hfp->mbuf, hfp->msize);
+#endif
 #ifdef HMMER_THREADS
   if (hfp->syncRead)      pthread_mutex_destroy (&hfp->readMutex);
 #endif
@@ -1182,6 +1207,187 @@ p7_hmmfile_Read(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc,  P7_HMM **opt_hmm)
   return (*hfp->parser)(hfp, ret_abc, opt_hmm);
 }
 
+/* Function:  p7_hmmfile_ReadBlock()
+ * Synopsis:  Read a block of HMMs, parsing ASCII records in parallel.
+ *
+ * Purpose:   Read up to <nmax> next HMMs from open file <hfp> into
+ *            caller-provided array <hmmv[0..nmax-1]>, in file order,
+ *            and return the number read in <*ret_n>. <ret_abc> works
+ *            as it does for <p7_hmmfile_Read()>.
+ *
+ *            For a HMMER3 ASCII file on disk, the file is memory
+ *            mapped on first use, record boundaries are found by
+ *            scanning for the closing // lines, and up to <ncpu>
+ *            threads parse the records. Any other input (a pressed
+ *            binary db, stdin, a gzip pipe, HMMER2 format, or a
+ *            system without <mmap()>) is read serially with
+ *            <p7_hmmfile_Read()>, so callers can use this on any
+ *            <hfp>. Calls to <p7_hmmfile_ReadBlock()> and
+ *            <p7_hmmfile_Read()> may be interleaved.
+ *
+ * Args:      hfp     - open HMM file
+ *            ncpu    - number of parsing threads; <= 1 for serial
+ *            ret_abc - expected alphabet, or ptr to NULL to set it
+ *                      from the first HMM read
+ *            hmmv    - RETURN: HMMs read, hmmv[0..*ret_n-1]
+ *            nmax    - maximum number of HMMs to read (>= 1)
+ *            ret_n   - RETURN: number of HMMs read
+ *
+ * Returns:   <eslOK> on success; <*ret_n> is >= 1.
+ *
+ *            <eslEOF> if no HMMs remain; <*ret_n> is 0.
+ *
+ *            <eslEFORMAT> or <eslEINCOMPAT> on a bad record, as for
+ *            <p7_hmmfile_Read()>, with a message in <hfp->errbuf>.
+ *            The <*ret_n> good HMMs that precede the bad one are
+ *            still returned in <hmmv>, and the caller frees them.
+ *
+ * Throws:    <eslEMEM> on allocation error; <eslESYS> if a system
+ *            call fails.
+ */
+int
+p7_hmmfile_ReadBlock(P7_HMMFILE *hfp, int ncpu, ESL_ALPHABET **ret_abc, P7_HMM **hmmv, int nmax, int *ret_n)
+{
+  off_t *rstart = NULL;	/* record i is mbuf[rstart[i]..rstart[i+1]-1] */
+  off_t  pos, q;
+  int    nrec   = 0;
+  int    n      = 0;
+  int    i;
+  int    status = eslOK;
+
+  *ret_n = 0;
+
+  if (hfp->efp == NULL || hfp->f == NULL || hfp->format == p7_HMMFILE_20 || map_hmmfile(hfp) != eslOK)
+    {
+      while (n < nmax && (status = p7_hmmfile_Read(hfp, ret_abc, &(hmmv[n]))) == eslOK) n++;
+      *ret_n = n;
+      if (status == eslEOF && n > 0) status = eslOK;
+      return status;
+    }
+
+  /* Where does the next record start? */
+  if (hfp->newly_opened) pos = 0;
+  else if ((pos = ftello(hfp->f)) < 0) ESL_EXCEPTION(eslESYS, "ftello() failed");
+
+  /* Find up to <nmax> record boundaries. Trailing whitespace isn't a record. */
+  ESL_ALLOC(rstart, sizeof(off_t) * (nmax+1));
+  rstart[0] = pos;
+  while (nrec < nmax && pos < hfp->msize)
+    {
+      for (q = pos; q < hfp->msize && isspace(hfp->mbuf[q]); q++) ;
+      if (q == hfp->msize) break;
+      pos = rstart[++nrec] = next_record_end(hfp->mbuf, pos, hfp->msize);
+    }
+  if (nrec == 0) { status = eslEOF; goto DONE; }
+
+  /* If the alphabet's not known yet, the first record sets it */
+  if (*ret_abc == NULL)
+    {
+      if ((status = parse_asc_record(hfp, rstart[0], rstart[1], ret_abc, &(hmmv[0]), hfp->errbuf)) != eslOK) goto DONE;
+      n = 1;
+    }
+
+  status = block_parse(hfp, ncpu, *ret_abc, rstart, rstart+1, n, nrec, hmmv, &n);
+
+ DONE:
+  if (status != eslOK && status != eslEOF && status != eslEFORMAT && status != eslEINCOMPAT) goto ERROR;
+
+  /* Leave <hfp> poised on the next record (past a bad one), for either reader */
+  if (fseeko(hfp->f, rstart[ESL_MIN(n+1, nrec)], SEEK_SET) != 0) ESL_XEXCEPTION(eslESYS, "fseeko() failed");
+  hfp->newly_opened = FALSE;
+  free(rstart);
+  *ret_n = n;
+  return status;
+
+ ERROR:
+  if (rstart) free(rstart);
+  for (i = 0; i < n; i++) p7_hmm_Destroy(hmmv[i]);
+  return status;
+}
+
+
+
+/* Function:  p7_hmmfile_ReadOffsets()
+ * Synopsis:  Read the HMMs that start at a list of disk offsets.
+ *
+ * Purpose:   Read the <n> HMMs that start at disk offsets
+ *            <offset[0..n-1]> of <hfp>, as found in its SSI index or
+ *            an HMM's <offset>, into caller-provided array
+ *            <hmmv[0..n-1]>. <ret_abc> works as it does for
+ *            <p7_hmmfile_Read()>.
+ *
+ *            Offsets may come in any order, and may repeat (each
+ *            copy gives its own <P7_HMM>), but sorting them makes
+ *            the reads sequential. For a HMMER3 ASCII file, the
+ *            file is memory mapped (see <p7_hmmfile_ReadBlock()>) and
+ *            up to <ncpu> threads parse the records. Other files are
+ *            positioned and read one model at a time.
+ *
+ *            Afterwards, <hfp> is positioned just after the last HMM.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> if an offset isn't the start of a good HMM
+ *            record, or <eslEINCOMPAT> on an alphabet mismatch, with a
+ *            message in <hfp->errbuf>. In these cases no HMMs are
+ *            returned; <hmmv[]> is all <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation error; <eslESYS> if a system
+ *            call fails. <hmmv[]> is all <NULL>.
+ */
+int
+p7_hmmfile_ReadOffsets(P7_HMMFILE *hfp, int ncpu, ESL_ALPHABET **ret_abc, const off_t *offset, int n, P7_HMM **hmmv)
+{
+  off_t *rend = NULL;
+  int    nok  = 0;
+  int    i;
+  int    status;
+
+  for (i = 0; i < n; i++) hmmv[i] = NULL;
+  if (n == 0) return eslOK;
+
+  if (hfp->efp == NULL || hfp->f == NULL || hfp->format == p7_HMMFILE_20 || map_hmmfile(hfp) != eslOK)
+    {
+      for (i = 0; i < n; i++)
+	{
+	  if (offset[i] < 0) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "No HMM at offset %" PRId64 " in %s", (int64_t) offset[i], hfp->fname);
+	  if ((status = p7_hmmfile_Position(hfp, offset[i]))        != eslOK) goto ERROR;
+	  if ((status = p7_hmmfile_Read(hfp, ret_abc, &(hmmv[i]))) != eslOK) {
+	    if (status == eslEOF) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "No HMM at offset %" PRId64 " in %s", (int64_t) offset[i], hfp->fname);
+	    goto ERROR;
+	  }
+	}
+      return eslOK;
+    }
+
+  ESL_ALLOC(rend, sizeof(off_t) * n);
+  for (i = 0; i < n; i++)
+    {
+      if (offset[i] < 0 || offset[i] >= hfp->msize) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "No HMM at offset %" PRId64 " in %s", (int64_t) offset[i], hfp->fname);
+      rend[i] = next_record_end(hfp->mbuf, offset[i], hfp->msize);
+    }
+
+  if (*ret_abc == NULL)
+    {
+      if ((status = parse_asc_record(hfp, offset[0], rend[0], ret_abc, &(hmmv[0]), hfp->errbuf)) != eslOK) goto ERROR;
+      nok = 1;
+    }
+
+  status = block_parse(hfp, ncpu, *ret_abc, offset, rend, nok, n, hmmv, &nok);
+  if (status != eslOK) goto ERROR;
+
+  if (fseeko(hfp->f, rend[n-1], SEEK_SET) != 0) ESL_XEXCEPTION(eslESYS, "fseeko() failed");
+  hfp->newly_opened = FALSE;
+  free(rend);
+  return eslOK;
+
+ ERROR:
+  for (i = 0; i < n; i++) 
+    if (hmmv[i]) { p7_hmm_Destroy(hmmv[i]); hmmv[i] = NULL; }
+  if (rend) free(rend);
+  return status;
+}
+
 
 
 /* Function:  p7_hmmfile_PositionByKey()
@@ -1530,7 +1736,7 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
   if (strcmp(tok1, "COMPO") == 0) {
     for (x = 0; x < abc->K; x++)  {
       if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))     != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few fields on COMPO line");
-      hmm->compo[x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * atof(tok1)));
+      hmm->compo[x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * asc2double(tok1)));
     }
     hmm->flags |= p7H_COMPO;
     if ((status = esl_fileparser_NextLine(hfp->efp))                          != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data after COMPO line");  
@@ -1539,15 +1745,15 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
 
   /* First two lines are node 0: insert emissions, then transitions from node 0 (begin) */
 
-  hmm->ins[0][0] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+  hmm->ins[0][0] = (*tok1 == '*' ? 0.0 : expf(-1.0 * asc2double(tok1)));
   for (x = 1; x < abc->K; x++) {
     if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))       != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few fields on insert line, node 0: expected %d, got %d\n", abc->K, x);
-    hmm->ins[0][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+    hmm->ins[0][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * asc2double(tok1)));
   }
   if ((status = esl_fileparser_NextLine(hfp->efp))                            != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data in main model: no node 0 transition line");
   for (x = 0; x < p7H_NTRANSITIONS; x++) {
     if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))       != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few fields on begin (0) transition line");
-    hmm->t[0][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+    hmm->t[0][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * asc2double(tok1)));
   }
 
   /* The main model section. */
@@ -1560,7 +1766,7 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
       
       for (x = 0; x < abc->K; x++) {
 	if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))   != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few probability fields on match line, node %d: expected %d, got %d\n", k, abc->K, x);
-	hmm->mat[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+	hmm->mat[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * asc2double(tok1)));
       }
       
       if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))     != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Missing MAP field on match line for node %d: should at least be -", k);
@@ -1586,12 +1792,12 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
       if ((status = esl_fileparser_NextLine(hfp->efp))                        != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data in main model: no insert emission line, node %d", k);
       for (x = 0; x < abc->K; x++) {
 	if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))   != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few probability fields on insert line, node %d: expected %d, got %d\n", k, abc->K, x);
-	hmm->ins[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+	hmm->ins[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * asc2double(tok1)));
       }
       if ((status = esl_fileparser_NextLine(hfp->efp))                        != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data in main model: no transition line, node %d", k);
       for (x = 0; x < p7H_NTRANSITIONS; x++) {
 	if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))   != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few probability fields on transition line, node %d: expected %d, got %d\n", k, abc->K, x);
-	hmm->t[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+	hmm->t[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * asc2double(tok1)));
       }
     }
 
@@ -2242,6 +2448,166 @@ h2ascii2prob(char *s, float null)
 {
   return ((*s == '*') ? 0. : null * exp( atoi(s) * 0.00069314718));
 }
+
+/* asc2double()
+ * A faster atof() for the probability fields of ASCII save files,
+ * which are written as plain decimals like "2.68618". When the digits
+ * fit exactly in a double's mantissa, the value is the correctly
+ * rounded quotient of two exact doubles -- the same number strtod()
+ * returns. Anything else (exponents, long mantissas) goes to atof().
+ */
+static double
+asc2double(const char *s)
+{
+  static const double p10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9, 1e10, 1e11,
+				1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const char *p    = s;
+  uint64_t    m    = 0;
+  int         nd   = 0;		/* total digits */
+  int         nf   = 0;		/* digits after the decimal point */
+  int         sign = 1;
+
+  if      (*p == '-') { sign = -1; p++; }
+  else if (*p == '+') p++;
+  for ( ; *p >= '0' && *p <= '9'; p++, nd++)           m = m*10 + (*p - '0');
+  if (*p == '.')
+    for (p++; *p >= '0' && *p <= '9'; p++, nd++, nf++) m = m*10 + (*p - '0');
+
+  if (*p != '\0' || nd == 0 || nd > 15 || nf > 22) return atof(s);
+  return sign * ((double) m / p10[nf]);
+}
+
+
+/* map_hmmfile()
+ * Memory-map the ASCII file open in <hfp> for reading, if it isn't
+ * already. Returns <eslOK> if <hfp->mbuf> holds the file, or <eslFAIL>
+ * if it can't be mapped (a pipe, an empty file, no <mmap()>), in
+ * which case the caller reads serially instead.
+ */
+static int
+map_hmmfile(P7_HMMFILE *hfp)
+{
+#ifdef HAVE_MMAP
+  struct stat st;
+  void       *m;
+
+  if (hfp->mbuf != NULL) return eslOK;
+  if (hfp->do_stdin || hfp->do_gzip || hfp->f == NULL)      return eslFAIL;
+  if (fstat(fileno(hfp->f), &st) != 0 || ! S_ISREG(st.st_mode) || st.st_size == 0) return eslFAIL;
+  if ((m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(hfp->f), 0)) == MAP_FAILED) return eslFAIL;
+  hfp->mbuf  = (char *) m;
+  hfp->msize = st.st_size;
+  return eslOK;
+#else
+  return eslFAIL;
+#endif
+}
+
+
+/* next_record_end()
+ * Given an ASCII save file buffer <buf> of <size> bytes, with a
+ * record starting at offset <pos>, return the offset just past the
+ * // line that closes it, or <size> if the buffer ends first.
+ */
+static off_t
+next_record_end(const char *buf, off_t pos, off_t size)
+{
+  const char *nl = NULL;
+
+  while (pos < size)
+    {
+      nl = memchr(buf+pos, '\n', size-pos);
+      if (buf[pos] == '/' && pos+1 < size && buf[pos+1] == '/') break;
+      if (nl == NULL) return size;
+      pos = nl - buf + 1;
+    }
+  return (pos < size && nl != NULL ? nl - buf + 1 : size);
+}
+
+
+/* parse_asc_record()
+ * Parse one ASCII HMM record, <hfp->mbuf[start..end-1]>, with the
+ * usual format parser. The HMM's <offset> is set as if it had been
+ * read from <hfp> directly. Returns as <p7_hmmfile_Read()>, with any
+ * error message in <errbuf>.
+ */
+static int
+parse_asc_record(P7_HMMFILE *hfp, off_t start, off_t end, ESL_ALPHABET **ret_abc, P7_HMM **ret_hmm, char *errbuf)
+{
+  P7_HMMFILE *bfp = NULL;
+  int         status;
+
+  *ret_hmm = NULL;
+  status = p7_hmmfile_OpenBuffer(hfp->mbuf + start, (int) (end - start), &bfp);
+  if      (status == eslEFORMAT)    ESL_XFAIL(eslEFORMAT, errbuf, "HMM record at byte offset %" PRId64 " doesn't start with a format tag", (int64_t) start);
+  else if (status != eslOK)         goto ERROR;
+  if (bfp->format != hfp->format)   ESL_XFAIL(eslEFORMAT, errbuf, "HMM record at byte offset %" PRId64 " is in a different format from the first", (int64_t) start);
+
+  if ((status = p7_hmmfile_Read(bfp, ret_abc, ret_hmm)) != eslOK) {
+    if (status == eslEOF) status = eslEFORMAT;
+    if (errbuf != bfp->errbuf) strcpy(errbuf, bfp->errbuf);
+    goto ERROR;
+  }
+  (*ret_hmm)->offset = start;
+  p7_hmmfile_Close(bfp);
+  return eslOK;
+
+ ERROR:
+  p7_hmmfile_Close(bfp);
+  return status;
+}
+
+
+/* block_parse()
+ * Parse records <first..nrec-1>, <hfp->mbuf[rstart[i]..rend[i]-1]>,
+ * into <hmmv>, on up to <ncpu> threads with p7_ThreadedFor().
+ * On a bad record, everything after it is discarded: <*ret_n> is
+ * the number of good HMMs in <hmmv>, in order, and <hfp->errbuf>
+ * says what's wrong with the bad one.
+ */
+typedef struct {
+  P7_HMMFILE      *hfp;
+  ESL_ALPHABET    *abc;
+  const off_t     *rstart;
+  const off_t     *rend;
+  P7_HMM         **hmmv;
+  int              first;
+} BLOCK_WORKSET;
+
+static int
+block_work(void *arg, void *tls, int i, char *errbuf)
+{
+  BLOCK_WORKSET *ws  = (BLOCK_WORKSET *) arg;
+  ESL_ALPHABET  *abc = ws->abc;
+
+  i += ws->first;
+  return parse_asc_record(ws->hfp, ws->rstart[i], ws->rend[i], &abc, &(ws->hmmv[i]), errbuf);
+}
+
+static int
+block_parse(P7_HMMFILE *hfp, int ncpu, ESL_ALPHABET *abc, const off_t *rstart, const off_t *rend, int first, int nrec, P7_HMM **hmmv, int *ret_n)
+{
+  BLOCK_WORKSET ws;
+  int           failidx;
+  int           i;
+  int           status;
+
+  ws.hfp    = hfp;
+  ws.abc    = abc;
+  ws.rstart = rstart;
+  ws.rend   = rend;
+  ws.hmmv   = hmmv;
+  ws.first  = first;
+  for (i = first; i < nrec; i++) hmmv[i] = NULL;
+
+  status  = p7_ThreadedFor(ncpu, nrec - first, &ws, NULL, block_work, NULL, &failidx, hfp->errbuf);
+  failidx = first + ESL_MAX(failidx, 0);
+
+  /* records after a bad one may have been parsed before it was found */
+  for (i = failidx; i < nrec; i++) if (hmmv[i]) { p7_hmm_Destroy(hmmv[i]); hmmv[i] = NULL; }
+  *ret_n = failidx;
+  return status;
+}
 /*---------------- end, private utilities -----------------------*/
 
 
@@ -2270,6 +2636,7 @@ static ESL_OPTIONS options[] = {
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",  0 },
   { "-a",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "include time of profile configuration", 0 }, 
   { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "verbose: print model info as they're read", 0 }, 
+  { "-n",        eslARG_INT,     NULL, NULL,"n>=0", NULL,  NULL, NULL, "read in blocks, parsing with <n> threads",   0 }, 
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <HMM file>";
@@ -2287,6 +2654,9 @@ main(int argc, char **argv)
   P7_BG         *bg      = NULL;
   P7_PROFILE    *gm      = NULL;
   P7_OPROFILE   *om      = NULL;
+  P7_HMM        *hmmv[256];
+  int            nblk    = 0;
+  int            b       = 0;
   int            nmodel  = 0;
   uint64_t       totM    = 0;
   int            status;
@@ -2299,8 +2669,18 @@ main(int argc, char **argv)
   else if (status == eslEFORMAT)   p7_Fail("File format problem in trying to open HMM file %s.\n%s\n",                hmmfile, errbuf);
   else if (status != eslOK)        p7_Fail("Unexpected error %d in opening HMM file %s.\n%s\n",               status, hmmfile, errbuf);  
 
-  while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
+  while (1)
     {
+      if (esl_opt_IsOn(go, "-n"))
+	{
+	  if (b == nblk) {
+	    if ((status = p7_hmmfile_ReadBlock(hfp, esl_opt_GetInteger(go, "-n"), &abc, hmmv, 256, &nblk)) != eslOK) break;
+	    b = 0;
+	  }
+	  hmm = hmmv[b++];
+	}
+      else if ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) != eslOK) break;
+
       if (nmodel == 0) {   /* first time initialization, now that alphabet known */
   bg = p7_bg_Create(abc);
   p7_bg_SetLength(bg, 400);
@@ -2348,6 +2728,7 @@ main(int argc, char **argv)
  * 7. Unit tests.
  *****************************************************************/
 #ifdef p7HMMFILE_TESTDRIVE
+#include <unistd.h>	/* truncate() */
 
 /* utest_io_30: tests read/write for 3.0 save files.
  *              Caller provides a named tmpfile that we can
@@ -2446,6 +2827,213 @@ utest_io_3a(char *tmpfile, P7_HMM *hmm)
   return eslOK;
 }
 
+
+/* utest_readblock: p7_hmmfile_ReadBlock() on a multi-model ASCII
+ *              file must give the same HMMs, in the same order and
+ *              with the same disk offsets, as p7_hmmfile_Read(),
+ *              for any block size and thread count, including when
+ *              the two readers are interleaved; and a truncated
+ *              last record must still return the good ones before it.
+ */
+static int
+utest_readblock(char *tmpfile, ESL_RANDOMNESS *r, ESL_ALPHABET *abc)
+{
+  char          msg[]   = "ReadBlock unit test failed";
+  int           nhmm    = 23;
+  int           nmaxv[] = { 1, 5, 64 };
+  int           ncpuv[] = { 1, 4 };
+  P7_HMM      **hmm     = NULL;
+  P7_HMM      **blk     = NULL;
+  P7_HMM       *new     = NULL;
+  off_t        *offset  = NULL;
+  ESL_ALPHABET *newabc  = NULL;
+  P7_HMMFILE   *hfp     = NULL;
+  FILE         *fp      = NULL;
+  int           a, b, i, j, n, nread;
+  int           status;
+
+  ESL_ALLOC(hmm,    sizeof(P7_HMM *) * nhmm);
+  ESL_ALLOC(blk,    sizeof(P7_HMM *) * 64);
+  ESL_ALLOC(offset, sizeof(off_t)    * nhmm);
+
+  if ((fp = fopen(tmpfile, "w")) == NULL) esl_fatal(msg);
+  for (i = 0; i < nhmm; i++)
+    {
+      if (p7_hmm_Sample(r, 1 + esl_rnd_Roll(r, 60), abc, &(hmm[i])) != eslOK) esl_fatal(msg);
+      if (p7_hmmfile_WriteASCII(fp, -1, hmm[i])                     != eslOK) esl_fatal(msg);
+    }
+  fputs("\n  \n", fp);		/* trailing whitespace is not a record */
+  fclose(fp);
+
+  /* reference offsets, from the serial reader */
+  if (p7_hmmfile_OpenE(tmpfile, NULL, &hfp, NULL) != eslOK) esl_fatal(msg);
+  for (i = 0; i < nhmm; i++) {
+    if (p7_hmmfile_Read(hfp, &newabc, &new) != eslOK) esl_fatal(msg);
+    offset[i] = new->offset;
+    p7_hmm_Destroy(new);
+  }
+  if (p7_hmmfile_Read(hfp, &newabc, &new) != eslEOF) esl_fatal(msg);
+  p7_hmmfile_Close(hfp);
+
+  for (a = 0; a < sizeof(nmaxv) / sizeof(int); a++)
+    for (b = 0; b < sizeof(ncpuv) / sizeof(int); b++)
+      {
+	if (p7_hmmfile_OpenE(tmpfile, NULL, &hfp, NULL) != eslOK) esl_fatal(msg);
+	nread = 0;
+	while (1)
+	  {
+	    if (nread == 2) 	/* interleave a serial read */
+	      {
+		if (p7_hmmfile_Read(hfp, &newabc, &(blk[0])) != eslOK) esl_fatal(msg);
+		n = 1;
+	      }
+	    else
+	      {
+		status = p7_hmmfile_ReadBlock(hfp, ncpuv[b], &newabc, blk, nmaxv[a], &n);
+		if (status == eslEOF) break;
+		if (status != eslOK || n < 1 || n > nmaxv[a]) esl_fatal(msg);
+	      }
+	    for (j = 0; j < n; j++, nread++)
+	      {
+		if (nread >= nhmm)                                   esl_fatal(msg);
+		if (p7_hmm_Compare(hmm[nread], blk[j], 0.0001) != eslOK) esl_fatal(msg);
+		if (blk[j]->offset != offset[nread])                 esl_fatal(msg);
+		p7_hmm_Destroy(blk[j]);
+	      }
+	  }
+	if (n != 0 || nread != nhmm) esl_fatal(msg);
+	p7_hmmfile_Close(hfp);
+      }
+
+  /* Truncate the last record */
+  if (truncate(tmpfile, offset[nhmm-1] + 30) != 0)            esl_fatal(msg);
+  if (p7_hmmfile_OpenE(tmpfile, NULL, &hfp, NULL) != eslOK)   esl_fatal(msg);
+  if (p7_hmmfile_ReadBlock(hfp, 4, &newabc, blk, 64, &n) != eslEFORMAT) esl_fatal(msg);
+  if (n != nhmm-1) esl_fatal(msg);
+  for (j = 0; j < n; j++) p7_hmm_Destroy(blk[j]);
+  p7_hmmfile_Close(hfp);
+
+  for (i = 0; i < nhmm; i++) p7_hmm_Destroy(hmm[i]);
+  free(hmm);
+  free(blk);
+  free(offset);
+  esl_alphabet_Destroy(newabc);
+  return eslOK;
+
+ ERROR:
+  esl_fatal(msg);
+  return status;
+}
+
+
+/* utest_readoffsets: p7_hmmfile_ReadOffsets() must return the HMM at
+ *              each offset, in the order given, including repeated
+ *              offsets, serially or threaded, whether or not the
+ *              alphabet is known yet, for ASCII and binary files;
+ *              afterwards <hfp> must be poised on the HMM after the
+ *              last one read. An offset that isn't the start of a
+ *              record, or is outside the file, is an <eslEFORMAT>
+ *              that returns no HMMs.
+ */
+static int
+utest_readoffsets(char *tmpfile, ESL_RANDOMNESS *r, ESL_ALPHABET *abc)
+{
+  char          msg[]   = "ReadOffsets unit test failed";
+  int           nhmm    = 17;
+  int           ndup    = 5;
+  int           ncpuv[] = { 1, 4 };
+  P7_HMM      **hmm     = NULL;
+  P7_HMM      **hmmv    = NULL;
+  P7_HMM       *new     = NULL;
+  off_t        *offset  = NULL;	/* offset[0..nhmm-1] of each HMM in the file */
+  off_t        *query   = NULL;	/* offsets asked for, [0..nhmm+ndup-1]      */
+  int          *which   = NULL;	/* ... and which HMM each one is            */
+  off_t         bad[2];
+  ESL_ALPHABET *newabc  = NULL;
+  P7_HMMFILE   *hfp     = NULL;
+  FILE         *fp      = NULL;
+  int           nq      = nhmm + ndup;
+  int           is_binary, b, i, tmp;
+  int           status;
+
+  ESL_ALLOC(hmm,    sizeof(P7_HMM *) * nhmm);
+  ESL_ALLOC(hmmv,   sizeof(P7_HMM *) * nq);
+  ESL_ALLOC(offset, sizeof(off_t)    * nhmm);
+  ESL_ALLOC(query,  sizeof(off_t)    * nq);
+  ESL_ALLOC(which,  sizeof(int)      * nq);
+  for (i = 0; i < nhmm; i++)
+    if (p7_hmm_Sample(r, 1 + esl_rnd_Roll(r, 60), abc, &(hmm[i])) != eslOK) esl_fatal(msg);
+
+  for (is_binary = FALSE; is_binary <= TRUE; is_binary++)
+    {
+      if ((fp = fopen(tmpfile, "w")) == NULL) esl_fatal(msg);
+      for (i = 0; i < nhmm; i++)
+	if ((is_binary ? p7_hmmfile_WriteBinary(fp, -1, hmm[i]) : p7_hmmfile_WriteASCII(fp, -1, hmm[i])) != eslOK) esl_fatal(msg);
+      fclose(fp);
+
+      /* reference offsets, from the serial reader */
+      if (p7_hmmfile_OpenE(tmpfile, NULL, &hfp, NULL) != eslOK) esl_fatal(msg);
+      for (i = 0; i < nhmm; i++) {
+	if (p7_hmmfile_Read(hfp, &newabc, &new) != eslOK) esl_fatal(msg);
+	offset[i] = new->offset;
+	p7_hmm_Destroy(new);
+      }
+      p7_hmmfile_Close(hfp);
+
+      /* a shuffled order, with some repeats mixed in */
+      for (i = 0; i < nhmm; i++) which[i] = i;
+      for (i = nhmm; i < nq; i++) which[i] = esl_rnd_Roll(r, nhmm);
+      for (i = nq-1; i > 0; i--) { b = esl_rnd_Roll(r, i+1); tmp = which[i]; which[i] = which[b]; which[b] = tmp; }
+      for (i = 0; i < nq; i++) query[i] = offset[which[i]];
+
+      for (b = 0; b < sizeof(ncpuv) / sizeof(int); b++)
+	{
+	  esl_alphabet_Destroy(newabc);
+	  newabc = (b == 0 ? NULL : esl_alphabet_Create(abc->type)); /* unknown alphabet, then known */
+
+	  if (p7_hmmfile_OpenE(tmpfile, NULL, &hfp, NULL)                != eslOK) esl_fatal(msg);
+	  if (p7_hmmfile_ReadOffsets(hfp, ncpuv[b], &newabc, query, nq, hmmv) != eslOK) esl_fatal(msg);
+	  for (i = 0; i < nq; i++)
+	    {
+	      if (p7_hmm_Compare(hmm[which[i]], hmmv[i], 0.0001) != eslOK) esl_fatal(msg);
+	      if (hmmv[i]->offset != query[i])                         esl_fatal(msg);
+	      p7_hmm_Destroy(hmmv[i]);
+	    }
+
+	  /* poised after the last one */
+	  status = p7_hmmfile_Read(hfp, &newabc, &new);
+	  if (which[nq-1] == nhmm-1) { if (status != eslEOF) esl_fatal(msg); }
+	  else {
+	    if (status != eslOK || new->offset != offset[which[nq-1]+1]) esl_fatal(msg);
+	    p7_hmm_Destroy(new);
+	  }
+
+	  /* bad offsets: past the end, negative, and (ASCII) inside a record */
+	  bad[0] = offset[0];
+	  for (i = 0; i < (is_binary ? 2 : 3); i++)
+	    {
+	      bad[1] = (i == 0 ? offset[nhmm-1] + (off_t) 1000000 : (i == 1 ? -1 : offset[2] + 1));
+	      if (p7_hmmfile_ReadOffsets(hfp, ncpuv[b], &newabc, bad, 2, hmmv) != eslEFORMAT) esl_fatal(msg);
+	      if (hmmv[0] != NULL || hmmv[1] != NULL)                                      esl_fatal(msg);
+	    }
+	  p7_hmmfile_Close(hfp);
+	}
+    }
+
+  for (i = 0; i < nhmm; i++) p7_hmm_Destroy(hmm[i]);
+  free(hmm);
+  free(hmmv);
+  free(offset);
+  free(query);
+  free(which);
+  esl_alphabet_Destroy(newabc);
+  return eslOK;
+
+ ERROR:
+  esl_fatal(msg);
+  return status;
+}
+
 #endif /*p7HMMFILE_TESTDRIVE*/
 /*-------------------- end, unit tests --------------------------*/
 
@@ -2496,6 +3084,9 @@ main(int argc, char **argv)
   utest_io_3a     (tmpfile, hmm);
   p7_hmm_Destroy(hmm);
 
+  utest_readblock  (tmpfile, r, aa_abc);
+  utest_readoffsets(tmpfile, r, aa_abc);
+
   esl_alphabet_Destroy(aa_abc);
   esl_alphabet_Destroy(nt_abc);
   esl_randomness_Destroy(r);
@@ -16,6 +16,7 @@
 #include "esl_exponential.h"
 #include "esl_getopts.h"
 #include "esl_gumbel.h"
+#include "esl_stopwatch.h"
 #include "esl_vectorops.h"
 
 #include "hmmer.h"
@@ -86,9 +87,16 @@ typedef struct {
  *            | --nonull2    |  turn OFF biased comp score correction      |   FALSE   |
  *            | --seed       |  RNG seed (0=use arbitrary seed)            |      42   |
  *            | --acc        |  prefer accessions over names in output     |   FALSE   |
+ *            | --stagetimes |  time each filter stage                     |   FALSE   |
  *
  *            As a special case, if <go> is <NULL>, defaults are set as above.
  *            This shortcut is used in simplifying test programs and the like.
+ *
+ *            With <--stagetimes>, the pipeline also accumulates wall
+ *            clock time spent in each filter stage, and
+ *            <p7_pli_Statistics()> reports it. This is for
+ *            benchmarking (see test-speed/); it costs a few timer
+ *            calls per target, so it is off by default.
  *            
  * Returns:   ptr to new <P7_PIPELINE> object on success. Caller frees this
  *            with <p7_pipeline_Destroy()>.
@@ -240,14 +248,34 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
   pli->n_past_bias     = 0;
   pli->n_past_vit      = 0;
   pli->n_past_fwd      = 0;
+  pli->nres_bias       = 0;
   pli->pos_past_msv    = 0;
   pli->pos_past_bias   = 0;
   pli->pos_past_vit    = 0;
   pli->pos_past_fwd    = 0;
+  pli->seedsel         = NULL;
+  pli->n_seed_skip     = 0;
+  pli->n_seed_sample   = 0;
+  pli->n_seed_samplemsv= 0;
+  pli->clumap          = NULL;
+  pli->cluopen         = NULL;
+  pli->clu_reppass     = FALSE;
+  pli->n_clu_rep       = 0;
+  pli->n_clu_open      = 0;
+  pli->n_clu_skip      = 0;
+  pli->stagew          = NULL;
+  pli->t_msv           = 0.;
+  pli->t_bias          = 0.;
+  pli->t_vit           = 0.;
+  pli->t_fwd           = 0.;
+  pli->t_dom           = 0.;
+  if (go && esl_opt_GetBoolean(go, "--stagetimes") && (pli->stagew = esl_stopwatch_Create()) == NULL) goto ERROR;
   pli->mode            = mode;
   pli->show_accessions = (go && esl_opt_GetBoolean(go, "--acc")   ? TRUE  : FALSE);
   pli->show_alignments = (go && esl_opt_GetBoolean(go, "--noali") ? FALSE : TRUE);
   pli->hfp             = NULL;
+  pli->scan_L          = -1;
+  pli->scan_nullsc     = 0.0;
   pli->errbuf[0]       = '\0';
 
   return pli;
@@ -297,6 +325,7 @@ p7_pipeline_Destroy(P7_PIPELINE *pli)
   p7_omx_Destroy(pli->bck);
   esl_randomness_Destroy(pli->r);
   p7_domaindef_Destroy(pli->ddef);
+  esl_stopwatch_Destroy(pli->stagew);
   free(pli);
 }
 /*---------------- end, P7_PIPELINE object ----------------------*/
@@ -478,6 +507,12 @@ p7_pli_DomainIncludable(P7_PIPELINE *pli, float dom_score, double lnP)
  *            need to call <p7_bg_SetLength()> after a <NewModel()> call.
  *            (Failure to do this is bug #h85, 14 Dec 10.)
  *
+ *            In a protein scan pipeline, most models never get as far
+ *            as the bias filter, so there <p7_Pipeline()> sets up the
+ *            bias filter HMM itself, only for models that pass MSV,
+ *            and the null model length only needs to be set once per
+ *            query.
+ *
  *            The pipeline may alter the null model <bg> in a model-specific
  *            way (if we're using a composition bias filter HMM in the
  *            pipeline).
@@ -497,7 +532,8 @@ p7_pli_NewModel(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg)
   pli->nnodes += om->M;
   if (pli->Z_setby == p7_ZSETBY_NTARGETS && pli->mode == p7_SCAN_MODELS) pli->Z = pli->nmodels;
 
-  if (pli->do_biasfilter) p7_bg_SetFilter(bg, om->M, om->compo);
+  if (pli->do_biasfilter && (pli->mode == p7_SEARCH_SEQS || pli->long_targets))
+    p7_bg_SetFilter(bg, om->M, om->compo);
 
   if (pli->mode == p7_SEARCH_SEQS)
     status = p7_pli_NewModelThresholds(pli, om);
@@ -507,6 +543,31 @@ p7_pli_NewModel(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg)
   return status;
 }
 
+/* Function:  p7_pli_SkipModels()
+ * Synopsis:  Account for models that a scan skipped without scoring.
+ *
+ * Purpose:   Count <nmodels> models of total length <nnodes> as
+ *            searched in scan pipeline <pli>, without running them
+ *            through the pipeline: for example, the members of a
+ *            cluster whose representative couldn't pass the MSV
+ *            filter (see <hmmpress --clust>). They were compared to
+ *            the query, as far as the statistics are concerned, so
+ *            they count toward the search space size <Z> when it's
+ *            set by the number of targets. The statistics
+ *            summary reports how many were skipped.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_pli_SkipModels(P7_PIPELINE *pli, uint64_t nmodels, uint64_t nnodes)
+{
+  pli->nmodels    += nmodels;
+  pli->nnodes     += nnodes;
+  pli->n_clu_skip += nmodels;
+  if (pli->Z_setby == p7_ZSETBY_NTARGETS && pli->mode == p7_SCAN_MODELS) pli->Z = pli->nmodels;
+  return eslOK;
+}
+
 /* Function:  p7_pli_NewModelThresholds()
  * Synopsis:  Set reporting and inclusion bit score thresholds on a new model.
  *
@@ -523,6 +584,14 @@ p7_pli_NewModel(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg)
  *            <p7_oprofile_ReadRest()>, because that's when the bit
  *            score thresholds get read.
  *
+ *            The cutoffs don't tighten the filters. A target's final
+ *            score can be its domain sum reconstruction, which isn't
+ *            bounded by the uncorrected Forward score (envelopes are
+ *            scored by separate unihit Forwards, and may overlap),
+ *            so there's no lossless per-model Forward floor to derive
+ *            from them. MSV and Viterbi scores don't bound the final
+ *            score either.
+ *
  * Returns:   <eslOK> on success. 
  *            
  *            <eslEINVAL> if pipeline expects to be able to use a
@@ -570,6 +639,9 @@ p7_pli_NewModelThresholds(P7_PIPELINE *pli, const P7_OPROFILE *om)
  * Purpose:   Caller has a new sequence <sq>. Prepare the pipeline <pli>
  *            to receive this model as either a query or a target.
  *
+ *            For a query in a scan pipeline, this also forgets
+ *            anything cached about the previous query.
+ *
  * Returns:   <eslOK> on success.
  */
 int
@@ -578,6 +650,49 @@ p7_pli_NewSeq(P7_PIPELINE *pli, const ESL_SQ *sq)
   if (!pli->long_targets) pli->nseqs++; // if long_targets, sequence counting happens in the serial loop, which can track multiple windows for a single long sequence
   pli->nres += sq->n;
   if (pli->Z_setby == p7_ZSETBY_NTARGETS && pli->mode == p7_SEARCH_SEQS) pli->Z = pli->nseqs;
+  pli->scan_L = -1;
+  return eslOK;
+}
+
+/* Function:  p7_pli_SetClusters()
+ * Synopsis:  Search a redundant target database cluster by cluster.
+ *
+ * Purpose:   Configure search pipeline <pli> for one of the two passes
+ *            of a cluster-representative search of targets with
+ *            cluster map <cm>. <p7_Pipeline()> then identifies each
+ *            target <sq> by its ordinal <sq->idx> in the database.
+ *
+ *            If <is_reppass> is TRUE, this is the first pass: only
+ *            each cluster's representative is compared, through the
+ *            MSV, bias and Viterbi filters at P-value thresholds
+ *            relaxed by a factor of <margin> (>= 1), and a
+ *            representative that passes them sets <cluopen[c]> to
+ *            TRUE for its cluster <c>. No hits are reported. Counts
+ *            in <pli> are for this pass only; the caller discards
+ *            the pipeline afterwards.
+ *
+ *            If <is_reppass> is FALSE, this is the second pass: the
+ *            ordinary search, except that a target in a cluster
+ *            whose <cluopen[c]> is FALSE is skipped, after
+ *            <p7_pli_NewSeq()> has counted it, so Z is the full
+ *            number of targets. <margin> is unused.
+ *
+ *            <cluopen> is allocated and zeroed by the caller, and
+ *            shared by all the threads' pipelines.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_pli_SetClusters(P7_PIPELINE *pli, const P7_CLUMAP *cm, uint8_t *cluopen, int is_reppass, double margin)
+{
+  pli->clumap      = cm;
+  pli->cluopen     = cluopen;
+  pli->clu_reppass = is_reppass;
+  if (is_reppass)
+    {
+      pli->F1 = ESL_MIN(1.0, pli->F1 * margin);
+      pli->F2 = ESL_MIN(1.0, pli->F2 * margin);
+    }
   return eslOK;
 }
 
@@ -618,6 +733,7 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   p1->n_past_bias += p2->n_past_bias;
   p1->n_past_vit  += p2->n_past_vit;
   p1->n_past_fwd  += p2->n_past_fwd;
+  p1->nres_bias   += p2->nres_bias;
   p1->n_output    += p2->n_output;
 
   p1->pos_past_msv  += p2->pos_past_msv;
@@ -626,6 +742,19 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   p1->pos_past_fwd  += p2->pos_past_fwd;
   p1->pos_output    += p2->pos_output;
 
+  p1->n_seed_skip      += p2->n_seed_skip;
+  p1->n_seed_sample    += p2->n_seed_sample;
+  p1->n_seed_samplemsv += p2->n_seed_samplemsv;
+  p1->n_clu_rep        += p2->n_clu_rep;
+  p1->n_clu_open       += p2->n_clu_open;
+  p1->n_clu_skip       += p2->n_clu_skip;
+
+  p1->t_msv         += p2->t_msv;
+  p1->t_bias        += p2->t_bias;
+  p1->t_vit         += p2->t_vit;
+  p1->t_fwd         += p2->t_fwd;
+  p1->t_dom         += p2->t_dom;
+
   if (p1->Z_setby == p7_ZSETBY_NTARGETS)
     {
       p1->Z += (p1->mode == p7_SCAN_MODELS) ? p2->nmodels : p2->nseqs;
@@ -638,6 +767,26 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   return eslOK;
 }
 
+/* stage_start(), stage_stop()
+ * Optional per-stage timing: no-ops unless the pipeline was created
+ * with --stagetimes. stage_stop() adds the elapsed wall time
+ * since the last stage_start() to <*ret_t>.
+ */
+static void
+stage_start(P7_PIPELINE *pli)
+{
+  if (pli->stagew) esl_stopwatch_Start(pli->stagew);
+}
+
+static void
+stage_stop(P7_PIPELINE *pli, double *ret_t)
+{
+  if (pli->stagew) {
+    esl_stopwatch_Stop(pli->stagew);
+    *ret_t += pli->stagew->elapsed;
+  }
+}
+
 /* Function:  p7_Pipeline()
  * Synopsis:  HMMER3's accelerated seq/profile comparison pipeline.
  *
@@ -646,7 +795,13 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
  *            information about it is added to the <hitlist>. The pipeline 
  *            accumulates beancounting information about how many comparisons
  *            flow through the pipeline while it's active.
- *            
+ *
+ *            If the caller set <pli->seedsel> (hmmsearch/phmmer
+ *            --seedidx), <sq->idx> is the target's ordinal in the
+ *            database, and a target the seed index didn't select is
+ *            skipped. Likewise for a cluster map; see
+ *            <p7_pli_SetClusters()>.
+ *
  * Returns:   <eslOK> on success. If a significant hit is obtained,
  *            its information is added to the growing <hitlist>. 
  *            
@@ -691,27 +846,69 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   double           lnP;              /* log P-value of a hit */
   int              Ld;               /* # of residues in envelopes */
   int              d;
+  int              is_sample = FALSE;  /* TRUE if <sq> is only searched as the seed index's random sample */
+  uint32_t         clu       = 0;      /* <sq>'s cluster, if <pli->clumap> */
   int              status;
   
   if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
+
+  /* Targets that a seed index didn't select were still compared, as far as Z is concerned (p7_pli_NewSeq()), but skip the work */
+  if (pli->seedsel && sq->idx >= 0 && sq->idx < pli->seedsel->nseq && ! p7_SEEDSEL_TEST(pli->seedsel->cand, sq->idx))
+    {
+      if (! p7_SEEDSEL_TEST(pli->seedsel->samp, sq->idx)) { pli->n_seed_skip++; return eslOK; }
+      pli->n_seed_sample++;
+      is_sample = TRUE;
+    }
+
+  /* Cluster-representative search: first pass screens only representatives; second skips closed clusters */
+  if (pli->clumap && sq->idx >= 0 && sq->idx < pli->clumap->nseq)
+    {
+      clu = pli->clumap->clu[sq->idx];
+      if (pli->clu_reppass)
+	{
+	  if (pli->clumap->rep[clu] != sq->idx) return eslOK;
+	  pli->n_clu_rep++;
+	}
+      else if (! pli->cluopen[clu]) { pli->n_clu_skip++; return eslOK; }
+    }
+  else if (pli->clumap && pli->clu_reppass) return eslOK; /* not in the map; the caller checks the target count */
+
   if (sq->n > 100000) ESL_EXCEPTION(eslETYPE, "Target sequence length > 100K, over comparison pipeline limit.\n(Did you mean to use nhmmer/nhmmscan?)");
 
   p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);    /* expand the one-row omx if needed */
 
-  /* Base null model score (we could calculate this in NewSeq(), for a scan pipeline) */
-  p7_bg_NullOne  (bg, sq->dsq, sq->n, &nullsc);
+  /* Base null model score; in a scan pipeline, it's the same for every model */
+  if (pli->mode == p7_SCAN_MODELS)
+    {
+      if (pli->scan_L != sq->n) {
+	p7_bg_NullOne(bg, sq->dsq, sq->n, &(pli->scan_nullsc));
+	pli->scan_L = sq->n;
+      }
+      nullsc = pli->scan_nullsc;
+    }
+  else p7_bg_NullOne  (bg, sq->dsq, sq->n, &nullsc);
 
   /* First level filter: the MSV filter, multihit with <om> */
+  stage_start(pli);
   p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+  stage_stop(pli, &(pli->t_msv));
   seq_score = (usc - nullsc) / eslCONST_LOG2;
   P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
   if (P > pli->F1) return eslOK;
   pli->n_past_msv++;
+  if (is_sample) pli->n_seed_samplemsv++;
 
   /* biased composition HMM filtering */
   if (pli->do_biasfilter)
     {
+      if (pli->mode == p7_SCAN_MODELS) {  /* deferred from NewModel() to the few models that get here */
+	p7_bg_SetFilter(bg, om->M, om->compo);
+	p7_bg_SetLength(bg, sq->n);
+      }
+      stage_start(pli);
       p7_bg_FilterScore(bg, sq->dsq, sq->n, &filtersc);
+      stage_stop(pli, &(pli->t_bias));
+      pli->nres_bias += sq->n;
       seq_score = (usc - filtersc) / eslCONST_LOG2;
       P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
       if (P > pli->F1) return eslOK;
@@ -730,26 +927,39 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   /* Second level filter: ViterbiFilter(), multihit with <om> */
   if (P > pli->F2)
     {
+      stage_start(pli);
       p7_ViterbiFilter(sq->dsq, sq->n, om, pli->oxf, &vfsc);  
+      stage_stop(pli, &(pli->t_vit));
       seq_score = (vfsc-filtersc) / eslCONST_LOG2;
       P  = esl_gumbel_surv(seq_score,  om->evparam[p7_VMU],  om->evparam[p7_VLAMBDA]);
       if (P > pli->F2) return eslOK;
     }
   pli->n_past_vit++;
 
+  /* A representative that gets this far, at relaxed thresholds, opens its cluster for the second pass */
+  if (pli->clumap && pli->clu_reppass)
+    {
+      pli->cluopen[clu] = TRUE;
+      pli->n_clu_open++;
+      return eslOK;
+    }
 
   /* Parse it with Forward and obtain its real Forward score. */
+  stage_start(pli);
   p7_ForwardParser(sq->dsq, sq->n, om, pli->oxf, &fwdsc);
+  stage_stop(pli, &(pli->t_fwd));
   seq_score = (fwdsc-filtersc) / eslCONST_LOG2;
   P = esl_exp_surv(seq_score,  om->evparam[p7_FTAU],  om->evparam[p7_FLAMBDA]);
   if (P > pli->F3) return eslOK;
   pli->n_past_fwd++;
 
   /* ok, it's for real. Now a Backwards parser pass, and hand it to domain definition workflow */
+  stage_start(pli);
   p7_omx_GrowTo(pli->oxb, om->M, 0, sq->n);
   p7_BackwardParser(sq->dsq, sq->n, om, pli->oxf, pli->oxb, NULL);
 
   status = p7_domaindef_ByPosteriorHeuristics(sq, ntsq, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, FALSE, NULL, NULL, NULL);
+  stage_stop(pli, &(pli->t_dom));
   if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen  */
   if (pli->ddef->nregions   == 0) return eslOK; /* score passed threshold but there's no discrete domains here       */
   if (pli->ddef->nenvelopes == 0) return eslOK; /* rarer: region was found, stochastic clustered, no envelopes found */
@@ -820,6 +1030,9 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   lnP =  esl_exp_logsurv (seq_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
   if (p7_pli_TargetReportable(pli, seq_score, lnP))
     {
+      /* Only now, for a target we're keeping, format the domain alignments */
+      if ((status = p7_domaindef_CreateAlidisplays(pli->ddef, om, sq, ntsq)) != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+
       p7_tophits_CreateNextHit(hitlist, &hit);
       if (pli->mode == p7_SEARCH_SEQS) {
         if (                       (status  = esl_strdup(sq->name, -1, &(hit->name)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
@@ -1077,7 +1290,9 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
   p7_bg_NullOne  (bg, subseq, window_len, &nullsc);
   if (pli->do_biasfilter)
   {
+    stage_start(pli);
     p7_bg_FilterScore(bg, subseq, window_len, &bias_filtersc);
+    stage_stop(pli, &(pli->t_bias));
     bias_filtersc -= nullsc;  //remove nullsc, so bias scaling can be done, then add it back on later
   } else {
     bias_filtersc = 0;
@@ -1086,7 +1301,9 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
   p7_oprofile_ReconfigRestLength(om, window_len);
 
   /* Parse with Forward and obtain its real Forward score. */
+  stage_start(pli);
   p7_ForwardParser(subseq, window_len, om, pli->oxf, &fwdsc);
+  stage_stop(pli, &(pli->t_fwd));
   filtersc =  nullsc + (bias_filtersc * ( F3_L>window_len ? 1.0 : (float)F3_L/window_len) );
   seq_score = (fwdsc - filtersc) / eslCONST_LOG2;
   P = esl_exp_surv(seq_score,  om->evparam[p7_FTAU],  om->evparam[p7_FLAMBDA]);
@@ -1108,12 +1325,14 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
 
   /* Now a Backwards parser pass, and hand it to domain definition workflow
    * In this case "domains" will end up being translated as independent "hits" */
+  stage_start(pli);
   p7_omx_GrowTo(pli->oxb, om->M, 0, window_len);
   p7_BackwardParser(subseq, window_len, om, pli->oxf, pli->oxb, NULL);
 
   //if we're asked to not do null correction, pass a NULL instead of a temp scores variable - domaindef knows what to do
   status = p7_domaindef_ByPosteriorHeuristics(pli_tmp->tmpseq, NULL, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, TRUE,
                                               pli_tmp->bg, (pli->do_null2?pli_tmp->scores:NULL), pli_tmp->fwd_emissions_arr);
+  stage_stop(pli, &(pli->t_dom));
 
   pli_tmp->tmpseq->dsq = dsq_holder;
   if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen */
@@ -1339,7 +1558,9 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
   //initial bias filter, based on the input window_len
   if (pli->do_biasfilter) {
       p7_bg_SetLength(bg, window_len);
+      stage_start(pli);
       p7_bg_FilterScore(bg, subseq, window_len, &bias_filtersc);
+      stage_stop(pli, &(pli->t_bias));
       bias_filtersc -= nullsc; // doing this because I'll be modifying the bias part of filtersc based on length, then adding nullsc back in.
       filtersc =  nullsc + (bias_filtersc * (float)(( F1_L>window_len ? 1.0 : (float)F1_L/window_len)));
       seq_score = (usc - filtersc) / eslCONST_LOG2;
@@ -1369,7 +1590,9 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
   p7_omx_GrowTo(pli->oxf, om->M, 0, window_len);
 
   //use window_len instead of loc_window_len, because length parameterization is done, just need to loop over subseq
+  stage_start(pli);
   p7_ViterbiFilter_longtarget(subseq, window_len, om, pli->oxf, filtersc, pli->F2, vit_windowlist);
+  stage_stop(pli, &(pli->t_vit));
 
   p7_pli_ExtendAndMergeWindows (om, data, vit_windowlist, 0.5);
 
@@ -1527,10 +1750,12 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
    * This variant of SSV will scan a long sequence and find
    * short high-scoring regions.
    */
+  stage_start(pli);
   if (fmf) // using an FM-index
     p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, pli->strands, &msv_windowlist );
   else // compare directly to sequence
     p7_SSVFilter_longtarget(sq->dsq, sq->n, om, pli->oxf, data, bg, pli->F1, &msv_windowlist);
+  stage_stop(pli, &(pli->t_msv));
 
 
   /* convert hits to windows, merging neighboring windows
@@ -1616,11 +1841,16 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
       p7_bg_SetLength(bg, window->length);
       p7_bg_NullOne  (bg, subseq, window->length, &nullsc);
 
+      stage_start(pli);
       p7_bg_FilterScore(bg, subseq, window->length, &bias_filtersc);
+      stage_stop(pli, &(pli->t_bias));
+      pli->nres_bias += window->length;  // each SSV window once; the rescoring of it and its sub-windows downstream isn't counted again
       // Compute standard MSV to ensure that bias doesn't overcome SSV score when MSV
       // would have survived it
       p7_oprofile_ReconfigMSVLength(om, window->length);
+      stage_start(pli);
       p7_MSVFilter(subseq, window->length, om, pli->oxf, &usc);
+      stage_stop(pli, &(pli->t_msv));
       P = esl_gumbel_surv( (usc-nullsc)/eslCONST_LOG2,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
 
       if (P > pli->F1 ) continue;
@@ -1713,10 +1943,21 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
     fprintf(ofp, "Query model(s):              %15" PRId64 "  (%" PRId64 " nodes)\n",     pli->nmodels, pli->nnodes);
     fprintf(ofp, "Target sequences:            %15" PRId64 "  (%" PRId64 " residues searched)\n",  pli->nseqs,   pli->nres);
     ntargets = pli->nseqs;
+    if (pli->seedsel) {
+      fprintf(ofp, "Skipped by seed index:       %15" PRId64 "  (%.6g)\n", pli->n_seed_skip, (double) pli->n_seed_skip / ntargets);
+      if (pli->n_seed_sample)
+	fprintf(ofp, "Seed index random sample:    %15" PRId64 "  (%" PRId64 " passed MSV filter)\n", pli->n_seed_sample, pli->n_seed_samplemsv);
+    }
+    if (pli->clumap) {
+      fprintf(ofp, "Cluster representatives:     %15" PRId64 "  (%" PRId64 " clusters expanded)\n", pli->n_clu_rep, pli->n_clu_open);
+      fprintf(ofp, "Skipped in closed clusters:  %15" PRId64 "  (%.6g)\n", pli->n_clu_skip, (double) pli->n_clu_skip / ntargets);
+    }
   } else {
     fprintf(ofp, "Query sequence(s):           %15" PRId64 "  (%" PRId64 " residues searched)\n",  pli->nseqs,   pli->nres);
     fprintf(ofp, "Target model(s):             %15" PRId64 "  (%" PRId64 " nodes)\n",     pli->nmodels, pli->nnodes);
     ntargets = pli->nmodels;
+    if (pli->n_clu_skip)
+      fprintf(ofp, "Skipped in closed clusters:  %15" PRId64 "  (%.6g)\n", pli->n_clu_skip, (double) pli->n_clu_skip / ntargets);
   }
 
   if (pli->long_targets) { // nhmmer style
@@ -1774,6 +2015,13 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
       fprintf(ofp, "Domain search space  (domZ): %15.0f  %s\n", pli->domZ, pli->domZ_setby == p7_ZSETBY_OPTION ? "[as set by --domZ on cmdline]" : "[number of targets reported over threshold]");
   }
 
+  if (pli->stagew != NULL) {
+    fprintf(ofp, "# Stage times (wall, summed over threads): MSV %.2fs  bias %.2fs  Vit %.2fs  Fwd %.2fs  domains %.2fs\n",
+	    pli->t_msv, pli->t_bias, pli->t_vit, pli->t_fwd, pli->t_dom);
+    fprintf(ofp, "# Residues in bias filter: %" PRId64 "  (%.6g)\n",
+	    pli->nres_bias, (double) pli->nres_bias / ((double) pli->nres * (double) pli->nmodels));
+  }
+
   if (w != NULL) {
     esl_stopwatch_Display(ofp, w, "# CPU time: ");
     fprintf(ofp, "# Mc/sec: %.2f\n", 
@@ -1820,6 +2068,7 @@ static ESL_OPTIONS options[] = {
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
+  { "--stagetimes", eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "report wall time spent in each pipeline stage",                0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
@@ -1959,6 +2208,7 @@ static ESL_OPTIONS options[] = {
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
+  { "--stagetimes", eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "report wall time spent in each pipeline stage",                0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
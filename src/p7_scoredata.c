@@ -3,8 +3,9 @@
  *
  * Contents:
  *   1. The P7_SCOREDATA object: allocation, initialization, destruction.
- *   2. Unit tests.
- *   3. Test driver.
+ *   2. Binary i/o, for pressed DNA model databases.
+ *   3. Unit tests.
+ *   4. Test driver.
  */
 #include "p7_config.h"
 
@@ -387,7 +388,131 @@ p7_hmm_ScoreDataComputeRest(P7_OPROFILE *om, P7_SCOREDATA *data )
 
 
 /*****************************************************************
- * 2. Unit tests
+ * 2. Binary i/o, for pressed DNA model databases
+ *****************************************************************/
+
+/* hmmpress saves complete score data for nucleotide models in a
+ * <.h3s> file, one record per model in the same order as the <.h3f>
+ * and <.h3p> files, so nhmmscan doesn't have to rebuild it for each
+ * model and target.
+ */
+static uint32_t  v3f_smagic = 0xb3e6f3f3; /* 3/f binary score data file, "3fss" = 0x 33 66 73 73 + 0x80808080 */
+
+/* Function:  p7_hmm_ScoreDataWrite()
+ * Synopsis:  Write a complete <P7_SCOREDATA> to a binary stream.
+ *
+ * Purpose:   Write the score data <data> for a model, including the
+ *            parts filled in by <p7_hmm_ScoreDataComputeRest()>, to
+ *            open binary stream <fp>. <Kp> is the size of the model's
+ *            alphabet, including degeneracy codes. Only standard
+ *            (non-FM) score data can be written.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <data> is FM-type or incomplete.
+ *            <eslEWRITE> on any write failure, such as filling the disk.
+ */
+int
+p7_hmm_ScoreDataWrite(FILE *fp, const P7_SCOREDATA *data, int Kp)
+{
+  int n = data->M + 1;
+  int k;
+
+  if (data->type != p7_sd_std || data->prefix_lengths == NULL) ESL_EXCEPTION(eslEINVAL, "can only write complete, standard score data");
+
+  if (fwrite((char *) &(v3f_smagic),         sizeof(uint32_t), 1,    fp) != 1)    ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  if (fwrite((char *) &(data->M),            sizeof(int),      1,    fp) != 1)    ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  if (fwrite((char *) &Kp,                   sizeof(int),      1,    fp) != 1)    ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  if (fwrite((char *) data->ssv_scores,      sizeof(uint8_t),  n*Kp, fp) != n*Kp) ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  if (fwrite((char *) data->fwd_scores,      sizeof(float),    n*Kp, fp) != n*Kp) ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  for (k = 0; k < p7O_NTRANS; k++)
+    if (fwrite((char *) data->fwd_transitions[k], sizeof(float), n,  fp) != n)    ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  if (fwrite((char *) data->prefix_lengths,  sizeof(float),    n,    fp) != n)    ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  if (fwrite((char *) data->suffix_lengths,  sizeof(float),    n,    fp) != n)    ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  /* record ends with magic sentinel, for detecting binary file corruption */
+  if (fwrite((char *) &(v3f_smagic),         sizeof(uint32_t), 1,    fp) != 1)    ESL_EXCEPTION_SYS(eslEWRITE, "score data write failed");
+  return eslOK;
+}
+
+/* Function:  p7_hmm_ScoreDataRead()
+ * Synopsis:  Read the next complete <P7_SCOREDATA> from a binary stream.
+ *
+ * Purpose:   Read the next score data record, as written by
+ *            <p7_hmm_ScoreDataWrite()>, from open binary stream <fp>.
+ *            The record must be for a model of <M> nodes in an
+ *            alphabet of size <Kp>; the caller knows these from the
+ *            corresponding <P7_OPROFILE>. Return the new object in
+ *            <*ret_data>; it has its prefix/suffix lengths filled in,
+ *            so the pipeline won't call <p7_hmm_ScoreDataComputeRest()>
+ *            on it.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEOF> if there are no more records in <fp>.
+ *
+ *            <eslEFORMAT> on a parse error, or if the record doesn't
+ *            match <M> or <Kp>, with a message in <errbuf> (if
+ *            non-<NULL>). <*ret_data> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_hmm_ScoreDataRead(FILE *fp, int M, int Kp, P7_SCOREDATA **ret_data, char *errbuf)
+{
+  P7_SCOREDATA *data = NULL;
+  uint32_t      magic;
+  int           n    = M + 1;
+  int           fM, fKp;
+  int           k;
+  int           status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (! fread((char *) &magic, sizeof(uint32_t), 1, fp)) { status = eslEOF; goto ERROR; }
+  if (magic != v3f_smagic)                                       ESL_XFAIL(eslEFORMAT, errbuf, "bad magic; not a score data file?");
+  if (! fread((char *) &fM,    sizeof(int),      1, fp))         ESL_XFAIL(eslEFORMAT, errbuf, "failed to read model size M");
+  if (! fread((char *) &fKp,   sizeof(int),      1, fp))         ESL_XFAIL(eslEFORMAT, errbuf, "failed to read alphabet size");
+  if (fM != M || fKp != Kp)                                      ESL_XFAIL(eslEFORMAT, errbuf, "score data doesn't match its model; hmmpress again?");
+
+  ESL_ALLOC(data, sizeof(P7_SCOREDATA));
+  data->type            = p7_sd_std;
+  data->M               = M;
+  data->ssv_scores      = NULL;
+  data->opt_ext_fwd     = NULL;
+  data->opt_ext_rev     = NULL;
+  data->prefix_lengths  = NULL;
+  data->suffix_lengths  = NULL;
+  data->fwd_scores      = NULL;
+  data->fwd_transitions = NULL;
+
+  ESL_ALLOC(data->ssv_scores,      sizeof(uint8_t) * n * Kp);
+  ESL_ALLOC(data->fwd_scores,      sizeof(float)   * n * Kp);
+  ESL_ALLOC(data->fwd_transitions, sizeof(float *) * p7O_NTRANS);
+  for (k = 0; k < p7O_NTRANS; k++) data->fwd_transitions[k] = NULL;
+  for (k = 0; k < p7O_NTRANS; k++) ESL_ALLOC(data->fwd_transitions[k], sizeof(float) * n);
+  ESL_ALLOC(data->prefix_lengths,  sizeof(float)   * n);
+  ESL_ALLOC(data->suffix_lengths,  sizeof(float)   * n);
+
+  if (fread((char *) data->ssv_scores, sizeof(uint8_t), n*Kp, fp) != n*Kp) ESL_XFAIL(eslEFORMAT, errbuf, "failed to read SSV scores");
+  if (fread((char *) data->fwd_scores, sizeof(float),   n*Kp, fp) != n*Kp) ESL_XFAIL(eslEFORMAT, errbuf, "failed to read Forward emission scores");
+  for (k = 0; k < p7O_NTRANS; k++)
+    if (fread((char *) data->fwd_transitions[k], sizeof(float), n, fp) != n) ESL_XFAIL(eslEFORMAT, errbuf, "failed to read Forward transitions");
+  if (fread((char *) data->prefix_lengths, sizeof(float), n, fp) != n)     ESL_XFAIL(eslEFORMAT, errbuf, "failed to read prefix lengths");
+  if (fread((char *) data->suffix_lengths, sizeof(float), n, fp) != n)     ESL_XFAIL(eslEFORMAT, errbuf, "failed to read suffix lengths");
+  if (! fread((char *) &magic, sizeof(uint32_t), 1, fp))                   ESL_XFAIL(eslEFORMAT, errbuf, "no sentinel magic: .h3s file corrupted?");
+  if (magic != v3f_smagic)                                                 ESL_XFAIL(eslEFORMAT, errbuf, "bad sentinel magic; .h3s file corrupted?");
+
+  *ret_data = data;
+  return eslOK;
+
+ ERROR:
+  p7_hmm_ScoreDataDestroy(data);
+  *ret_data = NULL;
+  return status;
+}
+
+
+/*****************************************************************
+ * 3. Unit tests
  *****************************************************************/
 #ifdef p7SCOREDATA_TESTDRIVE
 
@@ -422,11 +547,69 @@ utest_createScoreData(ESL_GETOPTS *go, ESL_RANDOMNESS *r )
   p7_hmm_Destroy(hmm);
   esl_alphabet_Destroy(abc);
 }
+
+/* utest_readwrite()
+ * A complete score data record survives a write/read round trip.
+ */
+static void
+utest_readwrite(ESL_GETOPTS *go, ESL_RANDOMNESS *r)
+{
+  char           msg[]  = "score data read/write unit test failed";
+  ESL_ALPHABET  *abc    = NULL;
+  P7_HMM        *hmm    = NULL;
+  P7_BG         *bg     = NULL;
+  P7_PROFILE    *gm     = NULL;
+  P7_OPROFILE   *om     = NULL;
+  P7_SCOREDATA  *sd1    = NULL;
+  P7_SCOREDATA  *sd2    = NULL;
+  FILE          *fp     = NULL;
+  int            n, k;
+
+  if ( (abc = esl_alphabet_Create(eslDNA)) == NULL)           esl_fatal(msg);
+  if (  p7_hmm_Sample(r, 50, abc, &hmm)              != eslOK) esl_fatal(msg);
+  if ( (bg  = p7_bg_Create(abc))                     == NULL)  esl_fatal(msg);
+  if ( (gm  = p7_profile_Create(hmm->M, abc))        == NULL)  esl_fatal(msg);
+  if ( (om  = p7_oprofile_Create(hmm->M, abc))       == NULL)  esl_fatal(msg);
+  if (  p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL) != eslOK) esl_fatal(msg);
+  if (  p7_oprofile_Convert(gm, om)                  != eslOK) esl_fatal(msg);
+
+  if ( (sd1 = p7_hmm_ScoreDataCreate(om, NULL))      == NULL)  esl_fatal(msg);
+  if (  p7_hmm_ScoreDataComputeRest(om, sd1)         != eslOK) esl_fatal(msg);
+
+  if ( (fp = tmpfile())                              == NULL)  esl_fatal(msg);
+  if (  p7_hmm_ScoreDataWrite(fp, sd1, abc->Kp)      != eslOK) esl_fatal(msg);
+  if (  p7_hmm_ScoreDataWrite(fp, sd1, abc->Kp)      != eslOK) esl_fatal(msg);
+  rewind(fp);
+  if (  p7_hmm_ScoreDataRead(fp, om->M+1, abc->Kp, &sd2, NULL) != eslEFORMAT) esl_fatal(msg);
+  rewind(fp);
+  if (  p7_hmm_ScoreDataRead(fp, om->M, abc->Kp, &sd2, NULL)   != eslOK)      esl_fatal(msg);
+
+  n = om->M + 1;
+  if (memcmp(sd1->ssv_scores,     sd2->ssv_scores,     sizeof(uint8_t) * n * abc->Kp) != 0) esl_fatal(msg);
+  if (memcmp(sd1->fwd_scores,     sd2->fwd_scores,     sizeof(float)   * n * abc->Kp) != 0) esl_fatal(msg);
+  if (memcmp(sd1->prefix_lengths, sd2->prefix_lengths, sizeof(float)   * n)           != 0) esl_fatal(msg);
+  if (memcmp(sd1->suffix_lengths, sd2->suffix_lengths, sizeof(float)   * n)           != 0) esl_fatal(msg);
+  for (k = 0; k < p7O_NTRANS; k++)
+    if (memcmp(sd1->fwd_transitions[k], sd2->fwd_transitions[k], sizeof(float) * n)   != 0) esl_fatal(msg);
+  p7_hmm_ScoreDataDestroy(sd2);
+
+  if (  p7_hmm_ScoreDataRead(fp, om->M, abc->Kp, &sd2, NULL)   != eslOK)      esl_fatal(msg);
+  p7_hmm_ScoreDataDestroy(sd2);
+  if (  p7_hmm_ScoreDataRead(fp, om->M, abc->Kp, &sd2, NULL)   != eslEOF)     esl_fatal(msg);
+
+  fclose(fp);
+  p7_hmm_ScoreDataDestroy(sd1);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  esl_alphabet_Destroy(abc);
+}
 #endif /*p7SCOREDATA_TESTDRIVE*/
 
 
 /*****************************************************************
- * 3. Test driver
+ * 4. Test driver
  *****************************************************************/
 
 #ifdef p7SCOREDATA_TESTDRIVE
@@ -460,6 +643,7 @@ main(int argc, char **argv)
   if (be_verbose) printf("p7_scoredata unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
 
   utest_createScoreData(go, rng);
+  utest_readwrite(go, rng);
 
   esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
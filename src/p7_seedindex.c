@@ -0,0 +1,867 @@
+/* P7_SEEDINDEX: a k-mer seed index of a protein target database,
+ * for skipping targets before the MSV filter.
+ *
+ * The index maps every spaced word of a reduced amino acid alphabet
+ * to the list of target sequences that contain it. For a query
+ * profile, we enumerate the words that score at least <T> bits
+ * against some window of the profile, and take the union of their
+ * target lists as the candidates. Only candidates (plus an optional
+ * random sample of the others) go through the pipeline; the others
+ * are still counted as searched, so E-values are unchanged for the
+ * targets that are found.
+ *
+ * This is a heuristic, like the MSV filter itself: a homolog with no
+ * high-scoring word for the query is lost.
+ *
+ * Contents:
+ *   1. The P7_SEEDINDEX object: creation, construction, destruction.
+ *   2. Binary i/o.
+ *   3. Selecting candidate targets for a query.
+ *   4. Unit tests.
+ *   5. Test driver.
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_random.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+
+/* The reduced alphabet: Murphy, Wallqvist and Levy's 10-letter
+ * grouping [Protein Eng 13:149, 2000]. Changing it changes the
+ * index format; bump v3f_kmagic if you do.
+ */
+static const char *seedidx_groups[p7_SEEDIDX_K] = { "LVIM", "C", "A", "G", "ST", "P", "FYW", "EDNQ", "KR", "H" };
+
+static uint32_t v3f_kmagic = 0xb3e6ebf3; /* 3/f binary k-mer seed index, "3fks" = 0x 33 66 6b 73 + 0x80808080 */
+
+static int  seedidx_word(const P7_SEEDINDEX *sx, const ESL_DSQ *dsq, int i, uint64_t *ret_code);
+
+
+/*****************************************************************
+ *# 1. The P7_SEEDINDEX object: creation, construction, destruction.
+ *****************************************************************/
+
+/* Function:  p7_seedindex_Create()
+ * Synopsis:  Create an empty seed index.
+ *
+ * Purpose:   Create a seed index for digital protein sequences in
+ *            alphabet <abc>, using spaced seed <pattern>: a string of
+ *            '1' (care) and '0' (don't care) positions, starting and
+ *            ending with a '1', with at most <p7_SEEDIDX_MAXW> '1's
+ *            and at most <p7_SEEDIDX_MAXSPAN> positions; or <NULL>
+ *            for the default, <p7_SEEDIDX_PATTERN>. The index holds
+ *            no targets until <p7_seedindex_Build()>.
+ *
+ * Returns:   <eslOK> on success, and <*ret_sx> is the new index.
+ *
+ *            <eslEINVAL> if <abc> isn't amino or <pattern> is bad,
+ *            with a message in <errbuf> (if non-<NULL>). <*ret_sx>
+ *            is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seedindex_Create(const ESL_ALPHABET *abc, const char *pattern, P7_SEEDINDEX **ret_sx, char *errbuf)
+{
+  P7_SEEDINDEX *sx = NULL;
+  const char   *c;
+  int           g, x, j;
+  int           status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (pattern == NULL) pattern = p7_SEEDIDX_PATTERN;
+
+  ESL_ALLOC(sx, sizeof(P7_SEEDINDEX));
+  sx->span   = 0;
+  sx->w      = 0;
+  sx->rmap   = NULL;
+  sx->nwords = 1;
+  sx->nseq   = 0;
+  sx->nres   = 0;
+  sx->dbsize = 0;
+  sx->woff   = NULL;
+  sx->tidx   = NULL;
+  sx->abc    = abc;
+
+  if (abc->type != eslAMINO) ESL_XFAIL(eslEINVAL, errbuf, "a seed index is only for protein sequences");
+
+  for (j = 0; pattern[j] != '\0'; j++)
+    {
+      if      (j >= p7_SEEDIDX_MAXSPAN)  ESL_XFAIL(eslEINVAL, errbuf, "seed pattern %s is longer than %d", pattern, p7_SEEDIDX_MAXSPAN);
+      if      (pattern[j] == '0') continue;
+      else if (pattern[j] != '1')        ESL_XFAIL(eslEINVAL, errbuf, "seed pattern %s isn't a string of 0's and 1's", pattern);
+      if      (sx->w == p7_SEEDIDX_MAXW) ESL_XFAIL(eslEINVAL, errbuf, "seed pattern %s has more than %d 1's", pattern, p7_SEEDIDX_MAXW);
+      sx->pos[sx->w++] = j;
+      sx->nwords      *= p7_SEEDIDX_K;
+    }
+  sx->span = j;
+  if (sx->w < 2 || pattern[0] != '1' || pattern[sx->span-1] != '1')
+    ESL_XFAIL(eslEINVAL, errbuf, "seed pattern %s must start and end with a 1", pattern);
+
+  ESL_ALLOC(sx->rmap, sizeof(int8_t) * abc->Kp);
+  for (x = 0; x < abc->Kp; x++) sx->rmap[x] = -1;
+  for (g = 0; g < p7_SEEDIDX_K; g++)
+    for (c = seedidx_groups[g]; *c != '\0'; c++)
+      sx->rmap[esl_abc_DigitizeSymbol(abc, *c)] = g;
+
+  ESL_ALLOC(sx->woff, sizeof(uint64_t) * (sx->nwords + 1));
+  memset(sx->woff, 0, sizeof(uint64_t) * (sx->nwords + 1));
+
+  *ret_sx = sx;
+  return eslOK;
+
+ ERROR:
+  p7_seedindex_Destroy(sx);
+  *ret_sx = NULL;
+  return status;
+}
+
+
+/* Function:  p7_seedindex_Build()
+ * Synopsis:  Index all the sequences in a protein sequence file.
+ *
+ * Purpose:   Read every sequence in <sqfp>, which is open in digital
+ *            mode in the index's alphabet, and index its words in
+ *            <sx>, which must be empty. Windows that contain a
+ *            residue outside the reduced alphabet (X, B, Z and such)
+ *            aren't indexed.
+ *
+ *            Two passes are made over the file, one to count each
+ *            word's targets and one to fill in the lists, so <sqfp>
+ *            must be rewindable. The file's size is recorded too, for
+ *            <p7_seedindex_Validate()>. Memory is the word offsets (8 bytes
+ *            per word) and a 4-byte entry for each distinct word of
+ *            each target.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> on a sequence file parse error;
+ *            <eslEINVAL> if <sqfp> can't be rewound, or it changed
+ *            between passes; <eslERANGE> if it has more than
+ *            2^32-1 sequences. In all cases, with a message in
+ *            <errbuf> (if non-<NULL>), and <sx> is left empty.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seedindex_Build(P7_SEEDINDEX *sx, ESL_SQFILE *sqfp, char *errbuf)
+{
+  ESL_SQ   *sq   = NULL;
+  uint32_t *last = NULL;       /* [0..nwords-1] 1 + ordinal of the last target that counted word c; 0 if none */
+  uint64_t  nseq = 0;
+  uint64_t  code, c;
+  int       pass, i;
+  int       status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (! esl_sqfile_IsRewindable(sqfp))                      ESL_XFAIL(eslEINVAL, errbuf, "sequence file must be rewindable to build a seed index");
+  if (p7_FileSize(sqfp->filename, &(sx->dbsize)) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "failed to get the size of sequence file %s", sqfp->filename);
+
+  if ((sq = esl_sq_CreateDigital(sx->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  ESL_ALLOC(last, sizeof(uint32_t) * sx->nwords);
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      /* Pass 0 counts targets of word c in woff[c+1]; pass 1 uses woff[c] as the fill pointer. */
+      memset(last, 0, sizeof(uint32_t) * sx->nwords);
+      if ((status = esl_sqfile_Position(sqfp, 0)) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "failed to rewind sequence file");
+
+      nseq = 0;
+      while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+	{
+	  if (nseq == UINT32_MAX) ESL_XFAIL(eslERANGE, errbuf, "too many sequences for one seed index (max %u); split the database", (unsigned) UINT32_MAX);
+
+	  for (i = 1; i <= sq->n - sx->span + 1; i++)
+	    {
+	      if (seedidx_word(sx, sq->dsq, i, &code) != eslOK || last[code] == nseq+1) continue;
+	      last[code] = nseq+1;
+	      if (pass == 0) sx->woff[code+1]++;
+	      else           sx->tidx[sx->woff[code]++] = nseq;
+	    }
+	  if (pass == 0) sx->nres += sq->n;
+	  nseq++;
+	  esl_sq_Reuse(sq);
+	}
+      if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, "sequence file parse failed:\n%s", esl_sqfile_GetErrorBuf(sqfp));
+      else if (status != eslEOF)     goto ERROR;
+
+      if (pass == 0)
+	{
+	  sx->nseq = nseq;
+	  for (c = 0; c < sx->nwords; c++) sx->woff[c+1] += sx->woff[c];
+	  ESL_ALLOC(sx->tidx, sizeof(uint32_t) * ESL_MAX(1, sx->woff[sx->nwords]));
+	}
+      else if (nseq != sx->nseq) ESL_XFAIL(eslEINVAL, errbuf, "sequence file changed while it was being indexed");
+    }
+
+  /* each woff[c] now points to the end of word c's list, i.e. where c+1's starts */
+  for (c = sx->nwords; c > 0; c--) sx->woff[c] = sx->woff[c-1];
+  sx->woff[0] = 0;
+
+  free(last);
+  esl_sq_Destroy(sq);
+  return eslOK;
+
+ ERROR:
+  if (sx->tidx) free(sx->tidx);
+  sx->tidx = NULL;
+  memset(sx->woff, 0, sizeof(uint64_t) * (sx->nwords + 1));
+  sx->nseq = sx->nres = sx->dbsize = 0;
+  if (last) free(last);
+  if (sq)   esl_sq_Destroy(sq);
+  return status;
+}
+
+
+/* Function:  p7_seedindex_Destroy()
+ * Synopsis:  Free a seed index.
+ */
+void
+p7_seedindex_Destroy(P7_SEEDINDEX *sx)
+{
+  if (sx == NULL) return;
+  if (sx->rmap) free(sx->rmap);
+  if (sx->woff) free(sx->woff);
+  if (sx->tidx) free(sx->tidx);
+  free(sx);
+}
+
+
+/* seedidx_word()
+ * Code of the word of <sx>'s pattern starting at <dsq[i]>, in
+ * <*ret_code>, with the first care position as the least significant
+ * digit. Returns <eslEINVAL> if the window has a residue outside the
+ * reduced alphabet.
+ */
+static int
+seedidx_word(const P7_SEEDINDEX *sx, const ESL_DSQ *dsq, int i, uint64_t *ret_code)
+{
+  uint64_t code = 0;
+  int      j;
+
+  for (j = sx->w-1; j >= 0; j--)
+    {
+      if (sx->rmap[dsq[i + sx->pos[j]]] < 0) return eslEINVAL;
+      code = code * p7_SEEDIDX_K + sx->rmap[dsq[i + sx->pos[j]]];
+    }
+  *ret_code = code;
+  return eslOK;
+}
+/*------------------- end, P7_SEEDINDEX object ------------------*/
+
+
+
+/*****************************************************************
+ * 2. Binary i/o.
+ *****************************************************************/
+
+/* Function:  p7_seedindex_Write()
+ * Synopsis:  Save a seed index to a binary stream.
+ *
+ * Purpose:   Write seed index <sx> to open binary stream <fp>, in
+ *            the byte order of this machine.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on any write failure, such as filling the disk.
+ */
+int
+p7_seedindex_Write(FILE *fp, const P7_SEEDINDEX *sx)
+{
+  int      K  = p7_SEEDIDX_K;
+  uint64_t np = sx->woff[sx->nwords];
+
+  if (fwrite((char *) &(v3f_kmagic), sizeof(uint32_t), 1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) &K,            sizeof(int),      1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) &(sx->span),   sizeof(int),      1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) &(sx->w),      sizeof(int),      1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) sx->pos,       sizeof(int),      sx->w,         fp) != sx->w)         ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) &(sx->nseq),   sizeof(uint64_t), 1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) &(sx->nres),   sizeof(uint64_t), 1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) &(sx->dbsize), sizeof(uint64_t), 1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) sx->woff,      sizeof(uint64_t), sx->nwords+1,  fp) != sx->nwords+1)  ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  if (fwrite((char *) sx->tidx,      sizeof(uint32_t), np,            fp) != np)            ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  /* ends with magic sentinel, for detecting binary file corruption */
+  if (fwrite((char *) &(v3f_kmagic), sizeof(uint32_t), 1,             fp) != 1)             ESL_EXCEPTION_SYS(eslEWRITE, "seed index write failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_seedindex_Read()
+ * Synopsis:  Read a seed index from a binary stream.
+ *
+ * Purpose:   Read a seed index, as written by <p7_seedindex_Write()>,
+ *            from open binary stream <fp>, for sequences in (amino)
+ *            alphabet <abc>. Return the new index in <*ret_sx>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> if <fp> isn't a seed index or is corrupted;
+ *            <eslEINVAL> if <abc> isn't amino. In either case with a
+ *            message in <errbuf> (if non-<NULL>), and <*ret_sx> is
+ *            <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seedindex_Read(FILE *fp, const ESL_ALPHABET *abc, P7_SEEDINDEX **ret_sx, char *errbuf)
+{
+  P7_SEEDINDEX *sx = NULL;
+  char          pattern[p7_SEEDIDX_MAXSPAN+1];
+  uint32_t      magic;
+  int           K, span, w, pos[p7_SEEDIDX_MAXW];
+  uint64_t      c, np;
+  int           j;
+  int           status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (! fread((char *) &magic, sizeof(uint32_t), 1, fp) || magic != v3f_kmagic) ESL_XFAIL(eslEFORMAT, errbuf, "bad magic; not a HMMER seed index (makehmmerdb --kmer)?");
+  if (! fread((char *) &K,     sizeof(int),      1, fp))                       ESL_XFAIL(eslEFORMAT, errbuf, "failed to read reduced alphabet size");
+  if (! fread((char *) &span,  sizeof(int),      1, fp))                       ESL_XFAIL(eslEFORMAT, errbuf, "failed to read seed span");
+  if (! fread((char *) &w,     sizeof(int),      1, fp))                       ESL_XFAIL(eslEFORMAT, errbuf, "failed to read seed weight");
+  if (K != p7_SEEDIDX_K || span < 2 || span > p7_SEEDIDX_MAXSPAN || w < 2 || w > p7_SEEDIDX_MAXW || w > span)
+    ESL_XFAIL(eslEFORMAT, errbuf, "bad seed index header; file corrupted, or built by a different version?");
+  if (fread((char *) pos, sizeof(int), w, fp) != w)                            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read seed pattern");
+
+  /* rebuild the pattern string, and let Create() check it */
+  for (j = 0; j < span; j++) pattern[j] = '0';
+  for (j = 0; j < w;    j++) {
+    if (pos[j] < 0 || pos[j] >= span) ESL_XFAIL(eslEFORMAT, errbuf, "bad seed pattern in seed index");
+    pattern[pos[j]] = '1';
+  }
+  pattern[span] = '\0';
+  if ((status = p7_seedindex_Create(abc, pattern, &sx, errbuf)) != eslOK) goto ERROR;
+  if (sx->w != w) ESL_XFAIL(eslEFORMAT, errbuf, "bad seed pattern in seed index");
+
+  if (! fread((char *) &(sx->nseq), sizeof(uint64_t), 1, fp))                       ESL_XFAIL(eslEFORMAT, errbuf, "failed to read number of sequences");
+  if (! fread((char *) &(sx->nres), sizeof(uint64_t), 1, fp))                       ESL_XFAIL(eslEFORMAT, errbuf, "failed to read number of residues");
+  if (! fread((char *) &(sx->dbsize), sizeof(uint64_t), 1, fp))                     ESL_XFAIL(eslEFORMAT, errbuf, "failed to read size of sequence file");
+  if (fread((char *) sx->woff, sizeof(uint64_t), sx->nwords+1, fp) != sx->nwords+1) ESL_XFAIL(eslEFORMAT, errbuf, "failed to read word offsets");
+  for (c = 0; c < sx->nwords; c++)
+    if (sx->woff[c+1] < sx->woff[c]) ESL_XFAIL(eslEFORMAT, errbuf, "bad word offsets; seed index corrupted?");
+  np = sx->woff[sx->nwords];
+
+  ESL_ALLOC(sx->tidx, sizeof(uint32_t) * ESL_MAX(1, np));
+  if (fread((char *) sx->tidx, sizeof(uint32_t), np, fp) != np)                     ESL_XFAIL(eslEFORMAT, errbuf, "failed to read target lists");
+  if (! fread((char *) &magic, sizeof(uint32_t), 1, fp) || magic != v3f_kmagic)     ESL_XFAIL(eslEFORMAT, errbuf, "bad sentinel magic; seed index corrupted?");
+
+  *ret_sx = sx;
+  return eslOK;
+
+ ERROR:
+  p7_seedindex_Destroy(sx);
+  *ret_sx = NULL;
+  return status;
+}
+
+
+/* Function:  p7_seedindex_Validate()
+ * Synopsis:  Check that a seed index goes with a sequence file.
+ *
+ * Purpose:   Check, before searching, that seed index <sx> was built
+ *            from sequence file <dbfile>, by comparing the file's
+ *            size with the size recorded when <sx> was built. The
+ *            index identifies targets by their ordinal in the file,
+ *            so an index of a different or changed file would select
+ *            the wrong targets.
+ *
+ *            This is a fingerprint, not a proof: an edit that keeps
+ *            the file's size is missed. Callers can also check the
+ *            number of sequences and residues they read against
+ *            <sx->nseq> and <sx->nres> afterwards.
+ *
+ * Returns:   <eslOK> if the sizes match.
+ *
+ *            <eslEINVAL> if <dbfile> isn't a regular file (stdin, say),
+ *            so it can't be checked; <eslEINCOMPAT> if its size
+ *            differs. Either way with a message in <errbuf> (if
+ *            non-<NULL>).
+ */
+int
+p7_seedindex_Validate(const P7_SEEDINDEX *sx, const char *dbfile, char *errbuf)
+{
+  uint64_t dbsize;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (p7_FileSize(dbfile, &dbsize) != eslOK) ESL_FAIL(eslEINVAL,     errbuf, "%s isn't a file whose size can be checked against the seed index", dbfile);
+  if (dbsize != sx->dbsize)                   ESL_FAIL(eslEINCOMPAT, errbuf, "seed index was built from a %" PRIu64 "-byte sequence file, but %s has %" PRIu64 " bytes", sx->dbsize, dbfile, dbsize);
+  return eslOK;
+}
+/*-------------------- end, binary i/o --------------------------*/
+
+
+
+/*****************************************************************
+ * 3. Selecting candidate targets for a query.
+ *****************************************************************/
+
+/* Function:  p7_seedindex_Select()
+ * Synopsis:  Select the candidate targets for a query profile.
+ *
+ * Purpose:   For query profile <gm>, find every word of index <sx>
+ *            that scores at least <T> bits against some window of
+ *            <gm>'s match states, and select every target that
+ *            contains one of those words. A word's score at a
+ *            window is the sum over its care positions of the best
+ *            match emission score of a residue in its reduced
+ *            residue's group, so no real word that maps to it scores
+ *            higher.
+ *
+ *            If <sample> is $> 0$, each target that isn't a candidate
+ *            is also selected with probability <sample>, using
+ *            random number generator <rng>, for checking what the
+ *            index misses.
+ *
+ *            Words are enumerated by branch and bound over each
+ *            window, so the cost depends on how many words pass <T>,
+ *            not on the size of the word space.
+ *
+ * Returns:   <eslOK> on success, and <*ret_sel> is the selection.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seedindex_Select(const P7_SEEDINDEX *sx, const P7_PROFILE *gm, float T, double sample, ESL_RANDOMNESS *rng, P7_SEEDSEL **ret_sel)
+{
+  P7_SEEDSEL *sel    = NULL;
+  float      *sc     = NULL;   /* [(M+1)*K]: best bit score of group g at node k, sc[k*K+g] */
+  int        *ord    = NULL;   /* [(M+1)*K]: groups at node k, best first                   */
+  float      *colmax = NULL;   /* [0..M]: best group score at node k                        */
+  uint64_t   *wsel   = NULL;   /* bit array over words: word was seeded                     */
+  uint64_t    nb     = (sx->nseq   + 63) / 64;
+  uint64_t    nwb    = (sx->nwords + 63) / 64;
+  float       suf[p7_SEEDIDX_MAXW+1];
+  float       ps[p7_SEEDIDX_MAXW];
+  int         ci[p7_SEEDIDX_MAXW];
+  uint64_t    place[p7_SEEDIDX_MAXW];
+  uint64_t    code[p7_SEEDIDX_MAXW+1];
+  uint64_t    c, p, t;
+  float       s;
+  int         K = p7_SEEDIDX_K;
+  int         M = gm->M;
+  int         k, g, g2, d, col, x;
+  const char *r;
+  int         status;
+
+  ESL_ALLOC(sel, sizeof(P7_SEEDSEL));
+  sel->nseq   = sx->nseq;
+  sel->cand   = NULL;
+  sel->samp   = NULL;
+  sel->nwords = 0;
+  sel->ncand  = 0;
+  sel->nsamp  = 0;
+  ESL_ALLOC(sel->cand, sizeof(uint64_t) * ESL_MAX(1, nb));
+  ESL_ALLOC(sel->samp, sizeof(uint64_t) * ESL_MAX(1, nb));
+  memset(sel->cand, 0, sizeof(uint64_t) * ESL_MAX(1, nb));
+  memset(sel->samp, 0, sizeof(uint64_t) * ESL_MAX(1, nb));
+
+  ESL_ALLOC(sc,     sizeof(float)    * (M+1) * K);
+  ESL_ALLOC(ord,    sizeof(int)      * (M+1) * K);
+  ESL_ALLOC(colmax, sizeof(float)    * (M+1));
+  ESL_ALLOC(wsel,   sizeof(uint64_t) * nwb);
+  memset(wsel, 0, sizeof(uint64_t) * nwb);
+
+  /* Group scores per node, in bits, with groups sorted best first (insertion sort; K is 10) */
+  for (k = 1; k <= M; k++)
+    {
+      for (g = 0; g < K; g++)
+	{
+	  sc[k*K+g] = -eslINFINITY;
+	  for (r = seedidx_groups[g]; *r != '\0'; r++)
+	    {
+	      x = esl_abc_DigitizeSymbol(gm->abc, *r);
+	      sc[k*K+g] = ESL_MAX(sc[k*K+g], p7P_MSC(gm, k, x) / eslCONST_LOG2);
+	    }
+	  for (g2 = g; g2 > 0 && sc[k*K + ord[k*K+g2-1]] < sc[k*K+g]; g2--) ord[k*K+g2] = ord[k*K+g2-1];
+	  ord[k*K+g2] = g;
+	}
+      colmax[k] = sc[k*K + ord[k*K]];
+    }
+
+  for (d = 0, p = 1; d < sx->w; d++, p *= K) place[d] = p;
+
+  /* Branch and bound over the words at each window k..k+span-1 */
+  for (k = 1; k <= M - sx->span + 1; k++)
+    {
+      suf[sx->w] = 0.;
+      for (d = sx->w-1; d >= 0; d--) suf[d] = suf[d+1] + colmax[k + sx->pos[d]];
+      if (suf[0] < T) continue;
+
+      d = 0; ci[0] = 0; ps[0] = 0.; code[0] = 0;
+      while (d >= 0)
+	{
+	  col = k + sx->pos[d];
+	  if (ci[d] == K) { if (--d >= 0) ci[d]++; continue; }
+	  g = ord[col*K + ci[d]];
+	  s = ps[d] + sc[col*K + g];
+	  if (s + suf[d+1] < T) { if (--d >= 0) ci[d]++; continue; }  /* groups are sorted, so no later choice at <d> passes either */
+
+	  if (d == sx->w-1)
+	    {
+	      c = code[d] + g * place[d];
+	      if (! p7_SEEDSEL_TEST(wsel, c)) { wsel[c >> 6] |= (uint64_t) 1 << (c & 63); sel->nwords++; }
+	      ci[d]++;
+	    }
+	  else
+	    {
+	      code[d+1] = code[d] + g * place[d];
+	      ps[d+1]   = s;
+	      d++;
+	      ci[d]     = 0;
+	    }
+	}
+    }
+
+  /* Candidates: union of the seeded words' target lists */
+  for (c = 0; c < sx->nwords; c++)
+    if (p7_SEEDSEL_TEST(wsel, c))
+      for (p = sx->woff[c]; p < sx->woff[c+1]; p++)
+	{
+	  t = sx->tidx[p];
+	  if (! p7_SEEDSEL_TEST(sel->cand, t)) { sel->cand[t >> 6] |= (uint64_t) 1 << (t & 63); sel->ncand++; }
+	}
+
+  if (sample > 0.)
+    for (t = 0; t < sx->nseq; t++)
+      if (! p7_SEEDSEL_TEST(sel->cand, t) && esl_random(rng) < sample) { sel->samp[t >> 6] |= (uint64_t) 1 << (t & 63); sel->nsamp++; }
+
+  free(sc);
+  free(ord);
+  free(colmax);
+  free(wsel);
+  *ret_sel = sel;
+  return eslOK;
+
+ ERROR:
+  if (sc)     free(sc);
+  if (ord)    free(ord);
+  if (colmax) free(colmax);
+  if (wsel)   free(wsel);
+  p7_seedsel_Destroy(sel);
+  *ret_sel = NULL;
+  return status;
+}
+
+/* Function:  p7_seedsel_Destroy()
+ * Synopsis:  Free a target selection.
+ */
+void
+p7_seedsel_Destroy(P7_SEEDSEL *sel)
+{
+  if (sel == NULL) return;
+  if (sel->cand) free(sel->cand);
+  if (sel->samp) free(sel->samp);
+  free(sel);
+}
+/*------------------ end, target selection ----------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests.
+ *****************************************************************/
+#ifdef p7SEEDINDEX_TESTDRIVE
+#include "esl_randomseq.h"
+
+/* seed_score()
+ * Brute force oracle for utest_selection(): the best score, in bits,
+ * of any indexable word of <dsq> at any window of <gm>, computed the
+ * way p7_seedindex_Select() scores words (best match emission in each
+ * care position's reduced residue group) but without its branch and
+ * bound. -infinity if <dsq> has no indexable word.
+ */
+static float
+seed_score(const P7_SEEDINDEX *sx, const P7_PROFILE *gm, const ESL_DSQ *dsq, int L)
+{
+  float       best = -eslINFINITY;
+  float       s, gsc;
+  uint64_t    code;
+  const char *c;
+  int         i, k, d, g;
+
+  for (i = 1; i <= L - sx->span + 1; i++)
+    {
+      if (seedidx_word(sx, dsq, i, &code) != eslOK) continue;
+      for (k = 1; k <= gm->M - sx->span + 1; k++)
+	{
+	  for (s = 0., d = 0; d < sx->w; d++)
+	    {
+	      g   = sx->rmap[dsq[i + sx->pos[d]]];
+	      gsc = -eslINFINITY;
+	      for (c = seedidx_groups[g]; *c != '\0'; c++)
+		gsc = ESL_MAX(gsc, p7P_MSC(gm, k + sx->pos[d], esl_abc_DigitizeSymbol(gm->abc, *c)) / eslCONST_LOG2);
+	      s += gsc;
+	    }
+	  best = ESL_MAX(best, s);
+	}
+    }
+  return best;
+}
+
+/* utest_selection()
+ * Index a small database: random iid sequences, and the same number
+ * of sequences emitted from the query model; a few of the random
+ * ones have the query's best scoring word planted in them.
+ *  - the binary round trip gives the same index, and each word's
+ *    target list is sorted;
+ *  - with T = -infinity, every target with an indexable word is a
+ *    candidate;
+ *  - at a moderate T, the candidates are exactly the targets with a
+ *    word scoring >= T by brute force (up to float roundoff in the
+ *    bound), a subset of the T = -infinity ones; planted targets are
+ *    candidates, and so is every emitted homolog whose own aligned
+ *    residues at some seed window score >= T;
+ *  - with T = +infinity, only the random sample is selected.
+ */
+static void
+utest_selection(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int nseq, char *tmpfile)
+{
+  char          msg[]   = "seed index selection unit test failed";
+  char          errbuf[eslERRBUFSIZE];
+  P7_HMM       *hmm     = NULL;
+  P7_PROFILE   *gm      = NULL;
+  P7_SEEDINDEX *sx      = NULL;
+  P7_SEEDINDEX *sx2     = NULL;
+  P7_SEEDSEL   *sel     = NULL;
+  P7_SEEDSEL   *all     = NULL;
+  P7_TRACE     *tr      = p7_trace_Create();
+  ESL_SQ       *sq      = esl_sq_CreateDigital(abc);
+  ESL_SQFILE   *sqfp    = NULL;
+  FILE         *fp      = NULL;
+  float        *homsc   = NULL;	/* homsc[n]: emitted seq n's best own-alignment word score; -inf if none or not emitted */
+  int          *planted = NULL;	/* planted[n]: TRUE if seq n has the best word planted in it */
+  ESL_DSQ       bestw[p7_SEEDIDX_MAXSPAN];
+  char          seqfile[p7_TMPFILE_NAMELEN];
+  float         T, s, bestsc, colsc;
+  uint64_t      code, t;
+  int           i, k, kbest, d, x, xbest, n, z, z2, ncand;
+
+  if (p7_hmm_Sample(r, M, abc, &hmm)                     != eslOK) esl_fatal(msg);
+  if ((gm = p7_profile_Create(hmm->M, abc))              == NULL)  esl_fatal(msg);
+  if (p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL)         != eslOK) esl_fatal(msg);
+  if ((homsc   = malloc(sizeof(float) * nseq))           == NULL)  esl_fatal(msg);
+  if ((planted = malloc(sizeof(int)   * nseq))           == NULL)  esl_fatal(msg);
+  if (p7_seedindex_Create(abc, "11011", &sx, errbuf)     != eslOK) esl_fatal("%s\n%s", msg, errbuf);  /* small word space: T = -inf enumerates all of it */
+
+  /* The query's best word: best residue at each care position of its best window */
+  for (bestsc = -eslINFINITY, kbest = 0, k = 1; k <= gm->M - sx->span + 1; k++)
+    {
+      for (s = 0., d = 0; d < sx->w; d++)
+	{
+	  for (colsc = -eslINFINITY, x = 0; x < abc->K; x++) colsc = ESL_MAX(colsc, p7P_MSC(gm, k + sx->pos[d], x) / eslCONST_LOG2);
+	  s += colsc;
+	}
+      if (s > bestsc) { bestsc = s; kbest = k; }
+    }
+  if (kbest == 0) esl_fatal(msg);
+  for (d = 0; d < sx->span; d++) bestw[d] = 0;
+  for (d = 0; d < sx->w; d++)
+    {
+      for (xbest = 0, x = 1; x < abc->K; x++)
+	if (p7P_MSC(gm, kbest + sx->pos[d], x) > p7P_MSC(gm, kbest + sx->pos[d], xbest)) xbest = x;
+      bestw[sx->pos[d]] = xbest;
+    }
+  T = ESL_MIN(10.0, bestsc - 0.01);	/* moderate threshold that the planted word passes */
+
+  /* the database: alternately random and emitted; every 4th random one gets the planted word */
+  if (p7_TmpfileNamed(seqfile, &fp)                    != eslOK) esl_fatal(msg);
+  for (n = 0; n < nseq; n++)
+    {
+      homsc[n]   = -eslINFINITY;
+      planted[n] = FALSE;
+      if (n % 2)
+	{
+	  if (p7_ProfileEmit(r, hmm, gm, bg, sq, tr) != eslOK) esl_fatal(msg);
+	  /* score of each run of <span> consecutive M states on consecutive residues, with its own residues */
+	  for (z = 0; z < tr->N; z++)
+	    {
+	      for (z2 = z; z2 < z + sx->span && z2 < tr->N; z2++)
+		if (tr->st[z2] != p7T_M || tr->k[z2] != tr->k[z] + (z2-z) || tr->i[z2] != tr->i[z] + (z2-z)) break;
+	      if (z2 < z + sx->span) continue;
+	      if (seedidx_word(sx, sq->dsq, tr->i[z], &code) != eslOK) continue;
+	      for (s = 0., d = 0; d < sx->w; d++) s += p7P_MSC(gm, tr->k[z] + sx->pos[d], sq->dsq[tr->i[z] + sx->pos[d]]) / eslCONST_LOG2;
+	      homsc[n] = ESL_MAX(homsc[n], s);
+	    }
+	  p7_trace_Reuse(tr);
+	}
+      else
+	{
+	  if (esl_sq_GrowTo(sq, L)                                 != eslOK) esl_fatal(msg);
+	  if (esl_rsq_xfIID(r, bg->f, abc->K, L, sq->dsq)          != eslOK) esl_fatal(msg);
+	  sq->n = L;
+	  if (n % 8 == 0 && L >= sx->span)
+	    {
+	      i = 1 + esl_rnd_Roll(r, L - sx->span + 1);
+	      for (d = 0; d < sx->w; d++) sq->dsq[i + sx->pos[d]] = bestw[sx->pos[d]];
+	      planted[n] = TRUE;
+	    }
+	}
+      esl_sq_FormatName(sq, "seq%d", n);
+      if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE)         != eslOK) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  fclose(fp);
+
+  if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if (p7_seedindex_Build(sx, sqfp, errbuf)                            != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+  if (sx->nseq != nseq)                                                         esl_fatal(msg);
+
+  /* round trip */
+  if ((fp = fopen(tmpfile, "wb"))                  == NULL)  esl_fatal(msg);
+  if (p7_seedindex_Write(fp, sx)                   != eslOK) esl_fatal(msg);
+  fclose(fp);
+  if ((fp = fopen(tmpfile, "rb"))                  == NULL)  esl_fatal(msg);
+  if (p7_seedindex_Read(fp, abc, &sx2, errbuf)     != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+  fclose(fp);
+  if (sx2->nseq != sx->nseq || sx2->nres != sx->nres || sx2->nwords != sx->nwords) esl_fatal(msg);
+  if (sx2->dbsize != sx->dbsize || sx->dbsize == 0)                                esl_fatal(msg);
+  if (memcmp(sx2->woff, sx->woff, sizeof(uint64_t) * (sx->nwords+1)) != 0)         esl_fatal(msg);
+  if (memcmp(sx2->tidx, sx->tidx, sizeof(uint32_t) * sx->woff[sx->nwords]) != 0)   esl_fatal(msg);
+
+  /* each word list is sorted */
+  for (code = 0; code < sx->nwords; code++)
+    for (t = sx->woff[code]; t < sx->woff[code+1]; t++)
+      if (t > sx->woff[code] && sx->tidx[t] <= sx->tidx[t-1]) esl_fatal(msg);
+
+  /* T = -inf: every target with an indexable window is a candidate */
+  if (p7_seedindex_Select(sx, gm, -eslINFINITY, 0.0, r, &all) != eslOK) esl_fatal(msg);
+  if (esl_sqfile_Position(sqfp, 0)                         != eslOK) esl_fatal(msg);
+  for (t = 0; esl_sqio_Read(sqfp, sq) == eslOK; t++)
+    {
+      for (i = 1; i <= sq->n - sx->span + 1; i++)
+	if (seedidx_word(sx, sq->dsq, i, &code) == eslOK) break;
+      if ((i <= sq->n - sx->span + 1) != p7_SEEDSEL_TEST(all->cand, t)) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+
+  /* moderate T: candidates are the targets with a word scoring >= T, checked by brute force */
+  if (p7_seedindex_Select(sx, gm, T, 0.0, r, &sel)              != eslOK) esl_fatal(msg);
+  if (esl_sqfile_Position(sqfp, 0)                         != eslOK) esl_fatal(msg);
+  for (ncand = 0, t = 0; esl_sqio_Read(sqfp, sq) == eslOK; t++)
+    {
+      s = seed_score(sx, gm, sq->dsq, sq->n);
+      if (  p7_SEEDSEL_TEST(sel->cand, t) && s < T - 1e-4)           esl_fatal(msg); /* selected: has a word that seeds        */
+      if (! p7_SEEDSEL_TEST(sel->cand, t) && s > T + 1e-4)           esl_fatal(msg); /* has a word that seeds: selected        */
+      if (  p7_SEEDSEL_TEST(sel->cand, t) && ! p7_SEEDSEL_TEST(all->cand, t)) esl_fatal(msg); /* subset of T = -inf            */
+      if (planted[t] && ! p7_SEEDSEL_TEST(sel->cand, t))                esl_fatal(msg); /* planted best word is found             */
+      if (homsc[t] >= T + 1e-4 && ! p7_SEEDSEL_TEST(sel->cand, t))      esl_fatal(msg); /* homolog whose own alignment seeds      */
+      if (p7_SEEDSEL_TEST(sel->cand, t)) ncand++;
+      esl_sq_Reuse(sq);
+    }
+  if (t != nseq || ncand != sel->ncand || sel->ncand > all->ncand)     esl_fatal(msg);
+  if (sel->ncand == 0 || sel->nwords == 0)                             esl_fatal(msg); /* the planted ones, at least */
+  p7_seedsel_Destroy(sel);
+  p7_seedsel_Destroy(all);
+
+  /* T = +inf: nothing but the random sample */
+  if (p7_seedindex_Select(sx, gm, eslINFINITY, 0.5, r, &sel)  != eslOK) esl_fatal(msg);
+  if (sel->ncand != 0 || sel->nwords != 0)                             esl_fatal(msg);
+  if (sel->nsamp == 0 || sel->nsamp == nseq)                           esl_fatal(msg);
+  p7_seedsel_Destroy(sel);
+
+  esl_sqfile_Close(sqfp);
+
+  /* the index goes with its own sequence file; not with stdin, or with the file once it changes */
+  if (p7_seedindex_Validate(sx2, seqfile, errbuf)  != eslOK)        esl_fatal("%s\n%s", msg, errbuf);
+  if (p7_seedindex_Validate(sx2, "-", errbuf)      != eslEINVAL)    esl_fatal(msg);
+  if ((fp = fopen(seqfile, "a"))                   == NULL)         esl_fatal(msg);
+  fprintf(fp, ">extra\nACDEFGHIKLMNPQRSTVWY\n");
+  fclose(fp);
+  if (p7_seedindex_Validate(sx2, seqfile, errbuf)  != eslEINCOMPAT) esl_fatal(msg);
+
+  remove(seqfile);
+  remove(tmpfile);
+  free(homsc);
+  free(planted);
+  p7_seedindex_Destroy(sx);
+  p7_seedindex_Destroy(sx2);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  p7_trace_Destroy(tr);
+  esl_sq_Destroy(sq);
+}
+
+/* utest_patterns()
+ * Bad seed patterns are rejected; good ones give the right weight.
+ */
+static void
+utest_patterns(ESL_ALPHABET *abc)
+{
+  char          msg[] = "seed index pattern unit test failed";
+  char          errbuf[eslERRBUFSIZE];
+  P7_SEEDINDEX *sx    = NULL;
+
+  if (p7_seedindex_Create(abc, "0110",              &sx, errbuf) != eslEINVAL) esl_fatal(msg);
+  if (p7_seedindex_Create(abc, "11a1",              &sx, errbuf) != eslEINVAL) esl_fatal(msg);
+  if (p7_seedindex_Create(abc, "111111111",         &sx, errbuf) != eslEINVAL) esl_fatal(msg);
+  if (p7_seedindex_Create(abc, "10000000000000001", &sx, errbuf) != eslEINVAL) esl_fatal(msg);
+  if (p7_seedindex_Create(abc, "1011",              &sx, errbuf) != eslOK)     esl_fatal(msg);
+  if (sx->w != 3 || sx->span != 4 || sx->nwords != 1000)                       esl_fatal(msg);
+  p7_seedindex_Destroy(sx);
+}
+#endif /*p7SEEDINDEX_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7SEEDINDEX_TESTDRIVE
+/*
+  gcc -o p7_seedindex_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7SEEDINDEX_TESTDRIVE p7_seedindex.c -lhmmer -leasel -lm
+  ./p7_seedindex_utest
+ */
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL, NULL, NULL, NULL, "show brief help on version and usage",              0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL, NULL, NULL, NULL, "length of random target seqs",                      0 },
+  { "-M",        eslARG_INT,    "100", NULL, NULL, NULL, NULL, NULL, "length of sampled query model",                     0 },
+  { "-N",        eslARG_INT,    "200", NULL, NULL, NULL, NULL, NULL, "number of target seqs",                             0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the P7_SEEDINDEX k-mer seed index";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg      = p7_bg_Create(abc);
+  int             M       = esl_opt_GetInteger(go, "-M");
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  char            tmpfile[p7_TMPFILE_NAMELEN];
+
+  /* we only need a unique name for the index; the utest reopens it */
+  if (p7_TmpfileNamed(tmpfile, NULL) != eslOK) esl_fatal("failed to create tmp file");
+
+  utest_patterns(abc);
+  utest_selection(r, abc, bg, M, L, N, tmpfile);
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7SEEDINDEX_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
@@ -219,7 +219,9 @@ link_spsamples(const void *v1, const void *v2, const void *prm, int *ret_link)
 /* cluster_orderer()
  * is the routine that gets passed to qsort() to sort
  * the significant clusters by order of occurrence on
- * the target sequence
+ * the target sequence. Ties are broken on the other coords
+ * (and then posterior probability), so the order doesn't
+ * depend on how the clustering happened to number clusters.
  */
 static int
 cluster_orderer(const void *v1, const void *v2)
@@ -227,9 +229,164 @@ cluster_orderer(const void *v1, const void *v2)
   struct p7_spcoord_s   *h1    = (struct p7_spcoord_s *)   v1;
   struct p7_spcoord_s   *h2    = (struct p7_spcoord_s *)   v2;
 
-  if      (h1->i < h2->i) return -1;
-  else if (h1->i > h2->i) return 1;
-  else                    return 0;
+  if      (h1->i    < h2->i)    return -1;
+  else if (h1->i    > h2->i)    return 1;
+  else if (h1->j    < h2->j)    return -1;
+  else if (h1->j    > h2->j)    return 1;
+  else if (h1->k    < h2->k)    return -1;
+  else if (h1->k    > h2->k)    return 1;
+  else if (h1->m    < h2->m)    return -1;
+  else if (h1->m    > h2->m)    return 1;
+  else if (h1->prob > h2->prob) return -1;
+  else if (h1->prob < h2->prob) return 1;
+  else                          return 0;
+}
+
+
+/* struct p7_spsort_s:
+ * a seg pair's coords and its index in <sp->sp>, for sorting
+ * the ensemble in sweep_linkage().
+ */
+struct p7_spsort_s {
+  int i, j, k, m;
+  int h;
+};
+
+static int
+spsort_orderer(const void *v1, const void *v2)
+{
+  struct p7_spsort_s *s1 = (struct p7_spsort_s *) v1;
+  struct p7_spsort_s *s2 = (struct p7_spsort_s *) v2;
+
+  if (s1->i != s2->i) return (s1->i < s2->i ? -1 : 1);
+  if (s1->j != s2->j) return (s1->j < s2->j ? -1 : 1);
+  if (s1->k != s2->k) return (s1->k < s2->k ? -1 : 1);
+  if (s1->m != s2->m) return (s1->m < s2->m ? -1 : 1);
+  return (s1->h < s2->h ? -1 : (s1->h > s2->h ? 1 : 0));
+}
+
+static int
+uf_find(int *parent, int x)
+{
+  while (parent[x] != x) { parent[x] = parent[parent[x]]; x = parent[x]; }
+  return x;
+}
+
+/* sweep_linkage()
+ * 
+ * Single linkage clustering of the ensemble, giving the same
+ * partition as esl_cluster_SingleLinkage() with link_spsamples(), but
+ * without testing all O(n^2) pairs.
+ * 
+ * A sampled ensemble is highly redundant: the same (i,j,k,m) seg pair
+ * is typically sampled many times. We sort the seg pairs and collapse
+ * identical ones into groups, so each distinct pair is tested once.
+ * Copies of a seg pair link to each other only if it links to itself
+ * (the hmm overlap test is asymmetric in its +1, so a very short seg
+ * pair may not), but they always link to the same other seg pairs.
+ * 
+ * With <min_overlap> > 0, linkage requires overlap in sequence
+ * coords. Sweeping groups in order of start <i>, we only need to
+ * test a group against the groups whose end <j> reaches its start;
+ * union-find accumulates the clusters.
+ * 
+ * Clusters are numbered in order of their first seg pair in <sp->sp>.
+ * Sets <sp->assignment[0..n-1]> and <sp->nc>.
+ */
+static int
+sweep_linkage(P7_SPENSEMBLE *sp, struct p7_linkparam_s *param)
+{
+  struct p7_spsort_s  *srt = NULL;
+  struct p7_spcoord_s *hg;
+  int  *buf    = NULL;
+  int  *grp;		/* grp[h]    = group of seg pair h, 0..ng-1                    */
+  int  *rep;		/* rep[g]    = one seg pair h in group g                        */
+  int  *parent;		/* parent[g] : union-find forest over groups                   */
+  int  *linked;		/* linked[g] = TRUE if g links to itself or any other group    */
+  int  *cid;		/* cid[g]    = cluster index of root group g, or -1            */
+  int  *active;		/* groups whose seq end is >= start of the current group       */
+  int   n = sp->n;
+  int   ng, nact;
+  int   g, h, a, x, r;
+  int   link;
+  int   status;
+
+  sp->nc = 0;
+  if (n == 0) return eslOK;
+
+  ESL_ALLOC(srt, sizeof(struct p7_spsort_s) * n);
+  ESL_ALLOC(buf, sizeof(int) * n * 6);
+  grp    = buf;
+  rep    = buf + n;
+  parent = buf + 2*n;
+  linked = buf + 3*n;
+  cid    = buf + 4*n;
+  active = buf + 5*n;
+
+  for (h = 0; h < n; h++)
+    {
+      srt[h].i = sp->sp[h].i;
+      srt[h].j = sp->sp[h].j;
+      srt[h].k = sp->sp[h].k;
+      srt[h].m = sp->sp[h].m;
+      srt[h].h = h;
+    }
+  qsort((void *) srt, n, sizeof(struct p7_spsort_s), spsort_orderer);
+
+  for (ng = 0, x = 0; x < n; x++)
+    {
+      if (x == 0 || srt[x].i != srt[x-1].i || srt[x].j != srt[x-1].j || srt[x].k != srt[x-1].k || srt[x].m != srt[x-1].m)
+	{
+	  rep[ng]    = srt[x].h;
+	  parent[ng] = ng;
+	  linked[ng] = FALSE;
+	  cid[ng]    = -1;
+	  ng++;
+	}
+      grp[srt[x].h] = ng-1;
+    }
+
+  for (nact = 0, g = 0; g < ng; g++)
+    {
+      hg = &(sp->sp[rep[g]]);
+
+      /* groups ending before g starts can't overlap g, or any group after it */
+      for (x = 0, a = 0; a < nact; a++)
+	if (sp->sp[rep[active[a]]].j >= hg->i) active[x++] = active[a];
+      nact = x;
+
+      link_spsamples(hg, hg, param, &link);
+      if (link) linked[g] = TRUE;
+
+      for (a = 0; a < nact; a++)
+	{
+	  link_spsamples(&(sp->sp[rep[active[a]]]), hg, param, &link);
+	  if (! link) continue;
+	  linked[g] = linked[active[a]] = TRUE;
+	  x = uf_find(parent, active[a]);
+	  r = uf_find(parent, g);
+	  if (x != r) parent[ESL_MAX(x,r)] = ESL_MIN(x,r);
+	}
+      active[nact++] = g;
+    }
+
+  for (h = 0; h < n; h++)
+    {
+      g = grp[h];
+      if (! linked[g]) { sp->assignment[h] = sp->nc++; continue; } /* each copy of an unlinked seg pair is its own cluster */
+      r = uf_find(parent, g);
+      if (cid[r] == -1) cid[r] = sp->nc++;
+      sp->assignment[h] = cid[r];
+    }
+
+  free(srt);
+  free(buf);
+  return eslOK;
+
+ ERROR:
+  if (srt != NULL) free(srt);
+  if (buf != NULL) free(buf);
+  return status;
 }
 
 /* Function:  p7_spensemble_Cluster()
@@ -264,6 +421,11 @@ cluster_orderer(const void *v1, const void *v2)
  *            A reasonable (and tested) parameterization is
  *            <min_overlap = 0.8>, <of_smaller = TRUE>, <max_diagdiff
  *            = 4>, <min_posterior = 0.25>, <min_endpointp = 0.02>.
+ *
+ *            With <min_overlap> $>$ 0, only seg pairs that overlap in
+ *            sequence can be linked, and clustering is done by a sweep
+ *            over the distinct seg pairs in the ensemble in order of
+ *            their start points, rather than by testing all pairs.
  *            
  * Args:      sp            - segment pair ensemble to cluster
  *            min_overlap   - linkage requires fractional overlap >= this, in both seq and hmm segments
@@ -287,7 +449,10 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
   int c;
   int h;
   int idx_of_last;
-  int *ninc = NULL;
+  int *ninc   = NULL;
+  int *cstart = NULL;		/* members of cluster c are member[cstart[c]..cstart[c+1]-1] */
+  int *member = NULL;		/* seg pair indices h, bucketed by cluster, in order of h   */
+  int  x;
   int cwindow_width;
   int epc_threshold;
   int imin, jmin, kmin, mmin;
@@ -300,10 +465,25 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
   param.max_diagdiff  = max_diagdiff;
   param.min_posterior = min_posterior;
   param.min_endpointp = min_endpointp;
-  if ((status = esl_cluster_SingleLinkage(sp->sp, sp->n, sizeof(struct p7_spcoord_s), link_spsamples, (void *) &param,
-					  sp->workspace, sp->assignment, &(sp->nc))) != eslOK) goto ERROR;
+  if (min_overlap > 0.) 
+    {
+      if ((status = sweep_linkage(sp, &param)) != eslOK) goto ERROR;
+    }
+  else
+    {
+      if ((status = esl_cluster_SingleLinkage(sp->sp, sp->n, sizeof(struct p7_spcoord_s), link_spsamples, (void *) &param,
+					      sp->workspace, sp->assignment, &(sp->nc))) != eslOK) goto ERROR;
+    }
 
-  ESL_ALLOC(ninc, sizeof(int) * sp->nc);
+  ESL_ALLOC(ninc,   sizeof(int) * sp->nc);
+  ESL_ALLOC(cstart, sizeof(int) * (sp->nc+1));
+  ESL_ALLOC(member, sizeof(int) * ESL_MAX(1, sp->n));
+
+  /* Bucket the seg pairs by cluster, so each cluster's loops below only visit its own members */
+  esl_vec_ISet(cstart, sp->nc+1, 0);
+  for (h = 0; h < sp->n;  h++) cstart[sp->assignment[h]+1]++;
+  for (c = 0; c < sp->nc; c++) { cstart[c+1] += cstart[c]; ninc[c] = cstart[c]; }
+  for (h = 0; h < sp->n;  h++) member[ninc[sp->assignment[h]]++] = h;
 
   /* Look at each cluster in turn; most will be too small to worry about. */
   for (c = 0; c < sp->nc; c++)
@@ -314,31 +494,30 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
        * That's what the idx_of_last logic is doing, avoiding double-counting.
        */
       idx_of_last = -1;
-      for (ninc[c] = 0, h = 0; h < sp->n; h++) {
-	if (sp->assignment[h] == c) {
-	  if (sp->sp[h].idx != idx_of_last) ninc[c]++;
-	  idx_of_last = sp->sp[h].idx;
-	}
+      for (ninc[c] = 0, x = cstart[c]; x < cstart[c+1]; x++) {
+	h = member[x];
+	if (sp->sp[h].idx != idx_of_last) ninc[c]++;
+	idx_of_last = sp->sp[h].idx;
       }
       /* Reject low probability clusters: */
       if ((float) ninc[c] / (float) sp->nsamples < min_posterior) continue;
 
       /* Find the maximum extent of all seg pairs in this cluster in i,j k,m */
-      for (imin = 0, h = 0; h < sp->n; h++) 
-	if (sp->assignment[h] == c) 
-	  {
-	    if (imin == 0) {
-	      imin = imax = sp->sp[h].i;
-	      jmin = jmax = sp->sp[h].j;
-	      kmin = kmax = sp->sp[h].k;
-	      mmin = mmax = sp->sp[h].m;
-	    } else {
-	      imin = ESL_MIN(imin, sp->sp[h].i);  imax = ESL_MAX(imax, sp->sp[h].i);
-	      jmin = ESL_MIN(jmin, sp->sp[h].j);  jmax = ESL_MAX(jmax, sp->sp[h].j);
-	      kmin = ESL_MIN(kmin, sp->sp[h].k);  kmax = ESL_MAX(kmax, sp->sp[h].k);
-	      mmin = ESL_MIN(mmin, sp->sp[h].m);  mmax = ESL_MAX(mmax, sp->sp[h].m);
-	    }
+      for (imin = 0, x = cstart[c]; x < cstart[c+1]; x++) 
+	{
+	  h = member[x];
+	  if (imin == 0) {
+	    imin = imax = sp->sp[h].i;
+	    jmin = jmax = sp->sp[h].j;
+	    kmin = kmax = sp->sp[h].k;
+	    mmin = mmax = sp->sp[h].m;
+	  } else {
+	    imin = ESL_MIN(imin, sp->sp[h].i);  imax = ESL_MAX(imax, sp->sp[h].i);
+	    jmin = ESL_MIN(jmin, sp->sp[h].j);  jmax = ESL_MAX(jmax, sp->sp[h].j);
+	    kmin = ESL_MIN(kmin, sp->sp[h].k);  kmax = ESL_MAX(kmax, sp->sp[h].k);
+	    mmin = ESL_MIN(mmin, sp->sp[h].m);  mmax = ESL_MAX(mmax, sp->sp[h].m);
 	  }
+	}
       
       /* Set up a window in which we can examine the end point distributions for i,j,k,m in turn, independently */
       cwindow_width = ESL_MAX(ESL_MAX(imax-imin+1, jmax-jmin+1),
@@ -353,25 +532,25 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
 
       /* Identify the leftmost i that has enough endpoints. */
       esl_vec_ISet(sp->epc, imax-imin+1, 0);
-      for (h = 0; h < sp->n; h++) if (sp->assignment[h] == c) sp->epc[sp->sp[h].i-imin]++;
+      for (x = cstart[c]; x < cstart[c+1]; x++) sp->epc[sp->sp[member[x]].i-imin]++;
       for (best_i = imin; best_i <= imax; best_i++) if (sp->epc[best_i-imin] >= epc_threshold) break;
       if (best_i > imax) best_i = imin + esl_vec_IArgMax(sp->epc, imax-imin+1);
 
       /* Identify the leftmost k that has enough endpoints */
       esl_vec_ISet(sp->epc, kmax-kmin+1, 0);
-      for (h = 0; h < sp->n; h++) if (sp->assignment[h] == c) sp->epc[sp->sp[h].k-kmin]++;
+      for (x = cstart[c]; x < cstart[c+1]; x++) sp->epc[sp->sp[member[x]].k-kmin]++;
       for (best_k = kmin; best_k <= kmax; best_k++) if (sp->epc[best_k-kmin] >= epc_threshold) break;
       if (best_k > kmax) best_k = kmin + esl_vec_IArgMax(sp->epc, kmax-kmin+1);
 
       /* Identify the rightmost j that has enough endpoints. */
       esl_vec_ISet(sp->epc, jmax-jmin+1, 0);
-      for (h = 0; h < sp->n; h++) if (sp->assignment[h] == c) sp->epc[sp->sp[h].j-jmin]++;
+      for (x = cstart[c]; x < cstart[c+1]; x++) sp->epc[sp->sp[member[x]].j-jmin]++;
       for (best_j = jmax; best_j >= jmin; best_j--) if (sp->epc[best_j-jmin] >= epc_threshold) break;
       if (best_j < jmin) best_j = jmin + esl_vec_IArgMax(sp->epc, jmax-jmin+1);
 
       /* Identify the rightmost m that has enough endpoints. */
       esl_vec_ISet(sp->epc, mmax-mmin+1, 0);
-      for (h = 0; h < sp->n; h++) if (sp->assignment[h] == c) sp->epc[sp->sp[h].m-mmin]++;
+      for (x = cstart[c]; x < cstart[c+1]; x++) sp->epc[sp->sp[member[x]].m-mmin]++;
       for (best_m = mmax; best_m >= mmin; best_m--) if (sp->epc[best_m-mmin] >= epc_threshold) break;
       if (best_m < mmin) best_m = mmin + esl_vec_IArgMax(sp->epc, mmax-mmin+1);
       
@@ -401,11 +580,15 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
   qsort((void *) sp->sigc, sp->nsigc, sizeof(struct p7_spcoord_s), cluster_orderer);
 
   free(ninc);
+  free(cstart);
+  free(member);
   *ret_nclusters = sp->nsigc;
   return eslOK;
 
  ERROR:
-  if (ninc != NULL) free(ninc);
+  if (ninc   != NULL) free(ninc);
+  if (cstart != NULL) free(cstart);
+  if (member != NULL) free(member);
   *ret_nclusters = 0;
   return status;
 }
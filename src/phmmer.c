@@ -46,13 +46,11 @@ typedef struct {
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
-#if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
-#else
+/* --cpu and --mpi may be combined: each MPI worker then runs its own
+ * pool of <--cpu> pipeline threads (hybrid MPI/threads mode).
+ */
 #define CPUOPTS     NULL
 #define MPIOPTS     NULL
-#endif
 
 static ESL_OPTIONS options[] = {
   /* name           type              default   env  range   toggles   reqs   incomp                             help                                       docgroup*/
@@ -92,6 +90,9 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,       "1e-3", NULL, NULL,      NULL,  NULL, "--max",            "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,       "1e-5", NULL, NULL,      NULL,  NULL, "--max",            "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL, "--max",            "turn off composition bias filter",                             7 },
+  { "--seedidx",    eslARG_INFILE,  NULL, NULL, NULL,    NULL,  NULL, "--max",          "skip targets with no seed word in k-mer index <f> (makehmmerdb --kmer)", 7 },
+  { "--seedT",      eslARG_REAL,  "10.0", NULL, NULL,    NULL,"--seedidx", NULL,        "seed index: bit score threshold for the query's seed words",    7 },
+  { "--seedsample", eslARG_REAL,   "0.0", NULL, "0<=x<=1",NULL,"--seedidx", NULL,       "seed index: also search random fraction <x> of other targets",  7 },
 /* Control of E-value calibration */
   { "--EmL",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,              "length of sequences for MSV Gumbel mu fit",                   11 },   
   { "--EmN",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,              "number of sequences for MSV Gumbel mu fit",                   11 },   
@@ -102,6 +103,7 @@ static ESL_OPTIONS options[] = {
   { "--Eft",        eslARG_REAL,       "0.04", NULL,"0<x<1",    NULL,  NULL,  NULL,              "tail mass for Forward exponential tail tau fit",              11 },   
 /* other options */
   { "--nonull2",    eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "turn off biased composition score corrections",               12 },
+  { "--stagetimes", eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "report wall time spent in each pipeline stage",               12 },
   { "-Z",           eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,         "42",  NULL, "n>=0",    NULL,  NULL,  NULL,              "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
@@ -141,6 +143,7 @@ struct cfg_s {
   int              do_mpi;            /* TRUE if we're doing MPI parallelization         */
   int              nproc;             /* how many MPI processes, total                   */
   int              my_rank;           /* who am I, in 0..nproc-1                         */
+  int              mpi_threads;       /* TRUE if MPI allows worker threads (hybrid mode) */
 
   char             *firstseq_key;     /* name of the first sequence in the restricted db range */
   int              n_targetseq;       /* number of sequences in the restricted range */
@@ -267,11 +270,15 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--F2")        && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seedidx")    && fprintf(ofp, "# k-mer seed index of targets:     %s\n",             esl_opt_GetString(go, "--seedidx"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seedT")      && fprintf(ofp, "# seed word score threshold:       >= %g bits\n",    esl_opt_GetReal(go, "--seedT"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seedsample") && fprintf(ofp, "# seed index random sample:        %g\n",             esl_opt_GetReal(go, "--seedsample"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") && fprintf(ofp, "# Restrict db to start at seq key: %s\n",            esl_opt_GetString(go, "--restrictdb_stkey"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_n")     && fprintf(ofp, "# Restrict db to # target seqs:    %d\n",            esl_opt_GetInteger(go, "--restrictdb_n")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--ssifile")          && fprintf(ofp, "# Override ssi file to:            %s\n",            esl_opt_GetString(go, "--ssifile"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stagetimes") && fprintf(ofp, "# pipeline stage timing:           on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EmL")       && fprintf(ofp, "# seq length, MSV Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EmL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EmN")       && fprintf(ofp, "# seq number, MSV Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EmN"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EvL")       && fprintf(ofp, "# seq length, Vit Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EvL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -317,6 +324,7 @@ main(int argc, char **argv)
   cfg.do_mpi     = FALSE;	           /* this gets reset below, if we init MPI */
   cfg.nproc      = 0;		           /* this gets reset below, if we init MPI */
   cfg.my_rank    = 0;		           /* this gets reset below, if we init MPI */
+  cfg.mpi_threads= FALSE;	           /* this gets reset below, if we init MPI */
   cfg.firstseq_key = NULL;
   cfg.n_targetseq  = -1;
 
@@ -335,6 +343,10 @@ main(int argc, char **argv)
   if ( cfg.n_targetseq != -1 && cfg.n_targetseq < 1 )
     p7_Fail("--restrictdb_n must be >= 1\n");
 
+  /* a seed index identifies targets by their ordinal position in the whole database */
+  if (esl_opt_IsOn(go, "--seedidx") && (cfg.firstseq_key != NULL || cfg.n_targetseq != -1))
+    p7_Fail("--seedidx can't be used with --restrictdb_stkey or --restrictdb_n\n");
+
   /* Figure out who we are, and send control there: 
    * we might be an MPI master, an MPI worker, or a serial program.
    */
@@ -347,11 +359,20 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "--mpi")) 
     {
+      int mpi_thread_level;
+
+      if (esl_opt_IsOn(go, "--seedidx")) p7_Fail("--seedidx can't be used with --mpi\n");
+
       cfg.do_mpi     = TRUE;
-      MPI_Init(&argc, &argv);
+      MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &mpi_thread_level); /* only the main thread of a rank calls MPI */
       MPI_Comm_rank(MPI_COMM_WORLD, &(cfg.my_rank));
       MPI_Comm_size(MPI_COMM_WORLD, &(cfg.nproc));
 
+      /* hybrid mode needs threads beside MPI; without that, workers run serially */
+      cfg.mpi_threads = (mpi_thread_level >= MPI_THREAD_FUNNELED);
+      if (! cfg.mpi_threads && cfg.my_rank == 0 && esl_opt_IsUsed(go, "--cpu"))
+	fprintf(stderr, "Warning: MPI library doesn't support MPI_THREAD_FUNNELED; ignoring --cpu, MPI workers run serially\n");
+
       if (cfg.my_rank > 0)  status = mpi_worker(go, &cfg);
       else 		    status = mpi_master(go, &cfg);
 
@@ -403,6 +424,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              ncpus    = 0;
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_SEEDINDEX    *sx       = NULL;              /* k-mer seed index of the targets (--seedidx)     */
+  P7_SEEDSEL      *sel      = NULL;              /* targets it selects for the current query        */
+  ESL_RANDOMNESS  *seedrng  = NULL;              /* for its random sample of other targets          */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -470,6 +494,20 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   }
 
 
+  if (esl_opt_IsOn(go, "--seedidx"))
+    {
+      FILE *sxfp;
+      char  errbuf[eslERRBUFSIZE];
+
+      if ((sxfp = fopen(esl_opt_GetString(go, "--seedidx"), "rb")) == NULL) p7_Fail("Failed to open seed index %s for reading\n", esl_opt_GetString(go, "--seedidx"));
+      status = p7_seedindex_Read(sxfp, abc, &sx, errbuf);
+      if (status != eslOK) p7_Fail("Failed to read seed index %s:\n%s\n", esl_opt_GetString(go, "--seedidx"), errbuf);
+      status = p7_seedindex_Validate(sx, cfg->dbfile, errbuf);
+      if (status != eslOK) p7_Fail("Seed index %s doesn't go with %s:\n%s\nRebuild it with makehmmerdb --kmer\n", esl_opt_GetString(go, "--seedidx"), cfg->dbfile, errbuf);
+      fclose(sxfp);
+      seedrng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "--seed"));
+    }
+
   /* Open the query sequence file  */
   status = esl_sqfile_OpenDigital(abc, cfg->qfile, qformat, NULL, &qfp);
   if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",      cfg->qfile);
@@ -526,6 +564,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   while ((qstatus = esl_sqio_Read(qfp, qsq)) == eslOK)
     {
       P7_OPROFILE     *om       = NULL;           /* optimized query profile                  */
+      P7_PROFILE      *gm       = NULL;           /* generic query profile (--seedidx only)   */
 
       nquery++;
       if (qsq->n == 0) continue; /* skip zero length seqs as if they aren't even present */
@@ -554,7 +593,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 
       /* Build the model */
-      p7_SingleBuilder(bld, qsq, info[0].bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
+      p7_SingleBuilder(bld, qsq, info[0].bg, NULL, NULL, (sx ? &gm : NULL), &om); /* bypass HMM - only need model (and profile, for a seed index) */
+
+      /* Targets the seed index can't rule out for this query (--seedidx) */
+      if (sx && p7_seedindex_Select(sx, gm, esl_opt_GetReal(go, "--seedT"), esl_opt_GetReal(go, "--seedsample"), seedrng, &sel) != eslOK)
+        p7_Fail("Seed index selection failed for query %s\n", qsq->name);
 
       for (i = 0; i < infocnt; ++i)
       {
@@ -562,6 +605,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         info[i].th  = p7_tophits_Create();
         info[i].om  = p7_oprofile_Clone(om);
         info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+        info[i].pli->seedsel = sel;
         p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
 #ifdef HMMER_THREADS
@@ -601,6 +645,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         p7_oprofile_Destroy(info[i].om);
       }
 
+      /* The file's size was checked against the seed index's before searching;
+       * this catches an edit that kept the size, which would have skipped the
+       * wrong targets.
+       */
+      if (sx && (info->pli->nseqs != sx->nseq || info->pli->nres != sx->nres))
+        p7_Fail("Seed index %s was built for %" PRIu64 " sequences (%" PRIu64 " residues), but %s has %" PRIu64 " (%" PRIu64 "); rebuild it with makehmmerdb --kmer\n",
+                esl_opt_GetString(go, "--seedidx"), sx->nseq, sx->nres, cfg->dbfile, info->pli->nseqs, info->pli->nres);
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(info->th);
       p7_tophits_Threshold(info->th, info->pli);
@@ -641,6 +693,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_pipeline_Destroy(info->pli);
       p7_oprofile_Destroy(info->om);
       p7_oprofile_Destroy(om);
+      if (gm) p7_profile_Destroy(gm);
+      p7_seedsel_Destroy(sel);
+      sel = NULL;
       esl_sq_Reuse(qsq);
     } /* end outer loop over query sequences */
   if      (qstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n",
@@ -673,6 +728,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  p7_seedindex_Destroy(sx);
+  if (seedrng) esl_randomness_Destroy(seedrng);
   esl_sqfile_Close(dbfp);
   esl_sqfile_Close(qfp);
   esl_stopwatch_Destroy(w);
@@ -760,9 +817,49 @@ typedef struct {
   int        size;
   int        current;
   int        last;
+  uint64_t   max_length;      /* target size of one block, in bytes of the file */
   SEQ_BLOCK *blocks;
 } BLOCK_LIST;
 
+/* mpi_block_length()
+ * Size of the work units the master hands out. In hybrid MPI/threads
+ * mode (--cpu given with --mpi, and MPI supports threads:
+ * <cfg->mpi_threads>) each worker keeps <--cpu> pipeline threads
+ * busy, so the blocks are scaled up accordingly; this also cuts down
+ * the number of messages the master has to handle.
+ */
+static uint64_t
+mpi_block_length(ESL_GETOPTS *go, const struct cfg_s *cfg)
+{
+  uint64_t length = MAX_BLOCK_SIZE;
+
+#ifdef HMMER_THREADS
+  if (cfg->mpi_threads && esl_opt_IsUsed(go, "--cpu") && esl_opt_GetInteger(go, "--cpu") > 1)
+    length *= esl_opt_GetInteger(go, "--cpu");
+#endif
+  return length;
+}
+
+static void mpi_serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, ESL_SQ *dbsq, SEQ_BLOCK *block);
+#ifdef HMMER_THREADS
+static void mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, SEQ_BLOCK *block);
+#endif
+
+/* mpi_prefetch_block()
+ * Called by a worker as soon as it has received a nonempty block: ask
+ * the master for the next block right away and post a nonblocking
+ * receive for it, so the next work unit is in flight while this one
+ * is being searched. The caller waits on <req> when it is done.
+ */
+static void
+mpi_prefetch_block(SEQ_BLOCK *next, MPI_Request *req)
+{
+  int status = 0;
+
+  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+  MPI_Irecv(next, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, req);
+}
+
 /* this routine parses the database keeping track of the blocks
  * offset within the file, number of sequences and the length
  * of the block.  These blocks are passed as work units to the
@@ -804,7 +901,7 @@ int next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block,
 
   esl_sq_Reuse(sq);
   if (n_targetseqs == 0) status = eslEOF; //this is to handle the end-case of a restrictdb scenario, where no more targets are required, and we want to mark the list as complete
-  while (block->length < MAX_BLOCK_SIZE && (n_targetseqs < 0 || block->count < n_targetseqs) && (status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
+  while (block->length < list->max_length && (n_targetseqs < 0 || block->count < n_targetseqs) && (status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
     {
       if (block->count == 0) block->offset = sq->roff;
       block->length = sq->eoff - block->offset + 1;
@@ -976,11 +1073,12 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status != eslOK)        mpi_failure ("Unexpected error %d opening sequence file %s\n", status, cfg->qfile);
   qsq  = esl_sq_CreateDigital(abc);
 
-  ESL_ALLOC(list, sizeof(SEQ_BLOCK));
+  ESL_ALLOC(list, sizeof(BLOCK_LIST));
   list->complete = 0;
   list->size     = 0;
   list->current  = 0;
   list->last     = 0;
+  list->max_length = mpi_block_length(go, cfg);
   list->blocks   = NULL;
 
 
@@ -1069,7 +1167,11 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       block.length = 0;
       block.count  = 0;
 
-      /* wait for all workers to finish up their work blocks */
+      /* collect each worker's outstanding READY: the prefetch request it
+       * sent on starting its last block (or its first request, if it got
+       * no block). The empty block sent below answers it. Workers may
+       * still be searching that last block at this point.
+       */
       for (i = 1; i < cfg->nproc; ++i)
 	{
 	  if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
@@ -1091,16 +1193,20 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
 	}
 
-      /* merge the results of the search results */
+      /* send an empty block to signal the workers they are done */
       for (dest = 1; dest < cfg->nproc; ++dest)
+	MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+
+      /* merge the search results, taking each worker's as soon as it arrives */
+      for (i = 1; i < cfg->nproc; ++i)
 	{
 	  P7_PIPELINE     *mpi_pli   = NULL;
 	  P7_TOPHITS      *mpi_th    = NULL;
 
-	  /* send an empty block to signal the worker they are done */
-	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+	  if (MPI_Probe(MPI_ANY_SOURCE, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpistatus) != 0)
+	    mpi_failure("MPI error %d receiving tophits\n", mpistatus.MPI_ERROR);
+	  dest = mpistatus.MPI_SOURCE;
 
-	  /* wait for the results */
 	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
 
@@ -1220,7 +1326,6 @@ static int
 mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 {
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                  */
-  P7_BG           *bg       = NULL;	          /* null model                                      */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                       */
   ESL_SQ          *qsq      = NULL;               /* query sequence                                   */
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                 */
@@ -1232,17 +1337,24 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              seed;
   int              status   = eslOK;
   int              qstatus  = eslOK;
-  int              sstatus  = eslOK;
+  int              i;
 
   char            *mpi_buf  = NULL;               /* buffer used to pack/unpack structures            */
   int              mpi_size = 0;                  /* size of the allocated buffer                     */
 
+  int              ncpus    = 0;                  /* >0: hybrid mode, this rank runs <ncpus> threads  */
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+#ifdef HMMER_THREADS
+  ESL_SQ_BLOCK    *block    = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+#endif
   MPI_Status       mpistatus;
 
   /* Initializations */
   abc  = esl_alphabet_Create(eslAMINO);
   w    = esl_stopwatch_Create();
-  bg   = p7_bg_Create(abc);
 
   /* If caller declared input formats, decode them */
   if (esl_opt_IsOn(go, "--qformat")) {
@@ -1254,6 +1366,44 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
     if (dbformat == eslSQFILE_UNKNOWN) p7_Fail("%s is not a recognized sequence database file format\n", esl_opt_GetString(go, "--tformat"));
   }
 
+#ifdef HMMER_THREADS
+  /* hybrid MPI/threads: only when --cpu or HMMER_NCPU was set
+   * (esl_opt_IsUsed() is true for either, false for the compiled-in
+   * default), so that plain one-rank-per-core MPI runs don't
+   * oversubscribe the node; and only if the MPI library supports
+   * MPI_THREAD_FUNNELED (cfg->mpi_threads).
+   */
+  if (esl_opt_IsUsed(go, "--cpu") && cfg->mpi_threads)
+    ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue = esl_workqueue_Create(ncpus * 2);
+    }
+#endif
+
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  if ((info = calloc(infocnt, sizeof(*info))) == NULL) mpi_failure("Failed to allocate worker info\n"); /* zeroed: bg etc. stay NULL if no HMM is read */
+
+  for (i = 0; i < infocnt; ++i)
+    {
+      info[i].bg    = p7_bg_Create(abc);
+#ifdef HMMER_THREADS
+      info[i].queue = queue;
+#endif
+    }
+
+#ifdef HMMER_THREADS
+  for (i = 0; i < ncpus * 2; ++i)
+    {
+      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
+      if (block == NULL)   mpi_failure("Failed to allocate sequence block");
+
+      status = esl_workqueue_Init(queue, block);
+      if (status != eslOK) mpi_failure("Failed to add block to work queue");
+    }
+#endif
+
   /* Initialize a default builder configuration,
    * then set only the options we need for single sequence search
    */
@@ -1271,8 +1421,8 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   bld->EfN = esl_opt_GetInteger(go, "--EfN");
   bld->Eft = esl_opt_GetReal   (go, "--Eft");
 
-  if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
-  else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
+  if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), info->bg);
+  else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), info->bg); 
   if (status != eslOK) mpi_failure("Failed to set single query seq score system:\n%s\n", bld->errbuf);
 
   /* Open the target sequence database for sequential access. */
@@ -1296,11 +1446,9 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* Outer loop over sequence queries */
   while ((qstatus = esl_sqio_Read(qfp, qsq)) == eslOK)
     {
-      P7_PIPELINE     *pli      = NULL;		  /* processing pipeline                      */
-      P7_TOPHITS      *th       = NULL;        	  /* top-scoring sequence hits                */
       P7_OPROFILE     *om       = NULL;           /* optimized query profile                  */
 
-      SEQ_BLOCK        block;
+      SEQ_BLOCK        sblock;
 
       status = 0;
       MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
@@ -1310,59 +1458,51 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       esl_stopwatch_Start(w);
 
       /* Build the model */
-      p7_SingleBuilder(bld, qsq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
+      p7_SingleBuilder(bld, qsq, info->bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
 
-      /* Create processing pipeline and hit list */
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-      p7_pli_NewModel(pli, om, bg);
-
-      /* receive a sequence block from the master */
-      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-      while (block.count > 0)
+      for (i = 0; i < infocnt; ++i)
 	{
-	  uint64_t length = 0;
-	  uint64_t count  = block.count;
-
-	  status = esl_sqfile_Position(dbfp, block.offset);
-	  if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
-
-	  while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
-	    {
-	      length = dbsq->eoff - block.offset + 1;
-
-	      p7_pli_NewSeq(pli, dbsq);
-	      p7_bg_SetLength(bg, dbsq->n);
-	      p7_oprofile_ReconfigLength(om, dbsq->n);
-      
-	      p7_Pipeline(pli, om, bg, dbsq, NULL, th);
+	  /* Create processing pipeline and hit list */
+	  info[i].th  = p7_tophits_Create(); 
+	  info[i].om  = p7_oprofile_Clone(om);
+	  info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	  p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
-	      esl_sq_Reuse(dbsq);
-	      p7_pipeline_Reuse(pli);
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
 
-	      --count;
-	    }
+      /* receive the first sequence block from the master */
+      MPI_Recv(&sblock, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
 
-	  /* lets do a little bit of sanity checking here to make sure the blocks are the same */
-	  if (count > 0)              mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block.count,  block.count - count, block.offset);
-	  if (block.length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length,              block.offset);
+#ifdef HMMER_THREADS
+      if (ncpus > 0) mpi_thread_loop(threadObj, queue, dbfp, &sblock);
+      else           mpi_serial_loop(info, dbfp, dbsq, &sblock);
+#else
+      mpi_serial_loop(info, dbfp, dbsq, &sblock);
+#endif
 
-	  /* inform the master we need another block of sequences */
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      /* merge the results of this rank's threads */
+      for (i = 1; i < infocnt; ++i)
+	{
+	  p7_tophits_Merge(info[0].th, info[i].th);
+	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
-	  /* wait for the next block of sequences */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
+	  p7_oprofile_Destroy(info[i].om);
 	}
 
       esl_stopwatch_Stop(w);
 
       /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_tophits_MPISend(info->th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_pipeline_MPISend(info->pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
 
-      p7_tophits_Destroy(th);
-      p7_pipeline_Destroy(pli);
+      p7_tophits_Destroy(info->th);
+      p7_pipeline_Destroy(info->pli);
+      p7_oprofile_Destroy(info->om);
       p7_oprofile_Destroy(om);
       esl_sq_Reuse(qsq);
     } /* end outer loop over query sequences */
@@ -1376,8 +1516,21 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   if (mpi_buf != NULL) free(mpi_buf);
 
-  p7_bg_Destroy(bg);
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+	esl_sq_DestroyBlock(block);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
 
+  free(info);
   esl_sqfile_Close(dbfp);
   esl_sqfile_Close(qfp);
   esl_stopwatch_Destroy(w);
@@ -1387,6 +1540,134 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   esl_alphabet_Destroy(abc);
   return eslOK;
 }
+
+/* mpi_serial_loop()
+ * Search the blocks the master hands this (unthreaded) worker for the
+ * current query, starting with <block>, which the caller has already
+ * received. Returns when the master sends an empty block.
+ */
+static void
+mpi_serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, ESL_SQ *dbsq, SEQ_BLOCK *block)
+{
+  SEQ_BLOCK    next;
+  MPI_Request  req;
+  MPI_Status   mpistatus;
+  uint64_t     length;
+  uint64_t     count;
+  int          status;
+  int          sstatus = eslOK;
+
+  while (block->count > 0)
+    {
+      mpi_prefetch_block(&next, &req);
+
+      length = 0;
+      count  = block->count;
+
+      status = esl_sqfile_Position(dbfp, block->offset);
+      if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block->offset);
+
+      while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+	{
+	  length = dbsq->eoff - block->offset + 1;
+
+	  p7_pli_NewSeq(info->pli, dbsq);
+	  p7_bg_SetLength(info->bg, dbsq->n);
+	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
+
+	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+
+	  esl_sq_Reuse(dbsq);
+	  p7_pipeline_Reuse(info->pli);
+
+	  --count;
+	}
+
+      /* lets do a little bit of sanity checking here to make sure the blocks are the same */
+      if (count > 0)               mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block->count,  block->count - count, block->offset);
+      if (block->length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block->length, length,               block->offset);
+
+      /* the next block of sequences should be waiting for us by now */
+      MPI_Wait(&req, &mpistatus);
+      *block = next;
+    }
+}
+
+#ifdef HMMER_THREADS
+/* mpi_thread_loop()
+ * Hybrid MPI/threads version of mpi_serial_loop(): the rank's main
+ * thread reads the sequences of each block the master hands out and
+ * feeds them, in ESL_SQ_BLOCKs, to the same pipeline_thread() workers
+ * used by the threaded serial version. All MPI communication stays in
+ * this (main) thread.
+ */
+static void
+mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, SEQ_BLOCK *block)
+{
+  ESL_SQ_BLOCK *sqblock;
+  void         *newBlock;
+  SEQ_BLOCK     next;
+  MPI_Request   req;
+  MPI_Status    mpistatus;
+  uint64_t      length;
+  uint64_t      count;
+  int           status;
+  int           sstatus = eslOK;
+  int           i;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  while (block->count > 0)
+    {
+      mpi_prefetch_block(&next, &req);
+
+      length = 0;
+      count  = block->count;
+
+      status = esl_sqfile_Position(dbfp, block->offset);
+      if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block->offset);
+
+      while (count > 0)
+	{
+	  sqblock = (ESL_SQ_BLOCK *) newBlock;
+	  sstatus = esl_sqio_ReadBlock(dbfp, sqblock, -1, (int) ESL_MIN(count, (uint64_t) BLOCK_SIZE), /*max_init_window=*/FALSE, FALSE);
+	  if (sstatus != eslOK) break;
+
+	  length = sqblock->list[sqblock->count-1].eoff - block->offset + 1;
+	  count -= sqblock->count;
+
+	  status = esl_workqueue_ReaderUpdate(queue, sqblock, &newBlock);
+	  if (status != eslOK) mpi_failure("Work queue reader failed");
+	}
+
+      if (count > 0)               mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block->count,  block->count - count, block->offset);
+      if (block->length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block->length, length,               block->offset);
+
+      MPI_Wait(&req, &mpistatus);
+      *block = next;
+    }
+
+  /* an empty block tells each pipeline thread that this query is done */
+  for (i = 0; i < esl_threads_GetWorkerCount(obj); ++i)
+    {
+      sqblock = (ESL_SQ_BLOCK *) newBlock;
+      sqblock->count = 0;
+      status = esl_workqueue_ReaderUpdate(queue, sqblock, &newBlock);
+      if (status != eslOK) mpi_failure("Work queue reader failed");
+    }
+  sqblock = (ESL_SQ_BLOCK *) newBlock;
+  sqblock->count = 0;
+  status = esl_workqueue_ReaderUpdate(queue, sqblock, NULL);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);
+}
+#endif /*HMMER_THREADS*/
 #endif /*HMMER_MPI*/
 
 
@@ -1402,6 +1683,7 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
   /* Main loop: */
   while ((n_targetseqs==-1 || seq_cnt<n_targetseqs) && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
     {
+      dbsq->idx = seq_cnt;   /* ordinal in the database, for a seed index */
       p7_pli_NewSeq(info->pli, dbsq);
       p7_bg_SetLength(info->bg, dbsq->n);
       p7_oprofile_ReconfigLength(info->om, dbsq->n);
@@ -1428,6 +1710,8 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
   int  status  = eslOK;
   int  sstatus = eslOK;
   int  eofCount = 0;
+  int64_t nread  = 0;
+  int  i;
   ESL_SQ_BLOCK *block;
   void         *newBlock;
 
@@ -1449,6 +1733,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
       } else {
         sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
         n_targetseqs -= block->count;
+        for (i = 0; i < block->count; i++) block->list[i].idx = nread++; /* ordinals in the database, for a seed index */
       }
 
       if (sstatus == eslEOF)
@@ -2,6 +2,8 @@
  * 
  * Contents:
  *   1. API for aligning sequence or MSA traces
+ *      (including threaded trace computation, and mapped column
+ *       layouts for aligning a large sequence set in chunks)
  *   2. Internal functions used by the API
  *   3. Test driver
  * 
@@ -15,6 +17,9 @@
 #include "hmmer.h"
 
 static int     map_new_msa(P7_TRACE **tr, int nseq, int M, int optflags, int **ret_inscount, int **ret_matuse, int **ret_matmap, int *ret_alen);
+static int     map_columns(int *inscount, const int *matuse, int M, int optflags, int **ret_matmap, int *ret_alen);
+static int     make_seqs_msa(ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7_HMM *hmm, int *inscount, int *matuse, int *matmap, int alen, ESL_MSA **ret_msa);
+static int     trace_one(P7_PROFILE *gm, P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_GMX **gxf, P7_GMX **gxb, ESL_SQ *sq, P7_TRACE *tr);
 static ESL_DSQ get_dsq_z(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int idx, int z);
 static int     make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa);
 static int     make_text_msa   (ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa);
@@ -96,48 +101,131 @@ static int     rejustify_insertions_text     (const ESL_ALPHABET *abc, ESL_MSA *
 int
 p7_tracealign_Seqs(ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7_HMM *hmm, ESL_MSA **ret_msa)
 {
-  ESL_MSA      *msa        = NULL;	/* RETURN: new MSA */
-  const ESL_ALPHABET *abc  = sq[0]->abc;
   int          *inscount   = NULL;	/* array of max gaps between aligned columns */
   int          *matmap     = NULL;      /* matmap[k] = apos of match k matmap[1..M] = [1..alen] */
   int          *matuse     = NULL;      /* TRUE if an alignment column is associated with match state k [1..M] */
-  int           idx;                    /* counter over sequences */
   int           alen;		        /* width of alignment */
   int           status;
 
-  if ((status = map_new_msa(tr, nseq, M, optflags, &inscount, &matuse, &matmap, &alen)) != eslOK) return status;
+  if ((status = map_new_msa(tr, nseq, M, optflags, &inscount, &matuse, &matmap, &alen)) != eslOK) { *ret_msa = NULL; return status; }
+  status = make_seqs_msa(sq, tr, nseq, M, optflags, hmm, inscount, matuse, matmap, alen, ret_msa);
 
-  if (optflags & p7_DIGITIZE) { if ((status = make_digital_msa(sq, NULL, tr, nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
-  else                        { if ((status = make_text_msa   (sq, NULL, tr, nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
+  free(inscount);
+  free(matmap);
+  free(matuse);
+  return status;
+}
 
-  if ((status = annotate_rf(msa, M, matuse, matmap))                               != eslOK) goto ERROR;
-  if (hmm)
-    if ((status = annotate_mm(msa, hmm,    matuse, matmap))                          != eslOK) goto ERROR;
-  if ((status = annotate_posterior_probability(msa, tr, matmap, M, optflags)) != eslOK) goto ERROR;
 
-  if (optflags & p7_DIGITIZE) rejustify_insertions_digital(     msa, inscount, matmap, matuse, M);
-  else                        rejustify_insertions_text   (abc, msa, inscount, matmap, matuse, M);
+/* Function:  p7_tracealign_CountInserts()
+ * Synopsis:  Accumulate the column layout of a traces-to-MSA conversion.
+ *
+ * Purpose:   Fold the traces <tr[0..nseq-1]> into the column layout
+ *            arrays <inscount[0..M]> and <matuse[1..M]>: <inscount[k]>
+ *            is raised to the largest number of residues any trace
+ *            inserts after node k (N and C tails in <inscount[0]>,
+ *            <inscount[M]>), and <matuse[k]> is set <TRUE> if any
+ *            trace uses match state <k>.
+ *
+ *            This lets a caller align more sequences than it can
+ *            hold in memory at once: start with <inscount[]> all 0
+ *            and <matuse[]> all <FALSE> (or all <TRUE>, for
+ *            <p7_ALL_CONSENSUS_COLS>), count inserts over every chunk
+ *            of traces, then convert each chunk again with
+ *            <p7_tracealign_SeqsWithMap()>. Every chunk's alignment
+ *            then has the same columns, and their rows can be
+ *            written out one after another as one alignment.
+ *
+ * Args:      tr       - array of traces, 0..nseq-1
+ *            nseq     - number of traces
+ *            M        - length of model
+ *            inscount - column layout: max # of inserts after each node, 0..M
+ *            matuse   - column layout: TRUE if node k gets a column, 1..M
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tracealign_CountInserts(P7_TRACE **tr, int nseq, int M, int *inscount, int *matuse)
+{
+  int *insnum = NULL;   /* insnum[k=0..M] == # of inserts in node k in current trace */
+  int  idx;
+  int  z;
+  int  k;
+  int  status;
 
+  ESL_ALLOC(insnum, sizeof(int) * (M+1));
   for (idx = 0; idx < nseq; idx++)
     {
-      esl_msa_SetSeqName(msa, idx, sq[idx]->name, -1);
-      if (sq[idx]->acc[0]  != '\0') esl_msa_SetSeqAccession  (msa, idx, sq[idx]->acc,  -1);
-      if (sq[idx]->desc[0] != '\0') esl_msa_SetSeqDescription(msa, idx, sq[idx]->desc, -1);
-      msa->wgt[idx] = 1.0;
-      if (msa->sqlen != NULL) msa->sqlen[idx] = sq[idx]->n;
+      esl_vec_ISet(insnum, M+1, 0);
+      for (z = 1; z < tr[idx]->N; z++) 
+	{
+      	  switch (tr[idx]->st[z]) {
+	  case p7T_I:                                insnum[tr[idx]->k[z]]++; break;
+	  case p7T_N: if (tr[idx]->st[z-1] == p7T_N) insnum[0]++;             break;
+	  case p7T_C: if (tr[idx]->st[z-1] == p7T_C) insnum[M]++;             break;
+	  case p7T_M: matuse[tr[idx]->k[z]] = TRUE;                           break;
+	  case p7T_J: p7_Die("J state unsupported");
+	  default:                                                            break;
+	  }
+	}
+      for (k = 0; k <= M; k++) 
+	inscount[k] = ESL_MAX(inscount[k], insnum[k]);
     }
+  free(insnum);
+  return eslOK;
 
-  free(inscount);
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_tracealign_SeqsWithMap()
+ * Synopsis:  Convert traces to an MSA with a given column layout.
+ *
+ * Purpose:   Same as <p7_tracealign_Seqs()>, except that the
+ *            alignment's columns are laid out by <inscount[0..M]> and
+ *            <matuse[1..M]> as collected by
+ *            <p7_tracealign_CountInserts()> (possibly over many more
+ *            traces than the <nseq> given here), instead of by
+ *            <tr[0..nseq-1]> alone.
+ *
+ *            <optflags> are as for <p7_tracealign_Seqs()>; the
+ *            <p7_ALL_CONSENSUS_COLS> flag has no effect here, because
+ *            it acts on <matuse[]> before counting.
+ *
+ * Returns:   <eslOK> on success, and <*ret_msa> points to a new MSA.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <*ret_msa> is <NULL>.
+ */
+int
+p7_tracealign_SeqsWithMap(ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7_HMM *hmm, const int *inscount, const int *matuse, ESL_MSA **ret_msa)
+{
+  int *ins    = NULL;	/* copy of <inscount>: map_columns() zeros its tails for p7_TRIM */
+  int *use    = NULL;
+  int *matmap = NULL;
+  int  alen;
+  int  status;
+
+  ESL_ALLOC(ins, sizeof(int) * (M+1));
+  ESL_ALLOC(use, sizeof(int) * (M+1));
+  esl_vec_ICopy(inscount, M+1, ins);
+  esl_vec_ICopy(matuse,   M+1, use);
+  use[0] = 0;
+
+  if ((status = map_columns(ins, use, M, optflags, &matmap, &alen))                            != eslOK) goto ERROR;
+  if ((status = make_seqs_msa(sq, tr, nseq, M, optflags, hmm, ins, use, matmap, alen, ret_msa)) != eslOK) goto ERROR;
+
+  free(ins);
+  free(use);
   free(matmap);
-  free(matuse);
-  *ret_msa = msa;
   return eslOK;
 
  ERROR:
-  if (msa      != NULL) esl_msa_Destroy(msa);
-  if (inscount != NULL) free(inscount);
-  if (matmap   != NULL) free(matmap);
-  if (matuse   != NULL) free(matuse);
+  if (ins    != NULL) free(ins);
+  if (use    != NULL) free(use);
+  if (matmap != NULL) free(matmap);
   *ret_msa = NULL;
   return status;
 }
@@ -243,12 +331,9 @@ p7_tracealign_computeTraces(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRA
   P7_PROFILE   *gm      = NULL;
   P7_OPROFILE  *om      = NULL;
   P7_BG        *bg      = NULL;
-  int tfrom, tto;
-
   int           idx;
-  float         fwdsc;    /* Forward score                   */
-  float         oasc;   /* optimal accuracy score          */
-  int status;
+
+  if (N == 0) return eslOK;
 
   bg = p7_bg_Create(hmm->abc);
   gm = p7_profile_Create (hmm->M, hmm->abc);
@@ -264,88 +349,7 @@ p7_tracealign_computeTraces(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRA
   /* Collect an OA trace for each sequence that needs to be aligned
    */
   for (idx = offset; idx < offset+ N; idx++)
-  {
-    /* special case: a sequence of length 0. HMMER model can't generate 0 length seq. Set tr->N == 0 as a flag. (bug #h100 fix) */
-    if (sq[idx]->n == 0) { tr[idx]->N = 0; continue; }
-
-    p7_omx_GrowTo(oxf, hmm->M, sq[idx]->n, sq[idx]->n);
-    p7_omx_GrowTo(oxb, hmm->M, sq[idx]->n, sq[idx]->n);
-
-    p7_oprofile_ReconfigLength(om, sq[idx]->n);
-
-    p7_Forward (sq[idx]->dsq, sq[idx]->n, om,      oxf, &fwdsc);
-    p7_Backward(sq[idx]->dsq, sq[idx]->n, om, oxf, oxb, NULL);
-
-    status = p7_Decoding(om, oxf, oxb, oxb);      /* <oxb> is now overwritten with post probabilities     */
-
-    if (status == eslOK)
-      {
-        p7_OptimalAccuracy(om, oxb, oxf, &oasc);      /* <oxf> is now overwritten with OA scores              */
-        p7_OATrace        (om, oxb, oxf, tr[idx]);    /* tr[idx] is now an OA traceback for seq #idx          */
-      }
-    else if (status == eslERANGE)
-      {
-        /* Work around the numeric overflow problem in Decoding()
-         * xref J3/119-121 for commentary;
-         * also the note in impl_sse/decoding.c::p7_Decoding().
-         *
-         * In short: p7_Decoding() can overflow in cases where the
-         * model is in unilocal mode (expects to see a single
-         * "domain") but the target contains more than one domain.
-         * In searches, I believe this only happens on repetitive
-         * garbage, because the domain postprocessor is very good
-         * about identifying single domains before doing posterior
-         * decoding. But in hmmalign, we're in unilocal mode
-         * to begin with, and the user can definitely give us a
-         * multidomain protein.
-         *
-         * We need to make this far more robust; but that's probably
-         * an issue to deal with when we really spend some time
-         * looking hard at hmmalign performance. For now (Nov 2009;
-         * in beta tests leading up to 3.0 release) I'm more
-         * concerned with stabilizing the search programs.
-         *
-         * The workaround is to detect the overflow and fail over to
-         * slow generic routines.
-         */
-        if (gxf == NULL) gxf = p7_gmx_Create(hmm->M, sq[idx]->n);
-        else             p7_gmx_GrowTo(gxf,  hmm->M, sq[idx]->n);
-
-        if (gxb == NULL) gxb = p7_gmx_Create(hmm->M, sq[idx]->n);
-        else             p7_gmx_GrowTo(gxb,  hmm->M, sq[idx]->n);
-
-        p7_ReconfigLength(gm, sq[idx]->n);
-
-        p7_GForward (sq[idx]->dsq, sq[idx]->n, gm, gxf, &fwdsc);
-        p7_GBackward(sq[idx]->dsq, sq[idx]->n, gm, gxb, NULL);
-        p7_GDecoding(gm, gxf, gxb, gxb);
-        p7_GOptimalAccuracy(gm, gxb, gxf, &oasc);
-        p7_GOATrace        (gm, gxb, gxf, tr[idx]);
-        p7_gmx_Reuse(gxf);
-        p7_gmx_Reuse(gxb);
-      }
-
-
-    /* the above steps aren't storing the tfrom/tto values in the trace,
-     * which are required for downstream processing in this case, so
-     * hack them here. Note - this treats the whole thing as one domain,
-     * even if there are really multiple domains.
-     */
-    // skip the parts of the trace that precede the first match state
-    tfrom = 2;
-    while (tr[idx]->st[tfrom] != p7T_M)   tfrom++;
-
-    tto = tfrom + 1;
-    //run until the model is exited
-    while (tr[idx]->st[tto] != p7T_E)     tto++;
-
-    tr[idx]->tfrom[0]  = tfrom;
-    tr[idx]->tto[0]    = tto - 1;
-
-
-    p7_omx_Reuse(oxf);
-    p7_omx_Reuse(oxb);
-  }
+    trace_one(gm, om, oxf, oxb, &gxf, &gxb, sq[idx], tr[idx]);
 
 #if 0
   for (idx = 0; idx < nseq; idx++)
@@ -367,6 +371,114 @@ p7_tracealign_computeTraces(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRA
 }
 
 
+/* Work for p7_tracealign_computeTracesThreaded(), with
+ * p7_ThreadedFor(): iteration <i> traces sequence <offset+i> into
+ * its own slot, so results don't depend on which thread did what.
+ * Each thread has its own profile and DP matrices.
+ */
+typedef struct {
+  P7_HMM          *hmm;
+  ESL_SQ         **sq;
+  P7_TRACE       **tr;
+  int              offset;
+} TA_WORKSET;
+
+typedef struct {
+  P7_BG           *bg;
+  P7_PROFILE      *gm;
+  P7_OPROFILE     *om;
+  P7_OMX          *oxf;
+  P7_OMX          *oxb;
+  P7_GMX          *gxf;
+  P7_GMX          *gxb;
+} TA_WORKER;
+
+static void
+ta_fini(void *tls)
+{
+  TA_WORKER *w = (TA_WORKER *) tls;
+
+  if (w == NULL) return;
+  p7_bg_Destroy(w->bg);
+  p7_profile_Destroy(w->gm);
+  p7_oprofile_Destroy(w->om);
+  p7_omx_Destroy(w->oxf);
+  p7_omx_Destroy(w->oxb);
+  p7_gmx_Destroy(w->gxf);
+  p7_gmx_Destroy(w->gxb);
+  free(w);
+}
+
+static int
+ta_init(void *arg, int tid, void **ret_tls)
+{
+  TA_WORKSET *ws  = (TA_WORKSET *) arg;
+  TA_WORKER  *w   = NULL;
+  P7_HMM     *hmm = ws->hmm;
+  int         status;
+
+  ESL_ALLOC(w, sizeof(TA_WORKER));
+  w->bg  = p7_bg_Create(hmm->abc);
+  w->gm  = p7_profile_Create (hmm->M, hmm->abc);
+  w->om  = p7_oprofile_Create(hmm->M, hmm->abc);
+  w->oxf = p7_omx_Create(hmm->M, 0, 0);
+  w->oxb = p7_omx_Create(hmm->M, 0, 0);
+  w->gxf = NULL;
+  w->gxb = NULL;
+  if (w->bg == NULL || w->gm == NULL || w->om == NULL || w->oxf == NULL || w->oxb == NULL) { status = eslEMEM; goto ERROR; }
+
+  p7_ProfileConfig(hmm, w->bg, w->gm, ws->sq[ws->offset]->n, p7_UNILOCAL);
+  p7_oprofile_Convert(w->gm, w->om);
+  *ret_tls = w;
+  return eslOK;
+
+ ERROR:
+  ta_fini(w);
+  return status;
+}
+
+static int
+ta_work(void *arg, void *tls, int i, char *errbuf)
+{
+  TA_WORKSET *ws = (TA_WORKSET *) arg;
+  TA_WORKER  *w  = (TA_WORKER *) tls;
+
+  return trace_one(w->gm, w->om, w->oxf, w->oxb, &(w->gxf), &(w->gxb), ws->sq[ws->offset+i], ws->tr[ws->offset+i]);
+}
+
+
+/* Function: p7_tracealign_computeTracesThreaded()
+ *
+ * Synopsis: Compute traces for a collection of sequences, using
+ *           several threads
+ *
+ * Purpose:  Same as <p7_tracealign_computeTraces()>, but spreads the
+ *           <N> sequences over up to <ncpus> threads (the calling
+ *           thread included). Each thread has its own profile and DP
+ *           matrices; the traces are identical to the serial ones.
+ *
+ *           With <ncpus> $\leq 1$, or without <HMMER_THREADS>, this
+ *           is <p7_tracealign_computeTraces()>.
+ *
+ * Return:   <eslOK> on success.
+ *
+ * Throws:   <eslEMEM> on allocation failure.
+ */
+int
+p7_tracealign_computeTracesThreaded(P7_HMM *hmm, ESL_SQ **sq, int offset, int N, P7_TRACE **tr, int ncpus)
+{
+  TA_WORKSET ws;
+
+  if (ncpus <= 1 || N <= 1) return p7_tracealign_computeTraces(hmm, sq, offset, N, tr);
+
+  ws.hmm    = hmm;
+  ws.sq     = sq;
+  ws.tr     = tr;
+  ws.offset = offset;
+  return p7_ThreadedFor(ncpus, N, &ws, ta_init, ta_work, ta_fini, NULL, NULL);
+}
+
+
 /* Function: p7_tracealign_getTracesAndStats()
  *
  * Synopsis: Compute traces and stats for a collection of sequences
@@ -468,6 +580,105 @@ ERROR:
  * 2. Internal functions used by the API
  *****************************************************************/
 
+/* trace_one()
+ * 
+ * Collect the OA trace <tr> of one sequence <sq> for
+ * p7_tracealign_computeTraces(), using unilocal profiles <gm>, <om>
+ * and optimized matrices <oxf>, <oxb>. Generic matrices <*gxf>,
+ * <*gxb> are created on demand for the numeric overflow failover,
+ * and kept for the caller to reuse and free.
+ */
+static int
+trace_one(P7_PROFILE *gm, P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_GMX **gxf, P7_GMX **gxb, ESL_SQ *sq, P7_TRACE *tr)
+{
+  float fwdsc;		/* Forward score                   */
+  float oasc;		/* optimal accuracy score          */
+  int   tfrom, tto;
+  int   status;
+
+  /* special case: a sequence of length 0. HMMER model can't generate 0 length seq. Set tr->N == 0 as a flag. (bug #h100 fix) */
+  if (sq->n == 0) { tr->N = 0; return eslOK; }
+
+  p7_omx_GrowTo(oxf, om->M, sq->n, sq->n);
+  p7_omx_GrowTo(oxb, om->M, sq->n, sq->n);
+
+  p7_oprofile_ReconfigLength(om, sq->n);
+
+  p7_Forward (sq->dsq, sq->n, om,      oxf, &fwdsc);
+  p7_Backward(sq->dsq, sq->n, om, oxf, oxb, NULL);
+
+  status = p7_Decoding(om, oxf, oxb, oxb);      /* <oxb> is now overwritten with post probabilities     */
+
+  if (status == eslOK)
+    {
+      p7_OptimalAccuracy(om, oxb, oxf, &oasc);      /* <oxf> is now overwritten with OA scores              */
+      p7_OATrace        (om, oxb, oxf, tr);         /* tr is now an OA traceback for seq <sq>               */
+    }
+  else if (status == eslERANGE)
+    {
+      /* Work around the numeric overflow problem in Decoding()
+       * xref J3/119-121 for commentary;
+       * also the note in impl_sse/decoding.c::p7_Decoding().
+       *
+       * In short: p7_Decoding() can overflow in cases where the
+       * model is in unilocal mode (expects to see a single
+       * "domain") but the target contains more than one domain.
+       * In searches, I believe this only happens on repetitive
+       * garbage, because the domain postprocessor is very good
+       * about identifying single domains before doing posterior
+       * decoding. But in hmmalign, we're in unilocal mode
+       * to begin with, and the user can definitely give us a
+       * multidomain protein.
+       *
+       * We need to make this far more robust; but that's probably
+       * an issue to deal with when we really spend some time
+       * looking hard at hmmalign performance. For now (Nov 2009;
+       * in beta tests leading up to 3.0 release) I'm more
+       * concerned with stabilizing the search programs.
+       *
+       * The workaround is to detect the overflow and fail over to
+       * slow generic routines.
+       */
+      if (*gxf == NULL) *gxf = p7_gmx_Create(gm->M, sq->n);
+      else              p7_gmx_GrowTo(*gxf,  gm->M, sq->n);
+
+      if (*gxb == NULL) *gxb = p7_gmx_Create(gm->M, sq->n);
+      else              p7_gmx_GrowTo(*gxb,  gm->M, sq->n);
+
+      p7_ReconfigLength(gm, sq->n);
+
+      p7_GForward (sq->dsq, sq->n, gm, *gxf, &fwdsc);
+      p7_GBackward(sq->dsq, sq->n, gm, *gxb, NULL);
+      p7_GDecoding(gm, *gxf, *gxb, *gxb);
+      p7_GOptimalAccuracy(gm, *gxb, *gxf, &oasc);
+      p7_GOATrace        (gm, *gxb, *gxf, tr);
+      p7_gmx_Reuse(*gxf);
+      p7_gmx_Reuse(*gxb);
+    }
+
+
+  /* the above steps aren't storing the tfrom/tto values in the trace,
+   * which are required for downstream processing in this case, so
+   * hack them here. Note - this treats the whole thing as one domain,
+   * even if there are really multiple domains.
+   */
+  // skip the parts of the trace that precede the first match state
+  tfrom = 2;
+  while (tr->st[tfrom] != p7T_M)   tfrom++;
+
+  tto = tfrom + 1;
+  //run until the model is exited
+  while (tr->st[tto] != p7T_E)     tto++;
+
+  tr->tfrom[0]  = tfrom;
+  tr->tto[0]    = tto - 1;
+
+  p7_omx_Reuse(oxf);
+  p7_omx_Reuse(oxb);
+  return eslOK;
+}
+
+
 /* map_new_msa()
  *
  * Construct <inscount[0..M]>, <matuse[1..M]>, and <matmap[1..M]>
@@ -510,19 +721,13 @@ map_new_msa(P7_TRACE **tr, int nseq, int M, int optflags, int **ret_inscount,
 	    int **ret_matuse, int **ret_matmap, int *ret_alen)
 {
   int *inscount = NULL;	  /* inscount[k=0..M] == max # of inserts in node k */
-  int *insnum   = NULL;   /* insct[k=0..M] == # of inserts in node k in current trace */
   int *matuse   = NULL;	  /* matuse[k=1..M] == TRUE|FALSE: does node k map to an alignment column */
   int *matmap   = NULL;	  /* matmap[k=1..M]: if matuse[k] TRUE, what column 1..alen does node k map to */
-  int  idx;		  /* counter over sequences */
-  int  z;		  /* index into trace positions */
   int  alen;		  /* length of alignment */
-  int  k;		  /* counter over nodes 1..M */
   int  status;
   
   ESL_ALLOC(inscount, sizeof(int) * (M+1));   
-  ESL_ALLOC(insnum,   sizeof(int) * (M+1));   
   ESL_ALLOC(matuse,   sizeof(int) * (M+1)); matuse[0] = 0;
-  ESL_ALLOC(matmap,   sizeof(int) * (M+1)); matmap[0] = 0;
   esl_vec_ISet(inscount, M+1, 0);
   if (optflags & p7_ALL_CONSENSUS_COLS) esl_vec_ISet(matuse+1, M, TRUE); 
   else                                  esl_vec_ISet(matuse+1, M, FALSE);
@@ -530,35 +735,9 @@ map_new_msa(P7_TRACE **tr, int nseq, int M, int optflags, int **ret_inscount,
   /* Collect inscount[], matuse[] in a fairly general way 
    * (either profile or core traces work)
    */
-  for (idx = 0; idx < nseq; idx++)
-    {
-      esl_vec_ISet(insnum, M+1, 0);
-      for (z = 1; z < tr[idx]->N; z++) 
-	{
-      	  switch (tr[idx]->st[z]) {
-	  case p7T_I:                                insnum[tr[idx]->k[z]]++; break;
-	  case p7T_N: if (tr[idx]->st[z-1] == p7T_N) insnum[0]++;             break;
-	  case p7T_C: if (tr[idx]->st[z-1] == p7T_C) insnum[M]++;             break;
-	  case p7T_M: matuse[tr[idx]->k[z]] = TRUE;                           break;
-	  case p7T_J: p7_Die("J state unsupported");
-	  default:                                                            break;
-	  }
-	}
-      for (k = 0; k <= M; k++) 
-	inscount[k] = ESL_MAX(inscount[k], insnum[k]);
-    }
-
-  /* if we're trimming N and C off, reset inscount[0], inscount[M] to 0. */
-  if (optflags & p7_TRIM) { inscount[0] = inscount[M] = 0; }
-  
-  /* Use inscount, matuse to set the matmap[] */
-  alen      = inscount[0];
-  for (k = 1; k <= M; k++) {
-    if (matuse[k]) { matmap[k] = alen+1; alen += 1+inscount[k]; }
-    else           { matmap[k] = alen;   alen +=   inscount[k]; }
-  }
+  if ((status = p7_tracealign_CountInserts(tr, nseq, M, inscount, matuse)) != eslOK) goto ERROR;
+  if ((status = map_columns(inscount, matuse, M, optflags, &matmap, &alen)) != eslOK) goto ERROR;
 
-  free(insnum);
   *ret_inscount = inscount;
   *ret_matuse   = matuse;
   *ret_matmap   = matmap;
@@ -567,7 +746,6 @@ map_new_msa(P7_TRACE **tr, int nseq, int M, int optflags, int **ret_inscount,
 
  ERROR:
   if (inscount) free(inscount); 
-  if (insnum)   free(insnum);
   if (matuse)   free(matuse);
   if (matmap)   free(matmap);
   *ret_inscount = NULL;
@@ -577,6 +755,83 @@ map_new_msa(P7_TRACE **tr, int nseq, int M, int optflags, int **ret_inscount,
   return status;
 }
 
+/* map_columns()
+ * Second half of map_new_msa(): given the collected <inscount[0..M]>
+ * and <matuse[1..M]>, construct <matmap[1..M]> and <alen>. If
+ * <p7_TRIM> is set, <inscount[0]> and <inscount[M]> are reset to 0.
+ */
+static int
+map_columns(int *inscount, const int *matuse, int M, int optflags, int **ret_matmap, int *ret_alen)
+{
+  int *matmap = NULL;
+  int  alen;
+  int  k;
+  int  status;
+
+  ESL_ALLOC(matmap, sizeof(int) * (M+1)); matmap[0] = 0;
+
+  /* if we're trimming N and C off, reset inscount[0], inscount[M] to 0. */
+  if (optflags & p7_TRIM) { inscount[0] = inscount[M] = 0; }
+  
+  /* Use inscount, matuse to set the matmap[] */
+  alen      = inscount[0];
+  for (k = 1; k <= M; k++) {
+    if (matuse[k]) { matmap[k] = alen+1; alen += 1+inscount[k]; }
+    else           { matmap[k] = alen;   alen +=   inscount[k]; }
+  }
+
+  *ret_matmap = matmap;
+  *ret_alen   = alen;
+  return eslOK;
+
+ ERROR:
+  *ret_matmap = NULL;
+  *ret_alen   = 0;
+  return status;
+}
+
+/* make_seqs_msa()
+ * The body of p7_tracealign_Seqs() and p7_tracealign_SeqsWithMap():
+ * build the new MSA for <sq>, <tr> on an already computed column
+ * layout <inscount>, <matuse>, <matmap>, <alen>.
+ */
+static int
+make_seqs_msa(ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7_HMM *hmm, int *inscount, int *matuse, int *matmap, int alen, ESL_MSA **ret_msa)
+{
+  ESL_MSA            *msa = NULL;
+  const ESL_ALPHABET *abc = sq[0]->abc;
+  int                 idx;
+  int                 status;
+
+  if (optflags & p7_DIGITIZE) { if ((status = make_digital_msa(sq, NULL, tr, nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
+  else                        { if ((status = make_text_msa   (sq, NULL, tr, nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
+
+  if ((status = annotate_rf(msa, M, matuse, matmap))                               != eslOK) goto ERROR;
+  if (hmm)
+    if ((status = annotate_mm(msa, hmm,    matuse, matmap))                          != eslOK) goto ERROR;
+  if ((status = annotate_posterior_probability(msa, tr, matmap, M, optflags)) != eslOK) goto ERROR;
+
+  if (optflags & p7_DIGITIZE) rejustify_insertions_digital(     msa, inscount, matmap, matuse, M);
+  else                        rejustify_insertions_text   (abc, msa, inscount, matmap, matuse, M);
+
+  for (idx = 0; idx < nseq; idx++)
+    {
+      esl_msa_SetSeqName(msa, idx, sq[idx]->name, -1);
+      if (sq[idx]->acc[0]  != '\0') esl_msa_SetSeqAccession  (msa, idx, sq[idx]->acc,  -1);
+      if (sq[idx]->desc[0] != '\0') esl_msa_SetSeqDescription(msa, idx, sq[idx]->desc, -1);
+      msa->wgt[idx] = 1.0;
+      if (msa->sqlen != NULL) msa->sqlen[idx] = sq[idx]->n;
+    }
+
+  *ret_msa = msa;
+  return eslOK;
+
+ ERROR:
+  if (msa != NULL) esl_msa_Destroy(msa);
+  *ret_msa = NULL;
+  return status;
+}
+
 
 /* get_dsq_z()
  * this abstracts residue-fetching from either a sq array or a previous MSA;
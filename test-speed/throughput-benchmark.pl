@@ -0,0 +1,242 @@
+#! /usr/bin/perl
+
+# End-to-end throughput benchmark, run locally (no cluster needed).
+#
+# Usage:     ./throughput-benchmark.pl [options] <top_builddir> <top_srcdir> <workdir>
+# Example:   ./throughput-benchmark.pl -t 1,2,4,8 -o baseline.json ../build ..  tput.tmp
+#            ./throughput-benchmark.pl -t 1,2,4,8 -c baseline.json ../build ..  tput.tmp
+#
+# Builds a reproducible synthetic benchmark in <workdir> (created if
+# needed) from the tutorial models, using fixed RNG seeds throughout:
+#   - protein families sampled with hmmemit -a from globins4, fn3 and
+#     Pkinase, split into training alignments and embedded test
+#     domains by create-profmark against an iid background made by
+#     esl-shuffle -G;
+#   - query HMMs built from the training alignments (pressed, for
+#     hmmscan);
+#   - a DNA target of iid random sequence plus sampled MADE1 copies
+#     for nhmmer.
+#
+# Then runs hmmsearch, hmmscan and nhmmer at each thread count (--cpu),
+# and records wall time (best of <-r> replicates), per-stage pipeline
+# time (from one more run with --stagetimes; see p7_pipeline_Create()),
+# peak RSS (if GNU time is in /usr/bin/time) and scaling efficiency
+# relative to the smallest thread count. Wall time and RSS come from
+# the replicates, which run without stage timing, so the timer calls
+# don't inflate them.
+#
+# Results are written as JSON to stdout, or to <-o> file. With <-c>,
+# results are compared against a previously saved baseline, and the
+# script exits nonzero if any run's wall time is slower than the
+# baseline by more than the fractional tolerance <-x>.
+#
+# Options:
+#   -t <list> : comma-separated thread counts     [1,2,4]
+#   -r <n>    : replicates per run (min wall kept) [3]
+#   -N <n>    : # of negative target seqs          [20000]
+#   -o <f>    : save JSON results to <f>
+#   -c <f>    : compare to baseline JSON <f>
+#   -x <x>    : regression tolerance, fraction     [0.10]
+#   -k        : keep existing synthetic data in <workdir>
+
+use Getopt::Std;
+use JSON::PP;
+use Time::HiRes qw(time);
+use Sys::Hostname;
+
+getopts('t:r:N:o:c:x:k');
+$threadlist = ($opt_t ? $opt_t : "1,2,4");
+$nrep       = ($opt_r ? $opt_r : 3);
+$nneg       = ($opt_N ? $opt_N : 20000);
+$tolerance  = (defined $opt_x ? $opt_x : 0.10);
+@threads    = sort { $a <=> $b } split(/,/, $threadlist);
+
+if ($#ARGV != 2) { die "Usage: ./throughput-benchmark.pl [options] <top_builddir> <top_srcdir> <workdir>\n"; }
+$top_builddir = shift;
+$top_srcdir   = shift;
+$wrkdir       = shift;
+
+$hmmemit   = "$top_builddir/src/hmmemit";
+$hmmbuild  = "$top_builddir/src/hmmbuild";
+$hmmpress  = "$top_builddir/src/hmmpress";
+$hmmsearch = "$top_builddir/src/hmmsearch";
+$hmmscan   = "$top_builddir/src/hmmscan";
+$nhmmer    = "$top_builddir/src/nhmmer";
+$profmark  = "$top_builddir/profmark/create-profmark";
+$shuffle   = "$top_builddir/easel/miniapps/esl-shuffle";
+$sfetch    = "$top_builddir/easel/miniapps/esl-sfetch";
+foreach $prog ($hmmemit, $hmmbuild, $hmmpress, $hmmsearch, $hmmscan, $nhmmer, $profmark, $shuffle, $sfetch) {
+    if (! -x $prog) { die "didn't find executable $prog"; }
+}
+$gnutime = (-x "/usr/bin/time" && system("/usr/bin/time -f %M true >/dev/null 2>&1") == 0) ? "/usr/bin/time" : "";
+
+if (! -d $wrkdir) { mkdir($wrkdir) || die "failed to create $wrkdir"; }
+if (! $opt_k || ! -e "$wrkdir/pmark.hmm.h3m") { &make_benchmark(); }
+
+# Timed runs
+#
+# Options go before the arguments, where easel's getopts expects them.
+@jobs = (
+    [ "hmmsearch", "$hmmsearch --noali -o $wrkdir/out", "$wrkdir/pmark.hmm $wrkdir/pmark.fa" ],
+    [ "hmmscan",   "$hmmscan   --noali -o $wrkdir/out", "$wrkdir/pmark.hmm $wrkdir/scanq.fa" ],
+    [ "nhmmer",    "$nhmmer    --noali -o $wrkdir/out", "$top_srcdir/tutorial/MADE1.hmm $wrkdir/dna.fa" ],
+    );
+
+@runs = ();
+foreach $job (@jobs) {
+    ($program, $cmd, $args) = @$job;
+    $t0wall = 0;
+    foreach $n (@threads) {
+	$best = undef;
+	for ($rep = 0; $rep < $nrep; $rep++) {
+	    $r = &timed_run("$cmd --cpu $n $args");
+	    if (! defined $best || $r->{wall} < $best->{wall}) { $best = $r; }
+	}
+	$best->{stage}      = &stage_run("$cmd --cpu $n --stagetimes $args");
+	if ($t0wall == 0) { $t0wall = $best->{wall} * $n; }
+	$best->{program}    = $program;
+	$best->{threads}    = $n + 0;
+	$best->{efficiency} = sprintf("%.3f", $t0wall / ($best->{wall} * $n)) + 0;
+	push @runs, $best;
+	printf STDERR ("%-10s %3d threads  %8.2fs  eff %.2f\n", $program, $n, $best->{wall}, $best->{efficiency});
+    }
+}
+
+$result = {
+    host       => hostname(),
+    date       => scalar localtime(),
+    builddir   => $top_builddir,
+    nneg       => $nneg + 0,
+    replicates => $nrep + 0,
+    runs       => \@runs,
+};
+$json = JSON::PP->new->pretty->canonical;
+
+if ($opt_o) {
+    open(JSONOUT, ">$opt_o") || die "failed to open $opt_o for writing";
+    print JSONOUT $json->encode($result);
+    close JSONOUT;
+} elsif (! $opt_c) {
+    print $json->encode($result);
+}
+
+# Comparison to a saved baseline
+#
+$nregress = 0;
+if ($opt_c) {
+    open(JSONIN, $opt_c) || die "failed to open baseline $opt_c";
+    $baseline = $json->decode(join("", <JSONIN>));
+    close JSONIN;
+    foreach $base (@{$baseline->{runs}}) { $basewall{"$base->{program}/$base->{threads}"} = $base->{wall}; }
+
+    printf("%-10s %7s %10s %10s %8s\n", "program", "threads", "baseline", "now", "ratio");
+    foreach $r (@runs) {
+	$key = "$r->{program}/$r->{threads}";
+	if (! defined $basewall{$key}) { printf("%-10s %7d %10s %10.2f %8s\n", $r->{program}, $r->{threads}, "-", $r->{wall}, "-"); next; }
+	$ratio = $r->{wall} / $basewall{$key};
+	printf("%-10s %7d %10.2f %10.2f %8.3f%s\n", $r->{program}, $r->{threads}, $basewall{$key}, $r->{wall}, $ratio,
+	       $ratio > 1.0 + $tolerance ? "  REGRESSION" : "");
+	if ($ratio > 1.0 + $tolerance) { $nregress++; }
+    }
+    if ($nregress) { print "FAIL: $nregress run(s) slower than baseline by more than $tolerance\n"; exit 1; }
+    print "ok\n";
+}
+exit 0;
+
+
+
+# make_benchmark()
+# Create the synthetic databases in $wrkdir, reproducibly.
+#
+sub make_benchmark
+{
+    my ($fam, $seed, $name, $nseq);
+
+    # Synthetic families: 4 per tutorial model, renamed so create-profmark
+    # sees distinct MSAs.
+    open(MSAOUT, ">$wrkdir/families.sto") || die "failed to open $wrkdir/families.sto";
+    foreach $fam ("globins4", "fn3", "Pkinase") {
+	for ($seed = 1; $seed <= 4; $seed++) {
+	    $name = "$fam.$seed";
+	    system("$hmmemit -a -N 100 --seed $seed -o $wrkdir/tmp.sto $top_srcdir/tutorial/$fam.hmm") == 0 || die "FAIL: hmmemit $fam";
+	    open(MSAIN, "$wrkdir/tmp.sto") || die;
+	    while (<MSAIN>) {
+		next if /^#=GF ID/;
+		print MSAOUT;
+		if (/^# STOCKHOLM/) { print MSAOUT "#=GF ID $name\n"; }
+	    }
+	    close MSAIN;
+	}
+    }
+    close MSAOUT;
+    unlink "$wrkdir/tmp.sto";
+
+    # iid background, and the create-profmark split/embedding
+    system("$shuffle -G --amino -N 5000 -L 350 --seed 7 -o $wrkdir/bg.fa")                  == 0 || die "FAIL: esl-shuffle";
+    system("$sfetch --index $wrkdir/bg.fa > /dev/null")                                      == 0 || die "FAIL: esl-sfetch --index";
+    system("$profmark --seed 42 -N $nneg -1 0.6 -2 0.9 $wrkdir/pmark $wrkdir/families.sto $wrkdir/bg.fa > /dev/null") == 0 || die "FAIL: create-profmark";
+
+    # Queries
+    system("$hmmbuild --seed 42 $wrkdir/pmark.hmm $wrkdir/pmark.msa > /dev/null")            == 0 || die "FAIL: hmmbuild";
+    unlink glob("$wrkdir/pmark.hmm.h3?");
+    system("$hmmpress $wrkdir/pmark.hmm > /dev/null")                                        == 0 || die "FAIL: hmmpress";
+
+    # hmmscan queries: the first 200 target seqs
+    open(SEQIN,  "$wrkdir/pmark.fa")   || die;
+    open(SEQOUT, ">$wrkdir/scanq.fa") || die;
+    $nseq = 0;
+    while (<SEQIN>) {
+	if (/^>/) { $nseq++; }
+	last if $nseq > 200;
+	print SEQOUT;
+    }
+    close SEQIN;
+    close SEQOUT;
+
+    # DNA target for nhmmer
+    system("$shuffle -G --dna -N 20 -L 250000 --seed 7 -o $wrkdir/dna.fa")                   == 0 || die "FAIL: esl-shuffle --dna";
+    system("$hmmemit -N 50 --seed 7 $top_srcdir/tutorial/MADE1.hmm >> $wrkdir/dna.fa")       == 0 || die "FAIL: hmmemit MADE1";
+}
+
+
+# timed_run(<cmd>)
+# Run <cmd>; return a hash ref of wall time and peak RSS (kB).
+#
+sub timed_run
+{
+    my ($cmd) = @_;
+    my ($t0, $wall, $rss);
+
+    if ($gnutime) { $cmd = "$gnutime -f %M -o $wrkdir/rss $cmd"; }
+    $t0 = time();
+    system($cmd) == 0 || die "FAIL: $cmd";
+    $wall = time() - $t0;
+
+    $rss = undef;
+    if ($gnutime && open(RSS, "$wrkdir/rss")) {
+	while (<RSS>) { if (/^(\d+)\s*$/) { $rss = $1 + 0; } }
+	close RSS;
+    }
+    return { wall => sprintf("%.3f", $wall) + 0, peak_rss_kb => $rss };
+}
+
+
+# stage_run(<cmd>)
+# Run <cmd> (which has --stagetimes on); return a hash ref of
+# per-stage times summed over all queries.
+#
+sub stage_run
+{
+    my ($cmd) = @_;
+    my %stage = (msv => 0, bias => 0, vit => 0, fwd => 0, domains => 0);
+
+    system($cmd) == 0 || die "FAIL: $cmd";
+    open(OUT, "$wrkdir/out") || die "failed to open $wrkdir/out";
+    while (<OUT>) {
+	if (/^# Stage times.*MSV (\S+)s\s+bias (\S+)s\s+Vit (\S+)s\s+Fwd (\S+)s\s+domains (\S+)s/) {
+	    $stage{msv} += $1;  $stage{bias} += $2;  $stage{vit} += $3;  $stage{fwd} += $4;  $stage{domains} += $5;
+	}
+    }
+    close OUT;
+    return \%stage;
+}
@@ -0,0 +1,92 @@
+#! /usr/bin/perl
+
+# Test that hmmalign --stream writes exactly the same alignment as
+# hmmalign does when it holds everything in memory, whatever the
+# chunk size and number of threads. Stockholm is streamed as one
+# block, so it must match Pfam format.
+#
+# Usage:   ./i24-hmmalign-stream.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i24-hmmalign-stream.pl ..         ..       tmpfoo
+#
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+    $verbose   = shift;  # if arg not given, defaults to false (zero)
+}
+
+# The test creates the following files:
+# $tmppfx.fa          sequences to align
+# $tmppfx.1           hmmalign output, without --stream
+# $tmppfx.2           hmmalign output, with --stream
+
+@h3progs =  ( "hmmalign", "hmmemit");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")          { die "FAIL: didn't find $h3prog executable in $builddir/src\n";              } }
+
+$hmm = "$srcdir/testsuite/Caudal_act.hmm";
+
+# Full-length and local emissions, so there are insert columns and ragged ends.
+do_cmd("$builddir/src/hmmemit -N 20 --seed 42           $hmm >  $tmppfx.fa");
+do_cmd("$builddir/src/hmmemit -N 20 --seed 7 --unilocal $hmm >> $tmppfx.fa");
+
+# --cpu only exists if we're threaded
+$output = do_cmd("$builddir/src/hmmalign -h");
+@cpuopts = ($output =~ /--cpu/ ? ("--cpu 0", "--cpu 4") : (""));
+
+# The first sequences get descriptions, for #=GS DE lines.
+open(my $fh, "<", "$tmppfx.fa") || die "FAIL: couldn't open $tmppfx.fa\n";
+@lines = <$fh>;
+close $fh;
+$n = 0;
+foreach (@lines) { if (/^>(\S+)/ && $n++ < 3) { $_ = ">$1 description of $1\n"; } }
+open($fh, ">", "$tmppfx.fa") || die "FAIL: couldn't write $tmppfx.fa\n";
+print $fh @lines;
+close $fh;
+
+foreach $fmt ("stockholm", "pfam", "a2m", "afa")
+{
+    $nsfmt = ($fmt eq "stockholm" ? "pfam" : $fmt);
+    foreach $opts ("", "--trim")
+    {
+	do_cmd("$builddir/src/hmmalign --outformat $nsfmt $opts -o $tmppfx.1 $hmm $tmppfx.fa");
+	if ($? != 0) { die "FAIL: hmmalign --outformat $nsfmt $opts failed\n"; }
+	$expected = slurp("$tmppfx.1");
+
+	foreach $chunk (1, 7, 1000)
+	{
+	    foreach $cpuopt (@cpuopts)
+	    {
+		do_cmd("$builddir/src/hmmalign --stream --chunk $chunk $cpuopt --outformat $fmt $opts -o $tmppfx.2 $hmm $tmppfx.fa");
+		if ($? != 0) { die "FAIL: hmmalign --stream --chunk $chunk $cpuopt --outformat $fmt $opts failed\n"; }
+		if (slurp("$tmppfx.2") ne $expected) { die "FAIL: hmmalign --stream --chunk $chunk $cpuopt --outformat $fmt $opts output differs\n"; }
+	    }
+	}
+    }
+}
+
+# Formats that can't be streamed are refused
+do_cmd("$builddir/src/hmmalign --stream --outformat clustal $hmm $tmppfx.fa 2>&1");
+if ($? == 0) { die "FAIL: hmmalign --stream should refuse Clustal output\n"; }
+
+print "ok\n";
+unlink "$tmppfx.fa";
+unlink "$tmppfx.1";
+unlink "$tmppfx.2";
+exit 0;
+
+
+sub do_cmd {
+    $cmd = shift;
+    print "$cmd\n" if $verbose;
+    return `$cmd`;
+}
+
+sub slurp {
+    my $file = shift;
+    local $/;
+    open(my $fh, "<", $file) || die "FAIL: couldn't open $file\n";
+    my $s = <$fh>;
+    close $fh;
+    return $s;
+}
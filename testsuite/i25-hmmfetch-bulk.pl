@@ -0,0 +1,135 @@
+#! /usr/bin/perl
+
+# Test hmmfetch -f --bulk and --press.
+#   --bulk must fetch the same HMMs as a plain -f fetch, in file
+#   order, once each, whatever the order and repeats of the keys.
+#   --press must write a pressed database that hmmscan reads and
+#   gets the same hits from as from hmmpress'ing the same models;
+#   and it must refuse to overwrite an existing one, leaving it
+#   intact, or to leave a stale .h3c beside a new one.
+#
+# Usage:   ./i25-hmmfetch-bulk.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i25-hmmfetch-bulk.pl ..         ..       tmpfoo
+#
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+    $verbose   = shift;  # if arg not given, defaults to false (zero)
+}
+
+# The test creates the following files:
+# $tmppfx.hmm              minifam models, and its .ssi index
+# $tmppfx.keys             all keys, in file order
+# $tmppfx.keys2            some keys, shuffled, with repeats
+# $tmppfx.ref.hmm          the models named in .keys2, in file order, hmmpress'ed
+# $tmppfx.db.h3{m,i,f,p}   the same, written by hmmfetch --press
+# $tmppfx.db.h3c           a stale cluster file that --press must refuse
+# $tmppfx.out{1,2}         outputs to compare
+
+@h3progs =  ( "hmmbuild", "hmmfetch", "hmmpress", "hmmscan");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")          { die "FAIL: didn't find $h3prog executable in $builddir/src\n";              } }
+
+cleanup();
+do_cmd("$builddir/src/hmmbuild $tmppfx.hmm $srcdir/testsuite/minifam > /dev/null");
+do_cmd("$builddir/src/hmmfetch --index $tmppfx.hmm > /dev/null");
+if ($? != 0) { die "FAIL: hmmfetch --index failed\n"; }
+
+@names = (slurp("$tmppfx.hmm") =~ /^NAME\s+(\S+)/mg);
+if ($#names < 3) { die "FAIL: expected more models in minifam\n"; }
+open(KEYS, ">$tmppfx.keys") || die "FAIL: couldn't write $tmppfx.keys\n";
+foreach $name (@names) { print KEYS "$name\n"; }
+close KEYS;
+open(KEYS, ">$tmppfx.keys2") || die "FAIL: couldn't write $tmppfx.keys2\n";
+print KEYS "$names[3]\n$names[0]\n$names[3]\n$names[1]\n";
+close KEYS;
+
+# --cpu only exists if we're threaded
+$output = do_cmd("$builddir/src/hmmfetch -h");
+@cpuopts = ($output =~ /--cpu/ ? ("--cpu 0", "--cpu 4") : (""));
+
+# --bulk, all keys in file order, vs. plain -f
+do_cmd("$builddir/src/hmmfetch -f -o $tmppfx.out1 $tmppfx.hmm $tmppfx.keys");
+if ($? != 0) { die "FAIL: hmmfetch -f failed\n"; }
+$expected = slurp("$tmppfx.out1");
+foreach $cpuopt (@cpuopts)
+{
+    do_cmd("$builddir/src/hmmfetch -f --bulk $cpuopt -o $tmppfx.out2 $tmppfx.hmm $tmppfx.keys");
+    if ($? != 0)                          { die "FAIL: hmmfetch -f --bulk $cpuopt failed\n"; }
+    if (slurp("$tmppfx.out2") ne $expected) { die "FAIL: hmmfetch -f --bulk $cpuopt output differs from -f\n"; }
+}
+
+# --bulk, shuffled keys with a repeat: file order, once each
+open(KEYS, ">$tmppfx.keys3") || die "FAIL: couldn't write $tmppfx.keys3\n";
+print KEYS "$names[0]\n$names[1]\n$names[3]\n";
+close KEYS;
+do_cmd("$builddir/src/hmmfetch -f -o $tmppfx.ref.hmm $tmppfx.hmm $tmppfx.keys3");
+$expected = slurp("$tmppfx.ref.hmm");
+foreach $cpuopt (@cpuopts)
+{
+    do_cmd("$builddir/src/hmmfetch -f --bulk $cpuopt -o $tmppfx.out2 $tmppfx.hmm $tmppfx.keys2");
+    if ($? != 0)                          { die "FAIL: hmmfetch -f --bulk $cpuopt failed on shuffled keys\n"; }
+    if (slurp("$tmppfx.out2") ne $expected) { die "FAIL: hmmfetch -f --bulk $cpuopt on shuffled keys isn't file order, once each\n"; }
+}
+
+# --press, vs. hmmpress of the same models; compare hmmscan hits
+do_cmd("$builddir/src/hmmpress $tmppfx.ref.hmm > /dev/null");
+if ($? != 0) { die "FAIL: hmmpress failed\n"; }
+do_cmd("$builddir/src/hmmfetch -f --bulk --press -o $tmppfx.db $tmppfx.hmm $tmppfx.keys2");
+if ($? != 0) { die "FAIL: hmmfetch --press failed\n"; }
+foreach $sfx ("h3m", "h3i", "h3f", "h3p") { if (! -e "$tmppfx.db.$sfx") { die "FAIL: hmmfetch --press didn't make $tmppfx.db.$sfx\n"; } }
+
+do_cmd("$builddir/src/hmmscan --tblout $tmppfx.out1 $tmppfx.ref.hmm $srcdir/tutorial/HBB_HUMAN > /dev/null");
+if ($? != 0) { die "FAIL: hmmscan of hmmpress'ed db failed\n"; }
+do_cmd("$builddir/src/hmmscan --tblout $tmppfx.out2 $tmppfx.db      $srcdir/tutorial/HBB_HUMAN > /dev/null");
+if ($? != 0) { die "FAIL: hmmscan of hmmfetch --press'ed db failed\n"; }
+if (hits("$tmppfx.out1") ne hits("$tmppfx.out2")) { die "FAIL: hmmscan hits differ on hmmfetch --press'ed db\n"; }
+
+# --press again: must fail, and leave the existing db alone
+$size = -s "$tmppfx.db.h3m";
+do_cmd("$builddir/src/hmmfetch -f --press -o $tmppfx.db $tmppfx.hmm $tmppfx.keys 2>&1");
+if ($? == 0) { die "FAIL: hmmfetch --press overwrote an existing db\n"; }
+foreach $sfx ("h3m", "h3i", "h3f", "h3p") { if (! -e "$tmppfx.db.$sfx") { die "FAIL: failed hmmfetch --press removed existing $tmppfx.db.$sfx\n"; } }
+if (-s "$tmppfx.db.h3m" != $size) { die "FAIL: failed hmmfetch --press changed existing $tmppfx.db.h3m\n"; }
+
+# --press must also refuse a stale .h3c (or .h3s) it wouldn't rewrite
+foreach $sfx ("h3m", "h3i", "h3f", "h3p") { unlink "$tmppfx.db.$sfx"; }
+open(STALE, ">$tmppfx.db.h3c") || die "FAIL: couldn't write $tmppfx.db.h3c\n";
+print STALE "stale\n";
+close STALE;
+do_cmd("$builddir/src/hmmfetch -f --press -o $tmppfx.db $tmppfx.hmm $tmppfx.keys 2>&1");
+if ($? == 0)              { die "FAIL: hmmfetch --press ignored a stale $tmppfx.db.h3c\n"; }
+if (-e "$tmppfx.db.h3m")  { die "FAIL: failed hmmfetch --press left a partial $tmppfx.db\n"; }
+
+print "ok\n";
+cleanup();
+exit 0;
+
+
+sub hits {			# tblout lines, without comments (which have file names)
+    my $file = shift;
+    my $s    = slurp($file);
+    $s =~ s/^#.*\n//mg;
+    return $s;
+}
+
+sub cleanup {
+    foreach $f ("$tmppfx.hmm", "$tmppfx.hmm.ssi", "$tmppfx.keys", "$tmppfx.keys2", "$tmppfx.keys3", "$tmppfx.out1", "$tmppfx.out2") { unlink $f; }
+    foreach $sfx ("", ".h3m", ".h3i", ".h3f", ".h3p", ".h3s", ".h3c") { unlink "$tmppfx.ref.hmm$sfx"; unlink "$tmppfx.db$sfx"; }
+}
+
+sub do_cmd {
+    $cmd = shift;
+    print "$cmd\n" if $verbose;
+    return `$cmd`;
+}
+
+sub slurp {
+    my $file = shift;
+    local $/;
+    open(my $fh, "<", $file) || die "FAIL: couldn't open $file\n";
+    my $s = <$fh>;
+    close $fh;
+    return $s;
+}
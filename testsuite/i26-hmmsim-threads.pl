@@ -0,0 +1,72 @@
+#! /usr/bin/perl
+
+# Test that hmmsim's scores don't depend on the number of threads.
+# Random target sequences are drawn in blocks, each block from its own
+# random number stream seeded from --seed; so with a fixed --seed,
+# hmmsim -v must print exactly the same scores (and fits) with
+# --cpu 0 as with --cpu 4; only the CPU time line may differ.
+#
+# Usage:   ./i26-hmmsim-threads.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i26-hmmsim-threads.pl ..         ..       tmpfoo
+#
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+    $verbose   = shift;  # if arg not given, defaults to false (zero)
+}
+
+# The test creates the following files:
+# $tmppfx.hmm         two query models
+# $tmppfx.1           hmmsim -v output, with --cpu 0
+# $tmppfx.2           hmmsim -v output, with --cpu 4
+
+@h3progs =  ( "hmmsim");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")          { die "FAIL: didn't find $h3prog executable in $builddir/src\n";              } }
+
+# --cpu only exists if we're threaded
+$output = do_cmd("$builddir/src/hmmsim -h");
+if ($output !~ /--cpu/) { print "ok\n"; exit 0; }
+
+# Two models, so workers move on to a second query
+do_cmd("cat $srcdir/testsuite/Caudal_act.hmm $srcdir/tutorial/fn3.hmm > $tmppfx.hmm");
+
+# N isn't a multiple of the block size, so the last block is short
+foreach $opts ("", "--fwd", "--msv --fast", "--sw -a")
+{
+    do_cmd("$builddir/src/hmmsim -v --seed 42 -N 550 $opts --cpu 0 $tmppfx.hmm > $tmppfx.1");
+    if ($? != 0) { die "FAIL: hmmsim $opts --cpu 0 failed\n"; }
+    do_cmd("$builddir/src/hmmsim -v --seed 42 -N 550 $opts --cpu 4 $tmppfx.hmm > $tmppfx.2");
+    if ($? != 0) { die "FAIL: hmmsim $opts --cpu 4 failed\n"; }
+    if (results("$tmppfx.1") ne results("$tmppfx.2")) { die "FAIL: hmmsim $opts output differs for --cpu 0 and --cpu 4\n"; }
+}
+
+print "ok\n";
+unlink "$tmppfx.hmm";
+unlink "$tmppfx.1";
+unlink "$tmppfx.2";
+exit 0;
+
+
+sub results {			# output without the timing line
+    my $file = shift;
+    my $s    = slurp($file);
+    $s =~ s/^# CPU time.*\n//mg;
+    return $s;
+}
+
+sub do_cmd {
+    $cmd = shift;
+    print "$cmd\n" if $verbose;
+    return `$cmd`;
+}
+
+sub slurp {
+    my $file = shift;
+    local $/;
+    open(my $fh, "<", $file) || die "FAIL: couldn't open $file\n";
+    my $s = <$fh>;
+    close $fh;
+    return $s;
+}
@@ -0,0 +1,96 @@
+#! /usr/bin/perl
+
+# Test that nhmmscan finds the same hits whether it holds the model
+# database in memory (the default --dbmem) or streams it (--dbmem 0):
+# with score data from the .h3s file hmmpress saves, computed at load
+# when there's no .h3s, and recomputed for --bgfile; serially and
+# threaded.
+#
+# Usage:   ./i27-nhmmscan-dbmem.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i27-nhmmscan-dbmem.pl ..         ..       tmpfoo
+#
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+    $verbose   = shift;  # if arg not given, defaults to false (zero)
+}
+
+# The test creates the following files:
+# $tmppfx.hmm              DNA models, and its hmmpress auxfiles .h3{m,i,f,p,s}
+# $tmppfx.fa               query sequences
+# $tmppfx.bg               background frequencies for --bgfile
+# $tmppfx.tbl{1,2}         nhmmscan --tblout output, streamed and resident
+
+@h3progs =  ( "hmmpress", "nhmmscan");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")          { die "FAIL: didn't find $h3prog executable in $builddir/src\n";              } }
+
+cleanup();
+do_cmd("cat $srcdir/tutorial/MADE1.hmm $srcdir/testsuite/3box.hmm $srcdir/testsuite/ecori.hmm > $tmppfx.hmm");
+do_cmd("$builddir/src/hmmpress $tmppfx.hmm > /dev/null");
+if ($? != 0)            { die "FAIL: hmmpress failed\n"; }
+if (! -e "$tmppfx.hmm.h3s") { die "FAIL: hmmpress didn't save score data for a DNA database\n"; }
+do_cmd("cat $srcdir/tutorial/dna_target.fa $srcdir/testsuite/3box-alitest.fa > $tmppfx.fa");
+
+open(BG, ">$tmppfx.bg") || die "FAIL: couldn't write $tmppfx.bg\n";
+print BG "DNA\nA 0.35\nC 0.15\nG 0.15\nT 0.35\n";
+close BG;
+
+# --cpu only exists if we're threaded
+$output = do_cmd("$builddir/src/nhmmscan -h");
+@cpuopts = ($output =~ /--cpu/ ? ("--cpu 0", "--cpu 2") : (""));
+
+compare("",                   "with .h3s");
+compare("--bgfile $tmppfx.bg", "--bgfile");
+unlink "$tmppfx.hmm.h3s";
+compare("",                   "without .h3s");
+
+print "ok\n";
+cleanup();
+exit 0;
+
+
+sub compare {
+    my ($opts, $tag) = @_;
+    my ($cpuopt, $nhits);
+
+    foreach $cpuopt (@cpuopts)
+    {
+	do_cmd("$builddir/src/nhmmscan --dbmem 0 $cpuopt $opts --tblout $tmppfx.tbl1 $tmppfx.hmm $tmppfx.fa > /dev/null");
+	if ($? != 0) { die "FAIL: nhmmscan --dbmem 0 $cpuopt $opts failed ($tag)\n"; }
+	do_cmd("$builddir/src/nhmmscan           $cpuopt $opts --tblout $tmppfx.tbl2 $tmppfx.hmm $tmppfx.fa > /dev/null");
+	if ($? != 0) { die "FAIL: nhmmscan $cpuopt $opts failed ($tag)\n"; }
+
+	$nhits = () = (hits("$tmppfx.tbl1") =~ /^\S/mg);
+	if ($nhits == 0)                                  { die "FAIL: nhmmscan $cpuopt $opts found no hits ($tag)\n"; }
+	if (hits("$tmppfx.tbl1") ne hits("$tmppfx.tbl2")) { die "FAIL: nhmmscan $cpuopt $opts hits differ for --dbmem 0 and default ($tag)\n"; }
+    }
+}
+
+sub hits {			# tblout lines, without comments (which have file names and options)
+    my $file = shift;
+    my $s    = slurp($file);
+    $s =~ s/^#.*\n//mg;
+    return $s;
+}
+
+sub cleanup {
+    foreach $sfx ("", ".h3m", ".h3i", ".h3f", ".h3p", ".h3s") { unlink "$tmppfx.hmm$sfx"; }
+    foreach $f ("$tmppfx.fa", "$tmppfx.bg", "$tmppfx.tbl1", "$tmppfx.tbl2") { unlink $f; }
+}
+
+sub do_cmd {
+    $cmd = shift;
+    print "$cmd\n" if $verbose;
+    return `$cmd`;
+}
+
+sub slurp {
+    my $file = shift;
+    local $/;
+    open(my $fh, "<", $file) || die "FAIL: couldn't open $file\n";
+    my $s = <$fh>;
+    close $fh;
+    return $s;
+}
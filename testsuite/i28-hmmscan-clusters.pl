@@ -0,0 +1,104 @@
+#! /usr/bin/perl
+
+# Test hmmscan's cluster prefilter (hmmpress --clust).
+#   A database of near-copies of a few models (each built with a
+#   slightly different --ere) must cluster; hmmscan must skip some
+#   models with their clusters, and still find exactly the same hits
+#   as hmmscan --noclust, serially and threaded.
+#
+# Usage:   ./i28-hmmscan-clusters.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i28-hmmscan-clusters.pl ..         ..       tmpfoo
+#
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+    $verbose   = shift;  # if arg not given, defaults to false (zero)
+}
+
+# The test creates the following files:
+# $tmppfx.1.hmm            one model at a time, from hmmbuild
+# $tmppfx.hmm              the near-copies, and its hmmpress auxfiles .h3{m,i,f,p,c}
+# $tmppfx.tbl{1,2}         hmmscan --tblout output, with and without clusters
+# $tmppfx.dom{1,2}         hmmscan --domtblout output, with and without clusters
+
+@h3progs =  ( "hmmbuild", "hmmpress", "hmmscan");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")          { die "FAIL: didn't find $h3prog executable in $builddir/src\n";              } }
+
+# Models are consecutive by family, so each family's copies can cluster.
+# Accessions are dropped: they'd be duplicate keys in the .h3i index.
+cleanup();
+open(DB, ">$tmppfx.hmm") || die "FAIL: couldn't write $tmppfx.hmm\n";
+foreach $fam ("globins4", "fn3", "Pkinase")
+{
+    $i = 0;
+    foreach $ere ("0.59", "0.60", "0.61")
+    {
+	do_cmd("$builddir/src/hmmbuild -n $fam-$i --ere $ere $tmppfx.1.hmm $srcdir/tutorial/$fam.sto > /dev/null");
+	if ($? != 0) { die "FAIL: hmmbuild $fam --ere $ere failed\n"; }
+	$s = slurp("$tmppfx.1.hmm");
+	$s =~ s/^ACC .*\n//mg;
+	print DB $s;
+	$i++;
+    }
+}
+close DB;
+
+$output = do_cmd("$builddir/src/hmmpress --clust $tmppfx.hmm");
+if ($? != 0)                                  { die "FAIL: hmmpress --clust failed\n"; }
+if (! -s "$tmppfx.hmm.h3c")                   { die "FAIL: hmmpress --clust saved no clusters\n"; }
+if ($output !~ /\((\d+) clusters of (\d+) HMMs\)/) { die "FAIL: hmmpress --clust didn't report its clusters\n"; }
+if ($1 < 1 || $2 < 2)                         { die "FAIL: near-copies of a model didn't cluster\n"; }
+
+# --cpu only exists if we're threaded
+$output = do_cmd("$builddir/src/hmmscan -h");
+@cpuopts = ($output =~ /--cpu/ ? ("--cpu 0", "--cpu 2") : (""));
+
+foreach $cpuopt (@cpuopts)
+{
+    $output = do_cmd("$builddir/src/hmmscan $cpuopt --tblout $tmppfx.tbl1 --domtblout $tmppfx.dom1 $tmppfx.hmm $srcdir/tutorial/HBB_HUMAN");
+    if ($? != 0) { die "FAIL: hmmscan $cpuopt with clusters failed\n"; }
+    if ($output !~ /^Skipped in closed clusters:\s+(\d+)/m || $1 == 0) { die "FAIL: hmmscan $cpuopt skipped no models with their clusters\n"; }
+    if ($output !~ /^Target model\(s\):\s+9 /m)                         { die "FAIL: hmmscan $cpuopt didn't count skipped models as targets\n"; }
+
+    $output = do_cmd("$builddir/src/hmmscan $cpuopt --noclust --tblout $tmppfx.tbl2 --domtblout $tmppfx.dom2 $tmppfx.hmm $srcdir/tutorial/HBB_HUMAN");
+    if ($? != 0) { die "FAIL: hmmscan $cpuopt --noclust failed\n"; }
+    if ($output =~ /^Skipped in closed clusters:/m) { die "FAIL: hmmscan $cpuopt --noclust skipped models\n"; }
+
+    if (hits("$tmppfx.tbl1") eq "")                         { die "FAIL: hmmscan $cpuopt found no hits\n"; }
+    if (hits("$tmppfx.tbl1") ne hits("$tmppfx.tbl2"))       { die "FAIL: hmmscan $cpuopt hits differ with --noclust\n"; }
+    if (hits("$tmppfx.dom1") ne hits("$tmppfx.dom2"))       { die "FAIL: hmmscan $cpuopt domain hits differ with --noclust\n"; }
+}
+
+print "ok\n";
+cleanup();
+exit 0;
+
+
+sub hits {			# tblout lines, without comments (which have file names)
+    my $file = shift;
+    my $s    = slurp($file);
+    $s =~ s/^#.*\n//mg;
+    return $s;
+}
+
+sub cleanup {
+    foreach $f ("$tmppfx.1.hmm", "$tmppfx.tbl1", "$tmppfx.tbl2", "$tmppfx.dom1", "$tmppfx.dom2") { unlink $f; }
+    foreach $sfx ("", ".h3m", ".h3i", ".h3f", ".h3p", ".h3c") { unlink "$tmppfx.hmm$sfx"; }
+}
+
+sub do_cmd {
+    $cmd = shift;
+    print "$cmd\n" if $verbose;
+    return `$cmd`;
+}
+
+sub slurp {
+    my $file = shift;
+    local $/;
+    open(my $fh, "<", $file) || die "FAIL: couldn't open $file\n";
+    my $s = <$fh>;
+    close $fh;
+    return $s;
+}